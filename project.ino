@@ -1,11 +1,25 @@
 #include "src/config/config.h"
 #include "src/utils/display_utils.h"
+#include "src/utils/display_compositor.h"
+#include "src/utils/spi_bus.h"
+#include "src/utils/metrics.h"
+#include "src/utils/logger.h"
 #include "src/utils/time_utils.h"
+#include "src/utils/time_source.h"
+#include "src/utils/day_rollover.h"
+#include "src/utils/month_rollup.h"
+#include "src/utils/presence_index.h"
 #include "src/utils/sd_utils.h"
 #include "src/utils/security_utils.h"
 #include "src/utils/memory_utils.h"
+#include "src/utils/mem_pool.h"
+#include "src/utils/mem_placement.h"
 #include "src/components/fingerprint.h"
+#include "src/components/boot.h"
 #include "src/components/network.h"
+#include "src/components/roster_sync.h"
+#include "src/components/cloud_sync.h"
+#include "src/components/absentee_digest.h"
 #include "src/components/battery.h"
 #include "src/webserver/server_init.h"
 
@@ -26,6 +40,21 @@ const int WIFI_MAX_ATTEMPTS = 10;  // Reset after 10 failed attempts
 
 void setup() {
   Serial.begin(115200);
+  spiBusBegin();
+  networkBegin();
+  metricsBegin();
+  memPlacementBegin();
+  logBegin();
+  if (memHasPsram()) {
+    LOG_INFO("PSRAM: %u bytes, large buffers go there", (unsigned)ESP.getPsramSize());
+  } else {
+    LOG_INFO("No PSRAM, large buffers stay in internal RAM");
+  }
+  memPoolBegin();
+
+  // Start the wall clock from the RTC or the last checkpoint so scanning
+  // never waits for NTP
+  timeSourceBegin();
 
   // Check initial memory
   Serial.println("Initial free memory: " + String(getFreeMemory()) + " bytes");
@@ -38,181 +67,35 @@ void setup() {
   // Initialize battery monitoring
   setupBattery();
 
-  // Initialize SD card with error handling
-  int sdRetries = 0;
-  while (!setsd() && sdRetries < 3) {
-    Serial.println("SD card initialization failed, retrying...");
-    delay(1000);
-    sdRetries++;
-  }
-
-  if (sdRetries >= 3) {
-    Serial.println("Failed to initialize SD card after 3 attempts");
-    tft.fillScreen(TFT_WHITE);
-    tft.fillRect(0, 15, 128, 30, TFT_WHITE);
-    tft.setTextColor(TFT_RED);
-    tft.setCursor(2, 20);
-    tft.println("SD Card Error!");
-    tft.setCursor(2, 30);
-    tft.println("Check SD card or");
-    tft.setCursor(2, 40);
-    tft.println("press reset to retry");
-    return;
-  } else {
-    sdCardReady = true;
-  }
-
-  // Load Telegram credentials
-  readTelegramCredentials();
-
-  // Initialize WiFi with timeout
-  tft.fillScreen(TFT_WHITE);
-  tft.fillRect(0, 15, 128, 30, TFT_WHITE);
-  tft.setCursor(2, 20);
-  tft.println("Connecting to WiFi...");
-
-  unsigned long wifiStartTime = millis();
-  setupWiFi();
-  while (WiFi.status() != WL_CONNECTED && millis() - wifiStartTime < 30000) {
-    delay(500);
-    tft.setCursor(2, 30);
-    tft.println("Connecting... " + String((millis() - wifiStartTime) / 1000) + "s");
-  }
-
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi connection failed after 30 seconds");
-    tft.fillScreen(TFT_WHITE);
-    tft.fillRect(0, 15, 128, 30, TFT_WHITE);
-    tft.setTextColor(TFT_RED);
-    tft.setCursor(2, 20);
-    tft.println("WiFi Error!");
-    tft.setCursor(2, 30);
-    tft.println("Check credentials or");
-    tft.setCursor(2, 40);
-    tft.println("network availability");
-    return;
-  } else {
-    wifiConnected = true;
-    tft.setCursor(2, 30);
-    tft.println("Connected to:");
-    tft.setCursor(2, 40);
-    tft.println(WiFi.SSID());
-  }
-
-  // Initialize time
-  timeInit();
-
-  // Initialize Firebase with error handling
-  tft.fillScreen(TFT_WHITE);
-  tft.fillRect(0, 15, 128, 30, TFT_WHITE);
-  tft.setCursor(2, 20);
-  tft.println("Connecting to Firebase...");
-
-  if (!SetDB()) {
-    Serial.println("Firebase initialization failed!");
-    tft.fillScreen(TFT_WHITE);
-    tft.fillRect(0, 15, 128, 30, TFT_WHITE);
-    tft.setTextColor(TFT_RED);
-    tft.setCursor(2, 20);
-    tft.println("Firebase Error!");
-    tft.setCursor(2, 30);
-    tft.println("Check credentials");
-    tft.setCursor(2, 40);
-    tft.println("Will continue w/o sync");
-    delay(2000);
-  } else {
-    firebaseConnected = true;
-  }
-
-  // Initialize fingerprint sensor with retries
-  tft.fillScreen(TFT_WHITE);
-  tft.fillRect(0, 15, 128, 30, TFT_WHITE);
-  tft.setTextColor(TFT_BLACK);
-  tft.setCursor(2, 20);
-  tft.println("Init fingerprint sensor...");
-
-  int fpRetries = 0;
-  while (!setupFingerprint() && fpRetries < 3) {
-    Serial.println("Fingerprint sensor initialization failed, retrying...");
-    tft.setCursor(2, 30);
-    tft.println("Retry " + String(fpRetries + 1) + "/3");
-    delay(1000);
-    fpRetries++;
-  }
-
-  if (fpRetries >= 3) {
-    Serial.println("Failed to initialize fingerprint sensor after 3 attempts");
-    tft.fillScreen(TFT_WHITE);
-    tft.fillRect(0, 15, 128, 30, TFT_WHITE);
-    tft.setTextColor(TFT_RED);
-    tft.setCursor(2, 20);
-    tft.println("Fingerprint Error!");
-    tft.setCursor(2, 30);
-    tft.println("Check sensor or");
-    tft.setCursor(2, 40);
-    tft.println("press reset to retry");
-    return;
-  } else {
-    fingerprintReady = true;
-    systemReady = true;
-  }
-
   // Initialize temperature sensor
   sensors.begin();
 
-  // Initialize server
-  serverInit();
-
-  // Check final memory
-  Serial.println("Setup complete. Free memory: " + String(getFreeMemory()) + " bytes");
-
-  tft.fillScreen(TFT_WHITE);
-  tft.fillRect(0, 15, 128, 30, TFT_WHITE);
-  tft.setCursor(2, 20);
-  tft.setTextColor(TFT_BLACK);
-  tft.println("System ready!");
-  tft.println("IP: " + WiFi.localIP().toString());
-
-  // Display system status
-  String statusMsg = "";
-  if (!sdCardReady) statusMsg += "SD: NOK ";
-  if (!fingerprintReady) statusMsg += "FP: NOK ";
-  if (!wifiConnected) statusMsg += "WiFi: NOK ";
-  if (!firebaseConnected) statusMsg += "FB: NOK";
-
-  if (statusMsg != "") {
-    tft.setCursor(2, 50);
-    tft.setTextColor(TFT_RED);
-    tft.println(statusMsg);
-  }
-
-  // After WiFi is connected and IP is obtained
-  if (WiFi.status() == WL_CONNECTED) {
-    String ipMessage = "System Started!\nIP Address: " + WiFi.localIP().toString();
-    sendTelegramMessage(ipMessage.c_str());
-  }
+  // SD, sensor and network come up in background tasks; loop() starts the
+  // web server and scanning as soon as their dependencies are ready
+  bootStart();
+  Serial.println("Boot tasks started. Free memory: " + String(getFreeMemory()) + " bytes");
 }
 
 void loop() {
-  // Skip processing if system is not ready
+  bootTick();
+
+  // Skip processing until SD is up and the web server is running
   if (!systemReady) {
-    delay(1000);  // Wait before checking again
+    delay(10);
     return;
   }
 
   // Update battery display
   updateBatteryDisplay();
 
-  // Check WiFi connection with improved reconnection logic
-  if (WiFi.status() != WL_CONNECTED) {
+  // Check WiFi connection with improved reconnection logic, once the boot
+  // task has made its own attempt
+  bool wifiManaged = bootStageSettled(BOOT_STAGE_WIFI);
+  if (wifiManaged && WiFi.status() != WL_CONNECTED) {
     if (wifiConnected) {
       // First disconnect detected
-      Serial.println("WiFi disconnected, will attempt to reconnect...");
-      tft.fillScreen(TFT_WHITE);
-      tft.fillRect(0, 15, 128, 30, TFT_WHITE);
-      tft.setTextColor(TFT_RED);
-      tft.setCursor(2, 20);
-      tft.println("WiFi disconnected!");
+      LOG_WARN("WiFi disconnected, will attempt to reconnect...");
+      displayMessageScreen(TFT_RED, "WiFi disconnected!");
       wifiConnected = false;
       lastWiFiRetry = 0;  // Reset to trigger immediate first retry
       wifiReconnectAttempts = 0;
@@ -222,35 +105,18 @@ void loop() {
     // Check if it's time for next retry
     if (millis() - lastWiFiRetry >= currentBackoff) {
       wifiReconnectAttempts++;
-      Serial.printf("WiFi reconnection attempt %d/%d\n", wifiReconnectAttempts, WIFI_MAX_ATTEMPTS);
+      LOG_INFO("WiFi reconnection attempt %d/%d", wifiReconnectAttempts, WIFI_MAX_ATTEMPTS);
       
-      tft.fillRect(0, 30, 128, 20, TFT_WHITE);
-      tft.setCursor(2, 30);
-      tft.printf("Retry %d/%d...", wifiReconnectAttempts, WIFI_MAX_ATTEMPTS);
-
-      bool reconnectSuccess = WiFi.reconnect();
-      if (!reconnectSuccess) {
-        Serial.println("WiFi reconnection command failed to send");
-        tft.setTextColor(TFT_RED);
-        tft.setCursor(2, 40);
-        tft.println("Reconnect failed!");
-      } else {
-        // Wait a bit to see if connection establishes
-        unsigned long waitStart = millis();
-        while (millis() - waitStart < 5000) {  // Wait up to 5 seconds
-          if (WiFi.status() == WL_CONNECTED) {
-            Serial.println("WiFi connection established");
-            break;
-          }
-          delay(100);
-        }
-        // Final connection check
-        if (WiFi.status() != WL_CONNECTED) {
-          Serial.println("WiFi reconnection attempt timed out");
-          tft.setTextColor(TFT_RED);
-          tft.setCursor(2, 40);
-          tft.println("Connect timeout!");
-        }
+      compositorSetStatusLine(1, "Retry " + String(wifiReconnectAttempts) + "/" + String(WIFI_MAX_ATTEMPTS) + "...", TFT_RED);
+      compositorSetStatusLine(2, "", TFT_RED);
+      compositorFlush();
+
+      // Don't wait for the result: scanning carries on, and a later pass
+      // sees the connection come up
+      if (!WiFi.reconnect()) {
+        LOG_WARN("WiFi reconnection command failed to send");
+        compositorSetStatusLine(2, "Reconnect failed!", TFT_RED);
+        compositorFlush();
       }
       lastWiFiRetry = millis();
       
@@ -259,34 +125,28 @@ void loop() {
         currentBackoff *= 2;
       }
       
-      // If we've tried too many times, reset WiFi
+      // If we've tried too many times, restart the connection from scratch;
+      // the backoff keeps running so an absent network is not hammered
       if (wifiReconnectAttempts >= WIFI_MAX_ATTEMPTS) {
-        Serial.println("Max reconnection attempts reached, resetting WiFi...");
-        WiFi.disconnect();
-        delay(1000);
-        setupWiFi();
+        LOG_WARN("Max reconnection attempts reached, restarting WiFi...");
+        if (!wifiRestart()) {
+          LOG_WARN("No WiFi credentials, set them on the settings page");
+        }
         wifiReconnectAttempts = 0;
-        currentBackoff = WIFI_RETRY_INTERVAL;
       }
     }
-  } else if (!wifiConnected) {
+  } else if (wifiManaged && !wifiConnected) {
     // WiFi just reconnected
     wifiConnected = true;
     wifiReconnectAttempts = 0;
     currentBackoff = WIFI_RETRY_INTERVAL;
     
-    Serial.println("WiFi reconnected to: " + WiFi.SSID());
-    tft.fillScreen(TFT_WHITE);
-    tft.fillRect(0, 15, 128, 30, TFT_WHITE);
-    tft.setTextColor(TFT_GREEN);
-    tft.setCursor(2, 20);
-    tft.println("WiFi reconnected!");
-    tft.setCursor(2, 30);
-    tft.println("SSID: " + WiFi.SSID());
+    LOG_INFO("WiFi reconnected to: %s", WiFi.SSID().c_str());
+    displayMessageScreen(TFT_GREEN, "WiFi reconnected!", "SSID: " + WiFi.SSID());
     
     // Notify via Telegram
     String reconnectMsg = "WiFi Reconnected!\nSSID: " + WiFi.SSID() + "\nIP: " + WiFi.localIP().toString();
-    sendTelegramMessage(reconnectMsg.c_str());
+    queueTelegramMessage(reconnectMsg);
     
     delay(2000);  // Show the success message for 2 seconds
   }
@@ -295,33 +155,54 @@ void loop() {
   static unsigned long lastMemCheck = 0;
   if (millis() - lastMemCheck >= 60000) {  // Check every minute
     int freeMemory = getFreeMemory();
-    Serial.println("Free memory: " + String(freeMemory) + " bytes");
+    LOG_INFO("Free memory: %d bytes", freeMemory);
+    LOG_INFO("%s", spiBusReport().c_str());
+    LOG_INFO("%s", memPoolReport().c_str());
+    LOG_INFO("%s", memPlacementReport().c_str());
 
     // Warning if memory is low
     if (freeMemory < 10000) {
-      Serial.println("WARNING: Low memory!");
-      tft.setTextColor(TFT_RED);
-      tft.setCursor(2, 40);
-      tft.println("Low memory: " + String(freeMemory) + " bytes");
+      LOG_WARN("Low memory!");
+      displayLogLine("Low memory: " + String(freeMemory) + " bytes", TFT_RED);
     }
     lastMemCheck = millis();
   }
 
+  // Apply any NTP sync, refresh the cached wall clock, then roll the
+  // attendance day over if needed
+  timeSourceTick();
+  clockTick();
+  dayRolloverTick();
+
   // Update time display periodically
   if (millis() - lastDisplayUpdate >= DISPLAY_UPDATE_INTERVAL) {
     updateTimeDisplay();
     lastDisplayUpdate = millis();
   }
 
+  // Pull roster changes from other gates and push ours, then flush any
+  // queued attendance
+  rosterSyncTick();
+  cloudSyncTick();
+
+  // Compact closed months into rollups, a day file at a time
+  monthRollupTick();
+
+  // Load the term's presence bitsets, filling in a missing year a step at a time
+  presenceIndexTick();
+
+  // Queue the day's absentee digest for Telegram once the cutoff passes
+  absenteeDigestTick();
+
   // Handle server requests
   server.handleClient();
 
   // Add debug logging for scanning status
   static unsigned long lastScanStatusCheck = 0;
   if (millis() - lastScanStatusCheck >= 5000) {  // Check every 5 seconds
-    Serial.println("Scanning conditions: isBlinking=" + String(isBlinking ? "true" : "false") + 
-                    ", fingerprintReady=" + String(fingerprintReady ? "true" : "false") + 
-                    ", Will scan: " + String((isBlinking && fingerprintReady) ? "YES" : "NO"));
+    LOG_DEBUG("Scanning conditions: isBlinking=%s, fingerprintReady=%s, Will scan: %s",
+              isBlinking ? "true" : "false", fingerprintReady ? "true" : "false",
+              (isBlinking && fingerprintReady) ? "YES" : "NO");
     lastScanStatusCheck = millis();
   }
 
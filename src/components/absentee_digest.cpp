@@ -0,0 +1,152 @@
+#include "absentee_digest.h"
+#include "network.h"
+#include "../utils/day_rollover.h"
+#include "../utils/presence_index.h"
+#include "../utils/time_source.h"
+#include "../utils/time_utils.h"
+#include "../utils/logger.h"
+#include "../utils/mem_pool.h"
+#include "cloud_sync.h"
+#include <Preferences.h>
+
+static int cutoffMinutes = DIGEST_NO_CUTOFF;
+static String sentFor = "";  // Day the last digest was queued for
+static unsigned long lastCheck = 0;
+static Preferences digestPrefs;
+static bool prefsOpen = false;
+
+static void openPrefs() {
+  if (!prefsOpen) {
+    prefsOpen = digestPrefs.begin("digest", false);
+    sentFor = prefsOpen ? digestPrefs.getString("sent", "") : "";
+  }
+}
+
+// "HH:MM" to minutes after midnight, DIGEST_NO_CUTOFF if empty or invalid
+int absenteeDigestParseCutoff(const String &text) {
+  int colon = text.indexOf(':');
+  if (colon < 1) return DIGEST_NO_CUTOFF;
+  int hours = text.substring(0, colon).toInt();
+  int minutes = text.substring(colon + 1).toInt();
+  if (hours < 0 || hours > 23 || minutes < 0 || minutes > 59) return DIGEST_NO_CUTOFF;
+  return hours * 60 + minutes;
+}
+
+void absenteeDigestSetCutoff(int minutes) {
+  cutoffMinutes = minutes;
+}
+
+int absenteeDigestCutoff() {
+  return cutoffMinutes;
+}
+
+String absenteeDigestCutoffText() {
+  if (cutoffMinutes == DIGEST_NO_CUTOFF) return "";
+  char text[6];
+  snprintf(text, sizeof(text), "%02d:%02d", cutoffMinutes / 60, cutoffMinutes % 60);
+  return String(text);
+}
+
+static String studentLabel(int index) {
+  return name[index][2] + " " + name[index][0];
+}
+
+// Everyone on the roster without a day record yet, then the term's low
+// attenders. Sets absent to the number missing today.
+String absenteeDigestBuild(int &absent) {
+  String absentees = "";
+  String lowList = "";
+  int listed = 0, low = 0, lowListed = 0, lowAbsent = 0;
+  absent = 0;
+
+  for (int i = 0; i < namid; i++) {
+    uint16_t id = name[i][1].toInt();
+    bool here = findTodayRecord(id) != NULL;
+    if (!here) {
+      absent++;
+      if (listed < DIGEST_MAX_NAMES) {
+        absentees += (listed ? ", " : "") + studentLabel(i);
+        listed++;
+      }
+    }
+
+    PresenceStats stats;
+    if (presenceIndexStats(id, stats) && stats.low) {
+      low++;
+      if (!here) lowAbsent++;
+      if (lowListed < DIGEST_MAX_NAMES) {
+        lowList += String(lowListed ? ", " : "") + studentLabel(i) + " " +
+                   String(stats.present * 100 / stats.schoolDays) + "%";
+        lowListed++;
+      }
+    }
+  }
+
+  String message = "Absent " + todayDate();
+  if (cutoffMinutes != DIGEST_NO_CUTOFF) {
+    message += " at " + absenteeDigestCutoffText();
+  }
+  message += ": " + String(absent) + " of " + String(namid);
+  if (absent > 0) {
+    message += "\n" + absentees;
+    if (absent > listed) {
+      message += " and " + String(absent - listed) + " more";
+    }
+  }
+  if (low > 0) {
+    message += "\n\nBelow " + String(PRESENCE_LOW_PERCENT) + "% this term: " + String(low) + " (" +
+               String(lowAbsent) + " absent today)\n" + lowList;
+    if (low > lowListed) {
+      message += " and " + String(low - lowListed) + " more";
+    }
+  }
+  return message;
+}
+
+void absenteeDigestTick() {
+  if (cutoffMinutes == DIGEST_NO_CUTOFF) return;
+  if (lastCheck != 0 && millis() - lastCheck < DIGEST_CHECK_INTERVAL_MS) return;
+  lastCheck = millis();
+
+  // A provisional clock could send the digest at the wrong time or for the wrong day
+  const String &today = todayDate();
+  if (today == "" || clockQuality() != CLOCK_SYNCED || (int)(clockSecondsOfDay() / 60) < cutoffMinutes) return;
+  openPrefs();
+  if (sentFor == today) return;
+
+  sentFor = today;
+  if (prefsOpen) {
+    digestPrefs.putString("sent", today);
+  }
+
+  if (namid == 0 || !telegramConfigured()) return;
+  if (todayPresentCount() == 0) {
+    LOG_INFO("Nobody scanned in on %s, no absentee digest", today.c_str());
+    return;
+  }
+  if (presenceIndexIsHoliday(today)) {
+    LOG_INFO("%s is a holiday, no absentee digest", today.c_str());
+    return;
+  }
+
+  int absent;
+  String message = absenteeDigestBuild(absent);
+  if (queueTelegramMessage(message)) {
+    LOG_INFO("Absentee digest for %s queued: %d absent", today.c_str(), absent);
+  }
+}
+
+// GET /api/attendance/absentees: the digest as it would be sent now
+void handleDigestPreview() {
+  if (todayDate() == "") {
+    server.send(503, "application/json", "{\"error\":\"Clock not set\"}");
+    return;
+  }
+  int absent;
+  String message = absenteeDigestBuild(absent);
+  ArenaString json;
+  json.add("{\"date\":\"").add(todayDate()).add("\",\"cutoff\":").addJson(absenteeDigestCutoffText())
+      .add(",\"absent\":").addInt(absent).add(",\"total\":").addInt(namid).add(",\"text\":").addJson(message)
+      .add('}');
+  arenaSend(200, "application/json", json);
+}
@@ -0,0 +1,28 @@
+#ifndef ABSENTEE_DIGEST_H
+#define ABSENTEE_DIGEST_H
+
+#include "../config/config.h"
+
+// Daily Telegram digest of who has not scanned in by the cutoff time, plus
+// the students below PRESENCE_LOW_PERCENT for the term. Built from the
+// name table, today's day records and the presence index, all in memory,
+// and handed to the Telegram task so scanning never waits on the network.
+// Days nobody scanned in (weekends, closures) and holidays send nothing.
+//
+// The cutoff is saved in /telegram.txt as DIGEST_CUTOFF=HH:MM; without it
+// no digest is sent.
+
+#define DIGEST_NO_CUTOFF -1
+#define DIGEST_MAX_NAMES 40           // Listed by name; the rest are counted
+#define DIGEST_CHECK_INTERVAL_MS 5000
+
+// Function declarations for the absentee digest
+void absenteeDigestTick();
+void absenteeDigestSetCutoff(int minutes);
+int absenteeDigestCutoff();
+String absenteeDigestCutoffText();
+int absenteeDigestParseCutoff(const String &text);
+String absenteeDigestBuild(int &absent);
+void handleDigestPreview();
+
+#endif // ABSENTEE_DIGEST_H
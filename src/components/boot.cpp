@@ -0,0 +1,257 @@
+#include "boot.h"
+#include "fingerprint.h"
+#include "template_restore.h"
+#include "network.h"
+#include "roster_sync.h"
+#include "../utils/display_utils.h"
+#include "../utils/sd_utils.h"
+#include "../utils/time_utils.h"
+#include "../utils/time_source.h"
+#include "../utils/template_archive.h"
+#include "../utils/logger.h"
+#include "../webserver/server_init.h"
+#include <freertos/event_groups.h>
+
+// Status flags owned by the main project file
+extern bool systemReady;
+extern bool firebaseConnected;
+extern bool fingerprintReady;
+extern bool sdCardReady;
+extern bool wifiConnected;
+
+struct BootStageInfo {
+  volatile BootState state;
+  uint32_t startMs;
+  uint32_t endMs;
+};
+
+static const char *const STAGE_NAMES[BOOT_STAGE_COUNT] = {
+  "display", "sd", "sensor", "restore", "server", "wifi", "time", "cloud"
+};
+
+static const char *const STATE_NAMES[] = {"pending", "running", "done", "failed", "skipped"};
+
+static BootStageInfo stages[BOOT_STAGE_COUNT];
+static EventGroupHandle_t bootEvents = NULL;  // One bit per settled stage
+static bool timelineReported = false;
+
+// Credentials read while SD is being brought up, so the network task
+// never touches the card
+static String wifiSsid = "";
+static String wifiPassword = "";
+static bool haveFirebaseCredentials = false;
+
+static void stageBegin(BootStage stage) {
+  stages[stage].state = BOOT_RUNNING;
+  stages[stage].startMs = millis();
+}
+
+static void stageEnd(BootStage stage, BootState state) {
+  if (stages[stage].state == BOOT_PENDING) {
+    stages[stage].startMs = millis();
+  }
+  stages[stage].endMs = millis();
+  stages[stage].state = state;
+  LOG_INFO("Boot: %s %s after %lu ms", STAGE_NAMES[stage], STATE_NAMES[state], (unsigned long)stages[stage].endMs);
+  xEventGroupSetBits(bootEvents, 1 << stage);
+}
+
+static void waitForStage(BootStage stage) {
+  xEventGroupWaitBits(bootEvents, 1 << stage, pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+static void sdTask(void *param) {
+  stageBegin(BOOT_STAGE_SD);
+  int sdRetries = 0;
+  while (!setsd() && sdRetries < 3) {
+    LOG_WARN("SD card initialization failed, retrying...");
+    delay(1000);
+    sdRetries++;
+  }
+
+  if (sdRetries >= 3) {
+    LOG_ERROR("Failed to initialize SD card after 3 attempts");
+    displayMessageScreen(TFT_RED, "SD Card Error!", "Check SD card or", "press reset to retry");
+    stageEnd(BOOT_STAGE_SD, BOOT_FAILED);
+    vTaskDelete(NULL);
+    return;
+  }
+  sdCardReady = true;
+  logSetSinks(LOG_SINK_SERIAL | LOG_SINK_SD);
+
+  // Open the packed template archive, folding in any per-file backups
+  templateArchiveBegin();
+  rosterBegin();
+
+  readTelegramCredentials();
+  if (!readWiFiCredentials(wifiSsid, wifiPassword)) {
+    LOG_WARN("Failed to read WiFi credentials from SD card.");
+  }
+  haveFirebaseCredentials = readFirebaseCredentials();
+  stageEnd(BOOT_STAGE_SD, BOOT_DONE);
+  vTaskDelete(NULL);
+}
+
+static void sensorTask(void *param) {
+  stageBegin(BOOT_STAGE_SENSOR);
+  int fpRetries = 0;
+  while (!setupFingerprint() && fpRetries < 3) {
+    LOG_WARN("Fingerprint sensor initialization failed, retrying...");
+    delay(1000);
+    fpRetries++;
+  }
+  bool sensorOk = fpRetries < 3;
+  if (!sensorOk) {
+    LOG_ERROR("Failed to initialize fingerprint sensor after 3 attempts");
+    displayMessageScreen(TFT_RED, "Fingerprint Error!", "Check sensor or", "press reset to retry");
+  }
+  stageEnd(BOOT_STAGE_SENSOR, sensorOk ? BOOT_DONE : BOOT_FAILED);
+
+  // Scanning needs the roster and the card as well as the sensor
+  waitForStage(BOOT_STAGE_SD);
+  if (!sensorOk || !bootStageDone(BOOT_STAGE_SD)) {
+    stageEnd(BOOT_STAGE_RESTORE, BOOT_SKIPPED);
+    vTaskDelete(NULL);
+    return;
+  }
+
+  // Restore templates from SD backups if the sensor was replaced or wiped
+  stageBegin(BOOT_STAGE_RESTORE);
+  if (finger.getTemplateCount() == FINGERPRINT_OK && finger.templateCount < namid) {
+    LOG_INFO("Sensor has %u templates for %d students, restoring from SD...", finger.templateCount, namid);
+    TemplateRestoreReport restoreReport;
+    restoreTemplatesFromSD(restoreReport);
+  }
+  fingerprintReady = true;
+  stageEnd(BOOT_STAGE_RESTORE, BOOT_DONE);
+  displayMessageScreen(TFT_BLACK, "Ready to scan");
+  vTaskDelete(NULL);
+}
+
+static void networkTask(void *param) {
+  waitForStage(BOOT_STAGE_SD);
+  stageBegin(BOOT_STAGE_WIFI);
+
+  bool connected = wifiSsid.length() > 0 && connectWifi(wifiSsid, wifiPassword);
+  if (!connected && promptWiFiCredentials(wifiSsid, wifiPassword)) {
+    connected = connectWifi(wifiSsid, wifiPassword);
+  }
+  if (connected) {
+    wifiConnected = true;
+    stageEnd(BOOT_STAGE_WIFI, BOOT_DONE);
+  } else {
+    // loop() keeps retrying with backoff; time and cloud follow once it connects
+    LOG_WARN("WiFi not available at boot, continuing offline");
+    displayMessageScreen(TFT_RED, "WiFi Error!", "Scanning offline", "will retry");
+    stageEnd(BOOT_STAGE_WIFI, BOOT_FAILED);
+    while (WiFi.status() != WL_CONNECTED) {
+      delay(1000);
+    }
+  }
+
+  // Scanning already runs on the provisional clock, so this only decides
+  // whether the cloud comes up with a synced clock. A late sync is still
+  // picked up by timeSourceTick().
+  stageBegin(BOOT_STAGE_TIME);
+  timeInit();
+  uint32_t syncStart = millis();
+  while (!ntpSyncSeen() && millis() - syncStart < CLOCK_SYNC_WAIT_MS) {
+    vTaskDelay(pdMS_TO_TICKS(250));
+  }
+  if (!ntpSyncSeen()) {
+    LOG_WARN("NTP not answering, running on the %s clock", clockSourceName());
+  }
+  stageEnd(BOOT_STAGE_TIME, ntpSyncSeen() ? BOOT_DONE : BOOT_FAILED);
+
+  if (!haveFirebaseCredentials) {
+    LOG_WARN("Failed to read Firebase credentials from SD card.");
+    stageEnd(BOOT_STAGE_CLOUD, BOOT_SKIPPED);
+  } else {
+    stageBegin(BOOT_STAGE_CLOUD);
+    firebaseConnected = beginFirebase();
+    if (!firebaseConnected) {
+      displayLogLine("Firebase Error! Will continue w/o sync", TFT_RED);
+    }
+    stageEnd(BOOT_STAGE_CLOUD, firebaseConnected ? BOOT_DONE : BOOT_FAILED);
+  }
+
+  String ipMessage = "System Started!\nIP Address: " + WiFi.localIP().toString();
+  queueTelegramMessage(ipMessage);
+  vTaskDelete(NULL);
+}
+
+void bootStart() {
+  bootEvents = xEventGroupCreate();
+  for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+    stages[i] = {BOOT_PENDING, 0, 0};
+  }
+
+  stageBegin(BOOT_STAGE_DISPLAY);
+  displayBegin();
+  displayMessageScreen(TFT_BLACK, "Starting...");
+  stageEnd(BOOT_STAGE_DISPLAY, BOOT_DONE);
+
+  // The sensor UART and the SD card are independent; bring them up together
+  xTaskCreatePinnedToCore(sdTask, "bootSd", 8192, NULL, 2, NULL, 1);
+  xTaskCreatePinnedToCore(sensorTask, "bootSensor", 8192, NULL, 2, NULL, 0);
+  xTaskCreatePinnedToCore(networkTask, "bootNet", 8192, NULL, 1, NULL, 0);
+}
+
+// Runs from loop(): starts the web server once SD and the restore check
+// have settled, and reports the timeline once the local stages are done
+void bootTick() {
+  if (stages[BOOT_STAGE_SERVER].state == BOOT_PENDING &&
+      bootStageSettled(BOOT_STAGE_SD) && bootStageSettled(BOOT_STAGE_RESTORE)) {
+    if (bootStageDone(BOOT_STAGE_SD)) {
+      stageBegin(BOOT_STAGE_SERVER);
+      serverInit();
+      stageEnd(BOOT_STAGE_SERVER, BOOT_DONE);
+      systemReady = true;
+    } else {
+      stageEnd(BOOT_STAGE_SERVER, BOOT_SKIPPED);
+    }
+  }
+
+  // Time and cloud can join long after boot, so they are not waited for
+  if (!timelineReported) {
+    for (int i = 0; i <= BOOT_STAGE_WIFI; i++) {
+      if (!bootStageSettled((BootStage)i)) return;
+    }
+    timelineReported = true;
+    LOG_INFO("%s", bootTimeline().c_str());
+
+    String statusMsg = "";
+    if (!sdCardReady) statusMsg += "SD: NOK ";
+    if (!fingerprintReady) statusMsg += "FP: NOK ";
+    if (!wifiConnected) statusMsg += "WiFi: NOK ";
+    displayMessageScreen(TFT_BLACK, "System ready!", wifiConnected ? "IP: " + WiFi.localIP().toString() : String("Offline"));
+    if (statusMsg != "") {
+      displayLogLine(statusMsg, TFT_RED);
+    }
+  }
+}
+
+bool bootStageDone(BootStage stage) {
+  return stages[stage].state == BOOT_DONE;
+}
+
+bool bootStageSettled(BootStage stage) {
+  return stages[stage].state >= BOOT_DONE;
+}
+
+String bootTimeline() {
+  String timeline = "Boot timeline:";
+  for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+    const BootStageInfo &stage = stages[i];
+    timeline += String("\n  ") + STAGE_NAMES[i] + ": " + STATE_NAMES[stage.state];
+    if (stage.state != BOOT_PENDING) {
+      uint32_t end = stage.state == BOOT_RUNNING ? millis() : stage.endMs;
+      timeline += " " + String(stage.startMs) + "-" + String(end) + " ms (" + String(end - stage.startMs) + " ms)";
+    }
+  }
+  return timeline;
+}
+
+void handleDebugBoot() {
+  server.send(200, "text/plain", bootTimeline());
+}
@@ -0,0 +1,37 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include "../config/config.h"
+
+// Boot stages. SD and the sensor come up in parallel; the network chain
+// (WiFi, then NTP, then Firebase) starts once SD has supplied credentials
+// and never holds up scanning.
+enum BootStage {
+  BOOT_STAGE_DISPLAY,
+  BOOT_STAGE_SD,        // Mount, roster, template archive, credentials
+  BOOT_STAGE_SENSOR,
+  BOOT_STAGE_RESTORE,   // Template restore check; needs SD and sensor
+  BOOT_STAGE_SERVER,
+  BOOT_STAGE_WIFI,
+  BOOT_STAGE_TIME,
+  BOOT_STAGE_CLOUD,
+  BOOT_STAGE_COUNT
+};
+
+enum BootState {
+  BOOT_PENDING,
+  BOOT_RUNNING,
+  BOOT_DONE,
+  BOOT_FAILED,
+  BOOT_SKIPPED
+};
+
+// Function declarations for the boot orchestrator
+void bootStart();
+void bootTick();
+bool bootStageDone(BootStage stage);
+bool bootStageSettled(BootStage stage);
+String bootTimeline();
+void handleDebugBoot();
+
+#endif // BOOT_H
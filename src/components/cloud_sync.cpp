@@ -0,0 +1,465 @@
+#include "cloud_sync.h"
+#include "roster_sync.h"
+#include "fleet.h"
+#include "network.h"
+#include "../utils/sd_utils.h"
+#include "../utils/spi_bus.h"
+#include "../utils/time_source.h"
+#include "../utils/time_utils.h"
+#include "../utils/wire_format.h"
+#include "../utils/metrics.h"
+#include "../utils/mem_pool.h"
+#include "../utils/logger.h"
+#include <Preferences.h>
+#include <vector>
+#include <algorithm>
+
+// One outbox line names an attendance row, not its contents:
+// "a,DD-MM-YYYY,ID". The upload turns the row's current in and out times
+// into this gate's events, so repeated marks collapse. Students replicate
+// through roster_sync instead.
+struct SyncEntry {
+  String date;
+  uint16_t id;
+};
+
+static Preferences syncPrefs;
+static bool prefsOpen = false;
+static FixedPool<FirebaseJson, CLOUD_JSON_POOL> jsonPool;
+
+static void openPrefs() {
+  if (!prefsOpen) {
+    prefsOpen = syncPrefs.begin("sync", false);
+  }
+}
+
+static bool cloudConfigured() {
+  return firebaseConfig.host != "" && firebaseConfig.signer.tokens.legacy_token != "";
+}
+
+// Payload object for one Firebase write: from the pool, or the heap when
+// the pool is in use. Hand it back with cloudJsonRelease().
+FirebaseJson *cloudJsonAcquire() {
+  FirebaseJson *json = jsonPool.acquire();
+  return json ? json : new FirebaseJson();
+}
+
+void cloudJsonRelease(FirebaseJson *json) {
+  if (!jsonPool.owns(json)) {
+    delete json;
+    return;
+  }
+  json->clear();
+  jsonPool.release(json);
+}
+
+// Quote text as a JSON string value
+String jsonString(const String &text) {
+  String out = "\"";
+  for (unsigned int i = 0; i < text.length(); i++) {
+    char c = text[i];
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else if ((uint8_t)c < 0x20) {
+      out += ' ';
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+static void appendOutbox(const String &line) {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  if (!SD.exists("/sync")) {
+    SD.mkdir("/sync");
+  }
+  File outbox = SD.open(SYNC_OUTBOX_PATH, FILE_APPEND);
+  if (outbox) {
+    outbox.println(line);
+    outbox.close();
+  } else {
+    LOG_WARN("Failed to queue %s for sync", line.c_str());
+  }
+  spiBusRelease(SPI_DEV_SD);
+}
+
+void cloudSyncMarkAttendance(const String &date, uint16_t id) {
+  appendOutbox("a," + date + "," + String(id));
+}
+
+static bool parseEntry(const String &line, SyncEntry &entry) {
+  if (!line.startsWith("a,") || line.length() <= 13) {
+    return false;
+  }
+  entry = {line.substring(2, 12), (uint16_t)line.substring(13).toInt()};
+  return entry.id > 0;
+}
+
+// Packed uploads send whole days, so one entry per date is enough
+static bool sameEntry(const SyncEntry &a, const SyncEntry &b) {
+  return a.date == b.date && (CLOUD_WIRE_PACKED || a.id == b.id);
+}
+
+// This gate's whole day as one packed value, or null if the day is gone
+static String packedDayValue(const String &date) {
+  std::vector<WireEvent> events;
+  if (!wireReadDayEvents(date, events)) {
+    return "null";
+  }
+  return "{\"v\":" + String(WIRE_FORMAT_VERSION) + ",\"n\":" + String(events.size()) +
+         ",\"d\":\"" + wirePackEvents(events) + "\"}";
+}
+
+// Read up to SYNC_BATCH_SIZE distinct entries starting at offset.
+// nextOffset is where the following batch starts.
+static bool readBatch(uint32_t &offset, std::vector<SyncEntry> &batch, uint32_t &nextOffset, uint32_t &outboxSize) {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File outbox = SD.open(SYNC_OUTBOX_PATH, FILE_READ);
+  if (!outbox) {
+    spiBusRelease(SPI_DEV_SD);
+    outboxSize = 0;
+    nextOffset = 0;
+    return false;
+  }
+  outboxSize = outbox.size();
+  if (offset > outboxSize) {
+    offset = 0;  // Outbox was recreated after the offset was saved
+  }
+  outbox.seek(offset);
+  nextOffset = offset;
+
+  while (outbox.available() && batch.size() < SYNC_BATCH_SIZE) {
+    String line = outbox.readStringUntil('\n');
+    nextOffset = outbox.position();
+    line.trim();
+    SyncEntry entry;
+    if (!parseEntry(line, entry)) continue;
+
+    bool duplicate = false;
+    for (const SyncEntry &queued : batch) {
+      if (sameEntry(queued, entry)) {
+        duplicate = true;
+        break;
+      }
+    }
+    if (!duplicate) {
+      batch.push_back(entry);
+    }
+  }
+  outbox.close();
+  spiBusRelease(SPI_DEV_SD);
+  metricsInc(METRIC_SD_BYTES_READ, nextOffset - offset);
+  return true;
+}
+
+// Build one multi-location update body. Attendance rows are looked up one
+// day file at a time so each file is read once per batch. Rows no longer
+// on SD (day deleted, row moved by a re-stamp) are simply skipped: their
+// events were never uploaded under the times that are gone. In packed mode
+// each date is instead one value holding this gate's whole day.
+static String buildUpdate(const std::vector<SyncEntry> &batch) {
+  String body = "{";
+  std::vector<bool> written(batch.size(), false);
+
+  for (size_t i = 0; i < batch.size(); i++) {
+    if (written[i]) continue;
+    const SyncEntry &entry = batch[i];
+
+    if (CLOUD_WIRE_PACKED) {
+      if (body.length() > 1) body += ",";
+      body += "\"packed/" + entry.date.substring(3, 5) + "/" + entry.date + "/" + deviceId() + "\":" + packedDayValue(entry.date);
+      written[i] = true;
+      continue;
+    }
+
+    spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+    File file = SD.open(getAttendanceFilePath(entry.date), FILE_READ);
+    if (file) {
+      if (file.available()) {
+        file.readStringUntil('\n');  // Header
+      }
+      while (file.available()) {
+        String roll, studentName, idStr, inTime, outTime;
+        if (!readAttendanceCSVLine(file, roll, studentName, idStr, inTime, outTime)) continue;
+        uint16_t rowId = idStr.toInt();
+        for (size_t j = i; j < batch.size(); j++) {
+          if (written[j] || batch[j].id != rowId || batch[j].date != entry.date) continue;
+          uint32_t inSeconds = parseTimeOfDay(inTime);
+          uint32_t outSeconds = parseTimeOfDay(outTime);
+          if (inSeconds != TIME_OF_DAY_NONE) {
+            if (body.length() > 1) body += ",";
+            body += "\"" + fleetEventPath(entry.date, rowId, inSeconds) + "\":" +
+                    fleetEventJson(entry.date, inSeconds, inTime, false);
+          }
+          if (outSeconds != TIME_OF_DAY_NONE) {
+            if (body.length() > 1) body += ",";
+            body += "\"" + fleetEventPath(entry.date, rowId, outSeconds) + "\":" +
+                    fleetEventJson(entry.date, outSeconds, outTime, true);
+          }
+          written[j] = true;
+        }
+      }
+      file.close();
+    }
+    spiBusRelease(SPI_DEV_SD);
+
+    for (size_t j = i; j < batch.size(); j++) {
+      if (batch[j].date == entry.date) written[j] = true;
+    }
+  }
+  return body + "}";
+}
+
+// Queue every attendance row on SD and mark every student for upload. Used
+// for the first sync after upgrading and when a full resync is requested.
+bool cloudSyncQueueAll() {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  if (!SD.exists("/sync")) {
+    SD.mkdir("/sync");
+  }
+  File outbox = SD.open(SYNC_OUTBOX_PATH, FILE_APPEND);
+  if (!outbox) {
+    spiBusRelease(SPI_DEV_SD);
+    return false;
+  }
+
+  File attendanceRoot = SD.open("/Attendance");
+  if (attendanceRoot) {
+    File monthDir = attendanceRoot.openNextFile();
+    while (monthDir) {
+      if (monthDir.isDirectory()) {
+        File dayFile = monthDir.openNextFile();
+        while (dayFile) {
+          String fileName = String(dayFile.name());
+          if (fileName.endsWith(".csv") && fileName.length() == 14) {  // DD-MM-YYYY.csv
+            String date = fileName.substring(0, 10);
+            if (dayFile.available()) {
+              dayFile.readStringUntil('\n');  // Header
+            }
+            while (dayFile.available()) {
+              String roll, studentName, id, inTime, outTime;
+              if (readAttendanceCSVLine(dayFile, roll, studentName, id, inTime, outTime) && id.toInt() > 0) {
+                outbox.println("a," + date + "," + id);
+              }
+            }
+          }
+          dayFile.close();
+          dayFile = monthDir.openNextFile();
+        }
+      }
+      monthDir.close();
+      monthDir = attendanceRoot.openNextFile();
+    }
+    attendanceRoot.close();
+  }
+  outbox.close();
+  spiBusRelease(SPI_DEV_SD);
+
+  rosterMarkAllDirty();
+  openPrefs();
+  syncPrefs.putBool("seeded", true);
+  return true;
+}
+
+// Upload the next outbox batch. Returns 1 when a batch was acknowledged
+// (more may follow), 0 when the outbox is drained and -1 on a failed
+// upload, with report.error set. The offset lives in prefs rather than in
+// the caller so a manual sync and the background flush can interleave.
+static int sendNextBatch(CloudSyncReport &report, std::vector<String> &touchedDates) {
+  openPrefs();
+  uint32_t acked = syncPrefs.getULong("acked", 0);
+  std::vector<SyncEntry> batch;
+  uint32_t nextOffset = 0, outboxSize = 0;
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  if (!readBatch(acked, batch, nextOffset, outboxSize)) {
+    spiBusRelease(SPI_DEV_SD);
+    return 0;  // Nothing queued
+  }
+  if (batch.empty()) {
+    // Everything is acknowledged: start the next outbox from empty. The
+    // offset is cleared first so a reset in between only re-uploads.
+    syncPrefs.putULong("acked", 0);
+    SD.remove(SYNC_OUTBOX_PATH);
+    spiBusRelease(SPI_DEV_SD);
+    return 0;
+  }
+  String body = buildUpdate(batch);
+  spiBusRelease(SPI_DEV_SD);
+
+  // A batch whose rows are all gone has nothing to send but is still acked
+  if (body.length() > 2) {
+    FirebaseJson *json = cloudJsonAcquire();
+    json->setJsonData(body);
+    metricsInc(METRIC_CLOUD_WRITES);
+    firebaseAcquire();
+    bool sent = Firebase.updateNodeSilent(firebaseData, "/", *json);
+    String error = sent ? String("") : firebaseData.errorReason();
+    firebaseRelease();
+    cloudJsonRelease(json);
+    if (!sent) {
+      metricsInc(METRIC_CLOUD_FAILURES);
+      report.error = error;
+      report.pending = outboxSize - acked;
+      return -1;
+    }
+    report.batches++;
+    report.records += batch.size();
+    for (const SyncEntry &entry : batch) {
+      if (std::find(touchedDates.begin(), touchedDates.end(), entry.date) == touchedDates.end()) {
+        touchedDates.push_back(entry.date);
+      }
+    }
+  }
+
+  syncPrefs.putULong("acked", nextOffset);
+  return 1;
+}
+
+// Merge a day across gates and write it to /attendance
+static void publishDay(const String &date) {
+  std::vector<FleetDayRecord> records;
+  String error;
+  if (!fleetAggregateDay(date, records, error) || !fleetPublishDay(date, records, error)) {
+    LOG_WARN("Publishing %s failed: %s", date.c_str(), error.c_str());
+  }
+}
+
+bool cloudSyncRun(CloudSyncReport &report, bool full) {
+  report = CloudSyncReport();
+  unsigned long startTime = millis();
+
+  if (!cloudConfigured()) {
+    report.error = "Firebase credentials are not set";
+    return false;
+  }
+  if (clockQuality() != CLOCK_SYNCED) {
+    // Provisional stamps are corrected when NTP arrives; uploading them now
+    // would send times that are about to change
+    report.error = "Clock not synced yet";
+    return false;
+  }
+
+  openPrefs();
+  if (full || !syncPrefs.getBool("seeded", false)) {
+    if (!cloudSyncQueueAll()) {
+      report.error = "Cannot write sync outbox";
+      return false;
+    }
+    report.seeded = true;
+  }
+
+  // A roster failure (a rules problem, say) must not hold attendance back
+  RosterSyncReport roster;
+  if (!rosterSync(roster)) {
+    report.rosterError = roster.error;
+    LOG_WARN("Roster sync failed, flushing attendance anyway: %s", roster.error.c_str());
+  }
+  report.records += roster.pushed;
+  report.rosterConflicts = roster.conflicts;
+
+  std::vector<String> touchedDates;
+  int step;
+  do {
+    step = sendNextBatch(report, touchedDates);
+  } while (step > 0);
+  if (step < 0) {
+    report.elapsedMs = millis() - startTime;
+    LOG_WARN("Sync stopped after %d batches: %s", report.batches, report.error.c_str());
+    return false;
+  }
+
+  // Refresh the merged /attendance view of every day this run added scans
+  // to. It is derived data, so a failure only delays it to the next sync.
+  for (const String &date : touchedDates) {
+    publishDay(date);
+  }
+
+  report.elapsedMs = millis() - startTime;
+  if (report.rosterError != "") {
+    return false;
+  }
+  LOG_INFO("Sync complete. %s", cloudSyncSummary(report).c_str());
+  return true;
+}
+
+// Flush the outbox in the background so queued scans reach the cloud
+// without anyone pressing Sync. Scanning shares loop() with this, so each
+// pass does one step (a batch or a published day) and returns; a flush of
+// a long outbox spreads over as many passes as it has batches. Students
+// are left to rosterSyncTick().
+void cloudSyncTick() {
+  static unsigned long lastFlush = 0;
+  static bool flushing = false;
+  static CloudSyncReport report;
+  static std::vector<String> touchedDates;
+
+  if (!flushing) {
+    if (lastFlush != 0 && millis() - lastFlush < CLOUD_SYNC_INTERVAL_MS) {
+      return;
+    }
+    if (WiFi.status() != WL_CONNECTED || clockQuality() != CLOCK_SYNCED || !firebaseReady()) {
+      return;
+    }
+    lastFlush = millis();
+    report = CloudSyncReport();
+    touchedDates.clear();
+    openPrefs();
+    if (!syncPrefs.getBool("seeded", false)) {
+      if (!cloudSyncQueueAll()) {
+        LOG_WARN("Background sync: cannot write sync outbox");
+        return;
+      }
+      report.seeded = true;
+    }
+    flushing = true;
+    return;
+  }
+
+  if (WiFi.status() != WL_CONNECTED) {
+    flushing = false;  // The outbox offset is saved; the next flush resumes there
+    return;
+  }
+  if (!firebaseReady()) {
+    return;  // Client busy elsewhere; try again next pass
+  }
+  int step = sendNextBatch(report, touchedDates);
+  if (step > 0) {
+    return;
+  }
+  if (step == 0 && !touchedDates.empty()) {
+    publishDay(touchedDates.back());
+    touchedDates.pop_back();
+    return;
+  }
+
+  flushing = false;
+  report.elapsedMs = millis() - lastFlush;
+  if (step < 0) {
+    LOG_WARN("Background sync: %s", cloudSyncSummary(report).c_str());
+  } else if (report.batches > 0) {
+    LOG_INFO("Background sync: %s", cloudSyncSummary(report).c_str());
+  }
+}
+
+String cloudSyncSummary(const CloudSyncReport &report) {
+  String summary = "Uploaded " + String(report.records) + " records in " + String(report.batches) +
+                   " batches (" + String(report.elapsedMs / 1000.0, 1) + " s)";
+  if (report.seeded) {
+    summary += ", full resync queued";
+  }
+  if (report.error != "") {
+    summary += ", stopped: " + report.error + ", " + String(report.pending) + " bytes still queued";
+  }
+  if (report.rosterError != "") {
+    summary += ", students not synced: " + report.rosterError;
+  }
+  if (report.rosterConflicts > 0) {
+    summary += ", " + String(report.rosterConflicts) + " student IDs also enrolled on another gate (delete and re-enroll ours)";
+  }
+  return summary;
+}
@@ -0,0 +1,46 @@
+#ifndef CLOUD_SYNC_H
+#define CLOUD_SYNC_H
+
+#include "../config/config.h"
+
+// Records that still need to reach Firebase are noted in an append-only
+// outbox on SD. A sync uploads them in multi-location batches and saves
+// the outbox offset after every acknowledged batch, so an interrupted sync
+// resumes where it stopped instead of starting over. Students go through
+// roster replication, which a sync runs first.
+
+#define SYNC_OUTBOX_PATH "/sync/outbox.log"
+#define SYNC_BATCH_SIZE 25  // Records per Firebase update request
+#define CLOUD_SYNC_INTERVAL_MS 300000  // Background outbox flush, one batch per loop() pass
+#define CLOUD_JSON_POOL 2   // FirebaseJson payloads kept for reuse
+
+// 0: each scan is uploaded as it happens and the outbox only catches what
+// missed. 1: scans are not uploaded one by one; each flush sends every
+// touched day as one packed value (see wire_format.h), so the cloud lags
+// the gate by up to CLOUD_SYNC_INTERVAL_MS. Only for gates on metered or
+// very slow links.
+#define CLOUD_WIRE_PACKED 0
+
+// Result of a sync run
+struct CloudSyncReport {
+  int batches = 0;   // Update requests acknowledged
+  int records = 0;   // Records uploaded (or removed) in those batches
+  int pending = 0;   // Outbox bytes still waiting after the run
+  bool seeded = false;  // Everything on SD was queued for a full resync
+  String error = "";
+  String rosterError = "";  // Roster sync failed; the outbox was still flushed
+  int rosterConflicts = 0;
+  unsigned long elapsedMs = 0;
+};
+
+// Function declarations for incremental Firebase sync
+void cloudSyncMarkAttendance(const String &date, uint16_t id);
+bool cloudSyncQueueAll();
+bool cloudSyncRun(CloudSyncReport &report, bool full = false);
+void cloudSyncTick();
+String cloudSyncSummary(const CloudSyncReport &report);
+String jsonString(const String &text);
+FirebaseJson *cloudJsonAcquire();
+void cloudJsonRelease(FirebaseJson *json);
+
+#endif // CLOUD_SYNC_H
@@ -1,18 +1,26 @@
 #include "fingerprint.h"
 #include "../utils/display_utils.h"
 #include "../utils/time_utils.h"
+#include "../utils/time_source.h"
+#include "cloud_sync.h"
+#include "fleet.h"
+#include "network.h"
 #include "../utils/sd_utils.h"
+#include "../utils/roster_store.h"
+#include "../utils/template_archive.h"
+#include "../utils/day_rollover.h"
+#include "../utils/day_index.h"
+#include "../utils/presence_index.h"
+#include "../utils/spi_bus.h"
+#include "../utils/metrics.h"
+#include "../utils/logger.h"
+#include "../utils/scan_trace.h"
 
 bool setupFingerprint() {
   fingerSerial.begin(57600, SERIAL_8N1, RX_PIN, TX_PIN);
   finger.begin(57600);
   if (finger.verifyPassword()) {
-    tft.fillScreen(TFT_WHITE);                      // Clear the screen
-    tft.fillRect(0, 15, 128, 30, TFT_WHITE);        // Clear area below time and WiFi icon
-    tft.setCursor(2, 20);                           // Start below the time/WiFi area
-    tft.setTextColor(TFT_BLACK);                    // Set text color to black
-    tft.setTextSize(1);                             // Set text size
-    tft.println("Fingerprint sensor initialized");  // Display message on TFT
+    displayMessageScreen(TFT_BLACK, "Fingerprint sensor initialized");
     return true;
   } else {
     digitalWrite(25, 1);
@@ -25,34 +33,162 @@ bool setupFingerprint() {
   return true;
 }
 
-// Function to save fingerprint template to SD card
-bool saveTemplateToSD(uint16_t id, const uint8_t *templateData, uint16_t templateSize) {
-  // Create fingerprint templates directory if it doesn't exist
-  if (!SD.exists("/fingerprints")) {
-    if (!SD.mkdir("/fingerprints")) {
-      Serial.println("Failed to create fingerprints directory");
-      return false;
+// Raw sensor packets. The Adafruit library only exposes 64-byte packet buffers,
+// which is too small for the 128-byte data packets used by template transfers.
+static void writeSensorPacket(uint8_t type, const uint8_t *payload, uint16_t length) {
+  uint16_t packetLength = length + 2;  // Payload plus checksum
+  uint16_t checksum = type + (packetLength >> 8) + (packetLength & 0xFF);
+  for (uint16_t i = 0; i < length; i++) {
+    checksum += payload[i];
+  }
+
+  uint8_t header[9] = {0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, type, (uint8_t)(packetLength >> 8), (uint8_t)(packetLength & 0xFF)};
+  fingerSerial.write(header, sizeof(header));
+  fingerSerial.write(payload, length);
+  fingerSerial.write((uint8_t)(checksum >> 8));
+  fingerSerial.write((uint8_t)(checksum & 0xFF));
+}
+
+static bool readSensorPacket(uint8_t &type, uint8_t *payload, uint16_t &length, uint16_t maxLength, unsigned long timeout) {
+  uint8_t header[9];
+  uint16_t idx = 0;
+  unsigned long start = millis();
+
+  // Sync on the 0xEF01 start code, then read the fixed header
+  while (idx < sizeof(header)) {
+    if (millis() - start > timeout) return false;
+    if (!fingerSerial.available()) {
+      delay(1);
+      continue;
+    }
+    uint8_t b = fingerSerial.read();
+    if ((idx == 0 && b != 0xEF) || (idx == 1 && b != 0x01)) {
+      idx = 0;
+      continue;
     }
+    header[idx++] = b;
   }
 
-  // Create file path for the template
-  String filePath = "/fingerprints/" + String(id) + ".dat";
-  
-  // Open file for writing
-  File file = SD.open(filePath, FILE_WRITE);
-  if (!file) {
-    Serial.println("Failed to create template file");
+  type = header[6];
+  uint16_t packetLength = ((uint16_t)header[7] << 8) | header[8];
+  if (packetLength < 2 || packetLength - 2 > maxLength) return false;
+  length = packetLength - 2;
+
+  uint16_t checksum = type + header[7] + header[8];
+  for (uint16_t i = 0; i < packetLength; i++) {
+    while (!fingerSerial.available()) {
+      if (millis() - start > timeout) return false;
+      delay(1);
+    }
+    uint8_t b = fingerSerial.read();
+    if (i < length) {
+      payload[i] = b;
+      checksum += b;
+    } else if (i == length) {
+      checksum -= (uint16_t)b << 8;
+    } else {
+      checksum -= b;
+    }
+  }
+  return checksum == 0;
+}
+
+static uint8_t sendSensorCommand(const uint8_t *command, uint16_t length, uint8_t *reply, uint16_t &replyLength, uint16_t maxReply) {
+  writeSensorPacket(FINGERPRINT_COMMANDPACKET, command, length);
+  uint8_t type;
+  if (!readSensorPacket(type, reply, replyLength, maxReply, 1000) || type != FINGERPRINT_ACKPACKET || replyLength < 1) {
+    return FINGERPRINT_PACKETRECIEVEERR;
+  }
+  return reply[0];
+}
+
+// Download a template from the host into one of the sensor's char buffers
+bool uploadModel(const uint8_t *templateData, uint16_t templateSize, uint8_t slot) {
+  uint8_t command[2] = {FINGERPRINT_DOWNCHAR, slot};
+  uint8_t reply[4];
+  uint16_t replyLength = 0;
+  if (sendSensorCommand(command, sizeof(command), reply, replyLength, sizeof(reply)) != FINGERPRINT_OK) {
     return false;
   }
 
-  // Write template data
-  if (file.write(templateData, templateSize) != templateSize) {
-    Serial.println("Failed to write template data");
-    file.close();
+  for (uint16_t offset = 0; offset < templateSize; offset += FINGERPRINT_DATA_CHUNK) {
+    uint16_t chunk = min((uint16_t)FINGERPRINT_DATA_CHUNK, (uint16_t)(templateSize - offset));
+    bool last = offset + chunk >= templateSize;
+    writeSensorPacket(last ? FINGERPRINT_ENDDATAPACKET : FINGERPRINT_DATAPACKET, templateData + offset, chunk);
+  }
+  return true;
+}
+
+// Read a char buffer back from the sensor (call loadModel() first for stored slots)
+bool downloadModel(uint8_t *templateData, uint16_t &templateSize, uint16_t maxSize, uint8_t slot) {
+  uint8_t command[2] = {FINGERPRINT_UPLOAD, slot};
+  uint8_t reply[4];
+  uint16_t replyLength = 0;
+  if (sendSensorCommand(command, sizeof(command), reply, replyLength, sizeof(reply)) != FINGERPRINT_OK) {
     return false;
   }
 
-  file.close();
+  templateSize = 0;
+  uint8_t type = FINGERPRINT_DATAPACKET;
+  while (type != FINGERPRINT_ENDDATAPACKET) {
+    uint8_t chunk[FINGERPRINT_DATA_CHUNK];
+    uint16_t chunkLength = 0;
+    if (!readSensorPacket(type, chunk, chunkLength, sizeof(chunk), 1000)) return false;
+    if (type != FINGERPRINT_DATAPACKET && type != FINGERPRINT_ENDDATAPACKET) return false;
+    if (templateSize + chunkLength > maxSize) return false;
+    memcpy(templateData + templateSize, chunk, chunkLength);
+    templateSize += chunkLength;
+  }
+  return true;
+}
+
+// Read the sensor's slot occupancy bitmap (one bit per template ID)
+bool readSensorIndexTable(uint8_t *bitmap, uint16_t bitmapSize) {
+  memset(bitmap, 0, bitmapSize);
+  for (uint8_t page = 0; page * 32 < bitmapSize; page++) {
+    uint8_t command[2] = {FINGERPRINT_READINDEX, page};
+    uint8_t reply[33];
+    uint16_t replyLength = 0;
+    if (sendSensorCommand(command, sizeof(command), reply, replyLength, sizeof(reply)) != FINGERPRINT_OK || replyLength < 33) {
+      return false;
+    }
+    uint16_t copy = min((uint16_t)32, (uint16_t)(bitmapSize - page * 32));
+    memcpy(bitmap + page * 32, reply + 1, copy);
+  }
+  return true;
+}
+
+// Delete count consecutive slots starting at id with one DeleteChar command
+bool deleteModelRange(uint16_t id, uint16_t count) {
+  uint8_t command[5] = {FINGERPRINT_DELETE, (uint8_t)(id >> 8), (uint8_t)(id & 0xFF), (uint8_t)(count >> 8),
+                        (uint8_t)(count & 0xFF)};
+  uint8_t reply[4];
+  uint16_t replyLength = 0;
+  return sendSensorCommand(command, sizeof(command), reply, replyLength, sizeof(reply)) == FINGERPRINT_OK;
+}
+
+// Delete a sorted list of slots, one command per run of consecutive IDs.
+// Returns the number of slots the sensor confirmed.
+int deleteModels(const uint16_t *ids, int count) {
+  int deleted = 0;
+  int start = 0;
+  while (start < count) {
+    int end = start + 1;
+    while (end < count && ids[end] == ids[end - 1] + 1) end++;
+    if (deleteModelRange(ids[start], end - start)) {
+      deleted += end - start;
+    }
+    start = end;
+  }
+  return deleted;
+}
+
+// Function to save fingerprint template to SD card
+bool saveTemplateToSD(uint16_t id, const uint8_t *templateData, uint16_t templateSize) {
+  if (!templateArchivePut(id, templateData, templateSize)) {
+    LOG_ERROR("Failed to write template %u to archive", id);
+    return false;
+  }
   return true;
 }
 
@@ -61,12 +197,7 @@ void scanFingerprint() {
   rgbLED.setPixelColor(0, rgbLED.Color(0, 0, 0));
   rgbLED.show();  // Ensure LED is off initially
   Serial.println("Starting fingerprint enrollment...");
-  tft.fillScreen(TFT_WHITE);                // Clear the screen
-  tft.fillRect(0, 15, 128, 30, TFT_WHITE);  // Clear area below time and WiFi icon
-  tft.setCursor(2, 20);                     // Start below the time/WiFi area
-  tft.setTextColor(TFT_BLACK);              // Set text color to black
-  tft.setTextSize(1);                       // Set text size
-  tft.println("Place your finger on the scanner...");
+  displayMessageScreen(TFT_BLACK, "Place your finger on the scanner...");
 
   // Set RGB LED to blue (waiting for scan)
   setRGBColor(0, 0, 55);
@@ -79,7 +210,7 @@ void scanFingerprint() {
   // Convert the first image to a template
   if (finger.image2Tz(1) != FINGERPRINT_OK) {
     Serial.println("Failed to convert first fingerprint image to template.");
-    tft.println("Failed to process fingerprint.");
+    displayLogLine("Failed to process fingerprint.", TFT_RED);
     rgbLED.setPixelColor(0, rgbLED.Color(55, 0, 0));
     rgbLED.show();  // Set RGB LED to red (failure)
     server.send(200, "text/plain", "Failed to process fingerprint");
@@ -88,7 +219,7 @@ void scanFingerprint() {
   rgbLED.setPixelColor(0, rgbLED.Color(55, 35, 0));
   rgbLED.show();  // Set RGB LED to orange (scanning)
   Serial.println("Keep your finger on the scanner...");
-  tft.println("Keep your finger on the scanner...");
+  displayLogLine("Keep your finger on the scanner...");
 
   // Wait for the second scan
   delay(2000);  // Add a delay to ensure the sensor is ready for the second scan
@@ -96,7 +227,7 @@ void scanFingerprint() {
   // Convert the second image to a template
   if (finger.image2Tz(2) != FINGERPRINT_OK) {
     Serial.println("Failed to convert second fingerprint image to template.");
-    tft.println("Failed to process fingerprint.");
+    displayLogLine("Failed to process fingerprint.", TFT_RED);
     rgbLED.setPixelColor(0, rgbLED.Color(55, 0, 0));
     rgbLED.show();  // Set RGB LED to red (failure)
     server.send(200, "text/plain", "Failed to process fingerprint");
@@ -106,7 +237,7 @@ void scanFingerprint() {
   // Check if the fingerprint already exists in the sensor database
   if (finger.fingerFastSearch() == FINGERPRINT_OK) {
     Serial.println("Duplicate fingerprint detected!");
-    tft.println("Duplicate fingerprint detected!");
+    displayLogLine("Duplicate fingerprint detected!", TFT_RED);
     rgbLED.setPixelColor(0, rgbLED.Color(55, 0, 0));  // Changed from yellow to red for better visibility
     rgbLED.show();
     server.send(200, "text/plain", "Duplicate fingerprint detected");
@@ -116,7 +247,7 @@ void scanFingerprint() {
   // Create a model from the two templates
   if (finger.createModel() != FINGERPRINT_OK) {
     Serial.println("Failed to create fingerprint model. Ensure the same finger is used.");
-    tft.println("Failed to create fingerprint model.");
+    displayLogLine("Failed to create fingerprint model.", TFT_RED);
     rgbLED.setPixelColor(0, rgbLED.Color(55, 0, 0));
     rgbLED.show();  // Set RGB LED to red (failure)
     server.send(200, "text/plain", "Failed to create fingerprint model");
@@ -126,46 +257,46 @@ void scanFingerprint() {
   // Store the model in the fingerprint sensor
   if (finger.storeModel(addid) == FINGERPRINT_OK) {
     Serial.println("Fingerprint enrolled successfully!");
-    tft.println("Fingerprint enrolled successfully!");
+    displayLogLine("Fingerprint enrolled successfully!");
     
     // Get the template data from the sensor
     uint8_t templateBuffer[512];  // Buffer to store template data
     uint16_t templateSize = 0;
     
-    if (finger.getTemplate(addid, templateBuffer, &templateSize) == FINGERPRINT_OK) {
+    if (finger.loadModel(addid) == FINGERPRINT_OK && downloadModel(templateBuffer, templateSize, sizeof(templateBuffer))) {
       // Save template to SD card
       if (saveTemplateToSD(addid, templateBuffer, templateSize)) {
         Serial.println("Template backup saved to SD card");
-        tft.println("Template backup saved");
+        displayLogLine("Template backup saved");
         setRGBColor(0, 255, 0);  // Set RGB LED to green (complete success)
       } else {
         Serial.println("Failed to save template backup");
-        tft.println("Warning: Backup failed");
+        displayLogLine("Warning: Backup failed", TFT_RED);
         setRGBColor(0, 255, 55);  // Set RGB LED to blue-green (partial success)
       }
     } else {
       Serial.println("Failed to read template from sensor");
-      tft.println("Warning: Backup failed");
+      displayLogLine("Warning: Backup failed", TFT_RED);
       setRGBColor(0, 255, 55);  // Set RGB LED to blue-green (partial success)
     }
     
     server.send(200, "text/plain", "Fingerprint enrolled successfully");
   } else {
     Serial.println("Failed to store fingerprint model.");
-    tft.println("Failed to store fingerprint model.");
+    displayLogLine("Failed to store fingerprint model.", TFT_RED);
     setRGBColor(255, 0, 0);  // Set RGB LED to red (failure)
     server.send(200, "text/plain", "Failed to store fingerprint model");
   }
 
   // Reset the fingerprint sensor
   Serial.println("Resetting fingerprint sensor...");
-  tft.println("Resetting fingerprint sensor...");
+  displayLogLine("Resetting fingerprint sensor...");
   while (finger.getImage() != FINGERPRINT_NOFINGER) {
     delay(100);  // Wait for the finger to be removed
   }
   delay(1000);  // Allow the sensor to reset
   Serial.println("Fingerprint sensor reset complete.");
-  tft.println("Fingerprint sensor reset complete.");
+  displayLogLine("Fingerprint sensor reset complete.");
   setRGBColor(0, 0, 0);  // Turn off the RGB LED
 }
 
@@ -177,13 +308,13 @@ void continuousFingerprintScan() {
   
   // Debug log every 10 seconds to check if the function is being called
   if (millis() - lastDebugTime > 10000) { // Every 10 seconds
-    Serial.println("continuousFingerprintScan function called, isBlinking = " + String(isBlinking ? "true" : "false"));
+    LOG_DEBUG("continuousFingerprintScan called, isBlinking = %s", isBlinking ? "true" : "false");
     lastDebugTime = millis();
   }
 
   if (!isBlinking) {
     if (scanningInProgress) {
-      Serial.println("Continuous scanning stopped.");
+      LOG_INFO("Continuous scanning stopped.");
       displayStatusMessage("Continuous scanning stopped.", TFT_WHITE);
       scanningInProgress = false;
       setRGBColor(0, 0, 0);  // Turn off the RGB LED
@@ -192,7 +323,7 @@ void continuousFingerprintScan() {
   }
 
   if (!scanningInProgress) {
-    Serial.println("Starting continuous fingerprint scanning...");
+    LOG_INFO("Starting continuous fingerprint scanning...");
     displayStatusMessage("Scanning in progress...", TFT_WHITE);
     scanningInProgress = true;
     setRGBColor(0, 0, 55);  // Set RGB LED to blue when starting
@@ -200,7 +331,7 @@ void continuousFingerprintScan() {
 
   // Provide periodic status updates to confirm scanning is active
   if (millis() - lastStatusTime > 5000) { // Every 5 seconds
-    Serial.println("Continuous scan active - waiting for fingerprint");
+    LOG_DEBUG("Continuous scan active - waiting for fingerprint");
     lastStatusTime = millis();
   }
 
@@ -213,15 +344,23 @@ void continuousFingerprintScan() {
   if (millis() - lastScanTime < 1000) {  // Add a 1-second delay between scans
     return;
   }
+
+  // Records need today's date; boot can finish before the clock is set
+  if (todayDate() == "") {
+    displayStatusMessage("Waiting for clock...", TFT_RED);
+    return;
+  }
   
   // Print status information
+  int64_t stageStart = esp_timer_get_time();
+  scanTraceStart(stageStart);
   uint8_t fingerStatus = finger.getImage();
+  scanTraceStage(SCAN_STAGE_CAPTURE, stageStart);
   if (fingerStatus != FINGERPRINT_NOFINGER && fingerStatus != FINGERPRINT_OK) {
-    Serial.print("Fingerprint sensor status: ");
     switch (fingerStatus) {
-      case FINGERPRINT_PACKETRECIEVEERR: Serial.println("Communication error"); break;
-      case FINGERPRINT_IMAGEFAIL: Serial.println("Imaging error"); break;
-      default: Serial.println("Unknown error: " + String(fingerStatus)); break;
+      case FINGERPRINT_PACKETRECIEVEERR: LOG_WARN("Fingerprint sensor status: Communication error"); break;
+      case FINGERPRINT_IMAGEFAIL: LOG_WARN("Fingerprint sensor status: Imaging error"); break;
+      default: LOG_WARN("Fingerprint sensor status: Unknown error: %u", fingerStatus); break;
     }
   }
   
@@ -229,200 +368,245 @@ void continuousFingerprintScan() {
 
   // Perform fingerprint scanning
   if (fingerStatus == FINGERPRINT_OK) {
-    Serial.println("Image taken, processing...");
-    if (finger.image2Tz() == FINGERPRINT_OK) {
-      if (finger.fingerFastSearch() == FINGERPRINT_OK) {
+    LOG_DEBUG("Image taken, processing...");
+    metricsInc(METRIC_SCANS);
+    stageStart = esp_timer_get_time();
+    uint8_t convertStatus = finger.image2Tz();
+    scanTraceStage(SCAN_STAGE_IMAGE2TZ, stageStart);
+    if (convertStatus == FINGERPRINT_OK) {
+      stageStart = esp_timer_get_time();
+      uint8_t searchStatus = finger.fingerFastSearch();
+      scanTraceStage(SCAN_STAGE_SEARCH, stageStart);
+      if (searchStatus == FINGERPRINT_OK) {
+        metricsInc(METRIC_SCAN_MATCHES);
         int fingerId = finger.fingerID;
-        String currentDate = getCurrentDate();
-        String currentTime = getCurrentTime12(); // Use 12-hour format
-        
+        String currentDate = todayDate();
+        uint32_t scanTime = clockSecondsOfDay();
+        time_t scanEpoch = clockEpoch();
+        // Provisional stamps are marked in the day file and journaled so
+        // they can be corrected once NTP arrives
+        bool provisional = clockQuality() != CLOCK_SYNCED;
+        String currentTime = (provisional ? CLOCK_PROVISIONAL_MARK : "") + formatTimeOfDay12(scanTime);  // 12-hour format for the CSV
+
         // Check if this fingerprint has an entry for today
         bool hasEntry = false;
-        String inTime = "";
-        String outTime = "";
+        uint32_t inTime = TIME_OF_DAY_NONE;
+        uint32_t outTime = TIME_OF_DAY_NONE;
         String foundRoll = "";
         String foundName = "";
 
-        // First, get the name and roll number from students.csv
-        File nameFile = SD.open("/students.csv", FILE_READ);
-        if (nameFile) {
-          // Skip header line
-          if (nameFile.available()) {
-            nameFile.readStringUntil('\n');
-          }
-          
-          while (nameFile.available()) {
-            String id, roll, nameStr;
-            if (readCSVLine(nameFile, id, roll, nameStr)) {
-              if (id.toInt() == fingerId) {
-                foundRoll = roll;
-                foundName = nameStr;
-                break;
-              }
-            }
-          }
-          nameFile.close();
+        // First, get the name and roll number from the roster
+        stageStart = esp_timer_get_time();
+        int rosterIndex = rosterStoreFind(fingerId);
+        if (rosterIndex >= 0) {
+          foundRoll = name[rosterIndex][2];
+          foundName = name[rosterIndex][0];
         }
+        scanTraceStage(SCAN_STAGE_LOOKUP, stageStart);
 
         if (foundName != "") {
-          // Now check for existing entry
-          String filePath = getAttendanceFilePath(currentDate);
-          if (ensureAttendanceDirectory(currentDate)) {
-            // Create file with header if it doesn't exist
-            if (!SD.exists(filePath)) {
-              if (!createAttendanceCSVFile(filePath)) {
-                Serial.println("Failed to create attendance file");
-                displayStatusMessage("File creation failed", TFT_RED);
-                return;
-              }
-            }
+          // Today's directory, file and records are kept ready by the day-rollover scheduler
+          String filePath = todayAttendancePath();
+          if (!ensureTodayAttendanceFile()) {
+            LOG_ERROR("Failed to create attendance file");
+            scanTraceFinish(SCAN_OUTCOME_WRITE_FAILED, fingerId);
+            displayStatusMessage("File creation failed", TFT_RED);
+            return;
+          }
 
-            File file = SD.open(filePath, FILE_READ);
+          File file;
+          stageStart = esp_timer_get_time();
+          DayRecord *record = findTodayRecord(fingerId);
+          if (record) {
+            hasEntry = true;
+            inTime = record->inTime;
+            outTime = record->outTime;
+          }
+          scanTraceStage(SCAN_STAGE_DAY_LOOKUP, stageStart);
+
+          // Write the attendance record to the file
+          if (!hasEntry) {
+            // First scan - record in-time
+            stageStart = esp_timer_get_time();
+            spiBusAcquire(SPI_DEV_SD, SPI_PRIO_CRITICAL);
+            file = SD.open(filePath, FILE_APPEND);
+            bool appended = file;
             if (file) {
-              // Skip header line
-              if (file.available()) {
-                file.readStringUntil('\n');
+              writeAttendanceCSVLine(file, foundRoll, foundName, String(fingerId), currentTime, "-");
+              file.close();
+              if (provisional) {
+                journalProvisionalStamp(fingerId, false, scanEpoch);
               }
-
-              while (file.available()) {
-                String roll, name, id, in, out;
-                if (readAttendanceCSVLine(file, roll, name, id, in, out)) {
-                  if (id.toInt() == fingerId) {
-                    hasEntry = true;
-                    inTime = in;
-                    outTime = out;
-                    break;
+            }
+            spiBusRelease(SPI_DEV_SD);
+            scanTraceStage(SCAN_STAGE_SD_WRITE, stageStart);
+            if (appended) {
+              metricsInc(METRIC_ATTENDANCE_IN);
+              addTodayRecord(fingerId, scanTime);
+              dayIndexAdjust(currentDate, 1);
+              presenceIndexMark(currentDate, fingerId);
+              LOG_INFO("In-time recorded - ID: %d, Roll: %s, Name: %s", fingerId, foundRoll.c_str(), foundName.c_str());
+
+              // Upload to Firebase immediately; anything not uploaded goes
+              // to the sync outbox (provisional stamps, packed mode and scans
+              // while a sync holds the client always do)
+              bool uploaded = false;
+              if (!CLOUD_WIRE_PACKED && !provisional && firebaseAcquire(0)) {
+                if (Firebase.ready()) {
+                  String path = "/" + fleetEventPath(currentDate, fingerId, scanTime);
+                  FirebaseJson *json = cloudJsonAcquire();
+                  json->setJsonData(fleetEventJson(currentDate, scanTime, currentTime, false));
+
+                  stageStart = esp_timer_get_time();
+                  uploaded = Firebase.setJSON(firebaseData, path.c_str(), *json);
+                  cloudJsonRelease(json);
+                  scanTraceStage(SCAN_STAGE_CLOUD_WRITE, stageStart);
+                  metricsInc(METRIC_CLOUD_WRITES);
+                  if (uploaded) {
+                    LOG_DEBUG("Attendance uploaded to Firebase successfully");
+                  } else {
+                    metricsInc(METRIC_CLOUD_FAILURES);
+                    LOG_WARN("Failed to upload attendance to Firebase: %s", firebaseData.errorReason().c_str());
                   }
                 }
+                firebaseRelease();
+              }
+              if (!uploaded) {
+                cloudSyncMarkAttendance(currentDate, fingerId);
               }
-              file.close();
 
-              // Write the attendance record to the file
-              if (!hasEntry) {
-                // First scan - record in-time
-                file = SD.open(filePath, FILE_APPEND);
-                if (file) {
-                  writeAttendanceCSVLine(file, foundRoll, foundName, String(fingerId), currentTime, "-");
-                  file.close();
-                  Serial.println("In-time recorded - ID: " + String(fingerId) + ", Roll: " + foundRoll + ", Name: " + foundName);
+              scanTraceFinish(SCAN_OUTCOME_IN, fingerId);
 
-                  // Upload to Firebase immediately
-                  if (Firebase.ready()) {
-                    String month = currentDate.substring(3, 5);
-                    String path = "/attendance/" + month + "/" + currentDate + "/" + String(fingerId);
-                    FirebaseJson json;
-                    json.set("name", foundName);
-                    json.set("rollNumber", foundRoll);
-                    json.set("inTime", currentTime);
-                    json.set("outTime", "-");
-
-                    if (Firebase.setJSON(firebaseData, path.c_str(), json)) {
-                      Serial.println("Attendance uploaded to Firebase successfully");
+              // Update display
+              displayAttendanceRecord(fingerId, foundRoll, foundName, true);
+              setRGBColor(0, 55, 0);  // Set RGB LED to green for successful scan
+              delay(1000);            // Keep green for 1 second
+              setRGBColor(0, 0, 55);  // Return to blue
+            } else {
+              LOG_ERROR("Failed to open attendance file for append");
+              scanTraceFinish(SCAN_OUTCOME_WRITE_FAILED, fingerId);
+            }
+          } else if (outTime == TIME_OF_DAY_NONE) {
+            // Second scan - update out-time
+            // Create a temporary file
+            String tempPath = filePath + ".tmp";
+            stageStart = esp_timer_get_time();
+            spiBusAcquire(SPI_DEV_SD, SPI_PRIO_CRITICAL);
+            File tempFile = SD.open(tempPath, FILE_WRITE);
+            if (tempFile) {
+              // Write header
+              tempFile.println("Roll Number,Name,Fingerprint ID,In Time,Out Time");
+
+              // Copy all records, updating the matching one
+              file = SD.open(filePath, FILE_READ);
+              if (file) {
+                // Skip header
+                if (file.available()) {
+                  file.readStringUntil('\n');
+                }
+
+                while (file.available()) {
+                  String roll, name, id, in, out;
+                  if (readAttendanceCSVLine(file, roll, name, id, in, out)) {
+                    if (id.toInt() == fingerId) {
+                      // Update the out time for this record
+                      writeAttendanceCSVLine(tempFile, roll, name, id, in, currentTime);
                     } else {
-                      Serial.println("Failed to upload attendance to Firebase");
-                      Serial.println("Error: " + firebaseData.errorReason());
+                      // Copy the record as is
+                      writeAttendanceCSVLine(tempFile, roll, name, id, in, out);
                     }
                   }
-
-                  // Update display
-                  displayAttendanceRecord(fingerId, foundRoll, foundName, true);
-                  setRGBColor(0, 55, 0);  // Set RGB LED to green for successful scan
-                  delay(1000);            // Keep green for 1 second
-                  setRGBColor(0, 0, 55);  // Return to blue
                 }
-              } else if (outTime == "-") {
-                // Second scan - update out-time
-                // Create a temporary file
-                String tempPath = filePath + ".tmp";
-                File tempFile = SD.open(tempPath, FILE_WRITE);
-                if (tempFile) {
-                  // Write header
-                  tempFile.println("Roll Number,Name,Fingerprint ID,In Time,Out Time");
-
-                  // Copy all records, updating the matching one
-                  file = SD.open(filePath, FILE_READ);
-                  if (file) {
-                    // Skip header
-                    if (file.available()) {
-                      file.readStringUntil('\n');
-                    }
+                file.close();
+              }
+              tempFile.close();
 
-                    while (file.available()) {
-                      String roll, name, id, in, out;
-                      if (readAttendanceCSVLine(file, roll, name, id, in, out)) {
-                        if (id.toInt() == fingerId) {
-                          // Update the out time for this record
-                          writeAttendanceCSVLine(tempFile, roll, name, id, in, currentTime);
-                        } else {
-                          // Copy the record as is
-                          writeAttendanceCSVLine(tempFile, roll, name, id, in, out);
-                        }
-                      }
-                    }
-                    file.close();
-                  }
-                  tempFile.close();
-
-                  // Replace the original file with the temporary file
-                  if (SD.remove(filePath) && SD.rename(tempPath, filePath)) {
-                    Serial.println("Out-time recorded - ID: " + String(fingerId) + ", Roll: " + foundRoll + ", Name: " + foundName);
-
-                    // Upload to Firebase
-                    if (Firebase.ready()) {
-                      String month = currentDate.substring(3, 5);
-                      String path = "/attendance/" + month + "/" + currentDate + "/" + String(fingerId);
-                      FirebaseJson json;
-                      json.set("name", foundName);
-                      json.set("rollNumber", foundRoll);
-                      json.set("inTime", inTime);
-                      json.set("outTime", currentTime);
-
-                      if (Firebase.setJSON(firebaseData, path.c_str(), json)) {
-                        Serial.println("Out-time uploaded to Firebase successfully");
-                      } else {
-                        Serial.println("Failed to upload out-time to Firebase");
-                        Serial.println("Error: " + firebaseData.errorReason());
-                      }
+              // Replace the original file with the temporary file
+              bool replaced = SD.remove(filePath) && SD.rename(tempPath, filePath);
+              if (replaced && provisional) {
+                journalProvisionalStamp(fingerId, true, scanEpoch);
+              }
+              spiBusRelease(SPI_DEV_SD);
+              scanTraceStage(SCAN_STAGE_SD_WRITE, stageStart);
+              if (replaced) {
+                metricsInc(METRIC_ATTENDANCE_OUT);
+                record->outTime = scanTime;
+                LOG_INFO("Out-time recorded - ID: %d, Roll: %s, Name: %s", fingerId, foundRoll.c_str(), foundName.c_str());
+
+                // Upload to Firebase, or queue it for the next sync
+                bool uploaded = false;
+                if (!CLOUD_WIRE_PACKED && !provisional && firebaseAcquire(0)) {
+                  if (Firebase.ready()) {
+                    String path = "/" + fleetEventPath(currentDate, fingerId, scanTime);
+                    FirebaseJson *json = cloudJsonAcquire();
+                    json->setJsonData(fleetEventJson(currentDate, scanTime, currentTime, true));
+
+                    stageStart = esp_timer_get_time();
+                    uploaded = Firebase.setJSON(firebaseData, path.c_str(), *json);
+                    cloudJsonRelease(json);
+                    scanTraceStage(SCAN_STAGE_CLOUD_WRITE, stageStart);
+                    metricsInc(METRIC_CLOUD_WRITES);
+                    if (uploaded) {
+                      LOG_DEBUG("Out-time uploaded to Firebase successfully");
+                    } else {
+                      metricsInc(METRIC_CLOUD_FAILURES);
+                      LOG_WARN("Failed to upload out-time to Firebase: %s", firebaseData.errorReason().c_str());
                     }
-
-                    // Update display
-                    displayAttendanceRecord(fingerId, foundRoll, foundName, false);
-                    setRGBColor(0, 55, 0);  // Set RGB LED to green for successful scan
-                    delay(1000);            // Keep green for 1 second
-                    setRGBColor(0, 0, 55);  // Return to blue
-                  } else {
-                    Serial.println("Failed to update attendance file");
-                    displayStatusMessage("Failed to update record", TFT_RED);
                   }
-                } else {
-                  Serial.println("Failed to create temp file");
-                  displayStatusMessage("Failed to update record", TFT_RED);
+                  firebaseRelease();
                 }
-              } else {
-                Serial.println("Student already marked present and out");
-                displayStatusMessage("Already marked out", TFT_YELLOW);
-                setRGBColor(55, 35, 0);  // Set RGB LED to orange
-                delay(1000);            // Keep orange for 1 second
+                if (!uploaded) {
+                  cloudSyncMarkAttendance(currentDate, fingerId);
+                }
+
+                scanTraceFinish(SCAN_OUTCOME_OUT, fingerId);
+
+                // Update display
+                displayAttendanceRecord(fingerId, foundRoll, foundName, false);
+                setRGBColor(0, 55, 0);  // Set RGB LED to green for successful scan
+                delay(1000);            // Keep green for 1 second
                 setRGBColor(0, 0, 55);  // Return to blue
+              } else {
+                LOG_ERROR("Failed to update attendance file");
+                scanTraceFinish(SCAN_OUTCOME_WRITE_FAILED, fingerId);
+                displayStatusMessage("Failed to update record", TFT_RED);
               }
+            } else {
+              spiBusRelease(SPI_DEV_SD);
+              LOG_ERROR("Failed to create temp file");
+              scanTraceFinish(SCAN_OUTCOME_WRITE_FAILED, fingerId);
+              displayStatusMessage("Failed to update record", TFT_RED);
             }
+          } else {
+            LOG_INFO("Student %d already marked present and out", fingerId);
+            scanTraceFinish(SCAN_OUTCOME_ALREADY_OUT, fingerId);
+            displayStatusMessage("Already marked out", TFT_YELLOW);
+            setRGBColor(55, 35, 0);  // Set RGB LED to orange
+            delay(1000);            // Keep orange for 1 second
+            setRGBColor(0, 0, 55);  // Return to blue
           }
         } else {
-          Serial.println("Fingerprint ID not found in students database");
+          metricsInc(METRIC_SCAN_ERRORS);
+          LOG_WARN("Fingerprint ID %d not found in students database", fingerId);
+          scanTraceFinish(SCAN_OUTCOME_UNKNOWN_ID, fingerId);
           displayStatusMessage("ID not found", TFT_RED);
           setRGBColor(55, 0, 0);  // Set RGB LED to red
           delay(1000);            // Keep red for 1 second
           setRGBColor(0, 0, 55);  // Return to blue
         }
       } else {
-        Serial.println("No match found");
+        metricsInc(METRIC_SCAN_NO_MATCH);
+        LOG_INFO("No match found");
+        scanTraceFinish(SCAN_OUTCOME_NO_MATCH);
         displayStatusMessage("No match found", TFT_RED);
         setRGBColor(55, 0, 0);  // Set RGB LED to red
         delay(1000);            // Keep red for 1 second
         setRGBColor(0, 0, 55);  // Return to blue
       }
     } else {
-      Serial.println("Failed to convert image");
+      metricsInc(METRIC_SCAN_ERRORS);
+      LOG_WARN("Failed to convert image");
+      scanTraceFinish(SCAN_OUTCOME_IMAGE_ERROR);
       displayStatusMessage("Image error", TFT_RED);
       setRGBColor(55, 0, 0);  // Set RGB LED to red
       delay(1000);            // Keep red for 1 second
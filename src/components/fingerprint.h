@@ -3,6 +3,16 @@
 
 #include "../config/config.h"
 
+// Sensor commands not defined by Adafruit_Fingerprint
+#ifndef FINGERPRINT_DOWNCHAR
+#define FINGERPRINT_DOWNCHAR 0x09   // Host -> sensor char buffer
+#endif
+#ifndef FINGERPRINT_READINDEX
+#define FINGERPRINT_READINDEX 0x1F  // Read slot occupancy table
+#endif
+#define FINGERPRINT_DATA_CHUNK 128  // Default data packet size of R307-class sensors
+#define FINGERPRINT_TEMPLATE_SIZE 512
+
 // External declarations
 extern Adafruit_Fingerprint finger;
 
@@ -10,5 +20,13 @@ extern Adafruit_Fingerprint finger;
 bool setupFingerprint();
 void scanFingerprint();
 void continuousFingerprintScan();
+bool saveTemplateToSD(uint16_t id, const uint8_t *templateData, uint16_t templateSize);
+
+// Template transfer between host and sensor
+bool uploadModel(const uint8_t *templateData, uint16_t templateSize, uint8_t slot = 1);
+bool downloadModel(uint8_t *templateData, uint16_t &templateSize, uint16_t maxSize, uint8_t slot = 1);
+bool readSensorIndexTable(uint8_t *bitmap, uint16_t bitmapSize);
+bool deleteModelRange(uint16_t id, uint16_t count);
+int deleteModels(const uint16_t *ids, int count);
 
 #endif // FINGERPRINT_H 
\ No newline at end of file
@@ -0,0 +1,290 @@
+#include "fleet.h"
+#include "network.h"
+#include "cloud_sync.h"
+#include "../utils/time_utils.h"
+#include "../utils/wire_format.h"
+#include "../utils/day_rollover.h"
+#include "../utils/attendance_query.h"
+#include "../utils/security_utils.h"
+
+// Local epoch for a time of day on a DD-MM-YYYY date
+static uint32_t epochOf(const String &date, uint32_t secondsOfDay) {
+  struct tm info = {};
+  info.tm_mday = date.substring(0, 2).toInt();
+  info.tm_mon = date.substring(3, 5).toInt() - 1;
+  info.tm_year = date.substring(6).toInt() - 1900;
+  info.tm_hour = secondsOfDay / 3600;
+  info.tm_min = (secondsOfDay / 60) % 60;
+  info.tm_sec = secondsOfDay % 60;
+  info.tm_isdst = -1;
+  return mktime(&info);
+}
+
+static String eventsDayPath(const String &date) {
+  return String(FLEET_EVENTS_ROOT) + "/" + date.substring(3, 5) + "/" + date;
+}
+
+String fleetEventPath(const String &date, uint16_t id, uint32_t secondsOfDay) {
+  return eventsDayPath(date) + "/" + String(id) + "/" + deviceId() + "-" + String(secondsOfDay);
+}
+
+String fleetEventJson(const String &date, uint32_t secondsOfDay, const String &timeText, bool isOut) {
+  return "{\"at\":" + String(epochOf(date, secondsOfDay)) +
+         ",\"t\":" + jsonString(timeText) +
+         ",\"kind\":\"" + (isOut ? "out" : "in") + "\"" +
+         ",\"gate\":" + jsonString(deviceId()) + "}";
+}
+
+static FleetDayRecord *findRecord(std::vector<FleetDayRecord> &records, uint16_t id) {
+  for (FleetDayRecord &record : records) {
+    if (record.id == id) return &record;
+  }
+  return NULL;
+}
+
+// Fold one event into its student's merged record
+static void mergeEvent(std::vector<FleetDayRecord> &records, uint16_t id, uint32_t at, const String &timeText, const String &gate) {
+  FleetDayRecord *record = findRecord(records, id);
+  if (!record) {
+    records.push_back({id, at, at, timeText, timeText, gate, 1});
+    return;
+  }
+  record->events++;
+  if (at < record->firstAt) {
+    record->firstAt = at;
+    record->inTime = timeText;
+  }
+  if (at > record->lastAt) {
+    record->lastAt = at;
+    record->outTime = timeText;
+  }
+  if (("," + record->gates + ",").indexOf("," + gate + ",") < 0) {
+    record->gates += "," + gate;
+  }
+}
+
+// Fold in the gates that upload whole days packed (wire_format.h)
+static bool mergePackedDay(const String &date, std::vector<FleetDayRecord> &records, String &error) {
+  String path = "/packed/" + date.substring(3, 5) + "/" + date;
+  if (!Firebase.getJSON(firebaseData, path.c_str())) {
+    if (firebaseData.dataType() == "null") {
+      return true;
+    }
+    error = firebaseData.errorReason();
+    return false;
+  }
+
+  FirebaseJson &gates = firebaseData.jsonObject();
+  size_t count = gates.iteratorBegin();
+  for (size_t i = 0; i < count; i++) {
+    int type;
+    String gate, value;
+    gates.iteratorGet(i, type, gate, value);
+    if (type != FirebaseJson::JSON_OBJECT || !gate.startsWith("gate-")) continue;
+
+    FirebaseJson day;
+    FirebaseJsonData field;
+    day.setJsonData(value);
+    std::vector<WireEvent> events;
+    if (!day.get(field, "d") || !wireUnpackEvents(field.stringValue, events)) {
+      continue;
+    }
+    for (const WireEvent &event : events) {
+      String timeText = (event.provisional ? "~" : "") + formatTimeOfDay12(event.secondsOfDay);
+      mergeEvent(records, event.id, epochOf(date, event.secondsOfDay), timeText, gate);
+    }
+  }
+  gates.iteratorEnd();
+  return true;
+}
+
+// Fold in one student's events, keyed by <gate>-<second of day>
+static void mergeStudentEvents(std::vector<FleetDayRecord> &records, uint16_t id, const String &date, const String &value) {
+  FirebaseJson student;
+  student.setJsonData(value);
+  size_t eventCount = student.iteratorBegin();
+  for (size_t e = 0; e < eventCount; e++) {
+    int eventType;
+    String eventKey, eventValue;
+    student.iteratorGet(e, eventType, eventKey, eventValue);
+    int dash = eventKey.lastIndexOf('-');
+    if (eventType != FirebaseJson::JSON_OBJECT || dash <= 0) continue;
+
+    FirebaseJson event;
+    FirebaseJsonData field;
+    event.setJsonData(eventValue);
+    uint32_t at = event.get(field, "at") ? field.intValue : epochOf(date, eventKey.substring(dash + 1).toInt());
+    String timeText = event.get(field, "t") ? field.stringValue : String("-");
+    mergeEvent(records, id, at, timeText, eventKey.substring(0, dash));
+  }
+  student.iteratorEnd();
+}
+
+static bool aggregateDay(const String &date, std::vector<FleetDayRecord> &records, String &error) {
+  records.clear();
+  String path = "/" + eventsDayPath(date);
+  if (!Firebase.getJSON(firebaseData, path.c_str())) {
+    if (firebaseData.dataType() == "null") {
+      return true;  // No events for that day
+    }
+    error = firebaseData.errorReason();
+    return false;
+  }
+
+  if (firebaseData.dataType() == "array") {
+    // Student IDs are small dense integers, which RTDB returns as an array
+    // indexed by ID rather than an object keyed by it
+    FirebaseJsonArray &day = firebaseData.jsonArray();
+    for (size_t i = 1; i < day.size(); i++) {
+      FirebaseJsonData student;
+      if (day.get(student, i) && student.typeNum == FirebaseJson::JSON_OBJECT) {
+        mergeStudentEvents(records, i, date, student.stringValue);
+      }
+    }
+  } else {
+    FirebaseJson &day = firebaseData.jsonObject();
+    size_t count = day.iteratorBegin();
+    for (size_t i = 0; i < count; i++) {
+      int type;
+      String key, value;
+      day.iteratorGet(i, type, key, value);
+      uint16_t id = key.toInt();
+      if (type != FirebaseJson::JSON_OBJECT || id == 0) continue;
+      mergeStudentEvents(records, id, date, value);
+    }
+    day.iteratorEnd();
+  }
+
+  if (!mergePackedDay(date, records, error)) {
+    return false;
+  }
+
+  for (FleetDayRecord &record : records) {
+    if (record.events == 1) {
+      record.outTime = "-";  // Only an in-scan so far
+    }
+  }
+  return true;
+}
+
+bool fleetAggregateDay(const String &date, std::vector<FleetDayRecord> &records, String &error) {
+  firebaseAcquire();
+  bool ok = aggregateDay(date, records, error);
+  firebaseRelease();
+  return ok;
+}
+
+// Write the merged view to /attendance/MM/DATE/ID for dashboards that read
+// the single-record layout. Every sync that uploads scans publishes the
+// days it touched; every gate derives the same result from the same
+// events, so publishing from several gates converges.
+bool fleetPublishDay(const String &date, const std::vector<FleetDayRecord> &records, String &error) {
+  if (records.empty()) return true;
+
+  String prefix = "\"attendance/" + date.substring(3, 5) + "/" + date + "/";
+  String body = "{";
+  for (const FleetDayRecord &record : records) {
+    String studentName = "", roll = "";
+    for (int i = 0; i < namid; i++) {
+      if (name[i][1].toInt() == record.id) {
+        studentName = name[i][0];
+        roll = name[i][2];
+        break;
+      }
+    }
+    if (body.length() > 1) body += ",";
+    body += prefix + String(record.id) + "\":{\"name\":" + jsonString(studentName) +
+            ",\"rollNumber\":" + jsonString(roll) +
+            ",\"inTime\":" + jsonString(record.inTime) +
+            ",\"outTime\":" + jsonString(record.outTime) +
+            ",\"gates\":" + jsonString(record.gates) + "}";
+  }
+  body += "}";
+
+  FirebaseJson *json = cloudJsonAcquire();
+  json->setJsonData(body);
+  firebaseAcquire();
+  bool sent = Firebase.updateNodeSilent(firebaseData, "/", *json);
+  if (!sent) error = firebaseData.errorReason();
+  firebaseRelease();
+  cloudJsonRelease(json);
+  return sent;
+}
+
+// The date argument, today when absent, in canonical DD-MM-YYYY form.
+// It ends up in RTDB paths, so anything queryParseDate() rejects is refused.
+static bool fleetDateArg(String &date) {
+  String text = server.hasArg("date") ? server.arg("date") : todayDate();
+  int32_t dayNumber;
+  if (text.length() != 10 || !queryParseDate(text.c_str(), dayNumber)) {
+    server.send(400, "application/json", "{\"error\":\"date must be DD-MM-YYYY\"}");
+    return false;
+  }
+  int day, month, year;
+  queryDateOf(dayNumber, day, month, year);
+  char canonical[11];
+  snprintf(canonical, sizeof(canonical), "%02d-%02d-%04d", day, month, year);
+  date = canonical;
+  return true;
+}
+
+// Merge a day for one of the handlers below; false once it has answered
+static bool fleetDayFor(String &date, std::vector<FleetDayRecord> &records) {
+  if (!fleetDateArg(date)) {
+    return false;
+  }
+  if (!firebaseReady()) {
+    server.send(503, "application/json", "{\"error\":\"Firebase not ready\"}");
+    return false;
+  }
+  String error;
+  if (!fleetAggregateDay(date, records, error)) {
+    server.send(502, "application/json", "{\"error\":" + jsonString(error) + "}");
+    return false;
+  }
+  return true;
+}
+
+// GET /api/fleet/day?date=DD-MM-YYYY: the merged day, read only
+void handleFleetDay() {
+  String date;
+  std::vector<FleetDayRecord> records;
+  if (!fleetDayFor(date, records)) {
+    return;
+  }
+
+  String json = "{\"date\":\"" + date + "\",\"gate\":" + jsonString(deviceId()) + ",\"students\":[";
+  for (size_t i = 0; i < records.size(); i++) {
+    const FleetDayRecord &record = records[i];
+    if (i > 0) json += ",";
+    json += "{\"id\":" + String(record.id) +
+            ",\"in\":" + jsonString(record.inTime) +
+            ",\"out\":" + jsonString(record.outTime) +
+            ",\"events\":" + String(record.events) +
+            ",\"gates\":" + jsonString(record.gates) + "}";
+  }
+  json += "]}";
+  server.send(200, "application/json", json);
+}
+
+// POST /api/fleet/publish with date=DD-MM-YYYY and csrf_token: rewrites
+// /attendance for a day no sync has touched since, e.g. after records were
+// edited by hand
+void handleFleetPublish() {
+  if (!verifyCSRFToken()) {
+    server.send(403, "application/json", "{\"error\":\"Invalid CSRF token\"}");
+    return;
+  }
+  String date;
+  std::vector<FleetDayRecord> records;
+  if (!fleetDayFor(date, records)) {
+    return;
+  }
+  String error;
+  if (!fleetPublishDay(date, records, error)) {
+    server.send(502, "application/json", "{\"error\":" + jsonString(error) + "}");
+    return;
+  }
+  server.send(200, "application/json",
+              "{\"date\":\"" + date + "\",\"published\":true,\"students\":" + String(records.size()) + "}");
+}
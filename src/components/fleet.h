@@ -0,0 +1,38 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include "../config/config.h"
+#include <vector>
+
+// Several gates share one database. Instead of each writing in/out fields
+// into /attendance/MM/DATE/ID (where they overwrite each other), every scan
+// is an event under /events/MM/DATE/ID/<gate>-<second of day>. Event keys
+// are unique per gate and deterministic, so retries and re-syncs rewrite
+// the same event. The merged day view takes the earliest event as the
+// in-time and the latest as the out-time, whichever gates they came from.
+// Gates uploading packed days (CLOUD_WIRE_PACKED) write /packed instead;
+// the merge reads both. After each sync that uploads scans, the gate
+// publishes the merged days back to /attendance for older dashboards.
+
+#define FLEET_EVENTS_ROOT "events"
+
+// One student's day merged across gates
+struct FleetDayRecord {
+  uint16_t id;
+  uint32_t firstAt;  // Epoch of the earliest event
+  uint32_t lastAt;   // Epoch of the latest event
+  String inTime;     // Time text as the gate stamped it
+  String outTime;    // "-" with a single event
+  String gates;      // Comma-separated gates that saw the student
+  int events;
+};
+
+// Function declarations for multi-gate attendance
+String fleetEventPath(const String &date, uint16_t id, uint32_t secondsOfDay);
+String fleetEventJson(const String &date, uint32_t secondsOfDay, const String &timeText, bool isOut);
+bool fleetAggregateDay(const String &date, std::vector<FleetDayRecord> &records, String &error);
+bool fleetPublishDay(const String &date, const std::vector<FleetDayRecord> &records, String &error);
+void handleFleetDay();
+void handleFleetPublish();
+
+#endif // FLEET_H
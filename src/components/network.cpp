@@ -1,22 +1,99 @@
 #include "network.h"
+#include "cloud_sync.h"
 #include "../utils/sd_utils.h"
 #include "../utils/display_utils.h"
+#include "../utils/display_compositor.h"
+#include "../utils/spi_bus.h"
+#include "../utils/logger.h"
+
+// A message waiting for the Telegram task, with the credentials it goes
+// out with copied in so the task never reads the globals
+struct TelegramMessage {
+  String botToken;
+  String chatId;
+  String text;
+};
+
+// Pointers to heap TelegramMessages the task deletes once handled
+static QueueHandle_t telegramQueue = NULL;
+
+// Guards telegramBotToken and telegramChatId, written on both cores
+static SemaphoreHandle_t telegramMutex = NULL;
+
+// Serialises Firebase and firebaseData between loop() and the core-0 tasks
+static SemaphoreHandle_t firebaseMutex = NULL;
+
+// Credentials of the last connect attempt, for wifiRestart()
+static String wifiSsid = "";
+static String wifiPassword = "";
+
+void networkBegin() {
+  if (firebaseMutex == NULL) {
+    firebaseMutex = xSemaphoreCreateRecursiveMutex();
+  }
+  if (telegramMutex == NULL) {
+    telegramMutex = xSemaphoreCreateMutex();
+  }
+}
+
+static void telegramLock() {
+  if (telegramMutex) xSemaphoreTake(telegramMutex, portMAX_DELAY);
+}
+
+static void telegramUnlock() {
+  if (telegramMutex) xSemaphoreGive(telegramMutex);
+}
+
+void telegramSetCredentials(const String &botToken, const String &chatId) {
+  String token = botToken, chat = chatId;
+  token.trim();
+  chat.trim();
+  telegramLock();
+  telegramBotToken = token;
+  telegramChatId = chat;
+  telegramUnlock();
+}
+
+bool telegramConfigured() {
+  telegramLock();
+  bool configured = telegramBotToken != "" && telegramChatId != "";
+  telegramUnlock();
+  return configured;
+}
+
+bool firebaseAcquire(TickType_t wait) {
+  if (firebaseMutex == NULL) return true;
+  return xSemaphoreTakeRecursive(firebaseMutex, wait) == pdTRUE;
+}
+
+void firebaseRelease() {
+  if (firebaseMutex == NULL) return;
+  xSemaphoreGiveRecursive(firebaseMutex);
+}
+
+// Firebase.ready() without waiting; false while another task has the client
+bool firebaseReady() {
+  if (!firebaseAcquire(0)) return false;
+  bool ready = Firebase.ready();
+  firebaseRelease();
+  return ready;
+}
 
 bool connectWifi(String ssid, String password) {
+  wifiSsid = ssid;
+  wifiPassword = password;
   WiFi.begin(ssid.c_str(), password.c_str());
   Serial.print("Connecting to WiFi...");
-  tft.fillScreen(TFT_WHITE);                // Clear the screen
-  tft.fillRect(0, 15, 128, 30, TFT_WHITE);  // Clear area below time and WiFi icon
-  tft.setCursor(2, 20);                     // Start below the time/WiFi area
-  tft.setTextColor(TFT_BLACK);              // Set text color to black
-  tft.setTextSize(1);                       // Set text size
-  tft.println("Connecting to WiFi...");
+  displayMessageScreen(TFT_BLACK, "Connecting to WiFi...");
   drawWiFiIcon(false);  // Show disconnected WiFi icon
+  String progress = "";
 
   unsigned long startAttemptTime = millis();
   while (WiFi.status() != WL_CONNECTED && millis() - startAttemptTime < 10000) {  // Retry for 10 seconds
     Serial.print(".");
-    tft.print(".");  // Show progress on TFT
+    progress += ".";
+    compositorSetStatusLine(1, progress, TFT_BLACK);  // Show progress on TFT
+    compositorFlush();
     delay(500);
   }
   if (WiFi.status() == WL_CONNECTED) {
@@ -27,42 +104,63 @@ bool connectWifi(String ssid, String password) {
   return false;
 }
 
-void setupWiFi() {
-  String ssid, password;
-  // Read WiFi credentials from the SD card
-  if (!readWiFiCredentials(ssid, password)) {
-    Serial.println("Failed to read WiFi credentials from SD card.");
-    ssid = "Realme 8";      // Fallback SSID
-    password = "88888888";  // Fallback password
-  }
-  Serial.print("Connecting to WiFi using SD card credentials...");
-  bool wifistatus = connectWifi(ssid, password);
-  if (wifistatus) {
-    Serial.println("\nWiFi connected using SD credentials.");
-    return;
-  } else {
-    if (connectWifi("Realme 8", "88888888")) {
-      Serial.println("\nWiFi connected using fallback credentials.");
-      return;
-    }
-  }
-  // If both SD card and fallback credentials fail, prompt to update WiFi credentials
-  Serial.println("\nFailed to connect to WiFi. Do you want to update WiFi credentials? (y/n)");
-  tft.println("\nFailed to connect to WiFi.");
-  tft.println("Update WiFi credentials? (y/n)");
+// Drop the connection and start over with the last credentials. Returns
+// straight away; loop() sees the result on a later pass.
+bool wifiRestart() {
+  if (wifiSsid.length() == 0) return false;
+  WiFi.disconnect();
+  WiFi.begin(wifiSsid.c_str(), wifiPassword.c_str());
+  return true;
+}
 
+// A trimmed line from the serial console, or "" after waitMs without one
+static String readSerialLine(uint32_t waitMs) {
+  uint32_t start = millis();
   while (!Serial.available()) {
+    if (millis() - start >= waitMs) return "";
     delay(100);
   }
+  String line = Serial.readStringUntil('\n');
+  line.trim();
+  return line;
+}
 
-  char response = Serial.read();
-  if (response == 'y' || response == 'Y') {
-    updateWiFiCredentials();
-    setupWiFi();  // Retry with updated credentials
-  } else {
+// Boot only: offer to enter new WiFi credentials on the serial console and
+// save them to the SD card. Each answer is waited for WIFI_PROMPT_WAIT_MS
+// at most, so a gate with no console attached carries on offline.
+bool promptWiFiCredentials(String &ssid, String &password) {
+  if (!Serial) return false;
+  Serial.println("\nFailed to connect to WiFi. Do you want to update WiFi credentials? (y/n)");
+  displayMessageScreen(TFT_RED, "Failed to connect to WiFi.", "Update WiFi credentials?", "(y/n on serial)");
+
+  String answer = readSerialLine(WIFI_PROMPT_WAIT_MS);
+  if (!answer.startsWith("y") && !answer.startsWith("Y")) {
     Serial.println("WiFi connection failed. Proceeding without WiFi.");
-    tft.println("WiFi connection failed.");
+    return false;
+  }
+
+  Serial.println("Enter new WiFi SSID:");
+  String newSSID = readSerialLine(WIFI_PROMPT_WAIT_MS);
+  if (newSSID.length() == 0) return false;
+  Serial.println("Enter new WiFi Password:");
+  String newPassword = readSerialLine(WIFI_PROMPT_WAIT_MS);
+  if (newPassword.length() == 0) return false;
+
+  // Save the new credentials to the SD card
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File file = SD.open("/wifi.txt", FILE_WRITE);
+  bool saved = (bool)file;
+  if (file) {
+    file.println("SSID=" + newSSID);
+    file.println("PASSWORD=" + newPassword);
+    file.close();
   }
+  spiBusRelease(SPI_DEV_SD);
+  Serial.println(saved ? "WiFi credentials updated successfully." : "Failed to update WiFi credentials.");
+
+  ssid = newSSID;
+  password = newPassword;
+  return true;
 }
 
 bool SetDB() {
@@ -71,12 +169,18 @@ bool SetDB() {
     Serial.println("Failed to read Firebase credentials from SD card.");
     return false;
   }
+  return beginFirebase();
+}
 
-  // Initialize Firebase
+// Start the Firebase client with credentials already in firebaseConfig
+bool beginFirebase() {
+  firebaseAcquire();
   Firebase.begin(&firebaseConfig, &firebaseAuth);
   Firebase.reconnectWiFi(true);
+  bool ready = Firebase.ready();
+  firebaseRelease();
 
-  if (Firebase.ready()) {
+  if (ready) {
     Serial.println("Firebase initialized successfully.");
     return true;
   } else {
@@ -85,239 +189,80 @@ bool SetDB() {
   }
 }
 
-void updateWiFiCredentials() {
-  Serial.println("Enter new WiFi SSID:");
-  String newSSID = "";
-  while (newSSID.length() == 0) {  // Wait until a valid input is received
-    if (Serial.available()) {
-      newSSID = Serial.readStringUntil('\n');
-      newSSID.trim();  // Remove any leading/trailing whitespace
-    }
+// Stable per-gate ID from the factory MAC, e.g. "gate-a1b2c3"
+const char *deviceId() {
+  static char id[16] = "";
+  if (id[0] == '\0') {
+    uint64_t mac = ESP.getEfuseMac();
+    snprintf(id, sizeof(id), "gate-%02x%02x%02x", (uint8_t)(mac >> 24), (uint8_t)(mac >> 32), (uint8_t)(mac >> 40));
   }
+  return id;
+}
 
-  Serial.println("Enter new WiFi Password:");
-  String newPassword = "";
-  while (newPassword.length() == 0) {  // Wait until a valid input is received
-    if (Serial.available()) {
-      newPassword = Serial.readStringUntil('\n');
-      newPassword.trim();  // Remove any leading/trailing whitespace
-    }
-  }
+// Runs on the Telegram task. Nothing here is logged that would expose
+// the bot token: it is part of the URL.
+static bool sendTelegram(const TelegramMessage &message) {
+  HTTPClient http;
+  http.begin("https://api.telegram.org/bot" + message.botToken + "/sendMessage");
+  http.addHeader("Content-Type", "application/json");
 
-  // Save the new credentials to the SD card
-  File file = SD.open("/wifi.txt", FILE_WRITE);
-  if (file) {
-    file.println("SSID=" + newSSID);
-    file.println("PASSWORD=" + newPassword);
-    file.close();
-    Serial.println("WiFi credentials updated successfully.");
-  } else {
-    Serial.println("Failed to update WiFi credentials.");
+  String jsonPayload = "{\"chat_id\":" + jsonString(message.chatId) + ",\"text\":" + jsonString(message.text) + "}";
+  int httpCode = http.POST(jsonPayload);
+  if (httpCode != 200) {
+    LOG_WARN("Telegram message not sent, HTTP code %d", httpCode);
   }
+  http.end();
+  return httpCode == 200;
 }
 
-void uploadNamesToFirebase() {
-  if (firebaseConfig.host == "" || firebaseConfig.signer.tokens.legacy_token == "") {
-    Serial.println("Firebase credentials are not set. Cannot upload names to Firebase.");
-    return;
-  }
-
-  Serial.println("Uploading names and attendance records to Firebase...");
-
-  // Upload names to Firebase
-  for (int i = 0; i < namid; i++) {
-    if (name[i][0] != "") {  // Ensure the record is not empty
-      String rollNumber = name[i][2];
-      String studentId = name[i][1];
-      String studentName = name[i][0];
-
-      // Check if this roll number already exists in Firebase
-      String path = "/students/" + studentId;
-      FirebaseJson json;
-      json.set("rollNumber", rollNumber);
-      json.set("name", studentName);
-
-      if (Firebase.setJSON(firebaseData, path.c_str(), json)) {
-        Serial.println("Uploaded to Firebase - ID: " + studentId + ", Roll: " + rollNumber + ", Name: " + studentName);
-      } else {
-        Serial.println("Failed to upload to Firebase - ID: " + studentId);
-        Serial.println("Error: " + firebaseData.errorReason());
+// Sends queued messages one at a time, retrying while WiFi or Telegram is down
+static void telegramTask(void *param) {
+  TelegramMessage *message;
+  while (true) {
+    xQueueReceive(telegramQueue, &message, portMAX_DELAY);
+    bool sent = false;
+    for (int attempt = 1; attempt <= TELEGRAM_MAX_ATTEMPTS && !sent; attempt++) {
+      sent = WiFi.status() == WL_CONNECTED && sendTelegram(*message);
+      if (!sent && attempt < TELEGRAM_MAX_ATTEMPTS) {
+        vTaskDelay(pdMS_TO_TICKS(TELEGRAM_RETRY_MS));
       }
     }
-  }
-
-  // Upload attendance records
-  File root = SD.open("/");
-  File file = root.openNextFile();
-  while (file) {
-    String fileName = file.name();
-    if (fileName.endsWith(".txt") && fileName.length() == 14) {  // Check for DD-MM-YYYY.txt format
-      String dateStr = fileName.substring(0, fileName.length() - 4);
-
-      // Read and upload attendance records
-      String filePath = "/" + fileName;
-      File attendanceFile = SD.open(filePath, FILE_READ);
-      if (attendanceFile) {
-        bool uploadSuccess = true;
-        while (attendanceFile.available()) {
-          String line = attendanceFile.readStringUntil('\n');
-          line.trim();
-          if (line.startsWith("<tr>") && line.endsWith("</tr>")) {
-            // Extract data from the HTML table row
-            int rollStart = line.indexOf("<td>") + 4;
-            int rollEnd = line.indexOf("</td>", rollStart);
-            int nameStart = line.indexOf("<td>", rollEnd) + 4;
-            int nameEnd = line.indexOf("</td>", nameStart);
-            int idStart = line.indexOf("<td>", nameEnd) + 4;
-            int idEnd = line.indexOf("</td>", idStart);
-            int inTimeStart = line.indexOf("<td>", idEnd) + 4;
-            int inTimeEnd = line.indexOf("</td>", inTimeStart);
-            int outTimeStart = line.indexOf("<td>", inTimeEnd) + 4;
-            int outTimeEnd = line.indexOf("</td>", outTimeStart);
-
-            if (rollStart > 0 && rollEnd > 0 && nameStart > 0 && nameEnd > 0 && idStart > 0 && idEnd > 0 && inTimeStart > 0 && inTimeEnd > 0) {
-
-              String rollNumber = line.substring(rollStart, rollEnd);
-              String name = line.substring(nameStart, nameEnd);
-              String id = line.substring(idStart, idEnd);
-              String inTime = line.substring(inTimeStart, inTimeEnd);
-              String outTime = outTimeStart > 0 && outTimeEnd > 0 ? line.substring(outTimeStart, outTimeEnd) : "-";
-
-              String path = "/attendance/" + dateStr + "/" + id;
-              FirebaseJson json;
-              json.set("rollNumber", rollNumber);
-              json.set("name", name);
-              json.set("inTime", inTime);
-              json.set("outTime", outTime);
-
-              if (!Firebase.setJSON(firebaseData, path.c_str(), json)) {
-                Serial.println("Failed to upload attendance record - Date: " + dateStr + ", ID: " + id);
-                Serial.println("Error: " + firebaseData.errorReason());
-                uploadSuccess = false;
-                break;
-              }
-            }
-          }
-        }
-        attendanceFile.close();
-      }
+    if (!sent) {
+      LOG_WARN("Dropped a Telegram message after %d attempts", TELEGRAM_MAX_ATTEMPTS);
     }
-    file = root.openNextFile();
+    delete message;
   }
-
-  Serial.println("Finished uploading names and attendance records to Firebase.");
 }
 
-void syncAttendanceWithFirebase() {
-  if (firebaseConfig.host == "" || firebaseConfig.signer.tokens.legacy_token == "") {
-    Serial.println("Firebase credentials are not set. Cannot sync with Firebase.");
-    return;
-  }
-
-  Serial.println("Starting full attendance sync with Firebase...");
-
-  // Open the /Attendance directory
-  File attendanceRoot = SD.open("/Attendance");
-  if (!attendanceRoot) {
-    Serial.println("Attendance directory not found.");
-    return;
-  }
-
-  // Iterate over all month directories
-  File monthDir = attendanceRoot.openNextFile();
-  while (monthDir) {
-    if (monthDir.isDirectory()) {
-      String month = String(monthDir.name());
-      File dateFile = SD.open("/Attendance/" + month);
-      if (dateFile) {
-        File file = dateFile.openNextFile();
-        while (file) {
-          String fileName = String(file.name());
-          if (fileName.endsWith(".csv") && fileName.length() == 14) { // DD-MM-YYYY.csv
-            String date = fileName.substring(0, fileName.length() - 4);
-            Serial.println("Syncing attendance file: " + date);
-            File attendanceFile = SD.open("/Attendance/" + month + "/" + fileName, FILE_READ);
-            if (attendanceFile) {
-              // Skip header line
-              if (attendanceFile.available()) {
-                attendanceFile.readStringUntil('\n');
-              }
-
-              while (attendanceFile.available()) {
-                String roll, name, id, inTime, outTime;
-                if (readAttendanceCSVLine(attendanceFile, roll, name, id, inTime, outTime)) {
-                  String path = "/attendance/" + month + "/" + date + "/" + id;
-                  FirebaseJson json;
-                  json.set("name", name);
-                  json.set("rollNumber", roll);
-                  json.set("inTime", inTime);
-                  json.set("outTime", outTime);
-
-                  if (!Firebase.setJSON(firebaseData, path.c_str(), json)) {
-                    Serial.println("Failed to upload attendance record - Date: " + date + ", ID: " + id);
-                    Serial.println("Error: " + firebaseData.errorReason());
-                  } else {
-                    Serial.println("Uploaded attendance record - Date: " + date + ", ID: " + id);
-                  }
-                }
-              }
-              attendanceFile.close();
-            }
-          }
-          file = dateFile.openNextFile();
-        }
-        dateFile.close();
-      }
+// Hand a message to the Telegram task; never waits on the network. Safe
+// from any task.
+bool queueTelegramMessage(const String &message) {
+  TelegramMessage *queued = new TelegramMessage();
+  telegramLock();
+  queued->botToken = telegramBotToken;
+  queued->chatId = telegramChatId;
+  if (!telegramQueue && telegramBotToken != "" && telegramChatId != "") {
+    telegramQueue = xQueueCreate(TELEGRAM_QUEUE_DEPTH, sizeof(TelegramMessage *));
+    if (telegramQueue) {
+      xTaskCreatePinnedToCore(telegramTask, "telegram", 8192, NULL, 1, NULL, 0);
     }
-    monthDir = attendanceRoot.openNextFile();
   }
-  attendanceRoot.close();
-  Serial.println("Finished syncing all attendance records with Firebase.");
-}
+  telegramUnlock();
 
-void sendTelegramMessage(const char *message) {
-  if (telegramBotToken == "" || telegramChatId == "") {
-    Serial.println("Telegram credentials not set");
-    Serial.println("Bot Token: " + telegramBotToken);
-    Serial.println("Chat ID: " + telegramChatId);
-    return;
+  if (queued->botToken == "" || queued->chatId == "") {
+    LOG_INFO("Telegram credentials not set, message not sent");
+    delete queued;
+    return false;
   }
-
-  // Trim whitespace from chat ID
-  telegramChatId.trim();
-
-  Serial.println("Attempting to send Telegram message...");
-  Serial.println("Bot Token: " + telegramBotToken);
-  Serial.println("Chat ID: " + telegramChatId);
-  Serial.println("Message: " + String(message));
-
-  HTTPClient http;
-  String url = "https://api.telegram.org/bot";
-  url += telegramBotToken;
-  url += "/sendMessage";
-
-  Serial.println("URL: " + url);
-
-  http.begin(url);
-  http.addHeader("Content-Type", "application/json");
-
-  // Create JSON payload
-  String jsonPayload = "{\"chat_id\":\"" + telegramChatId + "\",\"text\":\"" + String(message) + "\"}";
-  Serial.println("JSON Payload: " + jsonPayload);
-
-  int httpCode = http.POST(jsonPayload);
-  Serial.println("HTTP Code: " + String(httpCode));
-
-  if (httpCode > 0) {
-    String payload = http.getString();
-    Serial.println("Telegram Response: " + payload);
-
-    if (httpCode != 200) {
-      Serial.println("Error sending Telegram message. HTTP Code: " + String(httpCode));
-    }
-  } else {
-    Serial.println("Error sending Telegram message. HTTP Code: " + String(httpCode));
+  if (!telegramQueue) {
+    delete queued;
+    return false;
   }
-
-  http.end();
-} 
\ No newline at end of file
+  queued->text = message;
+  if (xQueueSend(telegramQueue, &queued, 0) != pdTRUE) {
+    delete queued;
+    LOG_WARN("Telegram queue full, message dropped");
+    return false;
+  }
+  return true;
+}
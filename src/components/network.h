@@ -3,13 +3,24 @@
 
 #include "../config/config.h"
 
+#define TELEGRAM_QUEUE_DEPTH 4
+#define TELEGRAM_MAX_ATTEMPTS 5
+#define TELEGRAM_RETRY_MS 30000
+#define WIFI_PROMPT_WAIT_MS 30000  // Serial prompt gives up after this long per answer
+
 // Function declarations for network module
-void setupWiFi();
+void networkBegin();
 bool connectWifi(String ssid, String password);
+bool wifiRestart();
+bool promptWiFiCredentials(String &ssid, String &password);
 bool SetDB();
-void sendTelegramMessage(const char *message);
-void updateWiFiCredentials();
-void uploadNamesToFirebase();
-void syncAttendanceWithFirebase();
+bool beginFirebase();
+bool firebaseAcquire(TickType_t wait = portMAX_DELAY);
+void firebaseRelease();
+bool firebaseReady();
+void telegramSetCredentials(const String &botToken, const String &chatId);
+bool telegramConfigured();
+bool queueTelegramMessage(const String &message);
+const char *deviceId();
 
 #endif // NETWORK_H 
\ No newline at end of file
@@ -0,0 +1,460 @@
+#include "reports.h"
+#include "cloud_sync.h"
+#include "../utils/day_index.h"
+#include "../utils/month_rollup.h"
+#include "../utils/sd_utils.h"
+#include "../utils/spi_bus.h"
+#include "../utils/time_utils.h"
+#include "../utils/day_rollover.h"
+#include "../utils/metrics.h"
+#include "../utils/mem_placement.h"
+#include "../webserver/html_components.h"
+#include <algorithm>
+
+// Feed one day file through the engine in fixed-size chunks
+static void streamDayFile(const String &path, const AttendanceQuery &query, QueryResult &result) {
+  char chunk[REPORT_READ_CHUNK];
+  QueryLineState state;
+  uint64_t before = result.bytesScanned;
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File file = SD.open(path, FILE_READ);
+  if (file) {
+    queryBeginDay(state);
+    int read;
+    while ((read = file.read((uint8_t *)chunk, sizeof(chunk))) > 0) {
+      queryFeed(query, result, state, chunk, read);
+    }
+    file.close();
+    queryEndDay(query, result, state);
+  }
+  spiBusRelease(SPI_DEV_SD);
+  metricsInc(METRIC_SD_BYTES_READ, result.bytesScanned - before);
+}
+
+// A closed month from its rollup, with roll numbers from the roster
+static bool feedRollup(int month, int year, const AttendanceQuery &query, QueryResult &result) {
+  MonthRollup rollup;
+  if (!monthRollupLoad(month, year, rollup)) return false;
+
+  std::vector<const char *> rolls(rollup.ids.size(), (const char *)NULL);
+  for (int i = 0; i < namid; i++) {
+    uint16_t id = name[i][1].toInt();
+    auto column = std::lower_bound(rollup.ids.begin(), rollup.ids.end(), id);
+    if (column != rollup.ids.end() && *column == id) {
+      rolls[column - rollup.ids.begin()] = name[i][2].c_str();
+    }
+  }
+  rollupFeed(rollup, rolls.data(), query, result);
+  metricsInc(METRIC_SD_BYTES_READ, rollup.bytes);
+  return true;
+}
+
+// Walk the range month by month. Closed months come from their rollup
+// when there is one. Otherwise the day index says which days have rows,
+// so days without a file (or with nobody present) are never opened.
+bool reportRun(const AttendanceQuery &query, QueryResult &result) {
+  int day, month, year, lastDay, lastMonth, lastYear;
+  queryDateOf(query.fromDay, day, month, year);
+  queryDateOf(query.toDay, lastDay, lastMonth, lastYear);
+
+  while (year < lastYear || (year == lastYear && month <= lastMonth)) {
+    if (feedRollup(month, year, query, result)) {
+      if (++month > 12) {
+        month = 1;
+        year++;
+      }
+      continue;
+    }
+
+    int16_t counts[32];
+    if (!dayIndexMonth(month, year, counts)) return false;
+    for (int d = 1; d <= 31; d++) {
+      if (counts[d] <= 0) continue;
+      int32_t dayNumber = queryDayNumber(d, month, year);
+      if (dayNumber < query.fromDay || dayNumber > query.toDay) continue;
+
+      char date[11];
+      snprintf(date, sizeof(date), "%02d-%02d-%04d", d, month, year);
+      streamDayFile(getAttendanceFilePath(date), query, result);
+      yield();
+    }
+    if (++month > 12) {
+      month = 1;
+      year++;
+    }
+  }
+  return true;
+}
+
+static bool parseQueryArgs(AttendanceQuery &query, String &error) {
+  int32_t fromDay, toDay;
+  String to = server.hasArg("to") ? server.arg("to") : todayDate();
+  if (!queryParseDate(server.arg("from").c_str(), fromDay) || !queryParseDate(to.c_str(), toDay)) {
+    error = "from and to must be DD-MM-YYYY";
+    return false;
+  }
+  if (toDay < fromDay || toDay - fromDay >= REPORT_MAX_DAYS) {
+    error = "to must be after from and at most " + String(REPORT_MAX_DAYS) + " days later";
+    return false;
+  }
+  queryInit(query, fromDay, toDay);
+
+  // id=3,7,12 and roll=A01,A02; a student named by either is included
+  String ids = server.arg("id") + ",";
+  for (int start = 0, comma; (comma = ids.indexOf(',', start)) >= 0; start = comma + 1) {
+    int id = ids.substring(start, comma).toInt();
+    if (id > 0) queryAllowId(query, id);
+  }
+  String rolls = server.arg("roll") + ",";
+  for (int start = 0, comma; (comma = rolls.indexOf(',', start)) >= 0; start = comma + 1) {
+    String roll = rolls.substring(start, comma);
+    roll.trim();
+    if (roll.length() > 0 && !queryAllowRoll(query, roll.c_str())) {
+      error = "at most " + String(QUERY_MAX_ROLLS) + " roll numbers";
+      return false;
+    }
+  }
+
+  String late = server.arg("late");
+  if (late.length() > 0) {
+    int hour, minute;
+    if (sscanf(late.c_str(), "%d:%d", &hour, &minute) != 2 || hour > 23 || minute > 59) {
+      error = "late must be HH:MM";
+      return false;
+    }
+    query.lateAfter = hour * 3600 + minute * 60;
+  }
+  return true;
+}
+
+static String timeJson(uint32_t seconds) {
+  return seconds == QUERY_NO_TIME ? String("null") : "\"" + formatTimeOfDay12(seconds) + "\"";
+}
+
+static String statsJson(const TimeStats &stats) {
+  return "{\"count\":" + String(stats.count) +
+         ",\"min\":" + timeJson(stats.count ? stats.min : QUERY_NO_TIME) +
+         ",\"mean\":" + timeJson(queryMean(stats)) +
+         ",\"max\":" + timeJson(stats.count ? stats.max : QUERY_NO_TIME) +
+         ",\"sdMinutes\":" + String(queryStdDev(stats) / 60.0, 1) + "}";
+}
+
+static String histogramJson(const uint32_t *buckets) {
+  String json = "[";
+  for (int i = 0; i < QUERY_BUCKETS; i++) {
+    json += (i ? "," : "") + String(buckets[i]);
+  }
+  return json + "]";
+}
+
+static String studentName(uint16_t id) {
+  for (int i = 0; i < namid; i++) {
+    if (name[i][1].toInt() == id) return name[i][0];
+  }
+  return "";
+}
+
+// GET /api/attendance/query?from=DD-MM-YYYY&to=DD-MM-YYYY[&id=3,7][&roll=A01][&late=09:00]
+void handleAttendanceQuery() {
+  AttendanceQuery query;
+  String error;
+  if (!parseQueryArgs(query, error)) {
+    server.send(400, "application/json", "{\"error\":" + jsonString(error) + "}");
+    return;
+  }
+
+  QueryResult *result = (QueryResult *)memAlloc(sizeof(QueryResult), MEM_USE_QUERY);
+  if (!result) {
+    server.send(503, "application/json", "{\"error\":\"Not enough memory for the query\"}");
+    return;
+  }
+  queryBegin(*result);
+  for (int i = 0; i < namid; i++) {
+    querySeedStudent(query, *result, name[i][1].toInt(), name[i][2].c_str());
+  }
+
+  unsigned long started = millis();
+  if (!reportRun(query, *result)) {
+    memFree(result, MEM_USE_QUERY);
+    server.send(503, "application/json", "{\"error\":\"SD card not available\"}");
+    return;
+  }
+  unsigned long elapsed = millis() - started;
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  server.sendContent("{\"from\":" + jsonString(server.arg("from")) +
+                     ",\"to\":" + jsonString(server.hasArg("to") ? server.arg("to") : todayDate()) +
+                     ",\"days\":" + String(result->daysScanned) +
+                     ",\"rows\":" + String(result->rowsScanned) +
+                     ",\"matched\":" + String(result->rowsMatched) +
+                     ",\"dropped\":" + String(result->rowsDropped) +
+                     ",\"bytes\":" + String((uint32_t)result->bytesScanned) +
+                     ",\"elapsedMs\":" + String(elapsed) +
+                     ",\"bucketMinutes\":" + String(QUERY_BUCKET_SECONDS / 60) +
+                     ",\"inHistogram\":" + histogramJson(result->inHistogram) +
+                     ",\"outHistogram\":" + histogramJson(result->outHistogram) +
+                     ",\"students\":[");
+  for (int i = 0; i < result->studentCount; i++) {
+    const StudentAggregate &student = result->students[i];
+    server.sendContent(String(i ? "," : "") +
+                       "{\"id\":" + String(student.id) +
+                       ",\"roll\":" + jsonString(student.roll) +
+                       ",\"name\":" + jsonString(studentName(student.id)) +
+                       ",\"daysPresent\":" + String(student.daysPresent) +
+                       ",\"lateDays\":" + String(student.lateDays) +
+                       ",\"in\":" + statsJson(student.in) +
+                       ",\"out\":" + statsJson(student.out) +
+                       ",\"hours\":" + String(student.workedSeconds / 3600.0, 1) +
+                       ",\"avgHours\":" + String(student.out.count ? student.workedSeconds / 3600.0 / student.out.count : 0.0, 2) +
+                       "}");
+  }
+  server.sendContent("]}");
+  server.sendContent("");
+  memFree(result, MEM_USE_QUERY);
+}
+
+void handleReportsPage() {
+  String html = R"rawliteral(
+<!DOCTYPE html>
+<html lang="en">
+<head>
+    <meta charset="UTF-8">
+    <meta name="viewport" content="width=device-width, initial-scale=1.0">
+    <title>Attendance Reports</title>
+    <link href="https://cdn.jsdelivr.net/npm/bootstrap@5.3.0/dist/css/bootstrap.min.css" rel="stylesheet">
+    <link href="https://cdnjs.cloudflare.com/ajax/libs/font-awesome/6.0.0/css/all.min.css" rel="stylesheet">
+    )rawliteral" + getGlassmorphismStyles() + R"rawliteral(
+    <style>
+        .container {
+            max-width: 1200px;
+            margin: 0 auto;
+            padding: 20px;
+        }
+
+        .histogram {
+            display: flex;
+            align-items: flex-end;
+            gap: 2px;
+            height: 120px;
+            margin-bottom: 4px;
+        }
+
+        .histogram div {
+            flex: 1;
+            background: rgba(52, 152, 219, 0.7);
+            border-radius: 3px 3px 0 0;
+        }
+
+        .histogram.out div {
+            background: rgba(231, 76, 60, 0.7);
+        }
+
+        .histogram-labels {
+            display: flex;
+            justify-content: space-between;
+            font-size: 0.8rem;
+            color: #555;
+        }
+
+        .summary {
+            font-size: 0.9rem;
+            color: #555;
+        }
+
+        th.sortable {
+            cursor: pointer;
+        }
+    </style>
+</head>
+<body>
+    )rawliteral" + getNavbarHtml() + R"rawliteral(
+    <div class="container">
+        <div class="glass-card">
+            <h2 class="text-center mb-4"><i class="fas fa-chart-bar me-2"></i>Attendance Reports</h2>
+            <form id="reportForm" class="row g-3 mb-3" onsubmit="runReport(event)">
+                <div class="col-md-2">
+                    <label class="form-label" for="from">From</label>
+                    <input type="date" class="form-control" id="from" required>
+                </div>
+                <div class="col-md-2">
+                    <label class="form-label" for="to">To</label>
+                    <input type="date" class="form-control" id="to" required>
+                </div>
+                <div class="col-md-2">
+                    <label class="form-label" for="ids">IDs</label>
+                    <input type="text" class="form-control" id="ids" placeholder="3,7,12">
+                </div>
+                <div class="col-md-2">
+                    <label class="form-label" for="rolls">Roll numbers</label>
+                    <input type="text" class="form-control" id="rolls" placeholder="A01,A02">
+                </div>
+                <div class="col-md-2">
+                    <label class="form-label" for="late">Late after</label>
+                    <input type="time" class="form-control" id="late" value="09:00">
+                </div>
+                <div class="col-md-2 d-flex align-items-end">
+                    <button type="submit" class="btn btn-primary w-100"><i class="fas fa-play me-1"></i>Run</button>
+                </div>
+            </form>
+            <div id="status" class="summary mb-3"></div>
+            <div id="charts" class="row mb-4" style="display:none;">
+                <div class="col-md-6">
+                    <h6>In-times</h6>
+                    <div id="inHistogram" class="histogram"></div>
+                    <div class="histogram-labels" id="inLabels"></div>
+                </div>
+                <div class="col-md-6">
+                    <h6>Out-times</h6>
+                    <div id="outHistogram" class="histogram out"></div>
+                    <div class="histogram-labels" id="outLabels"></div>
+                </div>
+            </div>
+            <div class="table-responsive">
+                <table class="table glass-table">
+                    <thead>
+                        <tr>
+                            <th class="sortable" onclick="sortBy('roll')">Roll Number</th>
+                            <th class="sortable" onclick="sortBy('name')">Name</th>
+                            <th class="sortable" onclick="sortBy('id')">ID</th>
+                            <th class="sortable" onclick="sortBy('daysPresent')">Days Present</th>
+                            <th class="sortable" onclick="sortBy('lateDays')">Late</th>
+                            <th>In (earliest / mean / latest)</th>
+                            <th>Out (earliest / mean / latest)</th>
+                            <th class="sortable" onclick="sortBy('hours')">Hours</th>
+                            <th class="sortable" onclick="sortBy('avgHours')">Avg / Day</th>
+                        </tr>
+                    </thead>
+                    <tbody id="reportRows"></tbody>
+                </table>
+            </div>
+        </div>
+    </div>
+
+    <script src="https://cdn.jsdelivr.net/npm/bootstrap@5.3.0/dist/js/bootstrap.bundle.min.js"></script>
+    <script>
+        let report = null;
+        let sortKey = 'roll';
+        let sortAscending = true;
+
+        // <input type="date"> is YYYY-MM-DD; the gate wants DD-MM-YYYY
+        function toGateDate(value) {
+            const [y, m, d] = value.split('-');
+            return `${d}-${m}-${y}`;
+        }
+
+        function escapeHtml(text) {
+            const div = document.createElement('div');
+            div.textContent = text == null ? '' : text;
+            return div.innerHTML;
+        }
+
+        function times(stats) {
+            if (!stats.count) {
+                return '-';
+            }
+            return `${stats.min} / <b>${stats.mean}</b> / ${stats.max}<br><small>&plusmn;${stats.sdMinutes} min</small>`;
+        }
+
+        function drawHistogram(id, labelsId, buckets, bucketMinutes) {
+            // Only the span of the day that has any scans
+            let first = buckets.findIndex(n => n > 0);
+            let last = buckets.length - 1 - [...buckets].reverse().findIndex(n => n > 0);
+            const chart = document.getElementById(id);
+            const labels = document.getElementById(labelsId);
+            chart.innerHTML = '';
+            labels.innerHTML = '';
+            if (first < 0) {
+                return;
+            }
+            const peak = Math.max(...buckets);
+            const label = i => {
+                const minutes = i * bucketMinutes;
+                return `${String(Math.floor(minutes / 60)).padStart(2, '0')}:${String(minutes % 60).padStart(2, '0')}`;
+            };
+            for (let i = first; i <= last; i++) {
+                const bar = document.createElement('div');
+                bar.style.height = (100 * buckets[i] / peak) + '%';
+                bar.title = `${label(i)}-${label(i + 1)}: ${buckets[i]}`;
+                chart.appendChild(bar);
+            }
+            labels.innerHTML = `<span>${label(first)}</span><span>${label(last + 1)}</span>`;
+        }
+
+        function renderRows() {
+            const students = [...report.students].sort((a, b) => {
+                const x = a[sortKey], y = b[sortKey];
+                const order = typeof x === 'number' ? x - y : String(x).localeCompare(String(y), undefined, {numeric: true});
+                return sortAscending ? order : -order;
+            });
+            document.getElementById('reportRows').innerHTML = students.map(s => {
+                const percent = report.days ? Math.round(100 * s.daysPresent / report.days) : 0;
+                return `<tr>
+                    <td>${escapeHtml(s.roll)}</td>
+                    <td>${escapeHtml(s.name)}</td>
+                    <td>${s.id}</td>
+                    <td>${s.daysPresent} <small>(${percent}%)</small></td>
+                    <td>${s.lateDays}</td>
+                    <td>${times(s.in)}</td>
+                    <td>${times(s.out)}</td>
+                    <td>${s.hours}</td>
+                    <td>${s.avgHours}</td>
+                </tr>`;
+            }).join('');
+        }
+
+        function sortBy(key) {
+            sortAscending = sortKey === key ? !sortAscending : true;
+            sortKey = key;
+            if (report) {
+                renderRows();
+            }
+        }
+
+        function runReport(event) {
+            event.preventDefault();
+            const params = new URLSearchParams({
+                from: toGateDate(document.getElementById('from').value),
+                to: toGateDate(document.getElementById('to').value),
+            });
+            const ids = document.getElementById('ids').value.trim();
+            const rolls = document.getElementById('rolls').value.trim();
+            const late = document.getElementById('late').value;
+            if (ids) params.set('id', ids);
+            if (rolls) params.set('roll', rolls);
+            if (late) params.set('late', late);
+
+            const status = document.getElementById('status');
+            status.textContent = 'Running...';
+            fetch('/api/attendance/query?' + params)
+                .then(response => response.json().then(data => ({ok: response.ok, data})))
+                .then(({ok, data}) => {
+                    if (!ok) {
+                        throw new Error(data.error || 'Query failed');
+                    }
+                    report = data;
+                    status.textContent = `${data.days} day(s) with attendance, ${data.rows} rows read ` +
+                        `(${(data.bytes / 1024).toFixed(1)} KB) in ${data.elapsedMs} ms`;
+                    document.getElementById('charts').style.display = '';
+                    drawHistogram('inHistogram', 'inLabels', data.inHistogram, data.bucketMinutes);
+                    drawHistogram('outHistogram', 'outLabels', data.outHistogram, data.bucketMinutes);
+                    renderRows();
+                })
+                .catch(error => {
+                    status.textContent = 'Error: ' + error.message;
+                });
+        }
+
+        // Default to the current month so far
+        const today = new Date();
+        const iso = d => `${d.getFullYear()}-${String(d.getMonth() + 1).padStart(2, '0')}-${String(d.getDate()).padStart(2, '0')}`;
+        document.getElementById('from').value = iso(new Date(today.getFullYear(), today.getMonth(), 1));
+        document.getElementById('to').value = iso(today);
+    </script>
+</body>
+</html>
+  )rawliteral";
+
+  server.send(200, "text/html", html);
+}
@@ -0,0 +1,23 @@
+#ifndef REPORTS_H
+#define REPORTS_H
+
+#include "../config/config.h"
+#include "../utils/attendance_query.h"
+
+// Attendance reports over a date range: days present, late arrivals and
+// hours per student, computed on the gate by the query engine in
+// src/utils/attendance_query.h. Closed months are read from their rollup
+// (src/utils/month_rollup.h); otherwise only days the day index knows
+// about are opened, one file at a time. The query runs inside the web
+// handler on loop(), so no scan is taken until it returns; the range cap
+// keeps that to about a dozen rollups plus one month of day files.
+
+#define REPORT_MAX_DAYS 366        // One year per query
+#define REPORT_READ_CHUNK 512      // Bytes read from a day file at a time
+
+// Function declarations for attendance reports
+bool reportRun(const AttendanceQuery &query, QueryResult &result);
+void handleAttendanceQuery();
+void handleReportsPage();
+
+#endif // REPORTS_H
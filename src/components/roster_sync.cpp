@@ -0,0 +1,510 @@
+#include "roster_sync.h"
+#include "cloud_sync.h"
+#include "network.h"
+#include "../utils/sd_utils.h"
+#include "../utils/roster_store.h"
+#include "../utils/spi_bus.h"
+#include "../utils/time_source.h"
+#include "../utils/template_archive.h"
+#include "../utils/presence_index.h"
+#include "../utils/logger.h"
+#include <Preferences.h>
+
+extern bool fingerprintReady;
+
+// Version of one student record as this gate last saw or wrote it
+struct RosterVersion {
+  uint16_t id;
+  uint32_t updatedAt;  // 0 for students that predate replication
+  char origin[16];
+  bool deleted;
+  bool dirty;          // Changed here and not yet acknowledged by Firebase
+  bool conflict;       // Another gate enrolled a different student under this ID
+};
+
+static RosterVersion versions[ROSTER_MAX_RECORDS];
+static int versionCount = 0;
+static Preferences rosterPrefs;
+static bool prefsOpen = false;
+static unsigned long lastSync = 0;
+static bool pushSoon = false;
+static bool fullPullSoon = false;
+
+enum RosterSyncStep { ROSTER_STEP_IDLE, ROSTER_STEP_PULL, ROSTER_STEP_PUSH };
+
+static void openPrefs() {
+  if (!prefsOpen) {
+    prefsOpen = rosterPrefs.begin("roster", false);
+  }
+}
+
+static RosterVersion *findVersion(uint16_t id) {
+  for (int i = 0; i < versionCount; i++) {
+    if (versions[i].id == id) return &versions[i];
+  }
+  return NULL;
+}
+
+// Find or add the version for id. When the table is full the oldest
+// acknowledged tombstone makes room.
+static RosterVersion *allocVersion(uint16_t id) {
+  RosterVersion *version = findVersion(id);
+  if (version) return version;
+
+  if (versionCount == ROSTER_MAX_RECORDS) {
+    int oldest = -1;
+    for (int i = 0; i < versionCount; i++) {
+      if (versions[i].deleted && !versions[i].dirty &&
+          (oldest < 0 || versions[i].updatedAt < versions[oldest].updatedAt)) {
+        oldest = i;
+      }
+    }
+    if (oldest < 0) {
+      LOG_WARN("Roster version table full, ID %u not tracked", id);
+      return NULL;
+    }
+    versions[oldest] = versions[--versionCount];
+  }
+  version = &versions[versionCount++];
+  *version = {id, 0, "", false, false, false};
+  return version;
+}
+
+static bool saveVersions() {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  if (!SD.exists("/roster")) {
+    SD.mkdir("/roster");
+  }
+  File file = SD.open(ROSTER_VERSIONS_PATH, FILE_WRITE);
+  bool ok = file;
+  if (file) {
+    for (int i = 0; i < versionCount; i++) {
+      const RosterVersion &v = versions[i];
+      file.printf("%u,%lu,%s,%d,%d,%d\n", v.id, (unsigned long)v.updatedAt, v.origin, v.deleted, v.dirty, v.conflict);
+    }
+    file.close();
+  } else {
+    LOG_ERROR("Failed to write %s", ROSTER_VERSIONS_PATH);
+  }
+  spiBusRelease(SPI_DEV_SD);
+  return ok;
+}
+
+static void stamp(RosterVersion &version, bool deleted) {
+  version.updatedAt = time(nullptr);
+  strlcpy(version.origin, deviceId(), sizeof(version.origin));
+  version.deleted = deleted;
+  version.dirty = true;
+}
+
+// A student that collided with another gate's never reached the cloud, so
+// deleting it must not tombstone theirs. Forget it instead and fetch the
+// whole roster next time so their student replaces it.
+static void stampDeleted(RosterVersion &version) {
+  if (version.conflict) {
+    version = {version.id, 0, "", true, false, false};
+    fullPullSoon = true;
+    return;
+  }
+  stamp(version, true);
+}
+
+void rosterBegin() {
+  versionCount = 0;
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File file = SD.open(ROSTER_VERSIONS_PATH, FILE_READ);
+  if (file) {
+    while (file.available() && versionCount < ROSTER_MAX_RECORDS) {
+      String line = file.readStringUntil('\n');
+      unsigned int id, deleted, dirty, conflict = 0;
+      unsigned long updatedAt;
+      char origin[16] = "";
+      // The conflict column was added later; older files have five
+      if (sscanf(line.c_str(), "%u,%lu,%15[^,],%u,%u,%u", &id, &updatedAt, origin, &deleted, &dirty, &conflict) >= 5 && id > 0) {
+        RosterVersion &v = versions[versionCount++];
+        v = {(uint16_t)id, (uint32_t)updatedAt, "", deleted != 0, dirty != 0, conflict != 0};
+        strlcpy(v.origin, origin, sizeof(v.origin));
+      }
+    }
+    file.close();
+  }
+  spiBusRelease(SPI_DEV_SD);
+
+  // Students from before replication start at version 0 so any cloud copy
+  // wins; they are stamped when first pushed
+  bool added = false;
+  for (int i = 0; i < namid; i++) {
+    uint16_t id = name[i][1].toInt();
+    if (id == 0 || findVersion(id)) continue;
+    RosterVersion *v = allocVersion(id);
+    if (!v) break;
+    strlcpy(v->origin, deviceId(), sizeof(v->origin));
+    v->dirty = true;
+    added = true;
+  }
+  if (added) {
+    saveVersions();
+  }
+  LOG_INFO("Roster versions loaded: %d records", versionCount);
+}
+
+void rosterLocalPut(uint16_t id) {
+  RosterVersion *v = allocVersion(id);
+  if (!v) return;
+  stamp(*v, false);
+  saveVersions();
+  pushSoon = true;
+}
+
+void rosterLocalDelete(uint16_t id) {
+  RosterVersion *v = allocVersion(id);
+  if (!v) return;
+  stampDeleted(*v);
+  saveVersions();
+  pushSoon = true;
+  presenceIndexForget(id);  // The ID may be enrolled again
+}
+
+// Tombstones for a bulk delete, saved once; the next push carries them
+// together in one multi-location update
+void rosterLocalDeleteMany(const uint16_t *ids, int count) {
+  for (int i = 0; i < count; i++) {
+    RosterVersion *v = allocVersion(ids[i]);
+    if (v) stampDeleted(*v);
+  }
+  presenceIndexForgetMany(ids, count);
+  saveVersions();
+  pushSoon = true;
+}
+
+void rosterLocalDeleteAll() {
+  for (int i = 0; i < namid; i++) {
+    allocVersion(name[i][1].toInt());
+  }
+  for (int i = 0; i < versionCount; i++) {
+    if (!versions[i].deleted) {
+      stamp(versions[i], true);
+      versions[i].conflict = false;
+    }
+  }
+  saveVersions();
+  pushSoon = true;
+  presenceIndexForgetAll();
+}
+
+void rosterMarkAllDirty() {
+  for (int i = 0; i < versionCount; i++) {
+    versions[i].dirty = true;
+  }
+  saveVersions();
+}
+
+static bool remoteWins(uint32_t remoteAt, const String &remoteOrigin, const RosterVersion *local) {
+  if (!local) return true;
+  if (remoteAt != local->updatedAt) return remoteAt > local->updatedAt;
+  return strcmp(remoteOrigin.c_str(), local->origin) > 0;
+}
+
+static void applyRemotePut(uint16_t id, const String &roll, const String &studentName) {
+  if (!rosterStorePut(id, roll, studentName)) {
+    LOG_WARN("Roster full or SD card failing, cannot add student %u from cloud", id);
+  }
+}
+
+static void applyRemoteDelete(uint16_t id) {
+  rosterStoreDelete(id);
+  if (fingerprintReady) {
+    finger.deleteModel(id);
+  }
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  templateArchiveRemove(id);
+  spiBusRelease(SPI_DEV_SD);
+  presenceIndexForget(id);
+}
+
+// True when a record enrolled here and one enrolled on another gate share
+// an ID. Students are never edited after enrolment, so a different roll
+// number under our ID means two students, not a newer version of ours.
+// Pre-replication students (updatedAt 0) are excluded: the cloud copy is
+// meant to replace them.
+static bool isEnrolmentConflict(const RosterVersion *local, const String &origin, const String &roll) {
+  if (!local || local->deleted || local->updatedAt == 0) return false;
+  if (strcmp(local->origin, deviceId()) != 0 || origin == deviceId()) return false;
+  int index = rosterStoreFind(local->id);
+  return index >= 0 && name[index][2] != roll;
+}
+
+// Apply one cloud record. On a full pull a record whose version matches
+// ours but whose fields differ was edited in the console without touching
+// updatedAt; the cloud copy is taken as long as we have nothing unpushed.
+static void pullRecord(uint16_t id, const String &value, bool full, RosterSyncReport &report, uint32_t &newest, bool &changed) {
+  FirebaseJson record;
+  FirebaseJsonData field;
+  record.setJsonData(value);
+  uint32_t updatedAt = record.get(field, "updatedAt") ? field.intValue : 0;
+  String origin = record.get(field, "origin") ? field.stringValue : String("");
+  bool deleted = record.get(field, "deleted") && field.boolValue;
+  String roll = record.get(field, "rollNumber") ? field.stringValue : String("");
+  String studentName = record.get(field, "name") ? field.stringValue : String("");
+  report.pulled++;
+  if (updatedAt > newest) newest = updatedAt;
+
+  RosterVersion *local = findVersion(id);
+  if (local && local->conflict) {
+    if (!deleted) return;
+    // The other gate removed its student, so ours can have the ID
+    local->conflict = false;
+    stamp(*local, false);
+    changed = true;
+    return;
+  }
+  if (!deleted && isEnrolmentConflict(local, origin, roll)) {
+    LOG_WARN("Roster: ID %u was enrolled here and on %s; keeping ours local only", id, origin.c_str());
+    local->conflict = true;
+    changed = true;
+    return;
+  }
+
+  bool wins = remoteWins(updatedAt, origin, local);
+  if (!wins && full && !deleted && !local->dirty && !local->deleted &&
+      updatedAt == local->updatedAt && origin == local->origin) {
+    int index = rosterStoreFind(id);
+    wins = index < 0 || name[index][2] != roll || name[index][0] != studentName;
+  }
+  if (!wins) return;
+
+  if (deleted) {
+    applyRemoteDelete(id);
+  } else {
+    applyRemotePut(id, roll, studentName);
+  }
+  RosterVersion *v = local ? local : allocVersion(id);
+  if (v) {
+    *v = {id, updatedAt, "", deleted, false, false};
+    strlcpy(v->origin, origin.c_str(), sizeof(v->origin));
+  }
+  report.applied++;
+  changed = true;
+}
+
+// Fetch records changed since the last pull, which needs
+// ".indexOn": "updatedAt" on /students in the database rules. Once a day
+// the whole node is read instead so console edits that left updatedAt
+// alone still arrive. One request per call. A refused query sets refused
+// and is remembered for a day, so a database without the index costs one
+// full read a day rather than a refused query and a full read every sync.
+static bool pullChanges(RosterSyncReport &report, bool &refused) {
+  openPrefs();
+  refused = false;
+  uint32_t watermark = rosterPrefs.getULong("pulled", 0);
+  uint32_t since = watermark > ROSTER_PULL_OVERLAP_SEC ? watermark - ROSTER_PULL_OVERLAP_SEC : 0;
+  uint32_t now = time(nullptr);
+  uint32_t refusedAt = rosterPrefs.getULong("noIndexAt", 0);
+  bool full = fullPullSoon || since == 0 || now - rosterPrefs.getULong("fullAt", 0) >= ROSTER_FULL_PULL_INTERVAL_SEC;
+  if (!full && refusedAt != 0 && now - refusedAt < ROSTER_FULL_PULL_INTERVAL_SEC) {
+    return true;  // No index: nothing arrives until the next full pull
+  }
+
+  bool ok;
+  if (full) {
+    ok = Firebase.getJSON(firebaseData, "/students");
+    // An empty node is not an error, there is just nothing to apply yet
+    if (!ok && firebaseData.httpCode() != 200) {
+      report.error = "Roster pull failed: " + firebaseData.errorReason();
+      return false;
+    }
+  } else {
+    QueryFilter query;
+    query.orderBy("updatedAt");
+    query.startAt((int)since);
+    ok = Firebase.getJSON(firebaseData, "/students", query);
+    query.clear();
+    if (!ok && firebaseData.httpCode() == 400) {
+      LOG_WARN("Roster query refused; reading all students once a day instead. Add \".indexOn\": \"updatedAt\" to /students in the database rules.");
+      rosterPrefs.putULong("noIndexAt", now);
+      fullPullSoon = true;  // Catch up with one full read now
+      refused = true;
+    }
+    if (!ok) {
+      report.error = "Roster pull failed: " + firebaseData.errorReason();
+      return false;
+    }
+    if (refusedAt != 0) {
+      rosterPrefs.remove("noIndexAt");
+    }
+  }
+
+  uint32_t newest = watermark;
+  bool changed = false;
+  if (firebaseData.dataType() == "array") {
+    // RTDB returns a node keyed by small dense integers as an array whose
+    // index is the key
+    FirebaseJsonArray &array = firebaseData.jsonArray();
+    for (size_t i = 1; i < array.size(); i++) {
+      FirebaseJsonData item;
+      if (array.get(item, i) && item.typeNum == FirebaseJson::JSON_OBJECT) {
+        pullRecord(i, item.stringValue, full, report, newest, changed);
+      }
+    }
+  } else if (firebaseData.dataType() == "json") {
+    FirebaseJson &json = firebaseData.jsonObject();
+    size_t count = json.iteratorBegin();
+    for (size_t i = 0; i < count; i++) {
+      int type;
+      String key, value;
+      json.iteratorGet(i, type, key, value);
+      uint16_t id = key.toInt();
+      if (type != FirebaseJson::JSON_OBJECT || id == 0) continue;
+      pullRecord(id, value, full, report, newest, changed);
+    }
+    json.iteratorEnd();
+  }
+
+  if (changed) {
+    saveVersions();
+    LOG_INFO("Roster: applied %d changes from the cloud", report.applied);
+  }
+  if (newest > watermark) {
+    rosterPrefs.putULong("pulled", newest);
+  }
+  if (full) {
+    rosterPrefs.putULong("fullAt", now);
+    fullPullSoon = false;
+  }
+  return true;
+}
+
+static String recordJson(const RosterVersion &v) {
+  String meta = "\"updatedAt\":" + String(v.updatedAt) + ",\"origin\":" + jsonString(v.origin);
+  int index = rosterStoreFind(v.id);
+  if (v.deleted || index < 0) {
+    return "{\"deleted\":true," + meta + "}";
+  }
+  return "{\"rollNumber\":" + jsonString(name[index][2]) + ",\"name\":" + jsonString(name[index][0]) + "," + meta + "}";
+}
+
+// Upload one multi-location batch of dirty records. more is set when a
+// batch went out, as others may still be waiting.
+static bool pushBatch(RosterSyncReport &report, bool &more) {
+  int batch[ROSTER_PUSH_BATCH_SIZE];
+  int batchCount = 0;
+  String body = "{";
+  more = false;
+  for (int i = 0; i < versionCount && batchCount < ROSTER_PUSH_BATCH_SIZE; i++) {
+    RosterVersion &v = versions[i];
+    if (!v.dirty || v.conflict) continue;
+    if (v.updatedAt == 0) {
+      // First push of a pre-replication student: the pull just showed no
+      // newer cloud copy, so it is current as of now
+      v.updatedAt = time(nullptr);
+    }
+    if (batchCount > 0) body += ",";
+    body += "\"students/" + String(v.id) + "\":" + recordJson(v);
+    batch[batchCount++] = i;
+  }
+  if (batchCount == 0) return true;
+  body += "}";
+
+  FirebaseJson *json = cloudJsonAcquire();
+  json->setJsonData(body);
+  bool sent = Firebase.updateNodeSilent(firebaseData, "/", *json);
+  cloudJsonRelease(json);
+  if (!sent) {
+    report.error = "Roster push failed: " + firebaseData.errorReason();
+    saveVersions();
+    return false;
+  }
+  for (int i = 0; i < batchCount; i++) {
+    versions[batch[i]].dirty = false;
+  }
+  report.pushed += batchCount;
+  saveVersions();
+  more = true;
+  return true;
+}
+
+static void countConflicts(RosterSyncReport &report) {
+  report.conflicts = 0;
+  for (int i = 0; i < versionCount; i++) {
+    if (versions[i].conflict) report.conflicts++;
+  }
+}
+
+// Pull first so local changes are only pushed if they still win. Runs the
+// whole round; rosterSyncTick() spreads the same steps over loop() passes.
+bool rosterSync(RosterSyncReport &report) {
+  report = RosterSyncReport();
+  if (clockQuality() != CLOCK_SYNCED) {
+    report.error = "Clock not synced yet";
+    return false;
+  }
+  pushSoon = false;
+  lastSync = millis();
+  firebaseAcquire();
+  bool refused;
+  bool ok = pullChanges(report, refused);
+  if (!ok && refused) {
+    ok = pullChanges(report, refused);
+  }
+  bool more = ok;
+  while (more) {
+    ok = pushBatch(report, more);
+  }
+  firebaseRelease();
+  countConflicts(report);
+  return ok;
+}
+
+// Background replication, one Firebase request per loop() pass so scanning
+// never waits on more than a single round trip: the pull, then one push
+// batch per pass until nothing is dirty.
+void rosterSyncTick() {
+  static RosterSyncStep step = ROSTER_STEP_IDLE;
+  static RosterSyncReport report;
+
+  if (step == ROSTER_STEP_IDLE) {
+    if (!pushSoon && lastSync != 0 && millis() - lastSync < ROSTER_SYNC_INTERVAL_MS) {
+      return;
+    }
+    if (WiFi.status() != WL_CONNECTED || clockQuality() != CLOCK_SYNCED || !firebaseReady()) {
+      return;
+    }
+    pushSoon = false;
+    lastSync = millis();
+    report = RosterSyncReport();
+    step = ROSTER_STEP_PULL;
+    return;
+  }
+
+  if (WiFi.status() != WL_CONNECTED || clockQuality() != CLOCK_SYNCED) {
+    step = ROSTER_STEP_IDLE;
+    return;
+  }
+  if (!firebaseReady()) {
+    return;  // Client busy elsewhere; try again next pass
+  }
+
+  firebaseAcquire();
+  bool ok;
+  if (step == ROSTER_STEP_PULL) {
+    bool refused;
+    ok = pullChanges(report, refused);
+    if (ok) {
+      step = ROSTER_STEP_PUSH;
+    } else if (refused) {
+      ok = true;  // The next pass does the full read instead
+    }
+  } else {
+    bool more;
+    ok = pushBatch(report, more);
+    if (ok && !more) {
+      step = ROSTER_STEP_IDLE;
+    }
+  }
+  firebaseRelease();
+
+  if (!ok) {
+    LOG_WARN("%s", report.error.c_str());
+    step = ROSTER_STEP_IDLE;
+  }
+}
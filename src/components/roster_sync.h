@@ -0,0 +1,41 @@
+#ifndef ROSTER_SYNC_H
+#define ROSTER_SYNC_H
+
+#include "../config/config.h"
+
+// Students are replicated through /students/<id> in Firebase. Every record
+// carries the time it last changed and the gate that changed it; deletes
+// leave a tombstone so they replicate like any other change. When two
+// gates disagree, the later updatedAt wins, ties going to the higher
+// origin ID. Changes made in the Firebase console must bump updatedAt to
+// replicate promptly; edits that do not are picked up by the daily full
+// pull. Two gates enrolling different students under the same ID is a
+// conflict: the later one keeps its student local until one is deleted.
+
+#define ROSTER_VERSIONS_PATH "/roster/versions.csv"
+#define ROSTER_MAX_RECORDS 192          // Live students plus tombstones
+#define ROSTER_SYNC_INTERVAL_MS 60000
+#define ROSTER_PUSH_BATCH_SIZE 128      // Records per update; a whole-roster delete is one request
+#define ROSTER_PULL_OVERLAP_SEC 600     // Re-read this far back to cover clock skew between gates
+#define ROSTER_FULL_PULL_INTERVAL_SEC 86400  // Read all of /students this often
+
+// Result of one pull-and-push round
+struct RosterSyncReport {
+  int pulled = 0;   // Changed cloud records fetched
+  int applied = 0;  // Cloud records that won and were applied locally
+  int pushed = 0;   // Local changes uploaded
+  int conflicts = 0;  // IDs held back because another gate enrolled them too
+  String error = "";
+};
+
+// Function declarations for roster replication
+void rosterBegin();
+void rosterLocalPut(uint16_t id);
+void rosterLocalDelete(uint16_t id);
+void rosterLocalDeleteMany(const uint16_t *ids, int count);
+void rosterLocalDeleteAll();
+void rosterMarkAllDirty();
+bool rosterSync(RosterSyncReport &report);
+void rosterSyncTick();
+
+#endif // ROSTER_SYNC_H
@@ -0,0 +1,191 @@
+#include "template_restore.h"
+#include "fingerprint.h"
+#include "../utils/display_utils.h"
+#include "../utils/template_archive.h"
+#include "../utils/spi_bus.h"
+#include "../utils/metrics.h"
+#include "../utils/mem_placement.h"
+#include "../utils/logger.h"
+#include <vector>
+
+// Two buffers let the SD reader task fill one template while the sensor
+// UART is busy with the other.
+#define RESTORE_BUFFER_COUNT 2
+#define SENSOR_INDEX_BYTES 128  // 1024 slots
+
+struct RestoreJob {
+  uint8_t buffer;  // Index into restoreBuffers
+  uint16_t id;     // 0 marks the end of the stream
+  uint16_t size;
+};
+
+// Only held while a restore runs. The sensor UART driver copies out of
+// them, so they need not be internal.
+static uint8_t (*restoreBuffers)[FINGERPRINT_TEMPLATE_SIZE] = NULL;
+static QueueHandle_t freeBuffers = NULL;
+static QueueHandle_t readyBuffers = NULL;
+static std::vector<uint16_t> restoreIds;
+
+// Producer: read each backup from SD into a free buffer
+static void templateReaderTask(void *param) {
+  for (uint16_t id : restoreIds) {
+    uint8_t buffer;
+    xQueueReceive(freeBuffers, &buffer, portMAX_DELAY);
+
+    RestoreJob job = {buffer, id, 0};
+    spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+    if (!templateArchiveGet(id, restoreBuffers[buffer], job.size)) {
+      job.size = 0;
+    }
+    spiBusRelease(SPI_DEV_SD);
+    xQueueSend(readyBuffers, &job, portMAX_DELAY);
+  }
+
+  RestoreJob done = {0, 0, 0};
+  xQueueSend(readyBuffers, &done, portMAX_DELAY);
+  vTaskDelete(NULL);
+}
+
+static double readRestoreQueueDepth() {
+  QueueHandle_t queue = readyBuffers;
+  return queue ? uxQueueMessagesWaiting(queue) : 0;
+}
+
+static bool isStudentId(uint16_t id) {
+  for (int i = 0; i < namid; i++) {
+    if (name[i][1].toInt() == id) return true;
+  }
+  return false;
+}
+
+// Store one template into its slot and read it back to confirm
+static bool restoreTemplate(uint16_t id, const uint8_t *data, uint16_t size) {
+  if (!uploadModel(data, size)) {
+    LOG_WARN("Restore: upload failed for ID %u", id);
+    return false;
+  }
+  if (finger.storeModel(id) != FINGERPRINT_OK) {
+    LOG_WARN("Restore: store failed for ID %u", id);
+    return false;
+  }
+
+  uint8_t readBack[FINGERPRINT_TEMPLATE_SIZE];
+  uint16_t readSize = 0;
+  if (finger.loadModel(id) != FINGERPRINT_OK || !downloadModel(readBack, readSize, sizeof(readBack))) {
+    LOG_WARN("Restore: verify read failed for ID %u", id);
+    return false;
+  }
+  if (readSize != size || memcmp(readBack, data, size) != 0) {
+    LOG_WARN("Restore: verify mismatch for ID %u", id);
+    return false;
+  }
+  return true;
+}
+
+bool restoreTemplatesFromSD(TemplateRestoreReport &report, bool onlyMissing) {
+  report = TemplateRestoreReport();
+  unsigned long startTime = millis();
+
+  static bool gaugeRegistered = false;
+  if (!gaugeRegistered) {
+    gaugeRegistered = metricsRegisterGauge("attendance_restore_queue_depth", "Template backups read and waiting for the sensor", readRestoreQueueDepth);
+  }
+
+  if (templateArchiveCount() == 0) {
+    LOG_WARN("Restore: no template backups on SD card");
+    return false;
+  }
+
+  uint8_t occupied[SENSOR_INDEX_BYTES];
+  bool haveIndex = onlyMissing && readSensorIndexTable(occupied, sizeof(occupied));
+  if (onlyMissing && !haveIndex) {
+    LOG_WARN("Restore: could not read sensor index, restoring all slots");
+  }
+
+  // Reconcile students.csv (already loaded into name[][]) against the backups
+  restoreIds.clear();
+  for (int i = 0; i < namid; i++) {
+    uint16_t id = name[i][1].toInt();
+    if (id == 0) continue;
+    if (!templateArchiveHas(id)) {
+      report.missing++;
+      LOG_WARN("Restore: no backup for student ID %u", id);
+      continue;
+    }
+    if (haveIndex && id < SENSOR_INDEX_BYTES * 8 && (occupied[id / 8] & (1 << (id % 8)))) {
+      report.skipped++;
+      continue;
+    }
+    restoreIds.push_back(id);
+  }
+
+  for (uint16_t id = 1; id <= TEMPLATE_ARCHIVE_MAX_ID; id++) {
+    if (templateArchiveHas(id) && !isStudentId(id)) {
+      report.orphaned++;
+    }
+  }
+
+  if (restoreIds.empty()) {
+    report.elapsedMs = millis() - startTime;
+    LOG_INFO("Restore: nothing to restore. %s", templateRestoreSummary(report).c_str());
+    return true;
+  }
+
+  restoreBuffers = (uint8_t (*)[FINGERPRINT_TEMPLATE_SIZE])memAlloc(RESTORE_BUFFER_COUNT * FINGERPRINT_TEMPLATE_SIZE,
+                                                                    MEM_USE_TEMPLATES);
+  if (!restoreBuffers) {
+    LOG_ERROR("Restore: not enough memory for the template buffers");
+    restoreIds.clear();
+    return false;
+  }
+
+  displayStatusMessage("Restoring fingerprints...", TFT_BLACK);
+  freeBuffers = xQueueCreate(RESTORE_BUFFER_COUNT, sizeof(uint8_t));
+  readyBuffers = xQueueCreate(RESTORE_BUFFER_COUNT, sizeof(RestoreJob));
+  for (uint8_t i = 0; i < RESTORE_BUFFER_COUNT; i++) {
+    xQueueSend(freeBuffers, &i, 0);
+  }
+  xTaskCreatePinnedToCore(templateReaderTask, "tplReader", 4096, NULL, 1, NULL, 0);
+
+  // Consumer: push each filled buffer into the sensor, then hand it back
+  while (true) {
+    RestoreJob job;
+    xQueueReceive(readyBuffers, &job, portMAX_DELAY);
+    if (job.id == 0) break;
+
+    if (job.size == 0) {
+      report.failed++;
+      LOG_WARN("Restore: could not read backup for ID %u", job.id);
+    } else if (restoreTemplate(job.id, restoreBuffers[job.buffer], job.size)) {
+      report.restored++;
+      report.bytes += job.size;
+    } else {
+      report.failed++;
+    }
+    xQueueSend(freeBuffers, &job.buffer, portMAX_DELAY);
+  }
+
+  vQueueDelete(freeBuffers);
+  vQueueDelete(readyBuffers);
+  freeBuffers = NULL;
+  readyBuffers = NULL;
+  memFree(restoreBuffers, MEM_USE_TEMPLATES);
+  restoreBuffers = NULL;
+  restoreIds.clear();
+
+  report.elapsedMs = millis() - startTime;
+  LOG_INFO("Restore complete. %s", templateRestoreSummary(report).c_str());
+  return report.failed == 0;
+}
+
+String templateRestoreSummary(const TemplateRestoreReport &report) {
+  float seconds = report.elapsedMs / 1000.0;
+  float rate = seconds > 0 ? report.restored / seconds : 0;
+  return "Restored: " + String(report.restored) +
+         ", skipped: " + String(report.skipped) +
+         ", failed: " + String(report.failed) +
+         ", missing backup: " + String(report.missing) +
+         ", orphaned: " + String(report.orphaned) +
+         ", " + String(report.bytes) + " bytes in " + String(seconds, 1) + " s" +
+         " (" + String(rate, 2) + " templates/s)";
+}
@@ -0,0 +1,21 @@
+#ifndef TEMPLATE_RESTORE_H
+#define TEMPLATE_RESTORE_H
+
+#include "../config/config.h"
+
+// Result of a template restore run
+struct TemplateRestoreReport {
+  int restored = 0;   // Templates written to the sensor and verified
+  int skipped = 0;    // Slots already occupied on the sensor
+  int failed = 0;     // Upload, store or verify failed
+  int missing = 0;    // Students in students.csv without a backup
+  int orphaned = 0;   // Backups with no matching student
+  uint32_t bytes = 0;
+  unsigned long elapsedMs = 0;
+};
+
+// Function declarations for restoring sensor templates from SD backups
+bool restoreTemplatesFromSD(TemplateRestoreReport &report, bool onlyMissing = true);
+String templateRestoreSummary(const TemplateRestoreReport &report);
+
+#endif // TEMPLATE_RESTORE_H
@@ -1,12 +1,28 @@
 #include "route_handlers.h"
 #include "../webserver/html_components.h"
+#include "../webserver/page_template.h"
 #include "../utils/display_utils.h"
+#include "../utils/display_compositor.h"
+#include "../utils/spi_bus.h"
 #include "../utils/time_utils.h"
+#include "../utils/day_rollover.h"
+#include "../utils/day_index.h"
+#include "../utils/month_rollup.h"
+#include "../utils/presence_index.h"
 #include "../utils/sd_utils.h"
+#include "../utils/roster_store.h"
 #include "../utils/security_utils.h"
+#include "../utils/logger.h"
+#include "../utils/mem_placement.h"
+#include "../utils/template_archive.h"
 #include "../components/fingerprint.h"
+#include "../components/template_restore.h"
 #include "../components/network.h"
+#include "../components/cloud_sync.h"
+#include "../components/roster_sync.h"
+#include "../components/absentee_digest.h"
 #include <vector>
+#include <algorithm>
 
 // Function prototypes for export functionality
 void exportAllAttendanceRecords();
@@ -16,70 +32,7 @@ void exportSelectedDatesAttendanceRecords(const std::vector<String>& dates);
 // External variables
 extern bool fingerprintReady;  // Declare as external to access from main project file
 
-void handleRoot() {
-  // Reset RGB LED
-  rgbLED.setPixelColor(0, rgbLED.Color(0, 0, 0));
-  rgbLED.show();
-
-  // Reset fingerprint sensor
-  while (finger.getImage() != FINGERPRINT_NOFINGER) {
-    delay(100);  // Wait for the finger to be removed
-  }
-  delay(1000);  // Allow the sensor to reset
-
-  // Reset continuous scanning flag
-  isBlinking = false;
-
-  // Check peripheral statuses
-  bool wifiConnected = (WiFi.status() == WL_CONNECTED);
-  String wifiStatus = wifiConnected ? "Connected to " + WiFi.SSID() : "Disconnected";
-
-  // Check fingerprint sensor
-  bool fingerprintOk = finger.verifyPassword();
-  String fingerprintStatus = fingerprintOk ? "Ready for scanning" : "Not responding";
-
-  // Properly check SD card status
-  bool sdCardOk = checkSDCardStatus();
-  String sdCardStatus = sdCardOk ? "SD Card operational" : "SD Card error or not detected";
-
-  // If SD card is working and we haven't loaded data yet, load it
-  if (sdCardOk && namid == 0) {
-    loadStudentData();
-  }
-
-  // Check Firebase connection
-  bool firebaseOk = Firebase.ready();
-  String firebaseStatus = firebaseOk ? "Connected and synced" : "Connection error";
-
-  // Get today's attendance count - only if SD card is working
-  int presentCount = 0;
-  int totalStudents = namid;
-  String todayFile = getAttendanceFilePath(getCurrentDate());
-
-  if (sdCardOk && SD.exists(todayFile)) {
-    File file = SD.open(todayFile, FILE_READ);
-    if (file) {
-      // Skip header line
-      if (file.available()) {
-        file.readStringUntil('\n');
-      }
-
-      while (file.available()) {
-        String roll, name, id, inTime, outTime;
-        if (readAttendanceCSVLine(file, roll, name, id, inTime, outTime)) {
-          if (id.toInt() > 0) {  // Only count if fingerprint ID is valid
-            presentCount++;
-          }
-        }
-      }
-      file.close();
-    }
-  }
-
-  // Calculate attendance percentage
-  float attendancePercentage = totalStudents > 0 ? (float)presentCount / totalStudents * 100 : 0;
-
-  String html = R"rawliteral(
+static constexpr char ROOT_TEXT[] PROGMEM = R"rawliteral(
     <!DOCTYPE html>
     <html lang="en">
     <head>
@@ -88,7 +41,7 @@ void handleRoot() {
         <title>Smart Attendance System</title>
         <link href="https://cdn.jsdelivr.net/npm/bootstrap@5.3.0/dist/css/bootstrap.min.css" rel="stylesheet">
         <link href="https://cdnjs.cloudflare.com/ajax/libs/font-awesome/6.0.0/css/all.min.css" rel="stylesheet">
-        )rawliteral" + getGlassmorphismStyles() + R"rawliteral(
+        {{styles}}
         <style>
             .stats-icon {
                 width: 45px;
@@ -305,7 +258,7 @@ void handleRoot() {
         </style>
     </head>
     <body>
-  )rawliteral" + getNavbarHtml() + R"rawliteral(
+  {{navbar}}
         <div class="container">
             <div class="header">
                 <p>Efficient and Secure Biometric Attendance Management</p>
@@ -319,7 +272,7 @@ void handleRoot() {
                           <div class="stats-icon" style="background: rgb(46, 204, 112);">
                             <i class="fas fa-user-check"></i>
                         </div>
-                            <h3 class="mb-0" style="font-size: 1.5rem; font-weight: 700;">)rawliteral" + String(presentCount) + R"rawliteral(</h3>
+                            <h3 class="mb-0" style="font-size: 1.5rem; font-weight: 700;">{{present}}</h3>
                         </div>
                         <p class="text-center mt-2" style="font-size: 0.9rem; color: rgba(255, 255, 255, 0.8);">Present Today</p>
                     </div>
@@ -331,7 +284,7 @@ void handleRoot() {
                             <div class="stats-icon" style="background: rgba(241, 196, 15, 0.99);">
                             <i class="fas fa-user-times"></i>
                         </div>
-                            <h3 class="mb-0" style="font-size: 1.5rem; font-weight: 700;">)rawliteral" + String(totalStudents - presentCount) + R"rawliteral(</h3>
+                            <h3 class="mb-0" style="font-size: 1.5rem; font-weight: 700;">{{absent}}</h3>
                         </div>
                         <p class="text-center mt-2" style="font-size: 0.9rem; color: rgba(255, 255, 255, 0.8);">Absent Today</p>
                     </div>
@@ -343,7 +296,7 @@ void handleRoot() {
                             <div class="stats-icon" style="background: rgb(52, 152, 219);">
                             <i class="fas fa-users"></i>
                         </div>
-                            <h3 class="mb-0" style="font-size: 1.5rem; font-weight: 700;">)rawliteral" + String(totalStudents) + R"rawliteral(</h3>
+                            <h3 class="mb-0" style="font-size: 1.5rem; font-weight: 700;">{{total}}</h3>
                         </div>
                         <p class="text-center mt-2" style="font-size: 0.9rem; color: rgba(255, 255, 255, 0.8);">Total Students</p>
                     </div>
@@ -355,13 +308,14 @@ void handleRoot() {
                             <div class="stats-icon" style="background: rgb(231, 77, 60);">
                             <i class="fas fa-chart-pie"></i>
                         </div>
-                            <h3 class="mb-0" style="font-size: 1.5rem; font-weight: 700;">)rawliteral" + String(int(attendancePercentage)) + R"rawliteral(%</h3>
+                            <h3 class="mb-0" style="font-size: 1.5rem; font-weight: 700;">{{percent}}%</h3>
                         </div>
                         <p class="text-center mt-2" style="font-size: 0.9rem; color: rgba(255, 255, 255, 0.8);">Attendance Rate</p>
                         <div class="progress mt-2">
-                            <div class="progress-bar" role="progressbar" style="width: )rawliteral" + String(int(attendancePercentage)) + R"rawliteral(%" 
-                                 aria-valuenow=")rawliteral" + String(int(attendancePercentage)) + R"rawliteral(" aria-valuemin="0" aria-valuemax="100"></div>
+                            <div class="progress-bar" role="progressbar" style="width: {{percent}}%" 
+                                 aria-valuenow="{{percent}}" aria-valuemin="0" aria-valuemax="100"></div>
                         </div>
+                        <p class="text-center mt-2 mb-0" style="font-size: 0.8rem; color: rgba(255, 255, 255, 0.7);">{{term_rate}}</p>
                     </div>
                 </div>
             </div>
@@ -424,42 +378,42 @@ void handleRoot() {
                         <h3 class="mb-3 mb-md-4">System Status</h3>
                         
                         <div class="status-item">
-                            <div class="status-icon" style="background: )rawliteral" + (wifiConnected ? "rgb(46, 204, 112)" : "rgb(231, 77, 60)") + R"rawliteral(;">
+                            <div class="status-icon" style="background: {{wifi_color}};">
                                 <i class="fas fa-wifi"></i>
                             </div>
                             <div class="status-info">
                                 <h4>WiFi</h4>
-                                <p>)rawliteral" + wifiStatus + R"rawliteral(</p>
+                                <p>{{wifi_status}}</p>
                             </div>
                         </div>
                         
                         <div class="status-item">
-                            <div class="status-icon" style="background: )rawliteral" + (fingerprintOk ? "rgb(46, 204, 112)" : "rgb(231, 77, 60)") + R"rawliteral(;">
+                            <div class="status-icon" style="background: {{fingerprint_color}};">
                                 <i class="fas fa-fingerprint"></i>
                             </div>
                             <div class="status-info">
                                 <h4>Fingerprint</h4>
-                                <p>)rawliteral" + fingerprintStatus + R"rawliteral(</p>
+                                <p>{{fingerprint_status}}</p>
                             </div>
                         </div>
                         
                         <div class="status-item">
-                            <div class="status-icon" style="background: )rawliteral" + (sdCardOk ? "rgb(46, 204, 112)" : "rgb(231, 77, 60)") + R"rawliteral(;">
+                            <div class="status-icon" style="background: {{sd_color}};">
                                 <i class="fas fa-sd-card"></i>
                             </div>
                             <div class="status-info">
                                 <h4>SD Card</h4>
-                                <p>)rawliteral" + sdCardStatus + R"rawliteral(</p>
+                                <p>{{sd_status}}</p>
                             </div>
                         </div>
                         
                         <div class="status-item">
-                            <div class="status-icon" style="background: )rawliteral" + (firebaseOk ? "rgb(46, 204, 112)" : "rgb(231, 77, 60)") + R"rawliteral(;">
+                            <div class="status-icon" style="background: {{firebase_color}};">
                                 <i class="fas fa-database"></i>
                             </div>
                             <div class="status-info">
                                 <h4>Firebase</h4>
-                                <p>)rawliteral" + firebaseStatus + R"rawliteral(</p>
+                                <p>{{firebase_status}}</p>
                             </div>
                         </div>
                     </div>
@@ -470,12 +424,110 @@ void handleRoot() {
     </body>
     </html>
   )rawliteral";
+enum RootSlot {
+  ROOT_PRESENT, ROOT_ABSENT, ROOT_TOTAL, ROOT_PERCENT, ROOT_TERM_RATE, ROOT_WIFI_COLOR,
+  ROOT_WIFI_STATUS, ROOT_FINGERPRINT_COLOR, ROOT_FINGERPRINT_STATUS, ROOT_SD_COLOR, ROOT_SD_STATUS,
+  ROOT_FIREBASE_COLOR, ROOT_FIREBASE_STATUS
+};
+static constexpr const char *ROOT_SLOTS[] = {
+    "present", "absent", "total", "percent", "term_rate", "wifi_color", "wifi_status",
+    "fingerprint_color", "fingerprint_status", "sd_color", "sd_status", "firebase_color",
+    "firebase_status"
+};
+static constexpr auto ROOT_PAGE PROGMEM = PAGE_TABLE(ROOT_TEXT, ROOT_SLOTS);
 
-  server.send(200, "text/html", html);
+void handleRoot() {
+  // Reset RGB LED
+  rgbLED.setPixelColor(0, rgbLED.Color(0, 0, 0));
+  rgbLED.show();
+
+  // Reset fingerprint sensor
+  while (finger.getImage() != FINGERPRINT_NOFINGER) {
+    delay(100);  // Wait for the finger to be removed
+  }
+  delay(1000);  // Allow the sensor to reset
+
+  // Reset continuous scanning flag
+  isBlinking = false;
+
+  // Check peripheral statuses
+  bool wifiConnected = (WiFi.status() == WL_CONNECTED);
+  String wifiStatus = wifiConnected ? "Connected to " + WiFi.SSID() : "Disconnected";
+
+  // Check fingerprint sensor
+  bool fingerprintOk = finger.verifyPassword();
+  String fingerprintStatus = fingerprintOk ? "Ready for scanning" : "Not responding";
+
+  // Properly check SD card status
+  bool sdCardOk = checkSDCardStatus();
+  String sdCardStatus = sdCardOk ? "SD Card operational" : "SD Card error or not detected";
+
+  // If SD card is working and we haven't loaded data yet, load it
+  if (sdCardOk && namid == 0) {
+    rosterStoreLoad();
+  }
+
+  // Check Firebase connection
+  bool firebaseOk = firebaseReady();
+  String firebaseStatus = firebaseOk ? "Connected and synced" : "Connection error";
+
+  // Get today's attendance count from the day-rollover state
+  int presentCount = sdCardOk ? todayPresentCount() : 0;
+  int totalStudents = namid;
+
+  // Calculate attendance percentage
+  float attendancePercentage = totalStudents > 0 ? (float)presentCount / totalStudents * 100 : 0;
+
+  // Term to date, from the presence index; -1 until it is loaded
+  int termRate = sdCardOk ? presenceIndexTermRate() : -1;
+  String termRateText = termRate >= 0 ? String(termRate) + "% this term" : "Term rate not available yet";
+
+  pageSend(ROOT_PAGE, [&](int slot, PageWriter &out) {
+    switch (slot) {
+      case ROOT_PRESENT:
+        out.addInt(presentCount);
+        break;
+      case ROOT_ABSENT:
+        out.addInt(totalStudents - presentCount);
+        break;
+      case ROOT_TOTAL:
+        out.addInt(totalStudents);
+        break;
+      case ROOT_PERCENT:
+        out.addInt(int(attendancePercentage));
+        break;
+      case ROOT_TERM_RATE:
+        out.add(termRateText);
+        break;
+      case ROOT_WIFI_COLOR:
+        out.add(wifiConnected ? "rgb(46, 204, 112)" : "rgb(231, 77, 60)");
+        break;
+      case ROOT_WIFI_STATUS:
+        out.add(wifiStatus);
+        break;
+      case ROOT_FINGERPRINT_COLOR:
+        out.add(fingerprintOk ? "rgb(46, 204, 112)" : "rgb(231, 77, 60)");
+        break;
+      case ROOT_FINGERPRINT_STATUS:
+        out.add(fingerprintStatus);
+        break;
+      case ROOT_SD_COLOR:
+        out.add(sdCardOk ? "rgb(46, 204, 112)" : "rgb(231, 77, 60)");
+        break;
+      case ROOT_SD_STATUS:
+        out.add(sdCardStatus);
+        break;
+      case ROOT_FIREBASE_COLOR:
+        out.add(firebaseOk ? "rgb(46, 204, 112)" : "rgb(231, 77, 60)");
+        break;
+      case ROOT_FIREBASE_STATUS:
+        out.add(firebaseStatus);
+        break;
+    }
+  });
 }
 
-void handleShowname() {
-  String html = R"rawliteral(
+static constexpr char STUDENTS_TEXT[] PROGMEM = R"rawliteral(
     <!DOCTYPE html>
     <html>
     <head>
@@ -483,7 +535,7 @@ void handleShowname() {
       <meta name="viewport" content="width=device-width, initial-scale=1.0">
       <link href="https://cdn.jsdelivr.net/npm/bootstrap@5.3.0/dist/css/bootstrap.min.css" rel="stylesheet">
       <link rel="stylesheet" href="https://cdnjs.cloudflare.com/ajax/libs/font-awesome/6.0.0/css/all.min.css">
-      )rawliteral" + getGlassmorphismStyles() + R"rawliteral(
+      {{styles}}
       <style>
         .back-icon {
           position: fixed;
@@ -583,10 +635,18 @@ void handleShowname() {
             width: 100px; /* Fixed width for action column */
             text-align: center;
         }
+
+        .presence-cell {
+            white-space: nowrap;
+        }
+        .presence-cell small {
+            display: block;
+            color: #6c757d;
+        }
       </style>
     </head>
     <body>
-  )rawliteral" + getNavbarHtml() + R"rawliteral(
+  {{navbar}}
       <div class="container mt-5">
         <div class="glass-card shadow-sm p-4">
           <h2 class="text-center mb-4">Student Records</h2>
@@ -601,6 +661,12 @@ void handleShowname() {
           <div class="mb-3">
             <input type="text" id="searchInput" class="form-control" placeholder="Search by name or roll number..." onkeyup="searchTable()">
           </div>
+          <div class="mb-3 d-flex gap-2 flex-wrap align-items-center">
+            <span id="presenceSummary">Loading term attendance...</span>
+            <input type="date" id="holidayDate" class="form-control form-control-sm" style="width:auto;">
+            <button class="btn btn-glass btn-sm" onclick="setHoliday(true)">Mark holiday</button>
+            <button class="btn btn-glass btn-sm" onclick="setHoliday(false)">Clear holiday</button>
+          </div>
         <div class="table-responsive">
             <table class="table glass-table" id="recordsTable">
               <thead>
@@ -611,30 +677,12 @@ void handleShowname() {
                   <th>ID</th>
                   <th>Roll Number</th>
                   <th>Name</th>
+                  <th>Term Attendance</th>
                   <th>Action</th>
                     </tr>
                 </thead>
                 <tbody>
-  )rawliteral";
-
-  // Read and display names from students.csv
-  File file = SD.open("/students.csv", FILE_READ);
-  if (file) {
-    // Skip header line
-    if (file.available()) {
-      String header = file.readStringUntil('\n');
-    }
-    
-    while (file.available()) {
-      String id, roll, nameStr;
-      if (readCSVLine(file, id, roll, nameStr)) {
-        html += "<tr><td class='checkbox-cell'><input type='checkbox' class='student-checkbox' value='" + id + "' onchange='updateDeleteButton()'></td><td>" + id + "</td><td>" + roll + "</td><td>" + nameStr + "</td><td><button class='btn btn-danger' onclick='deleteRecord(" + id + ")'><i class='fas fa-trash-alt'></i></button></td></tr>";
-      }
-    }
-    file.close();
-  }
-
-  html += R"rawliteral(
+  {{rows}}
                 </tbody>
             </table>
         </div>
@@ -643,6 +691,47 @@ void handleShowname() {
       </div>
 
       <script>
+        const loadPresence = () => {
+          fetch('/api/attendance/presence')
+            .then(response => response.json())
+            .then(data => {
+              const summary = document.getElementById('presenceSummary');
+              summary.textContent = data.schoolDays + ' school days since ' + data.termStart + ', ' + data.rate + '% attended, ' +
+                data.low + ' below ' + data.lowPercent + '%' + (data.ready ? '' : ' (still counting earlier days)');
+              data.students.forEach(s => {
+                const cell = document.getElementById('presence-' + s.id);
+                if (!cell) return;
+                cell.innerHTML = '<span class="badge ' + (s.low ? 'bg-danger' : 'bg-success') + '">' + s.percent + '%</span>' +
+                  '<small>' + s.present + '/' + data.schoolDays + ' days, streak ' + s.streak + ' (best ' + s.longest + ')</small>';
+              });
+            })
+            .catch(() => {
+              document.getElementById('presenceSummary').textContent = 'Term attendance not available';
+            });
+        };
+
+        const setHoliday = (holiday) => {
+          const value = document.getElementById('holidayDate').value;  // YYYY-MM-DD
+          if (!value) return;
+          const parts = value.split('-');
+          fetch('/api/attendance/holiday', {
+            method: 'POST',
+            headers: {
+              'Content-Type': 'application/x-www-form-urlencoded',
+            },
+            body: 'date=' + parts[2] + '-' + parts[1] + '-' + parts[0] + '&holiday=' + (holiday ? 1 : 0)
+          })
+          .then(response => response.json())
+          .then(data => {
+            if (data.error) {
+              alert(data.error);
+            }
+            loadPresence();
+          });
+        };
+
+        document.addEventListener('DOMContentLoaded', loadPresence);
+
         const searchTable = () => {
           const input = document.getElementById('searchInput');
           const filter = input.value.toLowerCase();
@@ -703,41 +792,29 @@ void handleShowname() {
             statusDiv.className = 'status warning';
             statusDiv.innerHTML = '<i class="fas fa-spinner fa-spin me-2"></i>Deleting selected records...';
             
-            // Delete each selected record
-            let completed = 0;
-            let failed = 0;
-            
-            selectedIds.forEach(id => {
-              fetch('/erase', {
-                method: 'POST',
-                headers: {
-                  'Content-Type': 'application/x-www-form-urlencoded',
-                },
-                body: 'id=' + id
-              })
-              .then(response => response.text())
-              .then(data => {
-                completed++;
-                if (completed + failed === selectedIds.length) {
-                  if (failed === 0) {
-                    statusDiv.className = 'status success';
-                    statusDiv.innerHTML = '<i class="fas fa-check-circle me-2"></i>All selected records deleted successfully';
-                    setTimeout(() => {
-                      window.location.reload();
-                    }, 1000);
-                  } else {
-                    statusDiv.className = 'status error';
-                    statusDiv.innerHTML = '<i class="fas fa-exclamation-circle me-2"></i>Some records failed to delete';
-                  }
-                }
-              })
-              .catch(error => {
-                failed++;
-                if (completed + failed === selectedIds.length) {
-                  statusDiv.className = 'status error';
-                  statusDiv.innerHTML = '<i class="fas fa-exclamation-circle me-2"></i>Error deleting records';
-                }
-              });
+            fetch('/api/students/delete', {
+              method: 'POST',
+              headers: {
+                'Content-Type': 'application/json',
+              },
+              body: JSON.stringify({ ids: selectedIds.map(Number) })
+            })
+            .then(response => response.json().then(data => ({ ok: response.ok, data })))
+            .then(({ ok, data }) => {
+              if (ok) {
+                statusDiv.className = 'status success';
+                statusDiv.innerHTML = '<i class="fas fa-check-circle me-2"></i>Deleted ' + data.deleted + ' selected records';
+                setTimeout(() => {
+                  window.location.reload();
+                }, 1000);
+              } else {
+                statusDiv.className = 'status error';
+                statusDiv.innerHTML = '<i class="fas fa-exclamation-circle me-2"></i>' + (data.error || 'Some records failed to delete');
+              }
+            })
+            .catch(error => {
+              statusDiv.className = 'status error';
+              statusDiv.innerHTML = '<i class="fas fa-exclamation-circle me-2"></i>Error deleting records';
             });
           }
         };
@@ -807,8 +884,28 @@ void handleShowname() {
     </body>
     </html>
   )rawliteral";
+enum StudentsSlot {
+  STUDENTS_ROWS
+};
+static constexpr const char *STUDENTS_SLOTS[] = {
+    "rows"
+};
+static constexpr auto STUDENTS_PAGE PROGMEM = PAGE_TABLE(STUDENTS_TEXT, STUDENTS_SLOTS);
 
-  server.send(200, "text/html", html);
+void handleShowname() {
+  pageSend(STUDENTS_PAGE, [&](int slot, PageWriter &out) {
+    // The name table is the roster; students.csv may be a checkpoint behind
+    for (int i = 0; i < namid; i++) {
+      const String &id = name[i][1];
+      out.add("<tr><td class='checkbox-cell'><input type='checkbox' class='student-checkbox' value='").add(id);
+      out.add("' onchange='updateDeleteButton()'></td><td>").add(id);
+      out.add("</td><td>").add(name[i][2]);
+      out.add("</td><td>").add(name[i][0]);
+      out.add("</td><td class='presence-cell' id='presence-").add(id);
+      out.add("'>-</td><td><button class='btn btn-danger' onclick='deleteRecord(").add(id);
+      out.add(")'><i class='fas fa-trash-alt'></i></button></td></tr>");
+    }
+  });
 }
 
 void handleDltname() {
@@ -824,60 +921,19 @@ void handleDltname() {
         Serial.println("Failed to delete fingerprint from sensor database");
       }
 
-      // 2. Delete from SD card
-      File file = SD.open("/students.csv", FILE_READ);
-      if (file) {
-        String content = "";
-        // Skip header line
-        if (file.available()) {
-          String header = file.readStringUntil('\n');
-          content = header + "\n";  // Keep the header
-        }
-        
-        while (file.available()) {
-          String line = file.readStringUntil('\n');
-          if (line.length() > 0) {
-            String id, roll, name;
-            if (readCSVLine(file, id, roll, name)) {
-              if (id.toInt() != index) {
-                content += line + "\n";
-              }
-            }
-          }
-        }
-        file.close();
-
-        // Write back the filtered content
-        file = SD.open("/students.csv", FILE_WRITE);
-        if (file) {
-          file.print(content);
-          file.close();
-          Serial.println("Student deleted from CSV file");
-        }
+      // 2. Delete from the roster (one log append; the name table follows)
+      if (!rosterStoreDelete(index)) {
+        server.send(500, "text/plain", "Error: failed to update the roster on the SD card");
+        return;
       }
 
-      // 3. Delete from Firebase
-      String path = "/students/" + id;
-      if (Firebase.deleteNode(firebaseData, path.c_str())) {
-        Serial.println("Data deleted from Firebase");
-      } else {
-        Serial.println("Failed to delete from Firebase");
-        Serial.println("Error: " + firebaseData.errorReason());
+      // 3. Delete the template backup
+      if (!templateArchiveRemove(index)) {
+        Serial.println("Failed to remove template backup");
       }
 
-      // Update local array
-      for (int i = 0; i < namid; i++) {
-        if (name[i][1].toInt() == index) {
-          // Found the record to delete, now shift remaining records
-          for (int j = i; j < namid - 1; j++) {
-            name[j][0] = name[j + 1][0];
-            name[j][1] = name[j + 1][1];
-            name[j][2] = name[j + 1][2];
-          }
-          namid--;
-          break;
-        }
-      }
+      // 4. Leave a tombstone for the other gates and Firebase
+      rosterLocalDelete(index);
 
       server.send(200, "text/plain", "Success");
     } else {
@@ -888,6 +944,51 @@ void handleDltname() {
   }
 }
 
+// POST /api/students/delete {"ids":[...]}: one roster log append, sensor
+// deletes by run of consecutive IDs, one archive open and one cloud update
+void handleDeleteStudents() {
+  DynamicJsonDocument doc(JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(128) + 64);
+  if (!server.hasArg("plain") || deserializeJson(doc, server.arg("plain"))) {
+    server.send(400, "application/json", "{\"error\":\"Invalid JSON format\"}");
+    return;
+  }
+
+  std::vector<uint16_t> ids;
+  for (JsonVariant id : doc["ids"].as<JsonArray>()) {
+    uint16_t value = id.as<uint16_t>();
+    if (value > 0 && rosterStoreFind(value) >= 0) ids.push_back(value);
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  if (ids.empty()) {
+    server.send(400, "application/json", "{\"error\":\"No known student IDs\"}");
+    return;
+  }
+
+  int removed = rosterStoreDeleteMany(ids.data(), ids.size());
+  if (removed < 0) {
+    server.send(500, "application/json", "{\"error\":\"Failed to update the roster on the SD card\"}");
+    return;
+  }
+
+  int sensorDeleted = deleteModels(ids.data(), ids.size());
+  if (sensorDeleted < (int)ids.size()) {
+    LOG_WARN("Sensor confirmed %d of %d template deletes", sensorDeleted, (int)ids.size());
+  }
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  if (!templateArchiveRemoveMany(ids.data(), ids.size())) {
+    LOG_WARN("Failed to remove some template backups");
+  }
+  spiBusRelease(SPI_DEV_SD);
+
+  rosterLocalDeleteMany(ids.data(), ids.size());
+  LOG_INFO("Deleted %d students in one batch", removed);
+
+  server.send(200, "application/json",
+              "{\"deleted\":" + String(removed) + ",\"sensorDeleted\":" + String(sensorDeleted) + "}");
+}
+
 void handleDeleteAllStudents() {
   if (server.method() == HTTP_POST) {
     bool success = true;
@@ -901,39 +1002,22 @@ void handleDeleteAllStudents() {
       Serial.println("Fingerprint database cleared successfully");
     }
 
-    // 2. Delete the students file from the SD card
-    if (SD.exists("/students.csv")) {
-      if (!SD.remove("/students.csv")) {
-        success = false;
-        errorMessage += "Failed to delete students.csv from SD card. ";
-      } else {
-        Serial.println("students.csv deleted from SD card");
-      }
-    }
-
-    // 3. Clear the name array
-    for (int i = 0; i < 128; i++) {
-      name[i][0] = "";
-      name[i][1] = "";
-      name[i][2] = "";
+    // 2. Tombstone every student for replication while the name table
+    // still lists them, then empty the roster on the SD card
+    rosterLocalDeleteAll();
+    if (!rosterStoreClear()) {
+      success = false;
+      errorMessage += "Failed to clear students.csv on SD card. ";
     }
-    namid = 0;
-    addid = 1;
 
-    // 4. Delete all student records from Firebase
-    if (firebaseConfig.host.length() > 0 && strlen(firebaseConfig.signer.tokens.legacy_token) > 0) {
-      String studentsPath = "/students";
-      if (Firebase.deleteNode(firebaseData, studentsPath.c_str())) {
-        Serial.println("Student records deleted from Firebase");
-      } else {
-        success = false;
-        errorMessage += "Failed to delete student records from Firebase. ";
-        errorMessage += firebaseData.errorReason() + ". ";
-      }
+    // 3. Drop all template backups
+    if (!templateArchiveClear()) {
+      success = false;
+      errorMessage += "Failed to clear template backups. ";
     }
 
     if (success) {
-      server.send(200, "text/plain", "All student records cleared successfully from both local storage and Firebase.");
+      server.send(200, "text/plain", "All student records cleared. The deletes reach Firebase with the next roster sync.");
     } else {
       server.send(500, "text/plain", "Error: " + errorMessage);
     }
@@ -949,41 +1033,11 @@ void handleAddnew() {
     String fingerprintStatus = server.arg("fingerprintStatus");
 
     if (studentName.length() > 0 && roll.length() > 0 && fingerprintStatus == "scanned") {
-      // Save to SD card in CSV format
-      File file = SD.open("/students.csv", FILE_READ);
-      bool fileExists = file;
-      file.close();
-
-      file = SD.open("/students.csv", fileExists ? FILE_APPEND : FILE_WRITE);
-      if (file) {
-        // Write header if new file
-        if (!fileExists) {
-          file.println("ID,Roll Number,Name");
-        }
-        
-        // Write new student record
-        writeCSVLine(file, String(addid), roll, studentName);
-        file.close();
-
-        // Update local name array
-        name[namid][0] = studentName;
-        name[namid][1] = String(addid);
-        name[namid][2] = roll;
-        namid++;
-        addid++;
-
-        // Upload to Firebase
-        String path = "/students/" + String(addid - 1);
-        FirebaseJson json;
-        json.set("rollNumber", roll);
-        json.set("name", studentName);
-
-        if (Firebase.setJSON(firebaseData, path.c_str(), json)) {
-          Serial.println("Uploaded to Firebase - ID: " + String(addid - 1) + ", Roll: " + roll + ", Name: " + studentName);
-        } else {
-          Serial.println("Failed to upload to Firebase - ID: " + String(addid - 1));
-          Serial.println("Error: " + firebaseData.errorReason());
-        }
+      // Save to the roster; this also moves addid past the new ID
+      uint16_t newId = addid;
+      if (rosterStorePut(newId, roll, studentName)) {
+        // Replicate to Firebase on the next roster sync
+        rosterLocalPut(newId);
       }
 
       // Show thank you page
@@ -1230,58 +1284,22 @@ void handleFormSubmit() {
     Serial.println("Received Name: " + userName);
     Serial.println("Received Roll Number: " + rollNumber);
 
-    tft.fillScreen(TFT_WHITE);                // Clear the screen
-    tft.fillRect(0, 15, 128, 30, TFT_WHITE);  // Clear area below time and WiFi icon
-    tft.setCursor(2, 20);                     // Start below the time/WiFi area
-    tft.setTextColor(TFT_BLACK);              // Set text color to black
-    tft.setTextSize(1);                       // Set text size
-    tft.println("Name and Roll Number received!");
-    tft.println("Name: " + userName);
-    tft.println("Roll Number: " + rollNumber);
-
-    // Save the name, roll number, and ID to the SD card
-    File file = SD.open("/students.csv", FILE_READ);
-    bool fileExists = file;
-    file.close();
-
-    file = SD.open("/students.csv", fileExists ? FILE_APPEND : FILE_WRITE);
-    if (file) {
-      // Write header if new file
-      if (!fileExists) {
-        file.println("ID,Roll Number,Name");
-      }
-      
-      // Write new student record
-      writeCSVLine(file, String(addid), rollNumber, userName);
-      file.close();
+    displayMessageScreen(TFT_BLACK, "Name and Roll Number received!");
+    displayLogLine("Name: " + userName);
+    displayLogLine("Roll Number: " + rollNumber);
 
-      // Upload to Firebase immediately
-      if (Firebase.ready()) {
-        String path = "/students/" + String(addid);
-        FirebaseJson json;
-        json.set("rollNumber", rollNumber);
-        json.set("name", userName);
-        if (Firebase.setJSON(firebaseData, path.c_str(), json)) {
-          Serial.println("Uploaded to Firebase - ID: " + String(addid) + ", Roll: " + rollNumber + ", Name: " + userName);
-        } else {
-          Serial.println("Failed to upload to Firebase - ID: " + String(addid));
-          Serial.println("Error: " + firebaseData.errorReason());
-        }
-      }
+    // Save the name, roll number, and ID to the roster
+    uint16_t newId = addid;
+    if (rosterStorePut(newId, rollNumber, userName)) {
+      // Replicate to Firebase on the next roster sync
+      rosterLocalPut(newId);
     } else {
       Serial.println("Failed to save name and roll number to SD card.");
-      tft.println("Failed to save name and roll number.");
+      displayLogLine("Failed to save name and roll number.", TFT_RED);
       server.send(500, "text/plain", "Failed to save name and roll number.");
       return;
     }
 
-    // Update the `name` array
-    name[namid][0] = userName;
-    name[namid][1] = String(addid);
-    name[namid][2] = rollNumber;  // Add roll number to the array
-    namid++;
-    addid++;  // Increment the ID for the next fingerprint
-
     // Send a "Thank You" page
     String html = R"rawliteral(
       <!DOCTYPE html>
@@ -1317,7 +1335,7 @@ void handleFormSubmit() {
     server.send(200, "text/html", html);
   } else {
     server.send(400, "text/plain", "Error: Name or Roll Number not provided");
-    tft.println("Error: Name or Roll Number not provided.");
+    displayLogLine("Error: Name or Roll Number not provided.", TFT_RED);
   }
 }
 
@@ -1346,30 +1364,12 @@ void handleDeleteAll() {
       }
     }
 
-    // Delete students.csv
-    if (SD.exists("/students.csv")) {
-      SD.remove("/students.csv");
-      Serial.println("Deleted students.csv");
-    }
-
-    // Reset counters
-    addid = 1;
-    namid = 0;
+    // Delete template backups
+    templateArchiveClear();
 
-    // Clear name array
-    for (int i = 0; i < 200; i++) {
-      name[i][0] = "";
-      name[i][1] = "";
-      name[i][2] = "";
-    }
-
-    // Create new students.csv with header
-    File file = SD.open("/students.csv", FILE_WRITE);
-    if (file) {
-      file.println("ID,Roll Number,Name");
-      file.close();
-      Serial.println("Created new students.csv with header");
-    }
+    // Tombstone every student so the delete replicates, then empty the roster
+    rosterLocalDeleteAll();
+    rosterStoreClear();
 
     server.send(200, "text/plain", "All data deleted successfully");
   } else {
@@ -1395,16 +1395,29 @@ void handleDeleteSelectedDates() {
     for (JsonVariant date : dates) {
       String dateStr = date.as<String>();
       String fileName = getAttendanceFilePath(dateStr);
-      
-      if (SD.exists(fileName)) {
-        if (SD.remove(fileName)) {
+
+      spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+      bool existed = SD.exists(fileName);
+      bool removed = existed && SD.remove(fileName);
+      spiBusRelease(SPI_DEV_SD);
+
+      if (existed) {
+        if (removed) {
           successCount++;
+          dayIndexRemoveDay(dateStr);
+          presenceIndexRemoveDay(dateStr);
           
           // Also delete from Firebase if configured
           if (firebaseConfig.host != "" && firebaseConfig.signer.tokens.legacy_token != "") {
             String month = dateStr.substring(3, 5);  // Extract month (MM) from DD-MM-YYYY
             String path = "/attendance/" + month + "/" + dateStr;
+            firebaseAcquire();
+            Firebase.deleteNode(firebaseData, path.c_str());
+            path = "/events/" + month + "/" + dateStr;
+            Firebase.deleteNode(firebaseData, path.c_str());
+            path = "/packed/" + month + "/" + dateStr;
             Firebase.deleteNode(firebaseData, path.c_str());
+            firebaseRelease();
           }
         } else {
           failCount++;
@@ -1415,6 +1428,9 @@ void handleDeleteSelectedDates() {
       }
     }
 
+    // Today's file may have been among them
+    dayRolloverBegin();
+
     String response = "Successfully deleted " + String(successCount) + " date(s)";
     if (failCount > 0) {
       response += ", failed to delete " + String(failCount) + " date(s)";
@@ -1431,6 +1447,7 @@ void handleDeleteAllAttendance() {
   String errorMessage = "";
 
   // Iterate through the Attendance directory and delete all files
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
   File root = SD.open("/Attendance");
   if (root) {
     File monthDir = root.openNextFile();
@@ -1461,14 +1478,22 @@ void handleDeleteAllAttendance() {
     success = false;
     errorMessage = "Failed to open Attendance directory.";
   }
+  spiBusRelease(SPI_DEV_SD);
+
+  dayIndexClear();
+  monthRollupClear();
+  presenceIndexClear();
+  dayRolloverBegin();
 
   // Delete from Firebase if credentials are set
   if (firebaseConfig.host != "" && firebaseConfig.signer.tokens.legacy_token != "") {
-    String path = "/attendance";
-    if (!Firebase.deleteNode(firebaseData, path.c_str())) {
+    firebaseAcquire();
+    if (!Firebase.deleteNode(firebaseData, "/attendance") || !Firebase.deleteNode(firebaseData, "/events") ||
+        !Firebase.deleteNode(firebaseData, "/packed")) {
       success = false;
       errorMessage += "Failed to delete attendance records from Firebase. " + firebaseData.errorReason();
     }
+    firebaseRelease();
   }
 
   if (success) {
@@ -1481,31 +1506,11 @@ void handleDeleteAllAttendance() {
 void handleGetAttendanceCount() {
   if (server.hasArg("date")) {
     String date = server.arg("date");
-    String filePath = getAttendanceFilePath(date);
 
-    int presentCount = 0;
+    // Served from the day index; /api/month-summary returns a whole month at once
+    int presentCount = max(dayIndexCount(date), 0);
     int totalStudents = namid;  // Total number of students is the size of the `name` array
 
-    if (SD.exists(filePath)) {
-      File file = SD.open(filePath, FILE_READ);
-      if (file) {
-        // Skip header line
-        if (file.available()) {
-          file.readStringUntil('\n');
-        }
-
-        while (file.available()) {
-          String roll, name, id, inTime, outTime;
-          if (readAttendanceCSVLine(file, roll, name, id, inTime, outTime)) {
-            if (id.toInt() > 0) {  // Only count if fingerprint ID is valid
-              presentCount++;
-            }
-          }
-        }
-        file.close();
-      }
-    }
-
     String jsonResponse = "{\"present\":" + String(presentCount) + ",\"total\":" + String(totalStudents) + "}";
     server.send(200, "application/json", jsonResponse);
   } else {
@@ -1521,14 +1526,17 @@ void handleGetAttendanceData() {
 
   String date = server.arg("date");
   String filePath = getAttendanceFilePath(date);
-  
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
   if (!SD.exists(filePath)) {
+    spiBusRelease(SPI_DEV_SD);
     server.send(404, "text/plain", "No attendance records found for " + date);
     return;
   }
 
   File file = SD.open(filePath);
   if (!file) {
+    spiBusRelease(SPI_DEV_SD);
     server.send(500, "text/plain", "Failed to open attendance file");
     return;
   }
@@ -1581,6 +1589,7 @@ void handleGetAttendanceData() {
   }
   
   file.close();
+  spiBusRelease(SPI_DEV_SD);
 
   if (!hasRecords) {
     html += "<tr><td colspan='5' class='text-center'>No attendance records found</td></tr>";
@@ -1591,68 +1600,7 @@ void handleGetAttendanceData() {
 }
 
 // Settings management
-void handleSettings() {
-  // Read current WiFi credentials
-  String currentSSID = "";
-  String currentPassword = "";
-  readWiFiCredentials(currentSSID, currentPassword);
-
-  // Read current Firebase credentials
-  String currentFirebaseHost = "";
-  String currentFirebaseAuth = "";
-  File firebaseFile = SD.open("/firebase.txt", FILE_READ);
-  if (firebaseFile) {
-    while (firebaseFile.available()) {
-      String line = firebaseFile.readStringUntil('\n');
-      line.trim();
-      if (line.startsWith("HOST=")) {
-        currentFirebaseHost = line.substring(5);
-      } else if (line.startsWith("AUTH=")) {
-        currentFirebaseAuth = line.substring(5);
-      }
-    }
-    firebaseFile.close();
-  }
-
-  // Read current Telegram credentials
-  String currentBotToken = "";
-  String currentChatId = "";
-  File telegramFile = SD.open("/telegram.txt", FILE_READ);
-  if (telegramFile) {
-    while (telegramFile.available()) {
-      String line = telegramFile.readStringUntil('\n');
-      line.trim();
-      if (line.startsWith("BOT_TOKEN=")) {
-        currentBotToken = line.substring(10);
-      } else if (line.startsWith("CHAT_ID=")) {
-        currentChatId = line.substring(8);
-      }
-    }
-    telegramFile.close();
-  }
-
-  // Read current admin credentials (username/password)
-  String currentAdminUser = DEFAULT_USERNAME;
-  String currentAdminPass = DEFAULT_PASSWORD;
-  File adminFile = SD.open("/admin.txt", FILE_READ);
-  if (adminFile) {
-    while (adminFile.available()) {
-      String line = adminFile.readStringUntil('\n');
-      line.trim();
-      if (line.startsWith("USER=")) {
-        currentAdminUser = line.substring(5);
-      } else if (line.startsWith("PASS=")) {
-        currentAdminPass = line.substring(5);
-      }
-    }
-    adminFile.close();
-  }
-
-  // Generate CSRF token
-  String csrf = generateCSRFToken();
-  String csrfInput = "<input type='hidden' name='csrf_token' value='" + csrf + "'>";
-
-  String html = R"rawliteral(
+static constexpr char SETTINGS_TEXT[] PROGMEM = R"rawliteral(
     <!DOCTYPE html>
     <html lang="en">
     <head>
@@ -1661,7 +1609,7 @@ void handleSettings() {
         <title>Settings</title>
         <link href="https://cdn.jsdelivr.net/npm/bootstrap@5.1.3/dist/css/bootstrap.min.css" rel="stylesheet">
         <link href="https://cdnjs.cloudflare.com/ajax/libs/font-awesome/5.15.4/css/all.min.css" rel="stylesheet">
-        )rawliteral" + getGlassmorphismStyles() + R"rawliteral(
+        {{styles}}
         <style>
             .settings-section {
                 margin-bottom: 30px;
@@ -1706,7 +1654,7 @@ void handleSettings() {
         </style>
     </head>
     <body>
-    )rawliteral" + getNavbarHtml() + R"rawliteral(
+    {{navbar}}
       <div class="container mt-4">
         <div class="glass-card">
             <div class="glass-card-header">
@@ -1741,14 +1689,14 @@ void handleSettings() {
                 <div class="settings-section">
                     <h5 class="settings-title">Change Admin Credentials</h5>
                     <p class="settings-description">Change the username and password for the admin login.</p>
-                    <form id="adminForm" onsubmit="updateAdmin(event)">)rawliteral" + csrfInput + R"rawliteral(
+                    <form id="adminForm" onsubmit="updateAdmin(event)">{{csrf}}
                         <div class="mb-3">
                             <label for="adminUser" class="form-label">Username</label>
-                            <input type="text" class="form-control" id="adminUser" name="adminUser" value=")rawliteral" + currentAdminUser + R"rawliteral(" required>
+                            <input type="text" class="form-control" id="adminUser" name="adminUser" value="{{admin_user}}" required>
                         </div>
                         <div class="mb-3">
                             <label for="adminPass" class="form-label">Password</label>
-                            <input type="password" class="form-control" id="adminPass" name="adminPass" value=")rawliteral" + currentAdminPass + R"rawliteral(" required>
+                            <input type="password" class="form-control" id="adminPass" name="adminPass" value="{{admin_pass}}" required>
                         </div>
                         <button type="submit" class="btn btn-glass btn-glass-primary">
                             <i class="fas fa-save"></i> Update Admin
@@ -1759,14 +1707,14 @@ void handleSettings() {
                 <div class="settings-section">
                     <h5 class="settings-title">WiFi Settings</h5>
                     <p class="settings-description">Update WiFi credentials</p>
-                    <form id="wifiForm" onsubmit="updateWiFi(event)">)rawliteral" + csrfInput + R"rawliteral(
+                    <form id="wifiForm" onsubmit="updateWiFi(event)">{{csrf}}
                         <div class="mb-3">
                             <label for="ssid" class="form-label">WiFi SSID</label>
-                            <input type="text" class="form-control" id="ssid" name="ssid" value=")rawliteral" + currentSSID + R"rawliteral(" required>
+                            <input type="text" class="form-control" id="ssid" name="ssid" value="{{ssid}}" required>
                         </div>
                         <div class="mb-3">
                             <label for="password" class="form-label">WiFi Password</label>
-                            <input type="password" class="form-control" id="password" name="password" value=")rawliteral" + currentPassword + R"rawliteral(" required>
+                            <input type="password" class="form-control" id="password" name="password" value="{{wifi_password}}" required>
                         </div>
                         <button type="submit" class="btn btn-glass btn-glass-primary">
                             <i class="fas fa-save"></i> Update WiFi
@@ -1778,14 +1726,14 @@ void handleSettings() {
                 <div class="settings-section">
                     <h5 class="settings-title">Firebase Settings</h5>
                     <p class="settings-description">Update Firebase credentials</p>
-                    <form id="firebaseForm" onsubmit="updateFirebase(event)">)rawliteral" + csrfInput + R"rawliteral(
+                    <form id="firebaseForm" onsubmit="updateFirebase(event)">{{csrf}}
                         <div class="mb-3">
                             <label for="firebaseHost" class="form-label">Firebase Host URL</label>
-                            <input type="text" class="form-control" id="firebaseHost" name="firebaseHost" value=")rawliteral" + currentFirebaseHost + R"rawliteral(" required>
+                            <input type="text" class="form-control" id="firebaseHost" name="firebaseHost" value="{{firebase_host}}" required>
                         </div>
                         <div class="mb-3">
                             <label for="firebaseAuth" class="form-label">Firebase Auth Token</label>
-                            <input type="text" class="form-control" id="firebaseAuth" name="firebaseAuth" value=")rawliteral" + currentFirebaseAuth + R"rawliteral(" required>
+                            <input type="text" class="form-control" id="firebaseAuth" name="firebaseAuth" value="{{firebase_auth}}" required>
                         </div>
                         <button type="submit" class="btn btn-glass btn-glass-primary">
                             <i class="fas fa-save"></i> Update Firebase
@@ -1797,14 +1745,19 @@ void handleSettings() {
                 <div class="settings-section">
                     <h5 class="settings-title">Telegram Settings</h5>
                     <p class="settings-description">Update Telegram bot credentials</p>
-                    <form id="telegramForm" onsubmit="updateTelegram(event)">)rawliteral" + csrfInput + R"rawliteral(
+                    <form id="telegramForm" onsubmit="updateTelegram(event)">{{csrf}}
                         <div class="mb-3">
                             <label for="botToken" class="form-label">Bot Token</label>
-                            <input type="text" class="form-control" id="botToken" name="botToken" value=")rawliteral" + currentBotToken + R"rawliteral(" required>
+                            <input type="text" class="form-control" id="botToken" name="botToken" value="{{bot_token}}" required>
                         </div>
                         <div class="mb-3">
                             <label for="chatId" class="form-label">Chat ID</label>
-                            <input type="text" class="form-control" id="chatId" name="chatId" value=")rawliteral" + currentChatId + R"rawliteral(" required>
+                            <input type="text" class="form-control" id="chatId" name="chatId" value="{{chat_id}}" required>
+                        </div>
+                        <div class="mb-3">
+                            <label for="digestCutoff" class="form-label">Daily Absentee Digest</label>
+                            <input type="time" class="form-control" id="digestCutoff" name="digestCutoff" value="{{digest_cutoff}}">
+                            <small class="text-muted">Students not scanned in by this time are sent to the chat. Leave empty to turn it off.</small>
                         </div>
                         <button type="submit" class="btn btn-glass btn-glass-primary">
                             <i class="fas fa-save"></i> Update Telegram
@@ -1819,6 +1772,9 @@ void handleSettings() {
                     <button onclick="syncData()" class="btn btn-glass btn-glass-success">
                         <i class="fas fa-sync"></i> Sync Names & Attendance
                     </button>
+                    <button onclick="restoreTemplates()" class="btn btn-glass btn-glass-primary">
+                        <i class="fas fa-fingerprint"></i> Restore Fingerprints from SD
+                    </button>
                     <button onclick="deleteAllAttendance()" class="btn btn-glass btn-glass-danger">
                         <i class="fas fa-trash"></i> Delete All Attendance
                     </button>
@@ -1980,15 +1936,28 @@ void handleSettings() {
           function syncData() {
               showStatus('Syncing names and attendance...', false);
               fetch('/syncData', { method: 'POST' })
-                  .then(response => response.text())
-                  .then(data => {
-                      showStatus(data, data.includes('Error'));
-                  })
+                  .then(response => response.text().then(data => {
+                      showStatus(data, !response.ok);
+                  }))
                   .catch(error => {
                       showStatus('Error: ' + error, true);
                   });
           }
 
+          function restoreTemplates() {
+              if (confirm('Restore missing fingerprint templates from the SD card backups?')) {
+                  showStatus('Restoring fingerprint templates...', false);
+                  fetch('/restoreTemplates', { method: 'POST' })
+                      .then(response => response.text())
+                      .then(data => {
+                          showStatus(data, data.includes('Error'));
+                      })
+                      .catch(error => {
+                          showStatus('Error: ' + error, true);
+                      });
+              }
+          }
+
           function deleteAllAttendance() {
               if (confirm('Are you sure you want to delete all attendance records? This action cannot be undone.')) {
                   showStatus('Deleting all attendance records...', false);
@@ -2020,8 +1989,114 @@ void handleSettings() {
     </body>
     </html>
   )rawliteral";
+enum SettingsSlot {
+  SETTINGS_CSRF, SETTINGS_ADMIN_USER, SETTINGS_ADMIN_PASS, SETTINGS_SSID, SETTINGS_WIFI_PASSWORD,
+  SETTINGS_FIREBASE_HOST, SETTINGS_FIREBASE_AUTH, SETTINGS_BOT_TOKEN, SETTINGS_CHAT_ID,
+  SETTINGS_DIGEST_CUTOFF
+};
+static constexpr const char *SETTINGS_SLOTS[] = {
+    "csrf", "admin_user", "admin_pass", "ssid", "wifi_password", "firebase_host", "firebase_auth",
+    "bot_token", "chat_id", "digest_cutoff"
+};
+static constexpr auto SETTINGS_PAGE PROGMEM = PAGE_TABLE(SETTINGS_TEXT, SETTINGS_SLOTS);
 
-  server.send(200, "text/html", html);
+void handleSettings() {
+  // Read current WiFi credentials
+  String currentSSID = "";
+  String currentPassword = "";
+  readWiFiCredentials(currentSSID, currentPassword);
+
+  // Read current Firebase credentials
+  String currentFirebaseHost = "";
+  String currentFirebaseAuth = "";
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File firebaseFile = SD.open("/firebase.txt", FILE_READ);
+  if (firebaseFile) {
+    while (firebaseFile.available()) {
+      String line = firebaseFile.readStringUntil('\n');
+      line.trim();
+      if (line.startsWith("HOST=")) {
+        currentFirebaseHost = line.substring(5);
+      } else if (line.startsWith("AUTH=")) {
+        currentFirebaseAuth = line.substring(5);
+      }
+    }
+    firebaseFile.close();
+  }
+
+  // Read current Telegram credentials
+  String currentBotToken = "";
+  String currentChatId = "";
+  File telegramFile = SD.open("/telegram.txt", FILE_READ);
+  if (telegramFile) {
+    while (telegramFile.available()) {
+      String line = telegramFile.readStringUntil('\n');
+      line.trim();
+      if (line.startsWith("BOT_TOKEN=")) {
+        currentBotToken = line.substring(10);
+      } else if (line.startsWith("CHAT_ID=")) {
+        currentChatId = line.substring(8);
+      }
+    }
+    telegramFile.close();
+  }
+
+  // Read current admin credentials (username/password)
+  String currentAdminUser = DEFAULT_USERNAME;
+  String currentAdminPass = DEFAULT_PASSWORD;
+  File adminFile = SD.open("/admin.txt", FILE_READ);
+  if (adminFile) {
+    while (adminFile.available()) {
+      String line = adminFile.readStringUntil('\n');
+      line.trim();
+      if (line.startsWith("USER=")) {
+        currentAdminUser = line.substring(5);
+      } else if (line.startsWith("PASS=")) {
+        currentAdminPass = line.substring(5);
+      }
+    }
+    adminFile.close();
+  }
+  spiBusRelease(SPI_DEV_SD);
+
+  // Generate CSRF token
+  String csrf = generateCSRFToken();
+  String csrfInput = "<input type='hidden' name='csrf_token' value='" + csrf + "'>";
+
+  pageSend(SETTINGS_PAGE, [&](int slot, PageWriter &out) {
+    switch (slot) {
+      case SETTINGS_CSRF:
+        out.add(csrfInput);
+        break;
+      case SETTINGS_ADMIN_USER:
+        out.add(currentAdminUser);
+        break;
+      case SETTINGS_ADMIN_PASS:
+        out.add(currentAdminPass);
+        break;
+      case SETTINGS_SSID:
+        out.add(currentSSID);
+        break;
+      case SETTINGS_WIFI_PASSWORD:
+        out.add(currentPassword);
+        break;
+      case SETTINGS_FIREBASE_HOST:
+        out.add(currentFirebaseHost);
+        break;
+      case SETTINGS_FIREBASE_AUTH:
+        out.add(currentFirebaseAuth);
+        break;
+      case SETTINGS_BOT_TOKEN:
+        out.add(currentBotToken);
+        break;
+      case SETTINGS_CHAT_ID:
+        out.add(currentChatId);
+        break;
+      case SETTINGS_DIGEST_CUTOFF:
+        out.add(absenteeDigestCutoffText());
+        break;
+    }
+  });
 }
 
 void handleUpdateFirebase() {
@@ -2034,19 +2109,23 @@ void handleUpdateFirebase() {
     String newAuth = server.arg("firebaseAuth");
 
     // Save the new Firebase credentials to the SD card
+    spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
     File file = SD.open("/firebase.txt", FILE_WRITE);
+    bool saved = (bool)file;
     if (file) {
       file.println("HOST=" + newHost);
       file.println("AUTH=" + newAuth);
       file.close();
+    }
+    spiBusRelease(SPI_DEV_SD);
 
-      // Update the in-memory credentials
+    if (saved) {
+      // Update the in-memory credentials and reinitialize Firebase
+      firebaseAcquire();
       firebaseConfig.host = newHost.c_str();
       firebaseConfig.signer.tokens.legacy_token = newAuth.c_str();
-
-      // Reinitialize Firebase
-      Firebase.begin(&firebaseConfig, &firebaseAuth);
-      Firebase.reconnectWiFi(true);
+      beginFirebase();
+      firebaseRelease();
 
       server.send(200, "text/plain", "Firebase settings updated successfully. System will restart to apply changes.");
       delay(1000);
@@ -2073,12 +2152,17 @@ void handleUpdateWiFi() {
   String newPassword = server.arg("password");
 
   // Save new credentials to SD card
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
   File wifiFile = SD.open("/wifi.txt", FILE_WRITE);
+  bool saved = (bool)wifiFile;
   if (wifiFile) {
     wifiFile.println("SSID=" + newSSID);
     wifiFile.println("PASSWORD=" + newPassword);
     wifiFile.close();
-    server.send(200, "text/plain", "WiFi credentials updated successfully. System will restart to apply changes.");
+  }
+  spiBusRelease(SPI_DEV_SD);
+
+  if (saved) {    server.send(200, "text/plain", "WiFi credentials updated successfully. System will restart to apply changes.");
     delay(1000);
     ESP.restart();
   } else {
@@ -2098,15 +2182,29 @@ void handleUpdateTelegram() {
 
   String newBotToken = server.arg("botToken");
   String newChatId = server.arg("chatId");
+  String newCutoff = server.arg("digestCutoff");  // HH:MM, empty for no digest
+  int cutoffMinutes = absenteeDigestParseCutoff(newCutoff);
+  if (newCutoff != "" && cutoffMinutes == DIGEST_NO_CUTOFF) {
+    server.send(400, "text/plain", "Error: digest time must be HH:MM");
+    return;
+  }
 
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
   File telegramFile = SD.open("/telegram.txt", FILE_WRITE);
+  bool saved = (bool)telegramFile;
   if (telegramFile) {
     telegramFile.println("BOT_TOKEN=" + newBotToken);
     telegramFile.println("CHAT_ID=" + newChatId);
+    if (cutoffMinutes != DIGEST_NO_CUTOFF) {
+      telegramFile.println("DIGEST_CUTOFF=" + newCutoff);
+    }
     telegramFile.close();
+  }
+  spiBusRelease(SPI_DEV_SD);
 
-    telegramBotToken = newBotToken;
-    telegramChatId = newChatId;
+  if (saved) {
+    telegramSetCredentials(newBotToken, newChatId);
+    absenteeDigestSetCutoff(cutoffMinutes);
 
     server.send(200, "text/plain", "Telegram settings updated successfully");
   } else {
@@ -2127,12 +2225,17 @@ void handleUpdateAdmin() {
   String newPass = server.arg("adminPass");
 
   // Save to SD card
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
   File adminFile = SD.open("/admin.txt", FILE_WRITE);
+  bool saved = (bool)adminFile;
   if (adminFile) {
     adminFile.println("USER=" + newUser);
     adminFile.println("PASS=" + newPass);
     adminFile.close();
-    server.send(200, "text/plain", "Admin credentials updated successfully");
+  }
+  spiBusRelease(SPI_DEV_SD);
+
+  if (saved) {    server.send(200, "text/plain", "Admin credentials updated successfully");
   } else {
     server.send(500, "text/plain", "Failed to save admin credentials");
   }
@@ -2183,31 +2286,27 @@ void handleStopContinuousScanning() {
 }
 
 void handleReinitializeDisplay() {
+  spiBusAcquire(SPI_DEV_TFT, SPI_PRIO_NORMAL);
   tft.init(INITR_BLACKTAB);
   tft.setRotation(1);
-  tft.fillScreen(TFT_WHITE);
-  tft.setTextColor(TFT_BLACK);
-  tft.setTextSize(1);
-  tft.setCursor(2, 2);
-  tft.println("Display reinitialized");
+  spiBusRelease(SPI_DEV_TFT);
+  compositorInvalidate();
+  displayMessageScreen(TFT_BLACK, "Display reinitialized");
   server.send(200, "text/plain", "Display reinitialized successfully. Screen has been reset.");
 }
 
 void handleReinitializeSD() {
-  tft.fillScreen(TFT_WHITE);                // Clear the screen
-  tft.fillRect(0, 15, 128, 30, TFT_WHITE);  // Clear area below time and WiFi icon
-  tft.setCursor(2, 20);                     // Start below the time/WiFi area
-  tft.setTextColor(TFT_BLACK);              // Set text color to black
-  tft.setTextSize(1);                       // Set text size
-  tft.println("Reinitializing SD card...");
+  displayMessageScreen(TFT_BLACK, "Reinitializing SD card...");
 
   // Unmount SD card
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
   SD.end();
   delay(1000);  // Wait for SD card to be fully unmounted
 
   // Try to remount SD card
-  if (!SD.begin(SD_CS_PIN)) {
-    tft.println("Failed to reinitialize SD card!");
+  if (!SD.begin(SD_CS, SPI, SD_SPI_FREQUENCY)) {
+    spiBusRelease(SPI_DEV_SD);
+    displayLogLine("Failed to reinitialize SD card!", TFT_RED);
     server.send(500, "text/plain", "Failed to reinitialize SD card");
     return;
   }
@@ -2215,13 +2314,15 @@ void handleReinitializeSD() {
   // Test if we can read the students.csv file
   File testFile = SD.open("/students.csv", FILE_READ);
   if (!testFile) {
-    tft.println("Cannot read students.csv!");
+    spiBusRelease(SPI_DEV_SD);
+    displayLogLine("Cannot read students.csv!", TFT_RED);
     server.send(500, "text/plain", "Cannot read students.csv");
     return;
   }
   testFile.close();
+  spiBusRelease(SPI_DEV_SD);
 
-  tft.println("SD card reinitialized successfully!");
+  displayLogLine("SD card reinitialized successfully!", TFT_GREEN);
   server.send(200, "text/plain", "SD card reinitialized successfully");
 }
 
@@ -2230,9 +2331,11 @@ void handleSyncData() {
     server.send(401, "text/plain", "Unauthorized");
     return;
   }
-  uploadNamesToFirebase();
-  syncAttendanceWithFirebase();
-  server.send(200, "text/plain", "Names and attendance synced successfully.");
+  // Only records queued since the last acknowledged sync are uploaded;
+  // ?full=1 queues everything on SD again first
+  CloudSyncReport report;
+  bool ok = cloudSyncRun(report, server.arg("full") == "1");
+  server.send(ok ? 200 : 503, "text/plain", (ok ? "Sync complete. " : "Sync incomplete. ") + cloudSyncSummary(report));
 }
 
 void handleReinitializeFingerprint() {
@@ -2245,8 +2348,29 @@ void handleReinitializeFingerprint() {
   server.send(200, "text/plain", "Fingerprint sensor reinitialized successfully. Sensor is ready for scanning.");
 }
 
-void handleScanningPage() {
-  String html = R"rawliteral(
+void handleRestoreTemplates() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "text/plain", "Method Not Allowed");
+    return;
+  }
+  if (!fingerprintReady) {
+    server.send(500, "text/plain", "Error: Fingerprint sensor not ready.");
+    return;
+  }
+
+  // Scanning would compete with the restore for the sensor UART
+  bool wasScanning = isBlinking;
+  isBlinking = false;
+
+  TemplateRestoreReport report;
+  bool ok = restoreTemplatesFromSD(report, server.arg("all") != "true");
+  isBlinking = wasScanning;
+
+  String summary = templateRestoreSummary(report);
+  server.send(ok ? 200 : 500, "text/plain", ok ? summary : "Error: " + summary);
+}
+
+static constexpr char SCANNING_TEXT[] PROGMEM = R"rawliteral(
     <!DOCTYPE html>
     <html lang="en">
     <head>
@@ -2255,7 +2379,7 @@ void handleScanningPage() {
         <title>Today's Attendance Records</title>
         <link href="https://cdn.jsdelivr.net/npm/bootstrap@5.3.0/dist/css/bootstrap.min.css" rel="stylesheet">
         <link href="https://cdnjs.cloudflare.com/ajax/libs/font-awesome/6.0.0/css/all.min.css" rel="stylesheet">
-        )rawliteral" + getGlassmorphismStyles() + R"rawliteral(
+        {{styles}}
         <style>
             .container {
                 max-width: 1200px;
@@ -2374,7 +2498,7 @@ void handleScanningPage() {
         </style>
     </head>
     <body>
-        )rawliteral" + getNavbarHtml() + R"rawliteral(
+        {{navbar}}
         <div class="container">
             <div class="glass-card">
                 <h2 class="text-center mb-4">Today's Attendance Records</h2>
@@ -2390,41 +2514,7 @@ void handleScanningPage() {
                             </tr>
                         </thead>
                         <tbody id="attendanceData">
-    )rawliteral";
-
-  // Read the current day's attendance records
-  String currentDate = getCurrentDate();
-  String filePath = getAttendanceFilePath(currentDate);
-  
-  if (SD.exists(filePath)) {
-    File file = SD.open(filePath, FILE_READ);
-    if (file) {
-      // Skip header line
-      if (file.available()) {
-        file.readStringUntil('\n');
-      }
-
-      while (file.available()) {
-        String roll, name, id, inTime, outTime;
-        if (readAttendanceCSVLine(file, roll, name, id, inTime, outTime)) {
-          html += "<tr>";
-          html += "<td>" + roll + "</td>";
-          html += "<td>" + name + "</td>";
-          html += "<td>" + id + "</td>";
-          html += "<td>" + inTime + "</td>";
-          html += "<td>" + outTime + "</td>";
-          html += "</tr>";
-        }
-      }
-      file.close();
-    } else {
-      html += "<tr><td colspan='5' class='text-center'>Failed to open attendance file.</td></tr>";
-    }
-  } else {
-    html += "<tr><td colspan='5' class='text-center'>No records found for today.</td></tr>";
-  }
-
-  html += R"rawliteral(
+    {{rows}}
                         </tbody>
                     </table>
                 </div>
@@ -2516,12 +2606,51 @@ void handleScanningPage() {
     </body>
     </html>
   )rawliteral";
+enum ScanningSlot {
+  SCANNING_ROWS
+};
+static constexpr const char *SCANNING_SLOTS[] = {
+    "rows"
+};
+static constexpr auto SCANNING_PAGE PROGMEM = PAGE_TABLE(SCANNING_TEXT, SCANNING_SLOTS);
 
-  server.send(200, "text/html", html);
+void handleScanningPage() {
+  pageSend(SCANNING_PAGE, [&](int slot, PageWriter &out) {
+    // Read the current day's attendance records
+    String filePath = todayAttendancePath();
+
+    spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+    if (SD.exists(filePath)) {
+      File file = SD.open(filePath, FILE_READ);
+      if (file) {
+        // Skip header line
+        if (file.available()) {
+          file.readStringUntil('\n');
+        }
+
+        while (file.available()) {
+          String roll, name, id, inTime, outTime;
+          if (readAttendanceCSVLine(file, roll, name, id, inTime, outTime)) {
+            out.add("<tr><td>").add(roll);
+            out.add("</td><td>").add(name);
+            out.add("</td><td>").add(id);
+            out.add("</td><td>").add(inTime);
+            out.add("</td><td>").add(outTime);
+            out.add("</td></tr>");
+          }
+        }
+        file.close();
+      } else {
+        out.add("<tr><td colspan='5' class='text-center'>Failed to open attendance file.</td></tr>");
+      }
+    } else {
+      out.add("<tr><td colspan='5' class='text-center'>No records found for today.</td></tr>");
+    }
+    spiBusRelease(SPI_DEV_SD);
+  });
 }
 
-void a2z() {
-  String html = R"rawliteral(
+static constexpr char RECORDS_TEXT[] PROGMEM = R"rawliteral(
     <!DOCTYPE html>
 <html lang="en">
 <head>
@@ -2530,7 +2659,7 @@ void a2z() {
     <title>Attendance Records</title>
     <link href="https://cdn.jsdelivr.net/npm/bootstrap@5.3.0/dist/css/bootstrap.min.css" rel="stylesheet">
     <link href="https://cdnjs.cloudflare.com/ajax/libs/font-awesome/6.0.0/css/all.min.css" rel="stylesheet">
-    )rawliteral" + getGlassmorphismStyles() + R"rawliteral(
+    {{styles}}
     <style>
     :root {
         --primary-color: #2c3e50;
@@ -3075,7 +3204,7 @@ void a2z() {
     </style>
 </head>
 <body>
-  )rawliteral" + getNavbarHtml() + R"rawliteral(
+  {{navbar}}
    <div class="container">
         <div class="glass-card">
     <script>
@@ -3083,44 +3212,7 @@ void a2z() {
       let currentMonth = new Date().getMonth();
       let currentYear = new Date().getFullYear();
       let attendanceDates = [
-)rawliteral";
-
-  // Collect attendance date strings in the JavaScript array
-  bool hasEntries = false;
-  File root = SD.open("/Attendance");
-  if (root) {
-    File monthDir = root.openNextFile();
-    while (monthDir) {
-      if (monthDir.isDirectory()) {
-        String monthPath = "/Attendance/" + String(monthDir.name());
-        File dateDir = SD.open(monthPath);
-        if (dateDir) {
-          File file = dateDir.openNextFile();
-          while (file) {
-            String fileName = file.name();
-            if (fileName.endsWith(".csv") && fileName.length() == 14) {  // Changed from .txt to .csv
-              String date = fileName.substring(0, fileName.length() - 4);
-              html += "        \"" + date + "\",\n";
-              hasEntries = true;
-            }
-            file = dateDir.openNextFile();
-          }
-          dateDir.close();
-        }
-      }
-      monthDir = root.openNextFile();
-    }
-    root.close();
-  }
-  
-  // Remove trailing comma if entries exist
-  if (hasEntries) {
-    // Trim the trailing comma and newline
-    html = html.substring(0, html.length() - 2);
-    html += "\n";
-  }
-
-  html += R"rawliteral(
+{{dates}}
       ];
 
 </script>
@@ -3359,21 +3451,6 @@ void a2z() {
                         toggleTable(date);
                     }
                 };
-
-                // Fetch attendance count
-                fetch('/getAttendanceCount?date=' + date)
-                    .then(response => response.json())
-                    .then(data => {
-                        const presentCount = data.present || 0;
-                        const totalStudents = data.total || 0;
-                        const countElement = document.createElement('div');
-                        countElement.className = 'attendance-count';
-                        countElement.textContent = presentCount + '/' + totalStudents;
-                        dayCell.appendChild(countElement);
-                    })
-                    .catch(error => {
-                        console.error('Error fetching attendance count:', error);
-                    });
             }
 
             // Check if this is a future date
@@ -3384,6 +3461,31 @@ void a2z() {
 
             calendarGrid.appendChild(dayCell);
         }
+
+        // Fetch the month's attendance counts in one request
+        const shownMonth = currentMonth;
+        const shownYear = currentYear;
+        fetch(`/api/month-summary?month=${currentMonth + 1}&year=${currentYear}`)
+            .then(response => response.json())
+            .then(data => {
+                if (shownMonth !== currentMonth || shownYear !== currentYear) {
+                    return;  // Already showing another month
+                }
+                const totalStudents = data.total || 0;
+                Object.entries(data.days || {}).forEach(([date, presentCount]) => {
+                    const dayCell = calendarGrid.querySelector(`.calendar-day[data-date="${date}"]`);
+                    if (!dayCell) {
+                        return;
+                    }
+                    const countElement = document.createElement('div');
+                    countElement.className = 'attendance-count';
+                    countElement.textContent = presentCount + '/' + totalStudents;
+                    dayCell.appendChild(countElement);
+                });
+            })
+            .catch(error => {
+                console.error('Error fetching attendance counts:', error);
+            });
     }
 
     function previousMonth() {
@@ -3678,8 +3780,66 @@ void a2z() {
 
 </html>
   )rawliteral";
+enum RecordsSlot {
+  RECORDS_DATES
+};
+static constexpr const char *RECORDS_SLOTS[] = {
+    "dates"
+};
+static constexpr auto RECORDS_PAGE PROGMEM = PAGE_TABLE(RECORDS_TEXT, RECORDS_SLOTS);
 
-  server.send(200, "text/html", html);
+void a2z() {
+  pageSend(RECORDS_PAGE, [&](int slot, PageWriter &out) {
+    // Collect attendance date strings in the JavaScript array
+    bool hasEntries = false;
+    spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+    File root = SD.open("/Attendance");
+    if (root) {
+      File monthDir = root.openNextFile();
+      while (monthDir) {
+        if (monthDir.isDirectory()) {
+          String monthPath = "/Attendance/" + String(monthDir.name());
+          File dateDir = SD.open(monthPath);
+          if (dateDir) {
+            File file = dateDir.openNextFile();
+            while (file) {
+              String fileName = file.name();
+              if (fileName.endsWith(".csv") && fileName.length() == 14) {  // Changed from .txt to .csv
+                if (hasEntries) out.add(",\n");
+                out.add("        \"").add(fileName.c_str(), fileName.length() - 4).add("\"");
+                hasEntries = true;
+              }
+              file = dateDir.openNextFile();
+            }
+            dateDir.close();
+          }
+        }
+        monthDir = root.openNextFile();
+      }
+      root.close();
+    }
+    spiBusRelease(SPI_DEV_SD);
+    if (hasEntries) out.add("\n");
+  });
+}
+
+// Stream an export file through one buffer instead of reading it all
+// into a String
+static void sendExportFile(File &file) {
+  uint8_t fallback[512];
+  uint8_t *buffer = (uint8_t *)memAlloc(EXPORT_CHUNK_BYTES, MEM_USE_EXPORT);
+  size_t chunk = buffer ? EXPORT_CHUNK_BYTES : sizeof(fallback);
+  if (!buffer) buffer = fallback;
+
+  while (true) {
+    // The bus is only held for each read, not while the chunk goes out
+    spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+    size_t n = file.available() ? file.read(buffer, chunk) : 0;
+    spiBusRelease(SPI_DEV_SD);
+    if (n == 0) break;
+    server.sendContent((const char *)buffer, n);
+  }
+  if (buffer != fallback) memFree(buffer, MEM_USE_EXPORT);
 }
 
 void handleExportAttendance() {
@@ -3691,8 +3851,10 @@ void handleExportAttendance() {
     // Check if it's an export all request
     if (server.hasArg("all") && server.arg("all") == "true") {
         // Create a temporary file to store all records
+        spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
         File tempFile = SD.open("/temp_export.csv", FILE_WRITE);
         if (!tempFile) {
+            spiBusRelease(SPI_DEV_SD);
             server.send(500, "text/plain", "Failed to create export file");
             return;
         }
@@ -3747,6 +3909,7 @@ void handleExportAttendance() {
 
         // Send the file
         File downloadFile = SD.open("/temp_export.csv", FILE_READ);
+        spiBusRelease(SPI_DEV_SD);
         if (downloadFile) {
             server.sendHeader("Content-Type", "application/octet-stream");
             server.sendHeader("Content-Disposition", "attachment; filename=all_attendance.csv");
@@ -3755,13 +3918,13 @@ void handleExportAttendance() {
             server.sendHeader("Pragma", "no-cache");
             server.sendHeader("Expires", "0");
             
-            while (downloadFile.available()) {
-                server.sendContent(downloadFile.readString());
-            }
-            downloadFile.close();
-            
+            sendExportFile(downloadFile);
+
             // Clean up
+            spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+            downloadFile.close();
             SD.remove("/temp_export.csv");
+            spiBusRelease(SPI_DEV_SD);
         } else {
             server.send(500, "text/plain", "Failed to read export file");
         }
@@ -3774,8 +3937,10 @@ void handleExportAttendance() {
         String year = server.arg("year");
         if (month.length() == 2 && year.length() == 4) {
             // Create a temporary file to store the records
+            spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
             File tempFile = SD.open("/temp_export.csv", FILE_WRITE);
             if (!tempFile) {
+                spiBusRelease(SPI_DEV_SD);
                 server.send(500, "text/plain", "Failed to create export file");
                 return;
             }
@@ -3822,6 +3987,7 @@ void handleExportAttendance() {
 
             // Send the file
             File downloadFile = SD.open("/temp_export.csv", FILE_READ);
+            spiBusRelease(SPI_DEV_SD);
             if (downloadFile) {
                 server.sendHeader("Content-Type", "text/csv");
                 server.sendHeader("Content-Disposition", "attachment; filename=attendance_" + month + "_" + year + ".csv");
@@ -3829,13 +3995,13 @@ void handleExportAttendance() {
                 server.sendHeader("Cache-Control", "no-cache");
                 server.sendHeader("Pragma", "no-cache");
                 
-                while (downloadFile.available()) {
-                    server.sendContent(downloadFile.readString());
-                }
-                downloadFile.close();
-                
+                sendExportFile(downloadFile);
+
                 // Clean up
+                spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+                downloadFile.close();
                 SD.remove("/temp_export.csv");
+                spiBusRelease(SPI_DEV_SD);
             } else {
                 server.send(500, "text/plain", "Failed to read export file");
             }
@@ -3856,8 +4022,10 @@ void handleExportAttendance() {
         }
         if (!dates.empty()) {
             // Create a temporary file to store the records
+            spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
             File tempFile = SD.open("/temp_export.csv", FILE_WRITE);
             if (!tempFile) {
+                spiBusRelease(SPI_DEV_SD);
                 server.send(500, "text/plain", "Failed to create export file");
                 return;
             }
@@ -3894,6 +4062,7 @@ void handleExportAttendance() {
 
             // Send the file
             File downloadFile = SD.open("/temp_export.csv", FILE_READ);
+            spiBusRelease(SPI_DEV_SD);
             if (downloadFile) {
                 server.sendHeader("Content-Type", "text/csv");
                 server.sendHeader("Content-Disposition", "attachment; filename=selected_attendance.csv");
@@ -3901,13 +4070,13 @@ void handleExportAttendance() {
                 server.sendHeader("Cache-Control", "no-cache");
                 server.sendHeader("Pragma", "no-cache");
                 
-                while (downloadFile.available()) {
-                    server.sendContent(downloadFile.readString());
-                }
-                downloadFile.close();
-                
+                sendExportFile(downloadFile);
+
                 // Clean up
+                spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+                downloadFile.close();
                 SD.remove("/temp_export.csv");
+                spiBusRelease(SPI_DEV_SD);
             } else {
                 server.send(500, "text/plain", "Failed to read export file");
             }
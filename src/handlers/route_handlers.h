@@ -14,6 +14,7 @@ void handleScanFingerprint();
 // Student management
 void handleShowname();
 void handleDltname();
+void handleDeleteStudents();
 void handleDeleteAllStudents();
 
 // Attendance management
@@ -37,9 +38,11 @@ void handleStopContinuousScanning();
 void handleReinitializeDisplay();
 void handleReinitializeSD();
 void handleReinitializeFingerprint();
+void handleRestoreTemplates();
 void handleSyncData();
 
 // Export functions
+#define EXPORT_CHUNK_BYTES 8192  // Read and sent per step
 void handleExportAttendance();
 void exportAllAttendanceRecords();
 void exportMonthAttendanceRecords(String month, String year);
@@ -0,0 +1,300 @@
+#include "attendance_query.h"
+#include <string.h>
+#include <math.h>
+
+// Days since 1970-01-01 for a civil date (proleptic Gregorian)
+int32_t queryDayNumber(int day, int month, int year) {
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  uint32_t yearOfEra = (uint32_t)(year - era * 400);
+  uint32_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + (int32_t)dayOfEra - 719468;
+}
+
+void queryDateOf(int32_t dayNumber, int &day, int &month, int &year) {
+  dayNumber += 719468;
+  int32_t era = (dayNumber >= 0 ? dayNumber : dayNumber - 146096) / 146097;
+  uint32_t dayOfEra = (uint32_t)(dayNumber - era * 146097);
+  uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  uint32_t monthIndex = (5 * dayOfYear + 2) / 153;
+  day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+  month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+  year = (int)(yearOfEra + era * 400) + (month <= 2);
+}
+
+static int parseDigits(const char *&p, const char *end, int maxDigits) {
+  int value = 0, digits = 0;
+  while (p < end && digits < maxDigits && *p >= '0' && *p <= '9') {
+    value = value * 10 + (*p++ - '0');
+    digits++;
+  }
+  return digits ? value : -1;
+}
+
+// DD-MM-YYYY, the day file naming
+bool queryParseDate(const char *text, int32_t &dayNumber) {
+  const char *end = text + strlen(text);
+  const char *p = text;
+  int day = parseDigits(p, end, 2);
+  if (p >= end || *p++ != '-') return false;
+  int month = parseDigits(p, end, 2);
+  if (p >= end || *p++ != '-') return false;
+  int year = parseDigits(p, end, 4);
+  if (p != end || day < 1 || day > 31 || month < 1 || month > 12 || year < 1970) return false;
+  dayNumber = queryDayNumber(day, month, year);
+  return true;
+}
+
+// "hh:mm:ss AM", optionally with the provisional "~"; anything else is no time
+uint32_t queryParseTime(const char *text, size_t length) {
+  const char *end = text + length;
+  while (end > text && (end[-1] == ' ' || end[-1] == '\r')) end--;
+  const char *p = text;
+  while (p < end && (*p == ' ' || *p == '~')) p++;
+
+  int hour = parseDigits(p, end, 2);
+  if (hour < 0 || p >= end || *p++ != ':') return QUERY_NO_TIME;
+  int minute = parseDigits(p, end, 2);
+  if (minute < 0 || p >= end || *p++ != ':') return QUERY_NO_TIME;
+  int second = parseDigits(p, end, 2);
+  if (second < 0) return QUERY_NO_TIME;
+
+  if (end - p >= 2 && end[-1] == 'M') {
+    if (end[-2] == 'P' && hour < 12) {
+      hour += 12;
+    } else if (end[-2] == 'A' && hour == 12) {
+      hour = 0;
+    }
+  }
+  if (hour > 23 || minute > 59 || second > 59) return QUERY_NO_TIME;
+  return hour * 3600 + minute * 60 + second;
+}
+
+// One day-file row: Roll Number,Name,Fingerprint ID,In Time,Out Time.
+// Fields may be quoted with doubled quotes inside, as escapeCSV() writes them.
+bool queryParseRow(const char *line, size_t length, QueryRow &row) {
+  while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' ')) length--;
+
+  const char *start[5];
+  size_t size[5];
+  int fields = 0;
+  size_t fieldStart = 0;
+  bool inQuotes = false;
+  for (size_t i = 0; i <= length && fields < 5; i++) {
+    if (i < length && line[i] == '"') {
+      inQuotes = !inQuotes;
+    } else if (i == length || (line[i] == ',' && !inQuotes)) {
+      start[fields] = line + fieldStart;
+      size[fields] = i - fieldStart;
+      fields++;
+      fieldStart = i + 1;
+    }
+  }
+  if (fields < 5) return false;
+
+  // Roll, unquoted into the fixed buffer
+  const char *roll = start[0];
+  size_t rollSize = size[0];
+  bool quoted = rollSize >= 2 && roll[0] == '"' && roll[rollSize - 1] == '"';
+  if (quoted) {
+    roll++;
+    rollSize -= 2;
+  }
+  size_t out = 0;
+  for (size_t i = 0; i < rollSize && out < QUERY_ROLL_LEN - 1; i++) {
+    if (quoted && roll[i] == '"' && i + 1 < rollSize && roll[i + 1] == '"') i++;
+    row.roll[out++] = roll[i];
+  }
+  row.roll[out] = '\0';
+
+  const char *p = start[2];
+  int id = parseDigits(p, start[2] + size[2], 5);
+  // Out of range IDs are malformed, not wrapped onto a real student
+  if (id <= 0 || id > QUERY_MAX_ID || p != start[2] + size[2]) return false;
+  row.id = id;
+  row.inTime = queryParseTime(start[3], size[3]);
+  row.outTime = queryParseTime(start[4], size[4]);
+  return true;
+}
+
+void queryInit(AttendanceQuery &query, int32_t fromDay, int32_t toDay) {
+  memset(&query, 0, sizeof(query));
+  query.fromDay = fromDay;
+  query.toDay = toDay;
+  query.lateAfter = QUERY_NO_TIME;
+}
+
+void queryAllowId(AttendanceQuery &query, uint16_t id) {
+  if (id > QUERY_MAX_ID) return;
+  query.idFilter = true;
+  query.idMask[id / 8] |= 1 << (id % 8);
+}
+
+bool queryAllowRoll(AttendanceQuery &query, const char *roll) {
+  if (query.rollCount >= QUERY_MAX_ROLLS) return false;
+  strncpy(query.rolls[query.rollCount], roll, QUERY_ROLL_LEN - 1);
+  query.rolls[query.rollCount][QUERY_ROLL_LEN - 1] = '\0';
+  query.rollCount++;
+  return true;
+}
+
+// With both filters set a row passes if either one names it
+bool queryMatches(const AttendanceQuery &query, uint16_t id, const char *roll) {
+  if (!query.idFilter && query.rollCount == 0) return true;
+  if (query.idFilter && id <= QUERY_MAX_ID && (query.idMask[id / 8] & (1 << (id % 8)))) return true;
+  for (int i = 0; i < query.rollCount; i++) {
+    if (strcmp(query.rolls[i], roll) == 0) return true;
+  }
+  return false;
+}
+
+void queryBegin(QueryResult &result) {
+  memset(&result, 0, sizeof(result));
+  memset(result.slotById, 0xFF, sizeof(result.slotById));  // -1: no slot yet
+}
+
+static StudentAggregate *slotFor(QueryResult &result, uint16_t id, const char *roll) {
+  if (id > QUERY_MAX_ID) return NULL;
+  int16_t slot = result.slotById[id];
+  if (slot < 0) {
+    if (result.studentCount >= QUERY_MAX_STUDENTS) return NULL;
+    slot = result.studentCount++;
+    result.slotById[id] = slot;
+    StudentAggregate &student = result.students[slot];
+    student.id = id;
+    student.in.min = student.out.min = QUERY_NO_TIME;
+  }
+  StudentAggregate &student = result.students[slot];
+  strncpy(student.roll, roll, QUERY_ROLL_LEN - 1);  // Latest roll wins
+  student.roll[QUERY_ROLL_LEN - 1] = '\0';
+  return &student;
+}
+
+// Enrolled students get a slot up front so ones never present still show
+void querySeedStudent(const AttendanceQuery &query, QueryResult &result, uint16_t id, const char *roll) {
+  if (queryMatches(query, id, roll)) {
+    slotFor(result, id, roll);
+  }
+}
+
+static void addTime(TimeStats &stats, uint32_t seconds) {
+  stats.count++;
+  if (seconds < stats.min) stats.min = seconds;
+  if (seconds > stats.max) stats.max = seconds;
+  stats.sum += seconds;
+  stats.sumSquares += (uint64_t)seconds * seconds;
+}
+
+void queryAddRow(const AttendanceQuery &query, QueryResult &result, const QueryRow &row) {
+  result.rowsScanned++;
+  if (!queryMatches(query, row.id, row.roll)) return;
+  StudentAggregate *student = slotFor(result, row.id, row.roll);
+  if (!student) {
+    result.rowsDropped++;
+    return;
+  }
+  result.rowsMatched++;
+  student->daysPresent++;
+
+  if (row.inTime != QUERY_NO_TIME) {
+    addTime(student->in, row.inTime);
+    result.inHistogram[row.inTime / QUERY_BUCKET_SECONDS]++;
+    if (query.lateAfter != QUERY_NO_TIME && row.inTime > query.lateAfter) {
+      student->lateDays++;
+    }
+  }
+  if (row.outTime != QUERY_NO_TIME) {
+    addTime(student->out, row.outTime);
+    result.outHistogram[row.outTime / QUERY_BUCKET_SECONDS]++;
+    if (row.inTime != QUERY_NO_TIME && row.outTime >= row.inTime) {
+      student->workedSeconds += row.outTime - row.inTime;
+    }
+  }
+}
+
+void queryBeginDay(QueryLineState &state) {
+  state.length = 0;
+  state.overflow = false;
+  state.header = true;
+  state.dropped = 0;
+}
+
+static void finishLine(QueryLineState &state, QueryRowSink sink, void *context) {
+  if (state.header) {
+    state.header = false;
+  } else if (state.overflow) {
+    state.dropped++;
+  } else if (state.length > 0) {
+    QueryRow row;
+    if (queryParseRow(state.line, state.length, row)) {
+      sink(row, context);
+    } else if (state.length > 1) {
+      state.dropped++;
+    }
+  }
+  state.length = 0;
+  state.overflow = false;
+}
+
+// Split a chunk of a day file into rows; the header line is skipped
+void queryFeedRows(QueryLineState &state, const char *data, size_t length, QueryRowSink sink, void *context) {
+  while (length > 0) {
+    const char *newline = (const char *)memchr(data, '\n', length);
+    size_t take = newline ? (size_t)(newline - data) : length;
+    if (!state.overflow) {
+      if (state.length + take < QUERY_LINE_MAX) {
+        memcpy(state.line + state.length, data, take);
+        state.length += take;
+      } else {
+        state.overflow = true;
+      }
+    }
+    if (!newline) return;
+    finishLine(state, sink, context);
+    data = newline + 1;
+    length -= take + 1;
+  }
+}
+
+// A last line without a newline
+void queryEndRows(QueryLineState &state, QueryRowSink sink, void *context) {
+  if (state.length > 0 || state.overflow) {
+    finishLine(state, sink, context);
+  }
+}
+
+struct AggregateSink {
+  const AttendanceQuery *query;
+  QueryResult *result;
+};
+
+static void aggregateRow(const QueryRow &row, void *context) {
+  AggregateSink *sink = (AggregateSink *)context;
+  queryAddRow(*sink->query, *sink->result, row);
+}
+
+void queryFeed(const AttendanceQuery &query, QueryResult &result, QueryLineState &state, const char *data, size_t length) {
+  AggregateSink sink = {&query, &result};
+  result.bytesScanned += length;
+  queryFeedRows(state, data, length, aggregateRow, &sink);
+}
+
+void queryEndDay(const AttendanceQuery &query, QueryResult &result, QueryLineState &state) {
+  AggregateSink sink = {&query, &result};
+  queryEndRows(state, aggregateRow, &sink);
+  result.rowsDropped += state.dropped;
+  result.daysScanned++;
+}
+
+uint32_t queryMean(const TimeStats &stats) {
+  return stats.count ? (uint32_t)(stats.sum / stats.count) : QUERY_NO_TIME;
+}
+
+uint32_t queryStdDev(const TimeStats &stats) {
+  if (stats.count < 2) return 0;
+  double mean = (double)stats.sum / stats.count;
+  double variance = (double)stats.sumSquares / stats.count - mean * mean;
+  return variance > 0 ? (uint32_t)sqrt(variance) : 0;
+}
@@ -0,0 +1,111 @@
+#ifndef ATTENDANCE_QUERY_H
+#define ATTENDANCE_QUERY_H
+
+// Date-range aggregates over the day files, in one streaming pass.
+//
+// Day files are fed through in chunks of any size; rows are parsed in
+// place from a fixed line buffer and folded into one slot per student,
+// so memory is the same for a week or for five years. The caller decides
+// which day files to feed (src/components/reports.cpp walks the day index).
+//
+// Plain C++ with no Arduino types, so tools/bench can build it on a PC.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define QUERY_MAX_STUDENTS 128          // Matches the name table
+#define QUERY_MAX_ID 1023               // Highest fingerprint ID tracked
+#define QUERY_MAX_ROLLS 16              // Roll numbers in one filter
+#define QUERY_ROLL_LEN 16
+#define QUERY_LINE_MAX 192              // Longer rows are skipped
+#define QUERY_BUCKET_SECONDS 1800       // Histogram bucket width
+#define QUERY_BUCKETS (86400 / QUERY_BUCKET_SECONDS)
+#define QUERY_NO_TIME 0xFFFFFFFF        // Same value as TIME_OF_DAY_NONE
+
+struct QueryRow {
+  uint16_t id;
+  char roll[QUERY_ROLL_LEN];
+  uint32_t inTime;   // Seconds of day
+  uint32_t outTime;  // Seconds of day, QUERY_NO_TIME if never scanned out
+};
+
+// Running distribution of a time of day
+struct TimeStats {
+  uint16_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint64_t sumSquares;
+};
+
+struct StudentAggregate {
+  uint16_t id;
+  char roll[QUERY_ROLL_LEN];
+  uint16_t daysPresent;
+  uint16_t lateDays;
+  TimeStats in;
+  TimeStats out;
+  uint64_t workedSeconds;  // Over days with both an in- and an out-time
+};
+
+struct AttendanceQuery {
+  int32_t fromDay;     // queryDayNumber(), inclusive
+  int32_t toDay;
+  uint32_t lateAfter;  // In-times after this are late; QUERY_NO_TIME to skip
+  bool idFilter;
+  uint8_t idMask[(QUERY_MAX_ID + 8) / 8];
+  uint8_t rollCount;
+  char rolls[QUERY_MAX_ROLLS][QUERY_ROLL_LEN];
+};
+
+struct QueryResult {
+  StudentAggregate students[QUERY_MAX_STUDENTS];
+  uint16_t studentCount;
+  int16_t slotById[QUERY_MAX_ID + 1];
+  uint32_t inHistogram[QUERY_BUCKETS];
+  uint32_t outHistogram[QUERY_BUCKETS];
+  uint32_t daysScanned;
+  uint32_t rowsScanned;
+  uint32_t rowsMatched;
+  uint32_t rowsDropped;  // Malformed, or more students than slots
+  uint64_t bytesScanned;
+};
+
+// Where a day file is in the stream
+struct QueryLineState {
+  char line[QUERY_LINE_MAX];
+  size_t length;
+  bool overflow;
+  bool header;       // Still on the header line
+  uint32_t dropped;  // Rows too long or malformed
+};
+
+// Receives each parsed row when a day file is split without aggregating
+typedef void (*QueryRowSink)(const QueryRow &row, void *context);
+
+// Function declarations for the attendance query engine
+int32_t queryDayNumber(int day, int month, int year);
+void queryDateOf(int32_t dayNumber, int &day, int &month, int &year);
+bool queryParseDate(const char *text, int32_t &dayNumber);
+uint32_t queryParseTime(const char *text, size_t length);
+bool queryParseRow(const char *line, size_t length, QueryRow &row);
+
+void queryInit(AttendanceQuery &query, int32_t fromDay, int32_t toDay);
+void queryAllowId(AttendanceQuery &query, uint16_t id);
+bool queryAllowRoll(AttendanceQuery &query, const char *roll);
+bool queryMatches(const AttendanceQuery &query, uint16_t id, const char *roll);
+
+void queryBegin(QueryResult &result);
+void querySeedStudent(const AttendanceQuery &query, QueryResult &result, uint16_t id, const char *roll);
+void queryAddRow(const AttendanceQuery &query, QueryResult &result, const QueryRow &row);
+
+void queryBeginDay(QueryLineState &state);
+void queryFeed(const AttendanceQuery &query, QueryResult &result, QueryLineState &state, const char *data, size_t length);
+void queryEndDay(const AttendanceQuery &query, QueryResult &result, QueryLineState &state);
+void queryFeedRows(QueryLineState &state, const char *data, size_t length, QueryRowSink sink, void *context);
+void queryEndRows(QueryLineState &state, QueryRowSink sink, void *context);
+
+uint32_t queryMean(const TimeStats &stats);
+uint32_t queryStdDev(const TimeStats &stats);
+
+#endif // ATTENDANCE_QUERY_H
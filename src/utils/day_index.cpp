@@ -0,0 +1,259 @@
+#include "day_index.h"
+#include "sd_utils.h"
+#include "spi_bus.h"
+#include "logger.h"
+#include "month_rollup.h"
+#include <vector>
+
+// The month last asked for. The calendar and the scan path mostly ask for
+// the same one, so a single slot is enough.
+static String cachedKey = "";  // "MM-YYYY"
+static int16_t cachedCounts[32];
+static bool cachedHasLog = false;
+static int cachedLines = 0;
+
+static String monthKey(int month, int year) {
+  char key[8];
+  snprintf(key, sizeof(key), "%02d-%04d", month, year);
+  return String(key);
+}
+
+// An unknown day counts from zero; a count never goes below zero
+static int16_t addToCount(int16_t count, int delta) {
+  int sum = (count == DAY_INDEX_UNKNOWN ? 0 : count) + delta;
+  return sum < 0 ? 0 : sum;
+}
+
+static String monthDir(const String &key) {
+  return "/Attendance/" + key.substring(0, 2);
+}
+
+static String indexPath(const String &key) {
+  return monthDir(key) + "/index-" + key.substring(3) + ".log";
+}
+
+// Rows with a valid fingerprint ID, as /getAttendanceCount has always counted
+static int countDayFile(const String &path) {
+  File file = SD.open(path, FILE_READ);
+  if (!file) return DAY_INDEX_UNKNOWN;
+
+  int present = 0;
+  if (file.available()) {
+    file.readStringUntil('\n');  // Header
+  }
+  while (file.available()) {
+    String roll, studentName, id, inTime, outTime;
+    if (readAttendanceCSVLine(file, roll, studentName, id, inTime, outTime) && id.toInt() > 0) {
+      present++;
+    }
+  }
+  file.close();
+  return present;
+}
+
+// Replace the log with one line per known day
+static bool writeCompacted() {
+  String path = indexPath(cachedKey);
+  String tempPath = path + ".tmp";
+  File file = SD.open(tempPath, FILE_WRITE);
+  if (!file) return false;
+  for (int day = 1; day <= 31; day++) {
+    if (cachedCounts[day] != DAY_INDEX_UNKNOWN) {
+      file.printf("%02d,%d\n", day, cachedCounts[day]);
+    }
+  }
+  file.close();
+
+  if (SD.exists(path) && !SD.remove(path)) return false;
+  cachedHasLog = SD.rename(tempPath, path);
+  cachedLines = 0;
+  return cachedHasLog;
+}
+
+// Count the month from its day files and write a fresh log
+static void rebuildMonth() {
+  String dirPath = monthDir(cachedKey);
+  String suffix = "-" + cachedKey + ".csv";
+  File dir = SD.open(dirPath);
+  if (!dir) return;  // No day files yet; nothing to persist either
+
+  File file = dir.openNextFile();
+  while (file) {
+    String fileName = file.name();
+    file.close();
+    if (fileName.length() == 14 && fileName.endsWith(suffix)) {
+      int day = fileName.substring(0, 2).toInt();
+      if (day >= 1 && day <= 31) {
+        cachedCounts[day] = countDayFile(dirPath + "/" + fileName);
+      }
+    }
+    file = dir.openNextFile();
+  }
+  dir.close();
+
+  if (!writeCompacted()) {
+    LOG_WARN("Failed to write day index for %s", cachedKey.c_str());
+  }
+}
+
+// Make key the cached month. Returns true when the counts were just taken
+// from the day files, so they already include whatever the caller changed.
+static bool loadMonth(const String &key, bool rebuild = false) {
+  if (!rebuild && key == cachedKey) return false;
+
+  cachedKey = key;
+  cachedHasLog = false;
+  cachedLines = 0;
+  for (int day = 0; day < 32; day++) {
+    cachedCounts[day] = DAY_INDEX_UNKNOWN;
+  }
+
+  File log = rebuild ? File() : SD.open(indexPath(key), FILE_READ);
+  if (!log) {
+    rebuildMonth();
+    return true;
+  }
+
+  while (log.available()) {
+    String line = log.readStringUntil('\n');
+    int comma = line.indexOf(',');
+    int day = line.toInt();
+    if (comma < 0 || day < 1 || day > 31) continue;
+    cachedLines++;
+    if (line.charAt(comma + 1) == 'x') {
+      cachedCounts[day] = DAY_INDEX_UNKNOWN;
+      continue;
+    }
+    cachedCounts[day] = addToCount(cachedCounts[day], line.substring(comma + 1).toInt());
+  }
+  log.close();
+  cachedHasLog = true;
+
+  if (cachedLines > DAY_INDEX_COMPACT_LINES) {
+    writeCompacted();
+  }
+  return false;
+}
+
+static void appendLine(int day, const String &value) {
+  if (!cachedHasLog) {
+    writeCompacted();  // The month directory did not exist when the month was loaded
+    return;
+  }
+  File log = SD.open(indexPath(cachedKey), FILE_APPEND);
+  if (!log) return;
+  log.printf("%02d,%s\n", day, value.c_str());
+  log.close();
+  if (++cachedLines > DAY_INDEX_COMPACT_LINES) {
+    writeCompacted();
+  }
+}
+
+bool dayIndexMonth(int month, int year, int16_t counts[32], bool rebuild) {
+  if (!sdCardInitialized) return false;
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  loadMonth(monthKey(month, year), rebuild);
+  memcpy(counts, cachedCounts, sizeof(cachedCounts));
+  spiBusRelease(SPI_DEV_SD);
+  return true;
+}
+
+int dayIndexCount(const String &date) {
+  int16_t counts[32];
+  int day = date.substring(0, 2).toInt();
+  if (day < 1 || day > 31 || !dayIndexMonth(date.substring(3, 5).toInt(), date.substring(6).toInt(), counts)) {
+    return DAY_INDEX_UNKNOWN;
+  }
+  return counts[day];
+}
+
+// A day file was created (delta 0) or gained or lost rows. Call after the
+// day file itself has been written.
+void dayIndexAdjust(const String &date, int delta) {
+  int day = date.substring(0, 2).toInt();
+  if (day < 1 || day > 31) return;
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  if (!loadMonth(date.substring(3))) {
+    cachedCounts[day] = addToCount(cachedCounts[day], delta);
+    appendLine(day, (delta >= 0 ? "+" : "") + String(delta));
+  }
+  spiBusRelease(SPI_DEV_SD);
+  monthRollupInvalidate(date);
+}
+
+// The day file was deleted
+void dayIndexRemoveDay(const String &date) {
+  int day = date.substring(0, 2).toInt();
+  if (day < 1 || day > 31) return;
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  if (!loadMonth(date.substring(3))) {
+    cachedCounts[day] = DAY_INDEX_UNKNOWN;
+    appendLine(day, "x");
+  }
+  spiBusRelease(SPI_DEV_SD);
+  monthRollupInvalidate(date);
+}
+
+// Drop every log; months are counted again from whatever day files remain
+void dayIndexClear() {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  cachedKey = "";
+  File root = SD.open("/Attendance");
+  if (root) {
+    File dir = root.openNextFile();
+    while (dir) {
+      if (dir.isDirectory()) {
+        String dirPath = "/Attendance/" + String(dir.name());
+        std::vector<String> logs;
+        File month = SD.open(dirPath);
+        File file = month ? month.openNextFile() : File();
+        while (file) {
+          String fileName = file.name();
+          if (fileName.startsWith("index-")) {
+            logs.push_back(dirPath + "/" + fileName);
+          }
+          file = month.openNextFile();
+        }
+        if (month) month.close();
+        for (const String &path : logs) {
+          SD.remove(path);
+        }
+      }
+      dir = root.openNextFile();
+    }
+    root.close();
+  }
+  spiBusRelease(SPI_DEV_SD);
+}
+
+// GET /api/month-summary?month=3&year=2025[&rebuild=1]
+// {"month":3,"year":2025,"total":120,"days":{"03-03-2025":97,...}}
+void handleMonthSummary() {
+  int month = server.arg("month").toInt();
+  int year = server.arg("year").toInt();
+  if (month < 1 || month > 12 || year < 2000 || year > 2099) {
+    server.send(400, "application/json", "{\"error\":\"month and year required\"}");
+    return;
+  }
+
+  int16_t counts[32];
+  if (!dayIndexMonth(month, year, counts, server.arg("rebuild") == "1")) {
+    server.send(503, "application/json", "{\"error\":\"SD card not available\"}");
+    return;
+  }
+
+  String json = "{\"month\":" + String(month) + ",\"year\":" + String(year) +
+                ",\"total\":" + String(namid) + ",\"days\":{";
+  bool first = true;
+  char date[11];
+  for (int day = 1; day <= 31; day++) {
+    if (counts[day] == DAY_INDEX_UNKNOWN) continue;
+    snprintf(date, sizeof(date), "%02d-%02d-%04d", day, month, year);
+    json += String(first ? "" : ",") + "\"" + date + "\":" + String(counts[day]);
+    first = false;
+  }
+  json += "}}";
+  server.send(200, "application/json", json);
+}
@@ -0,0 +1,28 @@
+#ifndef DAY_INDEX_H
+#define DAY_INDEX_H
+
+#include "../config/config.h"
+
+// Per-day present counts, kept next to the day files so a month view does
+// not have to open and parse every day. One log per month and year:
+//
+//   /Attendance/MM/index-YYYY.log    one "DD,<delta>" or "DD,x" per line
+//
+// A line makes the day known and adds its delta (0 when the day file is
+// just created); "x" forgets the day again. Writers append, so the scan
+// path pays one short append. The log is summed when loaded and rewritten
+// as one line per day once it grows past DAY_INDEX_COMPACT_LINES. A month
+// without a log is counted from its day files once and the log written.
+
+#define DAY_INDEX_COMPACT_LINES 96
+#define DAY_INDEX_UNKNOWN -1  // No day file for that day
+
+// Function declarations for the per-day count index
+bool dayIndexMonth(int month, int year, int16_t counts[32], bool rebuild = false);
+int dayIndexCount(const String &date);
+void dayIndexAdjust(const String &date, int delta);
+void dayIndexRemoveDay(const String &date);
+void dayIndexClear();
+void handleMonthSummary();
+
+#endif // DAY_INDEX_H
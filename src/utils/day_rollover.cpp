@@ -0,0 +1,158 @@
+#include "day_rollover.h"
+#include "sd_utils.h"
+#include "time_utils.h"
+#include "day_index.h"
+#include "spi_bus.h"
+#include "logger.h"
+
+static String currentDay = "";
+static String currentPath = "";
+static bool currentFileReady = false;
+static String preparedDay = "";  // Tomorrow's date once its file exists
+static unsigned long lastRolloverCheck = 0;
+
+static DayRecord dayRecords[MAX_DAY_RECORDS];
+static int dayRecordCount = 0;
+
+static String formatDate(time_t when) {
+  struct tm info;
+  localtime_r(&when, &info);
+  char dateStr[11];
+  strftime(dateStr, sizeof(dateStr), "%d-%m-%Y", &info);
+  return String(dateStr);
+}
+
+// Create the month directory and the day file with its header
+static bool prepareAttendanceFile(const String &dateStr) {
+  String filePath = getAttendanceFilePath(dateStr);
+  if (!ensureAttendanceDirectory(dateStr)) {
+    return false;
+  }
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  bool exists = SD.exists(filePath);
+  spiBusRelease(SPI_DEV_SD);
+  if (!exists) {
+    if (!createAttendanceCSVFile(filePath)) {
+      LOG_ERROR("Failed to create attendance file %s", filePath.c_str());
+      return false;
+    }
+    dayIndexAdjust(dateStr, 0);
+  }
+  return true;
+}
+
+// Rebuild today's records from the day file (after a reboot mid-day)
+static void loadDayRecords() {
+  dayRecordCount = 0;
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File file = SD.exists(currentPath) ? SD.open(currentPath, FILE_READ) : File();
+  if (!file) {
+    spiBusRelease(SPI_DEV_SD);
+    return;
+  }
+
+  // Skip header line
+  if (file.available()) {
+    file.readStringUntil('\n');
+  }
+  while (file.available() && dayRecordCount < MAX_DAY_RECORDS) {
+    String roll, name, id, inTime, outTime;
+    if (readAttendanceCSVLine(file, roll, name, id, inTime, outTime) && id.toInt() > 0) {
+      dayRecords[dayRecordCount++] = {(uint16_t)id.toInt(), parseTimeOfDay(inTime), parseTimeOfDay(outTime)};
+    }
+  }
+  file.close();
+  spiBusRelease(SPI_DEV_SD);
+}
+
+static void rollOver(const String &newDay) {
+  LOG_INFO("Day rollover: %s -> %s", currentDay == "" ? "(boot)" : currentDay.c_str(), newDay.c_str());
+  currentDay = newDay;
+  currentPath = getAttendanceFilePath(newDay);
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  currentFileReady = preparedDay == newDay && SD.exists(currentPath);
+  spiBusRelease(SPI_DEV_SD);
+  preparedDay = "";
+
+  // Reset per-day state
+  for (int i = 0; i < MAX_DAY_RECORDS; i++) {
+    dayRecords[i] = {0, TIME_OF_DAY_NONE, TIME_OF_DAY_NONE};
+  }
+  dayRecordCount = 0;
+  Atindex = 0;
+  loadDayRecords();
+
+  // Keep the legacy date globals in step
+  day = newDay.substring(0, 2);
+  month = newDay.substring(3, 5);
+  year = newDay.substring(6);
+}
+
+void dayRolloverBegin() {
+  currentDay = "";
+  preparedDay = "";
+  lastRolloverCheck = 0;
+  dayRolloverTick();
+}
+
+void dayRolloverTick() {
+  if (lastRolloverCheck != 0 && millis() - lastRolloverCheck < 1000) {
+    return;
+  }
+  lastRolloverCheck = millis();
+
+  if (!clockValid()) {
+    return;  // Clock not set yet
+  }
+
+  String today = clockDateStr();
+  if (today != currentDay) {
+    rollOver(today);
+  }
+
+  // Just before midnight, pay tomorrow's directory and file creation up front
+  int secondsToMidnight = 86400 - clockSecondsOfDay();
+  if (secondsToMidnight <= DAY_PRECREATE_LEAD_SEC && preparedDay == "") {
+    String tomorrow = formatDate(clockEpoch() + secondsToMidnight + 1);
+    if (prepareAttendanceFile(tomorrow)) {
+      preparedDay = tomorrow;
+      LOG_INFO("Pre-created attendance file for %s", tomorrow.c_str());
+    }
+  }
+}
+
+const String &todayDate() {
+  return currentDay;
+}
+
+const String &todayAttendancePath() {
+  return currentPath;
+}
+
+bool ensureTodayAttendanceFile() {
+  if (currentFileReady) {
+    return true;
+  }
+  if (currentDay == "") {
+    return false;
+  }
+  currentFileReady = prepareAttendanceFile(currentDay);
+  return currentFileReady;
+}
+
+DayRecord *findTodayRecord(uint16_t id) {
+  for (int i = 0; i < dayRecordCount; i++) {
+    if (dayRecords[i].id == id) return &dayRecords[i];
+  }
+  return NULL;
+}
+
+DayRecord *addTodayRecord(uint16_t id, uint32_t inTime) {
+  if (dayRecordCount >= MAX_DAY_RECORDS) return NULL;
+  dayRecords[dayRecordCount] = {id, inTime, TIME_OF_DAY_NONE};
+  return &dayRecords[dayRecordCount++];
+}
+
+int todayPresentCount() {
+  return dayRecordCount;
+}
@@ -0,0 +1,28 @@
+#ifndef DAY_ROLLOVER_H
+#define DAY_ROLLOVER_H
+
+#include "../config/config.h"
+
+#define MAX_DAY_RECORDS 128      // One per enrolled student
+#define DAY_PRECREATE_LEAD_SEC 120  // Prepare tomorrow's file this long before midnight
+
+// Today's attendance for one student, mirrored from the day file
+struct DayRecord {
+  uint16_t id;
+  uint32_t inTime;   // Seconds since midnight
+  uint32_t outTime;  // Seconds since midnight, TIME_OF_DAY_NONE until scanned out
+};
+
+// Function declarations for the day-rollover scheduler
+void dayRolloverBegin();
+void dayRolloverTick();
+const String &todayDate();
+const String &todayAttendancePath();
+bool ensureTodayAttendanceFile();
+
+// Per-day in-memory state, reset at every rollover
+DayRecord *findTodayRecord(uint16_t id);
+DayRecord *addTodayRecord(uint16_t id, uint32_t inTime);
+int todayPresentCount();
+
+#endif // DAY_ROLLOVER_H
@@ -0,0 +1,223 @@
+#include "display_compositor.h"
+#include "spi_bus.h"
+#include "logger.h"
+
+struct DisplayLine {
+  String text;
+  uint16_t color;
+};
+
+struct RegionState {
+  int16_t x, y, w, h;
+  TFT_eSprite *sprite;  // NULL if the sprite could not be allocated
+  bool dirty;
+};
+
+// Frame model: what each region should show
+static String clockText = "";
+static bool wifiConnected = false;
+static DisplayLine statusLines[STATUS_LINES];
+static DisplayLine contentLines[CONTENT_LINES];
+static int contentCount = 0;
+
+static SemaphoreHandle_t modelMutex = NULL;
+
+// Scoped hold on the model for the setters below
+struct ModelGuard {
+  ModelGuard() { compositorLock(); }
+  ~ModelGuard() { compositorUnlock(); }
+};
+
+static RegionState regions[REGION_COUNT] = {
+  {0, 0, 128, 15, NULL, true},    // REGION_CLOCK
+  {130, 0, 30, 26, NULL, true},   // REGION_WIFI
+  {0, 15, 128, 30, NULL, true},   // REGION_STATUS
+  {0, 45, 128, 83, NULL, true},   // REGION_CONTENT
+};
+
+static void markDirty(DisplayRegion region) {
+  regions[region].dirty = true;
+}
+
+static bool setLine(DisplayLine &line, const String &text, uint16_t color) {
+  if (line.text == text && line.color == color) return false;
+  line.text = text;
+  line.color = color;
+  return true;
+}
+
+// Draw a region's model into g, with (ox, oy) as the region's top-left corner
+static void renderRegion(DisplayRegion region, TFT_eSPI &g, int16_t ox, int16_t oy) {
+  const RegionState &r = regions[region];
+  g.fillRect(ox, oy, r.w, r.h, TFT_WHITE);
+  g.setTextSize(1);
+
+  switch (region) {
+    case REGION_CLOCK:
+      g.setTextColor(TFT_BLACK);
+      g.setCursor(ox + 2, oy + 2);
+      g.print(clockText);
+      break;
+
+    case REGION_WIFI: {
+      int cx = ox + 12, cy = oy + 14;
+      if (wifiConnected) {
+        g.drawArc(cx, cy, 10, 6, 135, 225, TFT_BLUE, TFT_WHITE, true);  // Outer arc
+        g.drawArc(cx, cy, 7, 4, 135, 225, TFT_BLUE, TFT_WHITE, true);   // Second arc
+        g.drawArc(cx, cy, 4, 3, 135, 225, TFT_BLUE, TFT_WHITE, true);   // Third arc
+        g.drawArc(cx, cy, 2, 1, 135, 225, TFT_BLUE, TFT_WHITE, true);   // Inner arc
+        g.fillCircle(cx, cy, 1, TFT_BLUE);
+      } else {
+        g.drawLine(ox + 5, oy + 7, ox + 20, oy + 22, TFT_RED);
+        g.drawLine(ox + 20, oy + 7, ox + 5, oy + 22, TFT_RED);
+      }
+      break;
+    }
+
+    case REGION_STATUS:
+      for (int i = 0; i < STATUS_LINES; i++) {
+        g.setTextColor(statusLines[i].color);
+        g.setCursor(ox + 2, oy + 5 + i * 10);
+        g.print(statusLines[i].text);
+      }
+      break;
+
+    case REGION_CONTENT:
+      for (int i = 0; i < contentCount; i++) {
+        g.setTextColor(contentLines[i].color);
+        g.setCursor(ox + 2, oy + 5 + i * 10);
+        g.print(contentLines[i].text);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void compositorLock() {
+  if (modelMutex) xSemaphoreTakeRecursive(modelMutex, portMAX_DELAY);
+}
+
+void compositorUnlock() {
+  if (modelMutex) xSemaphoreGiveRecursive(modelMutex);
+}
+
+void compositorBegin() {
+  if (modelMutex == NULL) {
+    modelMutex = xSemaphoreCreateRecursiveMutex();
+  }
+  ModelGuard guard;
+  for (int i = 0; i < REGION_COUNT; i++) {
+    RegionState &r = regions[i];
+    if (r.sprite == NULL) {
+      // 8-bit sprites halve the RAM cost; the palette covers our few colors
+      r.sprite = new TFT_eSprite(&tft);
+      r.sprite->setColorDepth(8);
+      if (r.sprite->createSprite(r.w, r.h) == NULL) {
+        LOG_WARN("Display sprite allocation failed, region %d will draw directly", i);
+        delete r.sprite;
+        r.sprite = NULL;
+      }
+    }
+  }
+  compositorInvalidate();
+}
+
+// Push every dirty region as one rectangle. Skipped while another task
+// holds the SPI bus; the regions stay dirty and go out on the next flush.
+void compositorFlush() {
+  ModelGuard guard;
+  if (!spiBusAcquire(SPI_DEV_TFT, SPI_PRIO_COSMETIC, 0)) {
+    return;
+  }
+  for (int i = 0; i < REGION_COUNT; i++) {
+    RegionState &r = regions[i];
+    if (!r.dirty) continue;
+
+    if (r.sprite) {
+      renderRegion((DisplayRegion)i, *r.sprite, 0, 0);
+      r.sprite->pushSprite(r.x, r.y);
+    } else {
+      renderRegion((DisplayRegion)i, tft, r.x, r.y);
+    }
+    r.dirty = false;
+  }
+  spiBusRelease(SPI_DEV_TFT);
+}
+
+// Repaint everything on the next flush (after direct drawing or a TFT reinit)
+void compositorInvalidate() {
+  spiBusAcquire(SPI_DEV_TFT, SPI_PRIO_NORMAL);
+  tft.fillScreen(TFT_WHITE);
+  spiBusRelease(SPI_DEV_TFT);
+  ModelGuard guard;
+  for (int i = 0; i < REGION_COUNT; i++) {
+    regions[i].dirty = true;
+  }
+}
+
+void compositorSetClock(const char *timeText) {
+  ModelGuard guard;
+  if (clockText == timeText) return;
+  clockText = timeText;
+  markDirty(REGION_CLOCK);
+}
+
+void compositorSetWiFi(bool connected) {
+  ModelGuard guard;
+  if (wifiConnected == connected) return;
+  wifiConnected = connected;
+  markDirty(REGION_WIFI);
+}
+
+void compositorSetStatusLine(int line, const String &text, uint16_t color) {
+  ModelGuard guard;
+  if (line < 0 || line >= STATUS_LINES) return;
+  if (setLine(statusLines[line], text, color)) {
+    markDirty(REGION_STATUS);
+  }
+}
+
+void compositorClearStatus() {
+  ModelGuard guard;
+  for (int i = 0; i < STATUS_LINES; i++) {
+    compositorSetStatusLine(i, "", TFT_BLACK);
+  }
+}
+
+void compositorSetContentLine(int line, const String &text, uint16_t color) {
+  ModelGuard guard;
+  if (line < 0 || line >= CONTENT_LINES) return;
+  bool changed = setLine(contentLines[line], text, color);
+  if (line >= contentCount) {
+    contentCount = line + 1;
+    changed = true;
+  }
+  if (changed) {
+    markDirty(REGION_CONTENT);
+  }
+}
+
+// Add a line below the last one, scrolling the region when it is full
+void compositorAppendContentLine(const String &text, uint16_t color) {
+  ModelGuard guard;
+  if (contentCount == CONTENT_LINES) {
+    for (int i = 1; i < CONTENT_LINES; i++) {
+      contentLines[i - 1] = contentLines[i];
+    }
+    contentCount--;
+  }
+  contentLines[contentCount++] = {text, color};
+  markDirty(REGION_CONTENT);
+}
+
+void compositorClearContent() {
+  ModelGuard guard;
+  if (contentCount == 0) return;
+  for (int i = 0; i < CONTENT_LINES; i++) {
+    contentLines[i] = {"", TFT_BLACK};
+  }
+  contentCount = 0;
+  markDirty(REGION_CONTENT);
+}
@@ -0,0 +1,37 @@
+#ifndef DISPLAY_COMPOSITOR_H
+#define DISPLAY_COMPOSITOR_H
+
+#include "../config/config.h"
+
+// Screen regions (landscape 160x128)
+enum DisplayRegion {
+  REGION_CLOCK,    // Time band along the top
+  REGION_WIFI,     // WiFi icon, top right
+  REGION_STATUS,   // Three status lines below the time band
+  REGION_CONTENT,  // Attendance record or progress log
+  REGION_COUNT
+};
+
+#define STATUS_LINES 3
+#define CONTENT_LINES 8
+
+// Function declarations for the display compositor
+void compositorBegin();
+void compositorFlush();
+void compositorInvalidate();
+
+// The frame model is shared by every task that draws. Setters lock it
+// themselves; hold the lock around a group of calls to keep them together.
+void compositorLock();
+void compositorUnlock();
+
+// Frame model setters; changes are pushed on the next flush
+void compositorSetClock(const char *timeText);
+void compositorSetWiFi(bool connected);
+void compositorSetStatusLine(int line, const String &text, uint16_t color);
+void compositorClearStatus();
+void compositorSetContentLine(int line, const String &text, uint16_t color);
+void compositorAppendContentLine(const String &text, uint16_t color);
+void compositorClearContent();
+
+#endif // DISPLAY_COMPOSITOR_H
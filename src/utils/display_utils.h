@@ -4,9 +4,12 @@
 #include "../config/config.h"
 
 // Function declarations for display utilities
+void displayBegin();
 void drawWiFiIcon(bool isConnected);
 void updateTimeDisplay();
 void displayStatusMessage(const char *message, uint16_t color);
+void displayMessageScreen(uint16_t color, const String &line1, const String &line2 = "", const String &line3 = "");
+void displayLogLine(const String &text, uint16_t color = TFT_BLACK);
 void displayAttendanceRecord(int id, String roll, String name, bool isInTime);
 String getFormattedTime();
 void setRGBColor(uint8_t red, uint8_t green, uint8_t blue);
@@ -0,0 +1,219 @@
+#include "logger.h"
+#include "spi_bus.h"
+#include "metrics.h"
+#include "mem_placement.h"
+#include <atomic>
+#include <stdarg.h>
+
+#define LOG_DRAIN_BATCH 16        // Entries formatted per drain pass
+#define LOG_SD_FLUSH_BYTES 1024   // Write to SD once this much is pending...
+#define LOG_SD_FLUSH_MS 2000      // ...or this long after the first pending line
+
+// Bounded multi-producer ring. A slot's sequence number says whose turn it
+// is: seq == pos means free for the producer claiming pos, seq == pos + 1
+// means filled and waiting for the drain task.
+struct LogEntry {
+  std::atomic<uint32_t> seq;
+  uint32_t millis;
+  uint8_t level;
+  char text[LOG_LINE_MAX];
+};
+
+static LogEntry ring[LOG_RING_SLOTS];
+static std::atomic<uint32_t> ringHead(0);
+static uint32_t ringTail = 0;  // Only the drain task moves the tail
+static std::atomic<uint32_t> droppedCount(0);
+static std::atomic<uint8_t> activeSinks(LOG_SINK_SERIAL);
+static bool loggerReady = false;
+
+// Recent formatted output for /logs; NULL if it could not be allocated
+static char *history = NULL;
+static uint32_t historyWritten = 0;
+static portMUX_TYPE historyMux = portMUX_INITIALIZER_UNLOCKED;
+
+// SD output waiting for the next flush
+static char sdPending[LOG_SD_FLUSH_BYTES + LOG_DRAIN_BATCH * (LOG_LINE_MAX + 16)];
+static size_t sdPendingLen = 0;
+static unsigned long sdPendingSince = 0;
+
+static const char LEVEL_CHARS[] = {'-', 'E', 'W', 'I', 'D'};
+
+static void logDrainTask(void *param);
+
+static double readQueueDepth() {
+  return ringHead.load(std::memory_order_relaxed) - ringTail;
+}
+
+void logBegin() {
+  if (loggerReady) return;
+  for (uint32_t i = 0; i < LOG_RING_SLOTS; i++) {
+    ring[i].seq.store(i, std::memory_order_relaxed);
+  }
+  ringHead.store(0);
+  ringTail = 0;
+  history = (char *)memAlloc(LOG_HISTORY_BYTES, MEM_USE_LOG);
+  loggerReady = true;
+  metricsRegisterGauge("attendance_log_queue_depth", "Log lines waiting to be drained", readQueueDepth);
+  xTaskCreatePinnedToCore(logDrainTask, "logDrain", 4096, NULL, 1, NULL, 0);
+}
+
+void logSetSinks(uint8_t sinks) {
+  activeSinks.store(sinks);
+}
+
+uint32_t logDropped() {
+  return droppedCount.load();
+}
+
+void logWrite(uint8_t level, const char *format, ...) {
+  if (!loggerReady) return;
+
+  // Claim a slot; when the drain task has fallen a full ring behind, drop
+  // the line instead of blocking the caller
+  uint32_t pos = ringHead.load(std::memory_order_relaxed);
+  LogEntry *entry;
+  while (true) {
+    entry = &ring[pos % LOG_RING_SLOTS];
+    int32_t diff = (int32_t)(entry->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (ringHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      droppedCount++;
+      metricsInc(METRIC_LOG_DROPPED);
+      return;
+    } else {
+      pos = ringHead.load(std::memory_order_relaxed);
+    }
+  }
+
+  entry->millis = millis();
+  entry->level = level;
+  va_list args;
+  va_start(args, format);
+  vsnprintf(entry->text, sizeof(entry->text), format, args);
+  va_end(args);
+  entry->seq.store(pos + 1, std::memory_order_release);
+}
+
+static void appendHistory(const char *text, size_t len) {
+  if (!history) return;
+  portENTER_CRITICAL(&historyMux);
+  for (size_t i = 0; i < len; i++) {
+    history[historyWritten++ % LOG_HISTORY_BYTES] = text[i];
+  }
+  portEXIT_CRITICAL(&historyMux);
+}
+
+static void flushToSD() {
+  if (sdPendingLen == 0) return;
+  if (sdCardInitialized && spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL, pdMS_TO_TICKS(500))) {
+    if (!SD.exists("/logs")) {
+      SD.mkdir("/logs");
+    }
+    File file = SD.open(LOG_FILE_PATH, FILE_APPEND);
+    if (file && file.size() + sdPendingLen > LOG_FILE_MAX_BYTES) {
+      // Keep one previous generation
+      file.close();
+      SD.remove(LOG_FILE_ROTATED);
+      SD.rename(LOG_FILE_PATH, LOG_FILE_ROTATED);
+      file = SD.open(LOG_FILE_PATH, FILE_APPEND);
+    }
+    if (file) {
+      file.write((const uint8_t *)sdPending, sdPendingLen);
+      file.close();
+      metricsInc(METRIC_SD_BYTES_WRITTEN, sdPendingLen);
+    }
+    spiBusRelease(SPI_DEV_SD);
+  }
+  // Lines that could not be written are dropped; serial still has them
+  sdPendingLen = 0;
+}
+
+// Low-priority consumer: formats entries and feeds the sinks, so callers
+// never wait on the UART or the SD card
+static void logDrainTask(void *param) {
+  static char batch[LOG_DRAIN_BATCH * (LOG_LINE_MAX + 16)];
+
+  while (true) {
+    size_t len = 0;
+    int count = 0;
+    while (count < LOG_DRAIN_BATCH) {
+      LogEntry &entry = ring[ringTail % LOG_RING_SLOTS];
+      if (entry.seq.load(std::memory_order_acquire) != ringTail + 1) break;
+
+      int written = snprintf(batch + len, sizeof(batch) - len, "[%6lu.%03lu] %c %s\n",
+                             (unsigned long)(entry.millis / 1000), (unsigned long)(entry.millis % 1000),
+                             LEVEL_CHARS[entry.level <= LOG_LEVEL_DEBUG ? entry.level : 0], entry.text);
+      if (written > 0) {
+        len += min((size_t)written, sizeof(batch) - len - 1);
+      }
+      entry.seq.store(ringTail + LOG_RING_SLOTS, std::memory_order_release);
+      ringTail++;
+      count++;
+    }
+
+    uint8_t sinks = activeSinks.load();
+    if (len > 0) {
+      if (sinks & LOG_SINK_SERIAL) {
+        Serial.write((const uint8_t *)batch, len);
+      }
+      appendHistory(batch, len);
+      if (sinks & LOG_SINK_SD) {
+        if (sdPendingLen == 0) sdPendingSince = millis();
+        size_t room = sizeof(sdPending) - sdPendingLen;
+        memcpy(sdPending + sdPendingLen, batch, min(len, room));
+        sdPendingLen += min(len, room);
+      }
+    }
+
+    if (sdPendingLen >= LOG_SD_FLUSH_BYTES ||
+        (sdPendingLen > 0 && millis() - sdPendingSince >= LOG_SD_FLUSH_MS)) {
+      flushToSD();
+    }
+
+    if (count < LOG_DRAIN_BATCH) {
+      vTaskDelay(pdMS_TO_TICKS(50));
+    }
+  }
+}
+
+void handleLogs() {
+  // The SD copy survives reboots; the default view is the in-RAM tail
+  if (server.arg("source") == "sd") {
+    spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+    File file = SD.open(LOG_FILE_PATH, FILE_READ);
+    if (!file) {
+      spiBusRelease(SPI_DEV_SD);
+      server.send(404, "text/plain", "No log file on SD card");
+      return;
+    }
+    server.streamFile(file, "text/plain");
+    file.close();
+    spiBusRelease(SPI_DEV_SD);
+    return;
+  }
+
+  char *snapshot = history ? (char *)memAlloc(LOG_HISTORY_BYTES + 1, MEM_USE_LOG) : NULL;
+  if (snapshot == NULL) {
+    server.send(503, "text/plain", "Out of memory");
+    return;
+  }
+  size_t len;
+  portENTER_CRITICAL(&historyMux);
+  len = min(historyWritten, (uint32_t)LOG_HISTORY_BYTES);
+  uint32_t start = historyWritten - len;
+  for (size_t i = 0; i < len; i++) {
+    snapshot[i] = history[(start + i) % LOG_HISTORY_BYTES];
+  }
+  portEXIT_CRITICAL(&historyMux);
+  snapshot[len] = '\0';
+
+  // Start at a line boundary when the buffer has wrapped
+  char *text = snapshot;
+  if (historyWritten > LOG_HISTORY_BYTES) {
+    char *newline = strchr(snapshot, '\n');
+    if (newline) text = newline + 1;
+  }
+  server.send(200, "text/plain", text);
+  memFree(snapshot, MEM_USE_LOG);
+}
@@ -0,0 +1,60 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "../config/config.h"
+
+// Log levels. Calls above LOG_LEVEL compile to nothing, so their format
+// arguments are never evaluated.
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_SLOTS 64        // Entries waiting for the drain task
+#define LOG_LINE_MAX 120         // Longer messages are truncated
+#define LOG_HISTORY_BYTES 4096   // Recent output kept for /logs
+#define LOG_FILE_PATH "/logs/device.log"
+#define LOG_FILE_ROTATED "/logs/device.1.log"
+#define LOG_FILE_MAX_BYTES 262144
+
+// Drain destinations
+#define LOG_SINK_SERIAL 0x01
+#define LOG_SINK_SD 0x02
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+// Function declarations for the logger
+void logBegin();
+void logSetSinks(uint8_t sinks);
+void logWrite(uint8_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+uint32_t logDropped();
+void handleLogs();
+
+#endif // LOGGER_H
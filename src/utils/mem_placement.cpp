@@ -0,0 +1,110 @@
+#include "mem_placement.h"
+#include "metrics.h"
+#include <esp_heap_caps.h>
+
+// Ahead of every block, so a free knows what to take off the counts
+struct MemBlockHeader {
+  uint32_t size;
+  uint8_t region;
+  uint8_t reserved[3];  // Keeps the block 8-byte aligned
+};
+
+struct MemUsage {
+  uint32_t bytes[MEM_REGION_COUNT];
+  uint16_t blocks;
+  uint16_t fallbacks;  // Wanted PSRAM, got internal
+};
+
+static const char *USE_NAMES[MEM_USE_COUNT] = {"arena", "query", "presence", "templates", "export", "log"};
+static MemUsage usage[MEM_USE_COUNT];
+static bool psram = false;
+static portMUX_TYPE usageMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t placedBytes(MemRegion region) {
+  uint32_t total = 0;
+  for (int i = 0; i < MEM_USE_COUNT; i++) {
+    total += usage[i].bytes[region];
+  }
+  return total;
+}
+
+static double readPsramFree() {
+  return psram ? heap_caps_get_free_size(MALLOC_CAP_SPIRAM) : 0;
+}
+
+static double readPlacedInternal() {
+  return placedBytes(MEM_REGION_INTERNAL);
+}
+
+static double readPlacedPsram() {
+  return placedBytes(MEM_REGION_PSRAM);
+}
+
+// Call before anything allocates through memAlloc(). That includes the
+// logger, so the placement is logged by setup() once logBegin() has run.
+void memPlacementBegin() {
+  psram = psramFound();
+  metricsRegisterGauge("attendance_psram_free_bytes", "Free PSRAM (0 without PSRAM)", readPsramFree);
+  metricsRegisterGauge("attendance_placed_internal_bytes", "Large buffers in internal RAM", readPlacedInternal);
+  metricsRegisterGauge("attendance_placed_psram_bytes", "Large buffers in PSRAM", readPlacedPsram);
+}
+
+bool memHasPsram() {
+  return psram;
+}
+
+// PSRAM when fitted and the block is big enough, else internal RAM
+void *memAlloc(size_t size, MemUse use) {
+  size_t total = size + sizeof(MemBlockHeader);
+  bool wantPsram = psram && size >= MEM_PSRAM_MIN_BYTES;
+  MemRegion region = MEM_REGION_PSRAM;
+  MemBlockHeader *block = NULL;
+  if (wantPsram) {
+    block = (MemBlockHeader *)heap_caps_malloc(total, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  }
+  if (!block) {
+    region = MEM_REGION_INTERNAL;
+    block = (MemBlockHeader *)heap_caps_malloc(total, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  }
+  if (!block) return NULL;
+
+  block->size = size;
+  block->region = region;
+  portENTER_CRITICAL(&usageMux);
+  usage[use].bytes[region] += size;
+  usage[use].blocks++;
+  if (wantPsram && region == MEM_REGION_INTERNAL) usage[use].fallbacks++;
+  portEXIT_CRITICAL(&usageMux);
+  return block + 1;
+}
+
+void memFree(void *ptr, MemUse use) {
+  if (!ptr) return;
+  MemBlockHeader *block = (MemBlockHeader *)ptr - 1;
+  portENTER_CRITICAL(&usageMux);
+  usage[use].bytes[block->region] -= block->size;
+  usage[use].blocks--;
+  portEXIT_CRITICAL(&usageMux);
+  heap_caps_free(block);
+}
+
+String memPlacementReport() {
+  String report = "Memory: internal free=" + String(heap_caps_get_free_size(MALLOC_CAP_INTERNAL)) +
+                  " largest=" + String(heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL)) +
+                  " placed=" + String(placedBytes(MEM_REGION_INTERNAL));
+  if (psram) {
+    report += " psram free=" + String(heap_caps_get_free_size(MALLOC_CAP_SPIRAM)) +
+              " largest=" + String(heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM)) +
+              " placed=" + String(placedBytes(MEM_REGION_PSRAM));
+  } else {
+    report += " psram none";
+  }
+  for (int i = 0; i < MEM_USE_COUNT; i++) {
+    const MemUsage &u = usage[i];
+    if (u.blocks == 0 && u.fallbacks == 0) continue;
+    report += String(" ") + USE_NAMES[i] + "=" + String(u.bytes[MEM_REGION_INTERNAL]) + "i/" +
+              String(u.bytes[MEM_REGION_PSRAM]) + "p";
+    if (u.fallbacks) report += " fallbacks=" + String(u.fallbacks);
+  }
+  return report;
+}
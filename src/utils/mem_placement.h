@@ -0,0 +1,43 @@
+#ifndef MEM_PLACEMENT_H
+#define MEM_PLACEMENT_H
+
+#include "../config/config.h"
+
+// Where our larger buffers live. Large data that is not latency critical
+// (request arena, query results, presence rows, template buffers, export
+// chunks, log history) is allocated here: in PSRAM on WROVER boards, in
+// internal DRAM when there is no PSRAM or it is full.
+//
+// Everything else stays in static internal arrays: buffers handed to the
+// SPI and UART drivers, data touched while the flash cache is off, and
+// anything used through atomics, which the ESP32 cannot do on PSRAM (the
+// log ring, for one).
+//
+// Usage is counted per consumer and per region for the memory report.
+
+#define MEM_PSRAM_MIN_BYTES 1024  // Smaller blocks are not worth the slower access
+
+enum MemRegion {
+  MEM_REGION_INTERNAL,
+  MEM_REGION_PSRAM,
+  MEM_REGION_COUNT
+};
+
+enum MemUse {
+  MEM_USE_ARENA,       // Request arena (mem_pool)
+  MEM_USE_QUERY,       // Date-range query results
+  MEM_USE_PRESENCE,    // Presence index rows
+  MEM_USE_TEMPLATES,   // Template restore buffers
+  MEM_USE_EXPORT,      // CSV export chunks
+  MEM_USE_LOG,         // Log history for /logs
+  MEM_USE_COUNT
+};
+
+// Function declarations for memory placement
+void memPlacementBegin();
+bool memHasPsram();
+void *memAlloc(size_t size, MemUse use);
+void memFree(void *block, MemUse use);
+String memPlacementReport();
+
+#endif // MEM_PLACEMENT_H
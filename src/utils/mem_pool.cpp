@@ -0,0 +1,170 @@
+#include "mem_pool.h"
+#include "metrics.h"
+#include "logger.h"
+#include "mem_placement.h"
+
+static uint8_t *arena = NULL;
+static size_t arenaSize = 0;
+static size_t arenaTop = 0;
+static size_t arenaPeak = 0;
+static uint32_t arenaSpills = 0;   // Builders that outgrew the arena
+static FixedPool<CsvLine, CSV_LINE_POOL> csvLines;
+
+static double readArenaPeak() {
+  return arenaPeak;
+}
+
+static double readArenaSpills() {
+  return arenaSpills;
+}
+
+// Take the arena before the heap has had a chance to fragment
+bool memPoolBegin() {
+  if (arena) return true;
+  arenaSize = memHasPsram() ? ARENA_SIZE_PSRAM : ARENA_SIZE;
+  arena = (uint8_t *)memAlloc(arenaSize, MEM_USE_ARENA);
+  if (!arena) {
+    LOG_ERROR("No memory for the %d byte request arena", (int)arenaSize);
+    return false;
+  }
+  metricsRegisterGauge("attendance_arena_peak_bytes", "Most request arena used by one request", readArenaPeak);
+  metricsRegisterGauge("attendance_arena_spills", "Responses that outgrew the request arena", readArenaSpills);
+  return true;
+}
+
+// 4-byte aligned; NULL once the arena is used up
+void *arenaAlloc(size_t size) {
+  size_t start = (arenaTop + 3) & ~(size_t)3;
+  if (!arena || start + size > arenaSize) return NULL;
+  arenaTop = start + size;
+  if (arenaTop > arenaPeak) arenaPeak = arenaTop;
+  return arena + start;
+}
+
+// Grow the most recent allocation in place
+static bool arenaExtend(void *block, size_t oldSize, size_t newSize) {
+  if (!arena || (uint8_t *)block + oldSize != arena + arenaTop) return false;
+  size_t top = arenaTop - oldSize + newSize;
+  if (top > arenaSize) return false;
+  arenaTop = top;
+  if (arenaTop > arenaPeak) arenaPeak = arenaTop;
+  return true;
+}
+
+void arenaReset() {
+  arenaTop = 0;
+}
+
+// Send a built body without copying it into a String
+void arenaSend(int code, const char *contentType, const ArenaString &body) {
+  server.setContentLength(body.length());
+  server.send(code, contentType, "");
+  server.sendContent(body.c_str(), body.length());
+}
+
+CsvLine *csvLineAcquire() {
+  return csvLines.acquire();
+}
+
+void csvLineRelease(CsvLine *line) {
+  csvLines.release(line);
+}
+
+String memPoolReport() {
+  return "Memory pools: arena peak=" + String(arenaPeak) + "/" + String(arenaSize) +
+         " spills=" + String(arenaSpills) +
+         " csv peak=" + String(csvLines.peak) + "/" + String(CSV_LINE_POOL) +
+         " misses=" + String(csvLines.misses) +
+         " largest block=" + String(ESP.getMaxAllocHeap());
+}
+
+ArenaString::~ArenaString() {
+  if (onHeap) free(buf);
+}
+
+// Room for extra more bytes plus the terminator: grow in place at the top
+// of the arena, else move to a fresh arena block, else spill to the heap
+bool ArenaString::reserve(size_t extra) {
+  size_t need = len + extra + 1;
+  if (need <= cap) return true;
+  size_t newCap = cap ? cap : 64;
+  while (newCap < need) newCap *= 2;
+
+  if (!onHeap) {
+    if (buf && arenaExtend(buf, cap, newCap)) {
+      cap = newCap;
+      return true;
+    }
+    char *block = (char *)arenaAlloc(newCap);
+    if (block) {
+      if (buf) memcpy(block, buf, len + 1);
+      buf = block;
+      cap = newCap;
+      return true;
+    }
+    char *heap = (char *)malloc(newCap);
+    if (!heap) return false;
+    if (buf) memcpy(heap, buf, len + 1);
+    buf = heap;
+    cap = newCap;
+    onHeap = true;
+    arenaSpills++;
+    return true;
+  }
+
+  char *heap = (char *)realloc(buf, newCap);
+  if (!heap) return false;
+  buf = heap;
+  cap = newCap;
+  return true;
+}
+
+ArenaString &ArenaString::add(const char *text, size_t length) {
+  if (length == 0 || !reserve(length)) return *this;
+  memcpy(buf + len, text, length);
+  len += length;
+  buf[len] = '\0';
+  return *this;
+}
+
+ArenaString &ArenaString::add(const char *text) {
+  return add(text, strlen(text));
+}
+
+ArenaString &ArenaString::add(const String &text) {
+  return add(text.c_str(), text.length());
+}
+
+ArenaString &ArenaString::add(char c) {
+  return add(&c, 1);
+}
+
+ArenaString &ArenaString::addInt(long value) {
+  char digits[12];
+  int length = snprintf(digits, sizeof(digits), "%ld", value);
+  return add(digits, length);
+}
+
+ArenaString &ArenaString::addJson(const char *text) {
+  add('"');
+  const char *run = text;
+  for (const char *p = text; *p; p++) {
+    char c = *p;
+    if (c != '"' && c != '\\' && (uint8_t)c >= 0x20) continue;
+    add(run, p - run);
+    if (c == '"' || c == '\\') {
+      add('\\').add(c);
+    } else if (c == '\n') {
+      add("\\n", 2);
+    } else {
+      add(' ');
+    }
+    run = p + 1;
+  }
+  add(run);
+  return add('"');
+}
+
+ArenaString &ArenaString::addJson(const String &text) {
+  return addJson(text.c_str());
+}
@@ -0,0 +1,103 @@
+#ifndef MEM_POOL_H
+#define MEM_POOL_H
+
+#include "../config/config.h"
+
+// Allocation that does not fragment the heap over weeks of uptime.
+//
+// Request arena: one block taken at boot (in PSRAM when fitted) and handed
+// out by bumping a pointer. HTTP handlers build their responses in it with
+// ArenaString instead of chains of temporary Strings; timedRoute() resets
+// it once the handler returns, so nothing is freed piecemeal. A response that outgrows
+// the arena spills to the heap and still goes out, and is counted.
+//
+// Fixed pools: recurring objects of one size (CSV line buffers, FirebaseJson
+// payloads) come from a small array allocated once. A miss falls back to
+// the heap.
+
+#define ARENA_SIZE 16384
+#define ARENA_SIZE_PSRAM 65536  // With PSRAM the arena can take whole pages
+#define CSV_LINE_MAX 256    // Longest CSV line read through the pool
+#define CSV_LINE_POOL 2
+
+// Fixed set of N objects handed out and returned; acquire() gives NULL when
+// they are all in use
+template <typename T, int N>
+struct FixedPool {
+  T items[N];
+  bool used[N] = {};
+  uint16_t inUse = 0;
+  uint16_t peak = 0;
+  uint32_t misses = 0;
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+  T *acquire() {
+    T *item = NULL;
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < N && !item; i++) {
+      if (!used[i]) {
+        used[i] = true;
+        item = &items[i];
+        if (++inUse > peak) peak = inUse;
+      }
+    }
+    if (!item) misses++;
+    portEXIT_CRITICAL(&lock);
+    return item;
+  }
+
+  bool owns(const T *item) const {
+    return item >= items && item < items + N;
+  }
+
+  void release(T *item) {
+    if (!owns(item)) return;
+    portENTER_CRITICAL(&lock);
+    used[item - items] = false;
+    inUse--;
+    portEXIT_CRITICAL(&lock);
+  }
+};
+
+struct CsvLine {
+  char text[CSV_LINE_MAX];
+};
+
+// Append-only string built in the request arena. Only for use inside a
+// request handler: its memory goes when the request ends.
+class ArenaString {
+public:
+  ArenaString() {}
+  ~ArenaString();
+  ArenaString(const ArenaString &) = delete;
+  ArenaString &operator=(const ArenaString &) = delete;
+
+  ArenaString &add(const char *text, size_t length);
+  ArenaString &add(const char *text);
+  ArenaString &add(const String &text);
+  ArenaString &add(char c);
+  ArenaString &addInt(long value);
+  ArenaString &addJson(const char *text);  // Quoted and escaped like jsonString()
+  ArenaString &addJson(const String &text);
+
+  const char *c_str() const { return buf ? buf : ""; }
+  size_t length() const { return len; }
+
+private:
+  bool reserve(size_t extra);
+  char *buf = NULL;
+  size_t len = 0;
+  size_t cap = 0;
+  bool onHeap = false;
+};
+
+// Function declarations for the memory pools
+bool memPoolBegin();
+void *arenaAlloc(size_t size);
+void arenaReset();
+void arenaSend(int code, const char *contentType, const ArenaString &body);
+CsvLine *csvLineAcquire();
+void csvLineRelease(CsvLine *line);
+String memPoolReport();
+
+#endif // MEM_POOL_H
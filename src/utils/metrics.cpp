@@ -0,0 +1,201 @@
+#include "metrics.h"
+#include "spi_bus.h"
+#include "day_rollover.h"
+#include <atomic>
+
+// Bucket upper bounds in microseconds; the last bucket is +Inf
+static const uint32_t BUCKET_BOUNDS[] = {
+  1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000
+};
+#define BUCKET_COUNT (sizeof(BUCKET_BOUNDS) / sizeof(BUCKET_BOUNDS[0]) + 1)
+
+// Recording is a handful of relaxed atomic adds, safe from any task.
+// Buckets hold per-bucket counts; they are made cumulative when rendered.
+struct Histogram {
+  std::atomic<uint32_t> buckets[BUCKET_COUNT];
+  std::atomic<uint64_t> sumMicros;
+  std::atomic<uint32_t> count;
+};
+
+struct RouteMetric {
+  const char *route;
+  Histogram latency;
+};
+
+struct Gauge {
+  const char *name;
+  const char *help;
+  MetricGaugeFn read;
+};
+
+static const char *const COUNTER_NAMES[METRIC_COUNTER_COUNT][2] = {
+  {"attendance_scans_total", "Fingerprint images captured"},
+  {"attendance_scan_matches_total", "Scans matched to an enrolled template"},
+  {"attendance_scan_no_match_total", "Scans with no matching template"},
+  {"attendance_scan_errors_total", "Scans that failed conversion or lookup"},
+  {"attendance_in_records_total", "In-time records written"},
+  {"attendance_out_records_total", "Out-time records written"},
+  {"attendance_sd_read_bytes_total", "Bytes read from the SD card"},
+  {"attendance_sd_written_bytes_total", "Bytes written to the SD card"},
+  {"attendance_cloud_writes_total", "Firebase writes attempted"},
+  {"attendance_cloud_failures_total", "Firebase writes that failed"},
+  {"attendance_log_dropped_total", "Log lines dropped because the ring was full"},
+};
+
+static const char *const STAGE_NAMES[METRIC_HISTOGRAM_COUNT] = {
+  "capture", "image2tz", "search", "lookup", "day_lookup", "sd_write", "cloud_write"
+};
+
+static std::atomic<uint32_t> counters[METRIC_COUNTER_COUNT];
+static Histogram stageHistograms[METRIC_HISTOGRAM_COUNT];
+static RouteMetric routes[METRIC_MAX_ROUTES];
+static int routeCount = 0;
+static Gauge gauges[METRIC_MAX_GAUGES];
+static int gaugeCount = 0;
+
+static void observe(Histogram &h, uint32_t micros) {
+  size_t bucket = 0;
+  while (bucket < BUCKET_COUNT - 1 && micros > BUCKET_BOUNDS[bucket]) {
+    bucket++;
+  }
+  h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  h.sumMicros.fetch_add(micros, std::memory_order_relaxed);
+  h.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+static double readHeapFree() {
+  return ESP.getFreeHeap();
+}
+
+static double readHeapLargestBlock() {
+  return ESP.getMaxAllocHeap();
+}
+
+static double readHeapMinFree() {
+  return ESP.getMinFreeHeap();
+}
+
+static double readUptime() {
+  return millis() / 1000.0;
+}
+
+static double readStudents() {
+  return namid;
+}
+
+static double readPresentToday() {
+  return todayPresentCount();
+}
+
+void metricsBegin() {
+  metricsRegisterGauge("attendance_heap_free_bytes", "Free heap", readHeapFree);
+  metricsRegisterGauge("attendance_heap_largest_block_bytes", "Largest allocatable heap block", readHeapLargestBlock);
+  metricsRegisterGauge("attendance_heap_min_free_bytes", "Lowest free heap since boot", readHeapMinFree);
+  metricsRegisterGauge("attendance_uptime_seconds", "Time since boot", readUptime);
+  metricsRegisterGauge("attendance_students", "Enrolled students", readStudents);
+  metricsRegisterGauge("attendance_present_today", "Students with a record today", readPresentToday);
+}
+
+void metricsInc(MetricCounter counter, uint32_t amount) {
+  counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void metricsObserve(MetricHistogram histogram, uint32_t micros) {
+  observe(stageHistograms[histogram], micros);
+}
+
+// Routes are registered once while the server is set up, before any
+// request can observe them, so the table itself needs no locking.
+int metricsRegisterRoute(const char *route) {
+  for (int i = 0; i < routeCount; i++) {
+    if (strcmp(routes[i].route, route) == 0) return i;
+  }
+  if (routeCount >= METRIC_MAX_ROUTES) return METRIC_NO_ROUTE;
+  routes[routeCount].route = route;
+  return routeCount++;
+}
+
+void metricsObserveRoute(int route, uint32_t micros) {
+  if (route < 0 || route >= routeCount) return;
+  observe(routes[route].latency, micros);
+}
+
+bool metricsRegisterGauge(const char *name, const char *help, MetricGaugeFn read) {
+  if (gaugeCount >= METRIC_MAX_GAUGES) return false;
+  gauges[gaugeCount++] = {name, help, read};
+  return true;
+}
+
+// Output is streamed in chunks so a scrape never builds the whole page in RAM
+static void sendHeader(const char *name, const char *help, const char *type) {
+  server.sendContent(String("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n");
+}
+
+static void sendHistogram(const char *name, const String &labels, const Histogram &h) {
+  String out;
+  uint32_t cumulative = 0;
+  for (size_t i = 0; i < BUCKET_COUNT; i++) {
+    cumulative += h.buckets[i].load(std::memory_order_relaxed);
+    String le = i < BUCKET_COUNT - 1 ? String(BUCKET_BOUNDS[i] / 1000000.0, 4) : String("+Inf");
+    out += String(name) + "_bucket{" + labels + ",le=\"" + le + "\"} " + String(cumulative) + "\n";
+  }
+  double sumSeconds = h.sumMicros.load(std::memory_order_relaxed) / 1000000.0;
+  out += String(name) + "_sum{" + labels + "} " + String(sumSeconds, 6) + "\n";
+  out += String(name) + "_count{" + labels + "} " + String(h.count.load(std::memory_order_relaxed)) + "\n";
+  server.sendContent(out);
+}
+
+enum SpiField { SPI_TRANSACTIONS, SPI_CONTENDED, SPI_DEFERRED, SPI_BUSY, SPI_MAX_HOLD };
+
+static void sendSpiFamily(const char *name, const char *help, const char *type, SpiField field) {
+  static const char *const devices[SPI_DEV_COUNT] = {"sd", "tft"};
+  sendHeader(name, help, type);
+  String out;
+  for (int i = 0; i < SPI_DEV_COUNT; i++) {
+    const SpiDeviceStats &s = spiBusStats((SpiDevice)i);
+    String value;
+    switch (field) {
+      case SPI_TRANSACTIONS: value = String(s.transactions); break;
+      case SPI_CONTENDED: value = String(s.contended); break;
+      case SPI_DEFERRED: value = String(s.deferred); break;
+      case SPI_BUSY: value = String(s.busyMicros / 1000000.0, 6); break;
+      case SPI_MAX_HOLD: value = String(s.maxHoldMicros / 1000000.0, 6); break;
+    }
+    out += String(name) + "{device=\"" + devices[i] + "\"} " + value + "\n";
+  }
+  server.sendContent(out);
+}
+
+void handleMetrics() {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+
+  for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+    sendHeader(COUNTER_NAMES[i][0], COUNTER_NAMES[i][1], "counter");
+    server.sendContent(String(COUNTER_NAMES[i][0]) + " " + String(counters[i].load(std::memory_order_relaxed)) + "\n");
+  }
+
+  for (int i = 0; i < gaugeCount; i++) {
+    sendHeader(gauges[i].name, gauges[i].help, "gauge");
+    server.sendContent(String(gauges[i].name) + " " + String(gauges[i].read(), 3) + "\n");
+  }
+
+  sendHeader("attendance_scan_stage_seconds", "Time spent in each scan stage", "histogram");
+  for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+    sendHistogram("attendance_scan_stage_seconds", String("stage=\"") + STAGE_NAMES[i] + "\"", stageHistograms[i]);
+  }
+
+  sendHeader("attendance_http_request_seconds", "HTTP handler latency by route", "histogram");
+  for (int i = 0; i < routeCount; i++) {
+    sendHistogram("attendance_http_request_seconds", String("route=\"") + routes[i].route + "\"", routes[i].latency);
+  }
+
+  // The SPI arbiter keeps its own counters; export them here
+  sendSpiFamily("attendance_spi_transactions_total", "SPI bus transactions", "counter", SPI_TRANSACTIONS);
+  sendSpiFamily("attendance_spi_contended_total", "SPI transactions that waited for the bus", "counter", SPI_CONTENDED);
+  sendSpiFamily("attendance_spi_deferred_total", "Cosmetic SPI work skipped while the bus was busy", "counter", SPI_DEFERRED);
+  sendSpiFamily("attendance_spi_busy_seconds_total", "Time the SPI bus was held", "counter", SPI_BUSY);
+  sendSpiFamily("attendance_spi_max_hold_seconds", "Longest single SPI bus hold", "gauge", SPI_MAX_HOLD);
+
+  server.sendContent("");
+}
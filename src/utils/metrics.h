@@ -0,0 +1,49 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "../config/config.h"
+
+// Counters (monotonic)
+enum MetricCounter {
+  METRIC_SCANS,              // Images captured
+  METRIC_SCAN_MATCHES,       // Fingerprints matched to a template
+  METRIC_SCAN_NO_MATCH,
+  METRIC_SCAN_ERRORS,        // image2Tz failures and unknown IDs
+  METRIC_ATTENDANCE_IN,
+  METRIC_ATTENDANCE_OUT,
+  METRIC_SD_BYTES_READ,
+  METRIC_SD_BYTES_WRITTEN,
+  METRIC_CLOUD_WRITES,
+  METRIC_CLOUD_FAILURES,
+  METRIC_LOG_DROPPED,        // Log lines lost to a full ring
+  METRIC_COUNTER_COUNT
+};
+
+// Latency histograms, observed in microseconds
+enum MetricHistogram {
+  METRIC_STAGE_CAPTURE,      // finger.getImage()
+  METRIC_STAGE_IMAGE2TZ,
+  METRIC_STAGE_SEARCH,
+  METRIC_STAGE_LOOKUP,       // Student roster lookup
+  METRIC_STAGE_DAY_LOOKUP,   // Today's record for the ID
+  METRIC_STAGE_SD_WRITE,
+  METRIC_STAGE_CLOUD_WRITE,
+  METRIC_HISTOGRAM_COUNT
+};
+
+#define METRIC_MAX_ROUTES 48
+#define METRIC_MAX_GAUGES 16
+#define METRIC_NO_ROUTE -1
+
+typedef double (*MetricGaugeFn)();
+
+// Function declarations for the metrics registry
+void metricsBegin();
+void metricsInc(MetricCounter counter, uint32_t amount = 1);
+void metricsObserve(MetricHistogram histogram, uint32_t micros);
+int metricsRegisterRoute(const char *route);
+void metricsObserveRoute(int route, uint32_t micros);
+bool metricsRegisterGauge(const char *name, const char *help, MetricGaugeFn read);
+void handleMetrics();
+
+#endif // METRICS_H
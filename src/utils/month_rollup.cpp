@@ -0,0 +1,279 @@
+#include "month_rollup.h"
+#include "day_index.h"
+#include "day_rollover.h"
+#include "time_source.h"
+#include "sd_utils.h"
+#include "spi_bus.h"
+#include "logger.h"
+#include <algorithm>
+
+// Months waiting for a rollup, as year * 100 + month
+static std::vector<uint32_t> pending;
+static String scannedOn = "";  // Day the pending list was last rebuilt
+static unsigned long lastStep = 0;
+
+// The month being built, one day file per step
+struct RollupBuild {
+  bool active;
+  bool stale;  // Its day files changed while it was being built
+  int month;
+  int year;
+  int day;
+  int16_t counts[32];
+  uint32_t dayMask;
+  uint32_t sourceBytes;
+  std::vector<RollupEntry> entries;
+};
+static RollupBuild build = {};
+
+static String rollupPath(int month, int year) {
+  char path[40];
+  snprintf(path, sizeof(path), "/Attendance/%02d/rollup-%04d.bin", month, year);
+  return String(path);
+}
+
+// Months before the current one are closed
+static bool monthClosed(int month, int year) {
+  const String &today = todayDate();
+  if (today.length() != 10) return false;
+  int currentMonth = today.substring(3, 5).toInt();
+  int currentYear = today.substring(6).toInt();
+  return year < currentYear || (year == currentYear && month < currentMonth);
+}
+
+static void queueMonth(uint32_t key) {
+  if (std::find(pending.begin(), pending.end(), key) == pending.end()) {
+    pending.push_back(key);
+  }
+}
+
+// Closed months that have day files but no rollup
+static void findPending() {
+  pending.clear();
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File root = SD.open("/Attendance");
+  if (root) {
+    File dir = root.openNextFile();
+    while (dir) {
+      if (dir.isDirectory()) {
+        int month = String(dir.name()).toInt();
+        std::vector<uint32_t> withFiles, rolledUp;
+        File file = dir.openNextFile();
+        while (file) {
+          String fileName = file.name();
+          file.close();
+          if (fileName.length() == 14 && fileName.endsWith(".csv")) {
+            withFiles.push_back(fileName.substring(6, 10).toInt() * 100 + month);
+          } else if (fileName.startsWith("rollup-") && fileName.endsWith(".bin")) {
+            rolledUp.push_back(fileName.substring(7, 11).toInt() * 100 + month);
+          }
+          file = dir.openNextFile();
+        }
+        for (uint32_t key : withFiles) {
+          bool done = std::find(rolledUp.begin(), rolledUp.end(), key) != rolledUp.end();
+          if (!done && monthClosed(key % 100, key / 100)) {
+            queueMonth(key);
+          }
+        }
+      }
+      dir = root.openNextFile();
+    }
+    root.close();
+  }
+  spiBusRelease(SPI_DEV_SD);
+
+  // Newest first: the months reports are most likely to ask for
+  std::sort(pending.begin(), pending.end());
+  if (!pending.empty()) {
+    LOG_INFO("%d month(s) waiting for a rollup", (int)pending.size());
+  }
+}
+
+struct EntrySink {
+  RollupBuild *build;
+  int rows;
+};
+
+static void collectRow(const QueryRow &row, void *context) {
+  EntrySink *sink = (EntrySink *)context;
+  sink->build->entries.push_back(rollupEntryOf(sink->build->day, row));
+  sink->rows++;
+}
+
+static void startBuild(uint32_t key) {
+  build.active = true;
+  build.stale = false;
+  build.month = key % 100;
+  build.year = key / 100;
+  build.day = 1;
+  build.dayMask = 0;
+  build.sourceBytes = 0;
+  build.entries.clear();
+  if (!dayIndexMonth(build.month, build.year, build.counts)) {
+    build.active = false;
+  }
+}
+
+// Read the next day file that has rows
+static void stepBuild() {
+  while (build.day <= 31 && build.counts[build.day] <= 0) {
+    build.day++;
+  }
+  if (build.day > 31) return;
+
+  char date[11];
+  snprintf(date, sizeof(date), "%02d-%02d-%04d", build.day, build.month, build.year);
+  char chunk[512];
+  QueryLineState state;
+  EntrySink sink = {&build, 0};
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File file = SD.open(getAttendanceFilePath(date), FILE_READ);
+  if (file) {
+    queryBeginDay(state);
+    int read;
+    while ((read = file.read((uint8_t *)chunk, sizeof(chunk))) > 0) {
+      queryFeedRows(state, chunk, read, collectRow, &sink);
+      build.sourceBytes += read;
+    }
+    queryEndRows(state, collectRow, &sink);
+    file.close();
+  }
+  spiBusRelease(SPI_DEV_SD);
+
+  if (sink.rows > 0) {
+    build.dayMask |= 1UL << build.day;
+  }
+  build.day++;
+}
+
+static void finishBuild() {
+  build.active = false;
+  uint32_t key = build.year * 100 + build.month;
+  if (build.stale) {
+    queueMonth(key);  // Start over from the changed day files
+    return;
+  }
+
+  std::vector<uint8_t> encoded;
+  int rows = build.entries.size();
+  bool ok = rollupEncode(build.month, build.year, build.entries, build.dayMask, build.sourceBytes, encoded);
+  std::vector<RollupEntry>().swap(build.entries);  // Give the memory back
+  if (!ok) {
+    LOG_ERROR("Rollup for %02d-%04d does not fit the format", build.month, build.year);
+    return;
+  }
+
+  String path = rollupPath(build.month, build.year);
+  String tempPath = path + ".tmp";
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File file = SD.open(tempPath, FILE_WRITE);
+  ok = file && file.write(encoded.data(), encoded.size()) == encoded.size();
+  if (file) file.close();
+  ok = ok && (!SD.exists(path) || SD.remove(path)) && SD.rename(tempPath, path);
+  spiBusRelease(SPI_DEV_SD);
+
+  if (ok) {
+    LOG_INFO("Rolled up %02d-%04d: %d rows, %u bytes of day files into %u", build.month, build.year, rows,
+             (unsigned)build.sourceBytes, (unsigned)encoded.size());
+  } else {
+    LOG_ERROR("Failed to write rollup %s", path.c_str());
+  }
+}
+
+void monthRollupTick() {
+  unsigned long interval = build.active ? ROLLUP_STEP_INTERVAL_MS : ROLLUP_SCAN_INTERVAL_MS;
+  if (lastStep != 0 && millis() - lastStep < interval) return;
+  lastStep = millis();
+
+  // Provisional stamps may still move between days when NTP answers
+  if (!sdCardInitialized || clockQuality() != CLOCK_SYNCED || todayDate() == "") return;
+
+  if (build.active) {
+    if (build.day > 31) {
+      finishBuild();
+    } else {
+      stepBuild();
+    }
+    return;
+  }
+
+  if (scannedOn != todayDate()) {
+    scannedOn = todayDate();
+    findPending();
+  }
+  if (!pending.empty()) {
+    uint32_t key = pending.back();
+    pending.pop_back();
+    startBuild(key);
+  }
+}
+
+bool monthRollupLoad(int month, int year, MonthRollup &rollup) {
+  if (!sdCardInitialized) return false;
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File file = SD.open(rollupPath(month, year), FILE_READ);
+  std::vector<uint8_t> data;
+  if (file) {
+    data.resize(file.size());
+    if (file.read(data.data(), data.size()) != data.size()) {
+      data.clear();
+    }
+    file.close();
+  }
+  spiBusRelease(SPI_DEV_SD);
+  return !data.empty() && rollupDecode(data.data(), data.size(), rollup);
+}
+
+// A closed month's day file changed: its rollup no longer matches
+void monthRollupInvalidate(const String &date) {
+  int month = date.substring(3, 5).toInt();
+  int year = date.substring(6).toInt();
+  if (!monthClosed(month, year)) return;
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  String path = rollupPath(month, year);
+  if (SD.exists(path)) {
+    SD.remove(path);
+  }
+  spiBusRelease(SPI_DEV_SD);
+
+  if (build.active && build.month == month && build.year == year) {
+    build.stale = true;
+  } else {
+    queueMonth(year * 100 + month);
+  }
+}
+
+void monthRollupClear() {
+  pending.clear();
+  build.active = false;
+  std::vector<RollupEntry>().swap(build.entries);
+  scannedOn = "";
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File root = SD.open("/Attendance");
+  if (root) {
+    File dir = root.openNextFile();
+    while (dir) {
+      if (dir.isDirectory()) {
+        String dirPath = "/Attendance/" + String(dir.name());
+        std::vector<String> rollups;
+        File file = dir.openNextFile();
+        while (file) {
+          String fileName = file.name();
+          if (fileName.startsWith("rollup-")) {
+            rollups.push_back(dirPath + "/" + fileName);
+          }
+          file = dir.openNextFile();
+        }
+        for (const String &path : rollups) {
+          SD.remove(path);
+        }
+      }
+      dir = root.openNextFile();
+    }
+    root.close();
+  }
+  spiBusRelease(SPI_DEV_SD);
+}
@@ -0,0 +1,24 @@
+#ifndef MONTH_ROLLUP_H
+#define MONTH_ROLLUP_H
+
+#include "../config/config.h"
+#include "rollup_format.h"
+
+// Background compaction of closed months into columnar rollups
+// (/Attendance/MM/rollup-YYYY.bin, layout in rollup_format.h). Once a
+// month is over its day files are read one per tick, so scans are never
+// held up for long, and the rollup is written through a temp file. Day
+// files stay where they are for exports; reports read the rollup instead.
+// Any later change to a closed month's day files drops its rollup and
+// queues the month again.
+
+#define ROLLUP_SCAN_INTERVAL_MS 10000  // Looking for work
+#define ROLLUP_STEP_INTERVAL_MS 200    // Between day files while building
+
+// Function declarations for monthly rollups
+void monthRollupTick();
+bool monthRollupLoad(int month, int year, MonthRollup &rollup);
+void monthRollupInvalidate(const String &date);
+void monthRollupClear();
+
+#endif // MONTH_ROLLUP_H
@@ -0,0 +1,577 @@
+#include "presence_index.h"
+#include "attendance_query.h"
+#include "month_rollup.h"
+#include "day_index.h"
+#include "day_rollover.h"
+#include "sd_utils.h"
+#include "spi_bus.h"
+#include "logger.h"
+#include "mem_pool.h"
+#include "mem_placement.h"
+#include <rom/crc.h>
+#include <vector>
+
+#define PRESENCE_MAGIC 0x53455250  // "PRES"
+#define PRESENCE_VERSION 1
+#define PRESENCE_BITS (PRESENCE_WORDS * 32)
+
+struct PresenceHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t startYear;
+  uint16_t students;
+  uint16_t reserved;
+  uint32_t crc;  // CRC32 of everything after the header
+};
+
+struct PresenceRow {
+  uint16_t id;
+  uint32_t days[PRESENCE_WORDS];
+};
+
+static int loadedYear = 0;  // Year the loaded term began, 0 before the first load
+static uint32_t schoolDays[PRESENCE_WORDS];
+static uint32_t holidays[PRESENCE_WORDS];
+static PresenceRow *rows = NULL;  // PRESENCE_MAX_STUDENTS, allocated with the first term
+static int rowCount = 0;
+static int logLines = 0;
+static unsigned long lastStep = 0;
+
+// Filling in a term that has no snapshot, month by month
+struct PresenceFill {
+  bool active;
+  int month;
+  int year;
+  int day;  // 0 until the month's day index has been read
+  int16_t counts[32];
+};
+static PresenceFill fill = {};
+
+static void setBit(uint32_t *bits, int day) {
+  bits[day / 32] |= 1UL << (day % 32);
+}
+
+static void clearBit(uint32_t *bits, int day) {
+  bits[day / 32] &= ~(1UL << (day % 32));
+}
+
+static bool testBit(const uint32_t *bits, int day) {
+  return bits[day / 32] & (1UL << (day % 32));
+}
+
+static int32_t termStart(int termYear) {
+  return queryDayNumber(1, PRESENCE_YEAR_START_MONTH, termYear);
+}
+
+// Term and day of term (0 = first day) for "DD-MM-YYYY"
+static bool termOf(const String &date, int &termYear, int &termDay) {
+  int32_t dayNumber;
+  if (!queryParseDate(date.c_str(), dayNumber)) return false;
+  int day, month, year;
+  queryDateOf(dayNumber, day, month, year);
+  termYear = month >= PRESENCE_YEAR_START_MONTH ? year : year - 1;
+  termDay = dayNumber - termStart(termYear);
+  return termDay >= 0 && termDay < PRESENCE_BITS;
+}
+
+static String termPath(int termYear, const char *extension) {
+  char path[40];
+  snprintf(path, sizeof(path), "/Attendance/presence-%04d.%s", termYear, extension);
+  return String(path);
+}
+
+static PresenceRow *rowFor(uint16_t id, bool create) {
+  for (int i = 0; i < rowCount; i++) {
+    if (rows[i].id == id) return &rows[i];
+  }
+  if (!create || id == 0) return NULL;
+  if (rowCount >= PRESENCE_MAX_STUDENTS) {
+    LOG_WARN("Presence index full, cannot track student %u", id);
+    return NULL;
+  }
+  PresenceRow &row = rows[rowCount++];
+  row.id = id;
+  memset(row.days, 0, sizeof(row.days));
+  return &row;
+}
+
+// One change, as it is logged:
+//   +  id present on day        -  id not present on day after all
+//   x  day file deleted         H/h  day is/is not a holiday
+//   f  id forgotten             F  everyone forgotten
+static void apply(char kind, int id, int day) {
+  if (day < 0 || day >= PRESENCE_BITS) return;
+  PresenceRow *row;
+  switch (kind) {
+    case '+':
+      row = rowFor(id, true);
+      if (row) setBit(row->days, day);
+      setBit(schoolDays, day);
+      break;
+    case '-':
+      row = rowFor(id, false);
+      if (row) clearBit(row->days, day);
+      break;
+    case 'x':
+      clearBit(schoolDays, day);
+      for (int i = 0; i < rowCount; i++) {
+        clearBit(rows[i].days, day);
+      }
+      break;
+    case 'H':
+      setBit(holidays, day);
+      break;
+    case 'h':
+      clearBit(holidays, day);
+      break;
+    case 'f':
+      row = rowFor(id, false);
+      if (row) *row = rows[--rowCount];
+      break;
+    case 'F':
+      rowCount = 0;
+      break;
+  }
+}
+
+static bool writeSnapshot() {
+  PresenceHeader header = {PRESENCE_MAGIC, PRESENCE_VERSION, (uint16_t)loadedYear, (uint16_t)rowCount, 0, 0};
+  header.crc = crc32_le(0, (const uint8_t *)schoolDays, sizeof(schoolDays));
+  header.crc = crc32_le(header.crc, (const uint8_t *)holidays, sizeof(holidays));
+  header.crc = crc32_le(header.crc, (const uint8_t *)rows, rowCount * sizeof(PresenceRow));
+
+  String path = termPath(loadedYear, "bin");
+  String tempPath = path + ".tmp";
+  File file = SD.open(tempPath, FILE_WRITE);
+  if (!file) return false;
+  bool ok = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+            file.write((const uint8_t *)schoolDays, sizeof(schoolDays)) == sizeof(schoolDays) &&
+            file.write((const uint8_t *)holidays, sizeof(holidays)) == sizeof(holidays) &&
+            file.write((const uint8_t *)rows, rowCount * sizeof(PresenceRow)) == rowCount * sizeof(PresenceRow);
+  file.close();
+  ok = ok && (!SD.exists(path) || SD.remove(path)) && SD.rename(tempPath, path);
+  if (!ok) {
+    LOG_WARN("Failed to write presence snapshot %s", path.c_str());
+    return false;
+  }
+
+  // The snapshot has everything the log had
+  String logPath = termPath(loadedYear, "log");
+  if (SD.exists(logPath)) {
+    SD.remove(logPath);
+  }
+  logLines = 0;
+  return true;
+}
+
+static bool readSnapshot() {
+  File file = SD.open(termPath(loadedYear, "bin"), FILE_READ);
+  if (!file) return false;
+
+  PresenceHeader header;
+  bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) && header.magic == PRESENCE_MAGIC &&
+            header.version == PRESENCE_VERSION && header.startYear == loadedYear &&
+            header.students <= PRESENCE_MAX_STUDENTS &&
+            file.size() == sizeof(header) + sizeof(schoolDays) + sizeof(holidays) + header.students * sizeof(PresenceRow);
+  ok = ok && file.read((uint8_t *)schoolDays, sizeof(schoolDays)) == sizeof(schoolDays) &&
+       file.read((uint8_t *)holidays, sizeof(holidays)) == sizeof(holidays) &&
+       file.read((uint8_t *)rows, header.students * sizeof(PresenceRow)) == header.students * sizeof(PresenceRow);
+  file.close();
+  if (ok) {
+    uint32_t crc = crc32_le(0, (const uint8_t *)schoolDays, sizeof(schoolDays));
+    crc = crc32_le(crc, (const uint8_t *)holidays, sizeof(holidays));
+    crc = crc32_le(crc, (const uint8_t *)rows, header.students * sizeof(PresenceRow));
+    ok = crc == header.crc;
+  }
+
+  if (!ok) {
+    LOG_WARN("Presence snapshot for %d is damaged, filling it in again", loadedYear);
+    memset(schoolDays, 0, sizeof(schoolDays));
+    memset(holidays, 0, sizeof(holidays));
+    return false;
+  }
+  rowCount = header.students;
+  return true;
+}
+
+static void loadTerm(int termYear) {
+  // Fold the old term's log in before moving on
+  if (loadedYear != 0 && !fill.active && logLines > 0) {
+    writeSnapshot();
+  }
+
+  loadedYear = termYear;
+  rowCount = 0;
+  logLines = 0;
+  memset(schoolDays, 0, sizeof(schoolDays));
+  memset(holidays, 0, sizeof(holidays));
+  bool complete = readSnapshot();
+
+  File log = SD.open(termPath(termYear, "log"), FILE_READ);
+  if (log) {
+    while (log.available()) {
+      String line = log.readStringUntil('\n');
+      char kind;
+      int id, day;
+      if (sscanf(line.c_str(), "%c,%d,%d", &kind, &id, &day) == 3) {
+        apply(kind, id, day);
+        logLines++;
+      }
+    }
+    log.close();
+  }
+
+  fill.active = !complete;
+  if (fill.active) {
+    fill.month = PRESENCE_YEAR_START_MONTH;
+    fill.year = termYear;
+    fill.day = 0;
+    LOG_INFO("Filling in presence for the term starting %d", termYear);
+  }
+}
+
+// Load the term today falls in
+static bool ensureTerm() {
+  int termYear, termDay;
+  if (!sdCardInitialized || !termOf(todayDate(), termYear, termDay)) return false;
+  if (!rows) {
+    rows = (PresenceRow *)memAlloc(PRESENCE_MAX_STUDENTS * sizeof(PresenceRow), MEM_USE_PRESENCE);
+    if (!rows) return false;
+  }
+  if (termYear != loadedYear) {
+    spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+    loadTerm(termYear);
+    spiBusRelease(SPI_DEV_SD);
+  }
+  return true;
+}
+
+// Log the same change for several IDs in one append
+static void appendLines(char kind, const uint16_t *ids, int count, int day) {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File log = SD.open(termPath(loadedYear, "log"), FILE_APPEND);
+  if (log) {
+    for (int i = 0; i < count; i++) {
+      log.printf("%c,%d,%d\n", kind, ids[i], day);
+    }
+    log.close();
+    logLines += count;
+  }
+  // A snapshot taken mid-fill would look complete
+  if (logLines > PRESENCE_COMPACT_LINES && !fill.active) {
+    writeSnapshot();
+  }
+  spiBusRelease(SPI_DEV_SD);
+}
+
+static void appendLine(char kind, int id, int day) {
+  uint16_t one = id;
+  appendLines(kind, &one, 1, day);
+}
+
+// Apply and log a change to a day of the current term; other terms are
+// not served and are left alone
+static void record(const String &date, char kind, int id) {
+  int termYear, termDay;
+  if (!ensureTerm() || !termOf(date, termYear, termDay) || termYear != loadedYear) return;
+  apply(kind, id, termDay);
+  appendLine(kind, id, termDay);
+}
+
+static void markRow(const QueryRow &row, void *context) {
+  int termDay = *(int *)context;
+  if (row.id == 0) return;
+  PresenceRow *presence = rowFor(row.id, true);
+  if (presence) setBit(presence->days, termDay);
+  setBit(schoolDays, termDay);
+}
+
+// A closed month in one go from its rollup's presence bitsets
+static void fillFromRollup(const MonthRollup &rollup) {
+  size_t stride = (rollup.ids.size() + 7) / 8;
+  int32_t start = termStart(loadedYear);
+  for (int day = 1; day <= 31; day++) {
+    int termDay = queryDayNumber(day, rollup.month, rollup.year) - start;
+    if (termDay < 0 || termDay >= PRESENCE_BITS) continue;
+    if (rollup.dayMask & (1UL << day)) {
+      setBit(schoolDays, termDay);
+    }
+    const uint8_t *bits = stride ? &rollup.presence[(day - 1) * stride] : NULL;
+    for (size_t column = 0; bits && column < rollup.ids.size(); column++) {
+      if (bits[column / 8] & (1 << (column % 8))) {
+        PresenceRow *row = rowFor(rollup.ids[column], true);
+        if (row) setBit(row->days, termDay);
+      }
+    }
+  }
+}
+
+static void nextFillMonth() {
+  fill.day = 0;
+  if (++fill.month > 12) {
+    fill.month = 1;
+    fill.year++;
+  }
+}
+
+// Fill in one closed month from its rollup or one day file
+static void stepFill() {
+  int termYear, today;
+  termOf(todayDate(), termYear, today);
+  if (queryDayNumber(1, fill.month, fill.year) > termStart(loadedYear) + today) {
+    fill.active = false;
+    spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+    writeSnapshot();
+    spiBusRelease(SPI_DEV_SD);
+    LOG_INFO("Presence for the term starting %d filled in: %d students", loadedYear, rowCount);
+    return;
+  }
+
+  if (fill.day == 0) {
+    MonthRollup rollup;
+    if (monthRollupLoad(fill.month, fill.year, rollup)) {
+      fillFromRollup(rollup);
+      nextFillMonth();
+      return;
+    }
+    if (!dayIndexMonth(fill.month, fill.year, fill.counts)) return;  // SD card gone; try again later
+    fill.day = 1;
+  }
+
+  while (fill.day <= 31 && fill.counts[fill.day] <= 0) {
+    fill.day++;
+  }
+  if (fill.day > 31) {
+    nextFillMonth();
+    return;
+  }
+
+  char date[11];
+  snprintf(date, sizeof(date), "%02d-%02d-%04d", fill.day, fill.month, fill.year);
+  int termDay = queryDayNumber(fill.day, fill.month, fill.year) - termStart(loadedYear);
+  char chunk[512];
+  QueryLineState state;
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File file = SD.open(getAttendanceFilePath(date), FILE_READ);
+  if (file) {
+    queryBeginDay(state);
+    int read;
+    while ((read = file.read((uint8_t *)chunk, sizeof(chunk))) > 0) {
+      queryFeedRows(state, chunk, read, markRow, &termDay);
+    }
+    queryEndRows(state, markRow, &termDay);
+    file.close();
+  }
+  spiBusRelease(SPI_DEV_SD);
+  fill.day++;
+}
+
+void presenceIndexTick() {
+  if (lastStep != 0 && millis() - lastStep < PRESENCE_STEP_INTERVAL_MS) return;
+  lastStep = millis();
+
+  if (ensureTerm() && fill.active) {
+    stepFill();
+  }
+}
+
+void presenceIndexMark(const String &date, uint16_t id) {
+  record(date, '+', id);
+}
+
+void presenceIndexUnmark(const String &date, uint16_t id) {
+  record(date, '-', id);
+}
+
+void presenceIndexRemoveDay(const String &date) {
+  record(date, 'x', 0);
+}
+
+bool presenceIndexSetHoliday(const String &date, bool holiday) {
+  int termYear, termDay;
+  if (!ensureTerm() || !termOf(date, termYear, termDay) || termYear != loadedYear) return false;
+  record(date, holiday ? 'H' : 'h', 0);
+  return true;
+}
+
+bool presenceIndexIsHoliday(const String &date) {
+  int termYear, termDay;
+  return ensureTerm() && termOf(date, termYear, termDay) && termYear == loadedYear && testBit(holidays, termDay);
+}
+
+void presenceIndexForget(uint16_t id) {
+  if (!ensureTerm()) return;
+  apply('f', id, 0);
+  appendLine('f', id, 0);
+}
+
+// Bulk delete: every 'f' entry goes out in a single append
+void presenceIndexForgetMany(const uint16_t *ids, int count) {
+  if (count <= 0 || !ensureTerm()) return;
+  for (int i = 0; i < count; i++) {
+    apply('f', ids[i], 0);
+  }
+  appendLines('f', ids, count, 0);
+}
+
+void presenceIndexForgetAll() {
+  if (!ensureTerm()) return;
+  apply('F', 0, 0);
+  appendLine('F', 0, 0);
+}
+
+// Drop every term; the current one is filled in again from the day files
+void presenceIndexClear() {
+  loadedYear = 0;
+  rowCount = 0;
+  logLines = 0;
+  fill.active = false;
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  std::vector<String> paths;
+  File root = SD.open("/Attendance");
+  if (root) {
+    File file = root.openNextFile();
+    while (file) {
+      String fileName = file.name();
+      if (fileName.startsWith("presence-")) {
+        paths.push_back("/Attendance/" + fileName);
+      }
+      file = root.openNextFile();
+    }
+    root.close();
+  }
+  for (const String &path : paths) {
+    SD.remove(path);
+  }
+  spiBusRelease(SPI_DEV_SD);
+}
+
+// School days before today, holidays left out
+static int countedDays(uint32_t counted[PRESENCE_WORDS]) {
+  int termYear, today;
+  termOf(todayDate(), termYear, today);
+  if (termYear != loadedYear) today = PRESENCE_BITS;
+  int total = 0;
+  for (int w = 0; w < PRESENCE_WORDS; w++) {
+    uint32_t before = today >= (w + 1) * 32 ? 0xFFFFFFFF : today <= w * 32 ? 0 : (1UL << (today - w * 32)) - 1;
+    counted[w] = schoolDays[w] & ~holidays[w] & before;
+    total += __builtin_popcount(counted[w]);
+  }
+  return total;
+}
+
+static void statsOf(uint16_t id, const uint32_t counted[PRESENCE_WORDS], int total, PresenceStats &stats) {
+  memset(&stats, 0, sizeof(stats));
+  stats.id = id;
+  stats.schoolDays = total;
+  PresenceRow *row = rowFor(id, false);
+  if (row) {
+    for (int w = 0; w < PRESENCE_WORDS; w++) {
+      stats.present += __builtin_popcount(row->days[w] & counted[w]);
+    }
+
+    int run = 0;
+    for (int day = 0; day < PRESENCE_BITS; day++) {
+      if (!testBit(counted, day)) continue;
+      run = testBit(row->days, day) ? run + 1 : 0;
+      if (run > stats.longestStreak) stats.longestStreak = run;
+    }
+    stats.streak = run;
+  }
+  stats.low = total >= PRESENCE_MIN_DAYS && stats.present * 100 < PRESENCE_LOW_PERCENT * total;
+}
+
+bool presenceIndexStats(uint16_t id, PresenceStats &stats) {
+  if (!ensureTerm()) return false;
+  uint32_t counted[PRESENCE_WORDS];
+  int total = countedDays(counted);
+  statsOf(id, counted, total, stats);
+  return true;
+}
+
+// Share of school days the roster was present this term, -1 if not known yet
+int presenceIndexTermRate() {
+  if (!ensureTerm() || fill.active || namid == 0) return -1;
+  uint32_t counted[PRESENCE_WORDS];
+  int total = countedDays(counted);
+  if (total == 0) return -1;
+
+  uint32_t present = 0;
+  for (int i = 0; i < namid; i++) {
+    PresenceStats stats;
+    statsOf(name[i][1].toInt(), counted, total, stats);
+    present += stats.present;
+  }
+  return present * 100 / ((uint32_t)namid * total);
+}
+
+static String termDate(int termDay) {
+  int day, month, year;
+  queryDateOf(termStart(loadedYear) + termDay, day, month, year);
+  char date[11];
+  snprintf(date, sizeof(date), "%02d-%02d-%04d", day, month, year);
+  return String(date);
+}
+
+// GET /api/attendance/presence[?id=7]
+// {"ready":true,"termStart":"01-01-2026","schoolDays":180,"holidays":[...],
+//  "lowPercent":75,"rate":91,"low":3,"students":[{"id":7,"roll":"..","name":"..",
+//  "present":170,"percent":94,"streak":12,"longest":40,"low":false},...]}
+void handlePresenceSummary() {
+  if (!ensureTerm()) {
+    server.send(503, "application/json", "{\"error\":\"SD card or clock not ready\"}");
+    return;
+  }
+  int onlyId = server.hasArg("id") ? server.arg("id").toInt() : -1;
+
+  uint32_t counted[PRESENCE_WORDS];
+  int total = countedDays(counted);
+  ArenaString students;
+  int low = 0;
+  uint32_t present = 0;
+  for (int i = 0; i < namid; i++) {
+    PresenceStats stats;
+    statsOf(name[i][1].toInt(), counted, total, stats);
+    present += stats.present;
+    if (stats.low) low++;
+    if (onlyId >= 0 && stats.id != onlyId) continue;
+
+    students.add(students.length() ? ",{\"id\":" : "{\"id\":").addInt(stats.id)
+        .add(",\"roll\":").addJson(name[i][2]).add(",\"name\":").addJson(name[i][0])
+        .add(",\"present\":").addInt(stats.present)
+        .add(",\"percent\":").addInt(total ? stats.present * 100 / total : 0)
+        .add(",\"streak\":").addInt(stats.streak).add(",\"longest\":").addInt(stats.longestStreak)
+        .add(",\"low\":").add(stats.low ? "true}" : "false}");
+  }
+
+  int rate = namid && total ? present * 100 / ((uint32_t)namid * total) : 0;
+  ArenaString json;
+  json.add("{\"ready\":").add(fill.active ? "false" : "true").add(",\"termStart\":\"").add(termDate(0))
+      .add("\",\"schoolDays\":").addInt(total).add(",\"holidays\":[");
+  bool first = true;
+  for (int day = 0; day < PRESENCE_BITS; day++) {
+    if (testBit(holidays, day)) {
+      json.add(first ? "\"" : ",\"").add(termDate(day)).add('"');
+      first = false;
+    }
+  }
+  json.add("],\"lowPercent\":").addInt(PRESENCE_LOW_PERCENT).add(",\"rate\":").addInt(rate)
+      .add(",\"low\":").addInt(low).add(",\"students\":[").add(students.c_str(), students.length()).add("]}");
+  arenaSend(200, "application/json", json);
+}
+
+// POST /api/attendance/holiday  date=DD-MM-YYYY&holiday=1|0
+void handlePresenceHoliday() {
+  if (server.method() != HTTP_POST) {
+    server.send(405, "application/json", "{\"error\":\"Method Not Allowed\"}");
+    return;
+  }
+  String date = server.arg("date");
+  if (!presenceIndexSetHoliday(date, server.arg("holiday") != "0")) {
+    server.send(400, "application/json", "{\"error\":\"date must be DD-MM-YYYY in the current term\"}");
+    return;
+  }
+  server.send(200, "application/json", "{\"ok\":true}");
+}
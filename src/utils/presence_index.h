@@ -0,0 +1,53 @@
+#ifndef PRESENCE_INDEX_H
+#define PRESENCE_INDEX_H
+
+#include "../config/config.h"
+
+// Per-student presence for the current academic year: one bit per calendar
+// day, so term percentages and streaks are popcounts instead of a scan of
+// every day file. Next to the students' bits the year keeps two day masks:
+// school days (anyone scanned in) and holidays (set from the web UI, and
+// never counted even if someone scanned).
+//
+//   /Attendance/presence-YYYY.bin   snapshot, YYYY the year the term began
+//   /Attendance/presence-YYYY.log   changes since, one line each
+//
+// An in-scan appends one short line; the log is folded into the snapshot
+// once it grows past PRESENCE_COMPACT_LINES. A year without a snapshot is
+// filled in from rollups and day files, one step per tick. Term figures
+// only count days before today, so a day counts once it is over.
+
+#define PRESENCE_YEAR_START_MONTH 1    // The academic year starts on the 1st of this month
+#define PRESENCE_WORDS 12              // 384 bits, enough for any year
+#define PRESENCE_MAX_STUDENTS 128
+#define PRESENCE_COMPACT_LINES 256
+#define PRESENCE_LOW_PERCENT 75        // Below this a student is flagged
+#define PRESENCE_MIN_DAYS 10           // School days before anyone is flagged
+#define PRESENCE_STEP_INTERVAL_MS 200  // Between day files while filling in
+
+struct PresenceStats {
+  uint16_t id;
+  uint16_t present;     // School days present so far this year
+  uint16_t schoolDays;  // School days so far, holidays excluded
+  uint16_t streak;      // Present on each of the last n school days
+  uint16_t longestStreak;
+  bool low;
+};
+
+// Function declarations for the presence index
+void presenceIndexTick();
+void presenceIndexMark(const String &date, uint16_t id);
+void presenceIndexUnmark(const String &date, uint16_t id);
+void presenceIndexRemoveDay(const String &date);
+bool presenceIndexSetHoliday(const String &date, bool holiday);
+bool presenceIndexIsHoliday(const String &date);
+void presenceIndexForget(uint16_t id);
+void presenceIndexForgetMany(const uint16_t *ids, int count);
+void presenceIndexForgetAll();
+void presenceIndexClear();
+bool presenceIndexStats(uint16_t id, PresenceStats &stats);
+int presenceIndexTermRate();
+void handlePresenceSummary();
+void handlePresenceHoliday();
+
+#endif // PRESENCE_INDEX_H
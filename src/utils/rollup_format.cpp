@@ -0,0 +1,145 @@
+#include "rollup_format.h"
+#include <string.h>
+#include <algorithm>
+
+// Bitwise CRC32 (same polynomial as crc32_le), small enough to build anywhere
+static uint32_t rollupCrc(const uint8_t *data, size_t size) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
+
+static size_t strideOf(size_t students) {
+  return (students + 7) / 8;
+}
+
+RollupEntry rollupEntryOf(int day, const QueryRow &row) {
+  RollupEntry entry;
+  entry.day = day;
+  entry.id = row.id;
+  entry.inMinute = row.inTime == QUERY_NO_TIME ? ROLLUP_NO_MINUTE : std::min<uint32_t>((row.inTime + 59) / 60, 1439);
+  entry.outMinute = row.outTime == QUERY_NO_TIME ? ROLLUP_NO_MINUTE : row.outTime / 60;
+  return entry;
+}
+
+bool rollupEncode(int month, int year, std::vector<RollupEntry> &entries, uint32_t dayMask, uint32_t sourceBytes,
+                  std::vector<uint8_t> &out) {
+  std::vector<uint16_t> ids;
+  for (const RollupEntry &entry : entries) {
+    ids.push_back(entry.id);
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  if (ids.size() > 0xFFFF || entries.size() > 0xFFFF) return false;
+
+  std::sort(entries.begin(), entries.end(), [](const RollupEntry &a, const RollupEntry &b) {
+    return a.day != b.day ? a.day < b.day : a.id < b.id;
+  });
+
+  size_t stride = strideOf(ids.size());
+  std::vector<uint8_t> presence(31 * stride, 0);
+  std::vector<uint16_t> inMinutes, outMinutes;
+  for (const RollupEntry &entry : entries) {
+    if (entry.day < 1 || entry.day > 31) continue;
+    size_t column = std::lower_bound(ids.begin(), ids.end(), entry.id) - ids.begin();
+    uint8_t &byte = presence[(entry.day - 1) * stride + column / 8];
+    uint8_t mask = 1 << (column % 8);
+    if (byte & mask) continue;  // A second row for the same student and day
+    byte |= mask;
+    inMinutes.push_back(entry.inMinute);
+    outMinutes.push_back(entry.outMinute);
+  }
+
+  RollupHeader header;
+  header.magic = ROLLUP_MAGIC;
+  header.version = ROLLUP_VERSION;
+  header.month = month;
+  header.year = year;
+  header.students = ids.size();
+  header.rows = inMinutes.size();
+  header.dayMask = dayMask;
+  header.sourceBytes = sourceBytes;
+
+  size_t body = ids.size() * 2 + presence.size() + inMinutes.size() * 4;
+  out.resize(sizeof(header) + body);
+  uint8_t *p = out.data() + sizeof(header);
+  memcpy(p, ids.data(), ids.size() * 2);
+  p += ids.size() * 2;
+  memcpy(p, presence.data(), presence.size());
+  p += presence.size();
+  memcpy(p, inMinutes.data(), inMinutes.size() * 2);
+  p += inMinutes.size() * 2;
+  memcpy(p, outMinutes.data(), outMinutes.size() * 2);
+
+  header.crc = rollupCrc(out.data() + sizeof(header), body);
+  memcpy(out.data(), &header, sizeof(header));
+  return true;
+}
+
+bool rollupDecode(const uint8_t *data, size_t size, MonthRollup &rollup) {
+  RollupHeader header;
+  if (size < sizeof(header)) return false;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != ROLLUP_MAGIC || header.version != ROLLUP_VERSION) return false;
+
+  size_t stride = strideOf(header.students);
+  size_t body = header.students * 2 + 31 * stride + header.rows * 4;
+  if (size != sizeof(header) + body || rollupCrc(data + sizeof(header), body) != header.crc) return false;
+
+  rollup.month = header.month;
+  rollup.year = header.year;
+  rollup.dayMask = header.dayMask;
+  rollup.sourceBytes = header.sourceBytes;
+  rollup.bytes = size;
+  const uint8_t *p = data + sizeof(header);
+  rollup.ids.resize(header.students);
+  memcpy(rollup.ids.data(), p, header.students * 2);
+  p += header.students * 2;
+  rollup.presence.assign(p, p + 31 * stride);
+  p += 31 * stride;
+  rollup.inMinutes.resize(header.rows);
+  memcpy(rollup.inMinutes.data(), p, header.rows * 2);
+  p += header.rows * 2;
+  rollup.outMinutes.resize(header.rows);
+  memcpy(rollup.outMinutes.data(), p, header.rows * 2);
+  return true;
+}
+
+// Run a month's rows through the query engine, as the day files would be.
+// rolls[n] is the roll number for ids[n], or NULL to use "".
+void rollupFeed(const MonthRollup &rollup, const char *const *rolls, const AttendanceQuery &query, QueryResult &result) {
+  size_t stride = strideOf(rollup.ids.size());
+  size_t row = 0;
+  result.bytesScanned += rollup.bytes;
+  for (int day = 1; day <= 31; day++) {
+    int32_t dayNumber = queryDayNumber(day, rollup.month, rollup.year);
+    bool inRange = dayNumber >= query.fromDay && dayNumber <= query.toDay;
+    if (inRange && (rollup.dayMask & (1UL << day))) {
+      result.daysScanned++;
+    }
+
+    if (stride == 0) continue;
+    const uint8_t *bits = &rollup.presence[(day - 1) * stride];
+    for (size_t column = 0; column < rollup.ids.size(); column++) {
+      if (!(bits[column / 8] & (1 << (column % 8)))) continue;
+      if (inRange && row < rollup.inMinutes.size()) {
+        QueryRow entry;
+        entry.id = rollup.ids[column];
+        const char *roll = rolls && rolls[column] ? rolls[column] : "";
+        strncpy(entry.roll, roll, QUERY_ROLL_LEN - 1);
+        entry.roll[QUERY_ROLL_LEN - 1] = '\0';
+        uint16_t in = rollup.inMinutes[row];
+        uint16_t out = rollup.outMinutes[row];
+        entry.inTime = in == ROLLUP_NO_MINUTE ? QUERY_NO_TIME : in * 60U;
+        entry.outTime = out == ROLLUP_NO_MINUTE ? QUERY_NO_TIME : out * 60U;
+        queryAddRow(query, result, entry);
+      }
+      row++;
+    }
+  }
+}
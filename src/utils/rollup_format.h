@@ -0,0 +1,66 @@
+#ifndef ROLLUP_FORMAT_H
+#define ROLLUP_FORMAT_H
+
+// Columnar monthly rollup of the day files (/Attendance/MM/rollup-YYYY.bin).
+//
+// Layout, all little-endian:
+//   header    RollupHeader, 24 bytes
+//   ids       uint16 per student seen that month, ascending
+//   presence  31 bitsets, one per day, (students + 7) / 8 bytes each;
+//             bit n of day d set when ids[n] has a row on day d
+//   in        uint16 minute of day per set presence bit, in day then id order
+//   out       uint16 minute of day, same order; ROLLUP_NO_MINUTE if none
+//
+// In-times are rounded up to the minute and out-times down, so lateness
+// matches the day files and worked time is never overstated. Names and
+// roll numbers are left out; they come from the roster.
+//
+// Plain C++ with no Arduino types, so tools/bench can build it on a PC.
+
+#include "attendance_query.h"
+#include <vector>
+
+#define ROLLUP_MAGIC 0x50554C52  // "RLUP"
+#define ROLLUP_VERSION 1
+#define ROLLUP_NO_MINUTE 0xFFFF
+
+struct RollupHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t month;
+  uint16_t year;
+  uint16_t students;
+  uint16_t rows;
+  uint32_t dayMask;      // Bit d set: day d had at least one row
+  uint32_t sourceBytes;  // Size of the day files rolled up
+  uint32_t crc;          // CRC32 of everything after the header
+};
+
+// One day-file row on its way into a rollup
+struct RollupEntry {
+  uint8_t day;
+  uint16_t id;
+  uint16_t inMinute;
+  uint16_t outMinute;
+};
+
+struct MonthRollup {
+  int month;
+  int year;
+  uint32_t dayMask;
+  uint32_t sourceBytes;
+  uint32_t bytes;  // Size of the rollup itself
+  std::vector<uint16_t> ids;
+  std::vector<uint8_t> presence;
+  std::vector<uint16_t> inMinutes;
+  std::vector<uint16_t> outMinutes;
+};
+
+// Function declarations for the rollup format
+RollupEntry rollupEntryOf(int day, const QueryRow &row);
+bool rollupEncode(int month, int year, std::vector<RollupEntry> &entries, uint32_t dayMask, uint32_t sourceBytes,
+                  std::vector<uint8_t> &out);
+bool rollupDecode(const uint8_t *data, size_t size, MonthRollup &rollup);
+void rollupFeed(const MonthRollup &rollup, const char *const *rolls, const AttendanceQuery &query, QueryResult &result);
+
+#endif // ROLLUP_FORMAT_H
@@ -0,0 +1,286 @@
+#include "roster_store.h"
+#include "sd_utils.h"
+#include "spi_bus.h"
+#include "metrics.h"
+#include "logger.h"
+#include <rom/crc.h>
+
+#define ROSTER_TEMP_PATH "/students.csv.tmp"
+
+static int walLines = 0;
+
+int rosterStoreFind(uint16_t id) {
+  for (int i = 0; i < namid; i++) {
+    if (name[i][1].toInt() == id) return i;
+  }
+  return -1;
+}
+
+static bool applyPut(uint16_t id, const String &roll, const String &studentName) {
+  int index = rosterStoreFind(id);
+  if (index < 0) {
+    if (namid >= 128) return false;
+    index = namid++;
+  }
+  name[index][0] = studentName;
+  name[index][1] = String(id);
+  name[index][2] = roll;
+  if (id >= addid) {
+    addid = id + 1;
+  }
+  return true;
+}
+
+static void applyDelete(uint16_t id) {
+  int index = rosterStoreFind(id);
+  if (index < 0) return;
+  for (int j = index; j < namid - 1; j++) {
+    name[j][0] = name[j + 1][0];
+    name[j][1] = name[j + 1][1];
+    name[j][2] = name[j + 1][2];
+  }
+  namid--;
+  name[namid][0] = "";
+  name[namid][1] = "";
+  name[namid][2] = "";
+}
+
+static void applyClear() {
+  for (int i = 0; i < 128; i++) {
+    name[i][0] = "";
+    name[i][1] = "";
+    name[i][2] = "";
+  }
+  namid = 0;
+  addid = 1;
+}
+
+static String withCrc(const String &payload) {
+  char crc[10];
+  snprintf(crc, sizeof(crc), "*%08lx", (unsigned long)crc32_le(0, (const uint8_t *)payload.c_str(), payload.length()));
+  return payload + crc;
+}
+
+// Apply one log line; false if it is damaged
+static bool replayLine(const String &line) {
+  int star = line.length() - 9;
+  if (star < 1 || line.charAt(star) != '*') return false;
+  String payload = line.substring(0, star);
+  if (withCrc(payload) != line) return false;
+
+  char kind = payload.charAt(0);
+  if (kind == 'C') {
+    applyClear();
+    return true;
+  }
+  if (kind == 'D') {
+    applyDelete(payload.substring(2).toInt());
+    return true;
+  }
+  String id, roll, studentName;
+  if (kind != 'P' || !parseCSVLine(payload.substring(2), id, roll, studentName) || id.toInt() <= 0) return false;
+  if (!applyPut(id.toInt(), roll, studentName)) {
+    LOG_WARN("Roster full, student %s in the log not loaded", id.c_str());
+  }
+  return true;
+}
+
+// Append already checksummed lines with one open and close
+static bool appendWalLines(const String &lines, int count) {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File wal = SD.open(ROSTER_WAL_PATH, FILE_APPEND);
+  size_t written = wal ? wal.print(lines) : 0;
+  if (wal) wal.close();
+  spiBusRelease(SPI_DEV_SD);
+  metricsInc(METRIC_SD_BYTES_WRITTEN, written);
+
+  if (written != lines.length()) {
+    LOG_ERROR("Failed to write the roster log");
+    return false;
+  }
+  walLines += count;
+  return true;
+}
+
+static bool appendWal(const String &payload) {
+  return appendWalLines(withCrc(payload) + "\n", 1);
+}
+
+static void maybeCheckpoint() {
+  if (walLines >= ROSTER_CHECKPOINT_LINES) {
+    rosterStoreCheckpoint();
+  }
+}
+
+// Write the name table to a temp file, swap it in for students.csv and
+// drop the log it now contains
+bool rosterStoreCheckpoint() {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File file = SD.open(ROSTER_TEMP_PATH, FILE_WRITE);
+  bool ok = file;
+  if (file) {
+    ok = file.println(ROSTER_CSV_HEADER) > 0;
+    for (int i = 0; i < namid; i++) {
+      ok = writeCSVLine(file, name[i][1], name[i][2], name[i][0]) && ok;
+    }
+    file.close();
+  }
+  ok = ok && (!SD.exists(ROSTER_CSV_PATH) || SD.remove(ROSTER_CSV_PATH)) && SD.rename(ROSTER_TEMP_PATH, ROSTER_CSV_PATH);
+  if (ok && SD.exists(ROSTER_WAL_PATH)) {
+    ok = SD.remove(ROSTER_WAL_PATH);
+  }
+  spiBusRelease(SPI_DEV_SD);
+
+  if (!ok) {
+    LOG_ERROR("Roster checkpoint failed, keeping the log");
+    return false;
+  }
+  walLines = 0;
+  return true;
+}
+
+// Recover from an interrupted checkpoint, load students.csv into the name
+// table and replay the log on top
+bool rosterStoreLoad() {
+  applyClear();
+  walLines = 0;
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+
+  if (SD.exists(ROSTER_TEMP_PATH)) {
+    // students.csv is only removed once the temp file is complete
+    if (!SD.exists(ROSTER_CSV_PATH)) {
+      SD.rename(ROSTER_TEMP_PATH, ROSTER_CSV_PATH);
+      LOG_WARN("Roster: finished a checkpoint cut short by a reset");
+    } else {
+      SD.remove(ROSTER_TEMP_PATH);
+      LOG_WARN("Roster: dropped a partial checkpoint");
+    }
+  }
+
+  if (!SD.exists(ROSTER_CSV_PATH) && !SD.exists(ROSTER_WAL_PATH)) {
+    LOG_INFO("Roster: creating %s with header", ROSTER_CSV_PATH);
+    File file = SD.open(ROSTER_CSV_PATH, FILE_WRITE);
+    if (!file) {
+      spiBusRelease(SPI_DEV_SD);
+      LOG_ERROR("Roster: failed to create %s", ROSTER_CSV_PATH);
+      return false;
+    }
+    file.println(ROSTER_CSV_HEADER);
+    file.close();
+  }
+
+  File file = SD.open(ROSTER_CSV_PATH, FILE_READ);
+  if (file) {
+    // Skip header line if it exists
+    if (file.available()) {
+      String header = file.readStringUntil('\n');
+      if (!header.startsWith(ROSTER_CSV_HEADER)) {
+        // If first line is not a header, rewind file
+        file.seek(0);
+      }
+    }
+    while (file.available()) {
+      String id, roll, studentName;
+      if (readCSVLine(file, id, roll, studentName) && id.toInt() > 0 && !applyPut(id.toInt(), roll, studentName)) {
+        LOG_WARN("Roster full, student %s not loaded", id.c_str());
+      }
+    }
+    file.close();
+  }
+
+  int replayed = 0;
+  bool torn = false;
+  File wal = SD.open(ROSTER_WAL_PATH, FILE_READ);
+  if (wal) {
+    while (wal.available()) {
+      String line = wal.readStringUntil('\n');
+      line.trim();
+      if (line.length() == 0) continue;
+      if (!replayLine(line)) {
+        torn = true;
+        break;
+      }
+      replayed++;
+    }
+    wal.close();
+  }
+  spiBusRelease(SPI_DEV_SD);
+
+  if (torn) {
+    LOG_WARN("Roster: log cut short after %d entries, the rest dropped", replayed);
+  }
+  // Fold the log in now so a damaged tail is not appended to
+  if (replayed > 0 || torn) {
+    LOG_INFO("Roster: replayed %d log entries", replayed);
+    rosterStoreCheckpoint();
+  }
+  LOG_INFO("Roster loaded: %d students, next available ID: %d", namid, addid);
+  return true;
+}
+
+// Add or replace a student: one log append, then the name table
+bool rosterStorePut(uint16_t id, const String &roll, const String &studentName) {
+  if (id == 0 || (rosterStoreFind(id) < 0 && namid >= 128)) return false;
+  if (!appendWal("P," + String(id) + "," + escapeCSV(roll) + "," + escapeCSV(studentName))) return false;
+  applyPut(id, roll, studentName);
+  maybeCheckpoint();
+  return true;
+}
+
+bool rosterStoreDelete(uint16_t id) {
+  if (rosterStoreFind(id) < 0) return true;
+  if (!appendWal("D," + String(id))) return false;
+  applyDelete(id);
+  maybeCheckpoint();
+  return true;
+}
+
+static bool listed(const uint16_t *ids, int count, uint16_t id) {
+  for (int i = 0; i < count; i++) {
+    if (ids[i] == id) return true;
+  }
+  return false;
+}
+
+// Delete a set of students: one D line each in a single append, then one
+// pass that closes up the name table. Returns the number removed, or -1
+// if the log could not be written.
+int rosterStoreDeleteMany(const uint16_t *ids, int count) {
+  String lines = "";
+  int removed = 0;
+  for (int i = 0; i < namid; i++) {
+    uint16_t id = name[i][1].toInt();
+    if (listed(ids, count, id)) {
+      lines += withCrc("D," + String(id)) + "\n";
+      removed++;
+    }
+  }
+  if (removed == 0) return 0;
+  if (!appendWalLines(lines, removed)) return -1;
+
+  int kept = 0;
+  for (int i = 0; i < namid; i++) {
+    if (listed(ids, count, name[i][1].toInt())) continue;
+    if (kept != i) {
+      name[kept][0] = name[i][0];
+      name[kept][1] = name[i][1];
+      name[kept][2] = name[i][2];
+    }
+    kept++;
+  }
+  for (int i = kept; i < namid; i++) {
+    name[i][0] = "";
+    name[i][1] = "";
+    name[i][2] = "";
+  }
+  namid = kept;
+  maybeCheckpoint();
+  return removed;
+}
+
+// Everyone goes; the empty roster is checkpointed straight away
+bool rosterStoreClear() {
+  if (!appendWal("C")) return false;
+  applyClear();
+  return rosterStoreCheckpoint();
+}
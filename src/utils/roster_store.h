@@ -0,0 +1,39 @@
+#ifndef ROSTER_STORE_H
+#define ROSTER_STORE_H
+
+#include "../config/config.h"
+
+// Transactional store behind the name table. students.csv is the last
+// checkpoint; every add, edit or delete since is one line appended to a
+// write-ahead log and then applied to the name table, so a change costs
+// one short append instead of rewriting the roster.
+//
+//   /students.wal   P,<id>,<roll>,<name>*<crc>   put
+//                   D,<id>*<crc>                 delete
+//                   C*<crc>                      delete everyone
+//
+// Each line carries the CRC32 of what precedes the '*'; replay stops at the
+// first line that does not check out (a write cut short by a reset). Once
+// the log reaches ROSTER_CHECKPOINT_LINES the table is written to a temp
+// file that replaces students.csv and the log is dropped. At boot a
+// leftover temp file either finishes that swap (students.csv is gone) or
+// is discarded (students.csv is still there), then the log is replayed.
+//
+// The name table is always current; read it rather than students.csv,
+// which can be up to a checkpoint behind.
+
+#define ROSTER_CSV_PATH "/students.csv"
+#define ROSTER_WAL_PATH "/students.wal"
+#define ROSTER_CSV_HEADER "ID,Roll Number,Name"
+#define ROSTER_CHECKPOINT_LINES 32
+
+// Function declarations for the roster store
+bool rosterStoreLoad();
+int rosterStoreFind(uint16_t id);
+bool rosterStorePut(uint16_t id, const String &roll, const String &studentName);
+bool rosterStoreDelete(uint16_t id);
+int rosterStoreDeleteMany(const uint16_t *ids, int count);
+bool rosterStoreClear();
+bool rosterStoreCheckpoint();
+
+#endif // ROSTER_STORE_H
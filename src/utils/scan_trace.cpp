@@ -0,0 +1,125 @@
+#include "scan_trace.h"
+#include "metrics.h"
+#include <algorithm>
+
+static_assert((int)SCAN_STAGE_COUNT == (int)METRIC_HISTOGRAM_COUNT, "scan stages and stage histograms must line up");
+
+static const char *const STAGE_NAMES[SCAN_STAGE_COUNT] = {
+  "capture", "image2tz", "search", "lookup", "day_lookup", "sd_write", "cloud_write"
+};
+
+static const char *const OUTCOME_NAMES[] = {
+  "none", "in", "out", "already_out", "unknown_id", "no_match", "image_error", "write_failed"
+};
+
+// Spans are written by the scan loop and read by the web server, which
+// both run in loop(), so the ring needs no locking.
+static ScanSpan spans[SCAN_TRACE_SPANS];
+static uint32_t spanCount = 0;  // Spans ever finished
+static ScanSpan current;
+static bool currentOpen = false;
+
+void scanTraceStart(int64_t startUs) {
+  current.startUs = startUs;
+  current.totalUs = 0;
+  current.fingerId = 0;
+  current.outcome = SCAN_OUTCOME_NONE;
+  for (int i = 0; i < SCAN_STAGE_COUNT; i++) {
+    current.stageOffset[i] = SCAN_STAGE_SKIPPED;
+    current.stageDuration[i] = SCAN_STAGE_SKIPPED;
+  }
+  currentOpen = true;
+}
+
+// Close a stage that began at stageStartUs; returns its duration
+uint32_t scanTraceStage(ScanStage stage, int64_t stageStartUs) {
+  int64_t now = esp_timer_get_time();
+  uint32_t elapsed = now - stageStartUs;
+  metricsObserve((MetricHistogram)stage, elapsed);
+
+  if (currentOpen) {
+    current.stageOffset[stage] = stageStartUs - current.startUs;
+    // A stage can run twice (e.g. both cloud writes); keep the total
+    current.stageDuration[stage] = current.stageDuration[stage] == SCAN_STAGE_SKIPPED
+                                     ? elapsed
+                                     : current.stageDuration[stage] + elapsed;
+  }
+  return elapsed;
+}
+
+// Polls that found no finger are never finished; the next start drops them
+void scanTraceFinish(ScanOutcome outcome, uint16_t fingerId) {
+  if (!currentOpen) return;
+  current.seq = spanCount;
+  current.totalUs = esp_timer_get_time() - current.startUs;
+  current.outcome = outcome;
+  current.fingerId = fingerId;
+  spans[spanCount % SCAN_TRACE_SPANS] = current;
+  spanCount++;
+  currentOpen = false;
+}
+
+// Nearest-rank percentile of a sorted sample
+static uint32_t percentile(const uint32_t *sorted, int count, int pct) {
+  int rank = (pct * count + 99) / 100;
+  return sorted[max(rank, 1) - 1];
+}
+
+static String summaryJson(uint32_t *samples, int count) {
+  if (count == 0) {
+    return "{\"count\":0}";
+  }
+  std::sort(samples, samples + count);
+  return "{\"count\":" + String(count) +
+         ",\"p50\":" + String(percentile(samples, count, 50)) +
+         ",\"p95\":" + String(percentile(samples, count, 95)) +
+         ",\"p99\":" + String(percentile(samples, count, 99)) +
+         ",\"max\":" + String(samples[count - 1]) + "}";
+}
+
+void handleDebugScans() {
+  int stored = min(spanCount, (uint32_t)SCAN_TRACE_SPANS);
+  uint32_t first = spanCount - stored;
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "");
+  server.sendContent("{\"unit\":\"us\",\"spans\":[");
+
+  for (int i = 0; i < stored; i++) {
+    const ScanSpan &span = spans[(first + i) % SCAN_TRACE_SPANS];
+    String json = i > 0 ? "," : "";
+    json += "{\"seq\":" + String(span.seq) +
+            ",\"startMs\":" + String((unsigned long)(span.startUs / 1000)) +
+            ",\"total\":" + String(span.totalUs) +
+            ",\"outcome\":\"" + OUTCOME_NAMES[span.outcome] + "\"" +
+            ",\"id\":" + String(span.fingerId) + ",\"stages\":{";
+    bool firstStage = true;
+    for (int s = 0; s < SCAN_STAGE_COUNT; s++) {
+      if (span.stageDuration[s] == SCAN_STAGE_SKIPPED) continue;
+      json += String(firstStage ? "" : ",") + "\"" + STAGE_NAMES[s] + "\":[" +
+              String(span.stageOffset[s]) + "," + String(span.stageDuration[s]) + "]";
+      firstStage = false;
+    }
+    json += "}}";
+    server.sendContent(json);
+  }
+
+  // Per-stage percentiles over the spans still in the ring
+  static uint32_t samples[SCAN_TRACE_SPANS];
+  server.sendContent("],\"summary\":{");
+  for (int s = 0; s <= SCAN_STAGE_COUNT; s++) {
+    int count = 0;
+    for (int i = 0; i < stored; i++) {
+      const ScanSpan &span = spans[(first + i) % SCAN_TRACE_SPANS];
+      if (s == SCAN_STAGE_COUNT) {
+        samples[count++] = span.totalUs;
+      } else if (span.stageDuration[s] != SCAN_STAGE_SKIPPED) {
+        samples[count++] = span.stageDuration[s];
+      }
+    }
+    const char *stageName = s == SCAN_STAGE_COUNT ? "total" : STAGE_NAMES[s];
+    server.sendContent(String(s > 0 ? "," : "") + "\"" + stageName + "\":" + summaryJson(samples, count));
+  }
+  server.sendContent("}}");
+  server.sendContent("");
+}
@@ -0,0 +1,50 @@
+#ifndef SCAN_TRACE_H
+#define SCAN_TRACE_H
+
+#include "../config/config.h"
+
+// Stages of continuousFingerprintScan(), in the order they run. The order
+// matches the METRIC_STAGE_* histograms so each stage also feeds /metrics.
+enum ScanStage {
+  SCAN_STAGE_CAPTURE,       // getImage() over the sensor UART
+  SCAN_STAGE_IMAGE2TZ,
+  SCAN_STAGE_SEARCH,
+  SCAN_STAGE_LOOKUP,        // Roster lookup for name and roll
+  SCAN_STAGE_DAY_LOOKUP,    // Today's record for the ID
+  SCAN_STAGE_SD_WRITE,      // Day-file append or tmp-file rewrite
+  SCAN_STAGE_CLOUD_WRITE,   // Firebase.setJSON
+  SCAN_STAGE_COUNT
+};
+
+enum ScanOutcome {
+  SCAN_OUTCOME_NONE,
+  SCAN_OUTCOME_IN,
+  SCAN_OUTCOME_OUT,
+  SCAN_OUTCOME_ALREADY_OUT,
+  SCAN_OUTCOME_UNKNOWN_ID,
+  SCAN_OUTCOME_NO_MATCH,
+  SCAN_OUTCOME_IMAGE_ERROR,
+  SCAN_OUTCOME_WRITE_FAILED
+};
+
+#define SCAN_TRACE_SPANS 64
+#define SCAN_STAGE_SKIPPED 0xFFFFFFFF
+
+// One scan: stage start offsets and durations in microseconds from startUs
+struct ScanSpan {
+  uint32_t seq;
+  int64_t startUs;
+  uint32_t totalUs;
+  uint32_t stageOffset[SCAN_STAGE_COUNT];
+  uint32_t stageDuration[SCAN_STAGE_COUNT];  // SCAN_STAGE_SKIPPED if not reached
+  uint16_t fingerId;
+  uint8_t outcome;
+};
+
+// Function declarations for the scan tracer
+void scanTraceStart(int64_t startUs);
+uint32_t scanTraceStage(ScanStage stage, int64_t stageStartUs);
+void scanTraceFinish(ScanOutcome outcome, uint16_t fingerId = 0);
+void handleDebugScans();
+
+#endif // SCAN_TRACE_H
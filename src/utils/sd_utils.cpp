@@ -1,27 +1,30 @@
 #include "sd_utils.h"
 #include "display_utils.h"
+#include "spi_bus.h"
+#include "metrics.h"
+#include "logger.h"
+#include "roster_store.h"
+#include "mem_pool.h"
+#include "../components/absentee_digest.h"
+#include "../components/network.h"
 
 bool setsd() {
   SPI.begin();
   sdCardInitialized = false;
 
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
   int n = 0;
-  while (!SD.begin(SD_CS)) {
+  while (!SD.begin(SD_CS, SPI, SD_SPI_FREQUENCY)) {
     if (n == 5)
       break;
     n++;
   }
+  bool mounted = SD.begin(SD_CS, SPI, SD_SPI_FREQUENCY);
+  spiBusRelease(SPI_DEV_SD);
 
-  if (!SD.begin(SD_CS)) {
+  if (!mounted) {
     Serial.println("Card Mount Failed");
-    tft.init(INITR_BLACKTAB);
-    tft.setRotation(1);
-    tft.fillScreen(TFT_WHITE);
-    tft.fillRect(0, 15, 128, 30, TFT_WHITE);  // Clear area below time and WiFi icon
-    tft.setTextColor(TFT_RED);
-    tft.setCursor(2, 20);
-    tft.println("SD Card Mount Failed");
-    tft.setTextSize(1);
+    displayMessageScreen(TFT_RED, "SD Card Mount Failed");
     rgbLED.setPixelColor(0, rgbLED.Color(55, 0, 0));  // Set RGB LED to red (failure)
     rgbLED.show();
     return false;
@@ -29,78 +32,13 @@ bool setsd() {
 
   sdCardInitialized = true;
   Serial.println("SD Card initialized.");
-  delay(500);
-  tft.init(INITR_BLACKTAB);
-  tft.fillScreen(TFT_WHITE);
-  tft.fillRect(0, 15, 128, 30, TFT_WHITE);  // Clear area below time and WiFi icon
-  tft.setRotation(1);
-  tft.setTextColor(TFT_GREEN);
-  tft.setTextSize(1);
-  tft.setCursor(2, 20);
-  tft.println("SD Card initialized.");
-  addid = 1;
-  namid = 0;
-  for (int i = 0; i < 128; i++) {
-    name[i][0] = "";
-    name[i][1] = "";
-    name[i][2] = "";
-  }
-
-  // Check if students.csv exists, if not create it with header
-  if (!SD.exists("/students.csv")) {
-    Serial.println("Creating new students.csv file with header");
-    File file = SD.open("/students.csv", FILE_WRITE);
-    if (file) {
-      file.println("ID,Roll Number,Name");
-      file.close();
-      Serial.println("Created students.csv with header");
-    } else {
-      Serial.println("Failed to create students.csv");
-      return false;
-    }
-  }
-
-  File file = SD.open("/students.csv", FILE_READ);
-  if (file) {
-    Serial.println("Opened /students.csv successfully.");
-    int maxID = 0;
-    
-    // Skip header line if it exists
-    if (file.available()) {
-      String header = file.readStringUntil('\n');
-      if (!header.startsWith("ID,Roll Number,Name")) {
-        // If first line is not a header, rewind file
-        file.seek(0);
-      }
-    }
-    
-    while (file.available()) {
-      String id, roll, nameStr;
-      if (readCSVLine(file, id, roll, nameStr) && namid < 128) {
-        name[namid][1] = id;         // ID
-        name[namid][2] = roll;       // Roll Number
-        name[namid][0] = nameStr;    // Name
-
-        Serial.println("Stored - ID: " + name[namid][1] + ", Roll: " + name[namid][2] + ", Name: " + name[namid][0]);
+  displayMessageScreen(TFT_GREEN, "SD Card initialized.");
 
-        // Update maxID
-        int currentID = name[namid][1].toInt();
-        if (currentID > maxID) {
-          maxID = currentID;
-        }
-
-        namid++;
-      }
-    }
-    addid = maxID + 1;
-    file.close();
-  } else {
-    Serial.println("Failed to open /students.csv for reading.");
-    addid = 1;
+  // Recover and load the roster (students.csv plus its write-ahead log)
+  if (!rosterStoreLoad()) {
+    return false;
   }
 
-  Serial.println("Finished reading /students.csv. Total names: " + String(namid));
-  Serial.println("Next available ID: " + String(addid));
   rgbLED.setPixelColor(0, rgbLED.Color(0, 55, 0));  // Set RGB LED to green (success)
   rgbLED.show();
   delay(500);
@@ -109,59 +47,6 @@ bool setsd() {
   return true;
 }
 
-void loadStudentData() {
-  // Reset student data
-  addid = 1;
-  namid = 0;
-  for (int i = 0; i < 128; i++) {
-    name[i][0] = "";
-    name[i][1] = "";
-    name[i][2] = "";
-  }
-
-  // Read student data from SD card
-  File file = SD.open("/students.csv", FILE_READ);
-  if (file) {
-    Serial.println("Loading student data from SD card...");
-    int maxID = 0;
-
-    // Skip header line if it exists
-    if (file.available()) {
-      String header = file.readStringUntil('\n');
-      if (!header.startsWith("ID,Roll Number,Name")) {
-        // If first line is not a header, rewind file
-        file.seek(0);
-      }
-    }
-
-    while (file.available()) {
-      String id, roll, nameStr;
-      if (readCSVLine(file, id, roll, nameStr) && namid < 128) {
-        name[namid][1] = id;         // ID
-        name[namid][2] = roll;       // Roll Number
-        name[namid][0] = nameStr;    // Name
-
-        // Update maxID
-        int currentID = name[namid][1].toInt();
-        if (currentID > maxID) {
-          maxID = currentID;
-        }
-
-        namid++;
-        Serial.println("Loaded student - ID: " + name[namid - 1][1] + ", Roll: " + name[namid - 1][2] + ", Name: " + name[namid - 1][0]);
-      }
-    }
-
-    addid = maxID + 1;
-    file.close();
-    Serial.println("Finished loading student data. Total students: " + String(namid));
-    Serial.println("Next available ID: " + String(addid));
-  } else {
-    Serial.println("Failed to open students.csv for reading");
-    addid = 1;
-  }
-}
-
 String getAttendanceFilePath(String dateStr) {
   // Extract month from date (format: DD-MM-YYYY)
   String month = dateStr.substring(3, 5);
@@ -173,31 +58,24 @@ bool ensureAttendanceDirectory(String dateStr) {
   String attendanceDir = "/Attendance";
   String monthDir = attendanceDir + "/" + month;
 
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
   // Create Attendance directory if it doesn't exist
-  if (!SD.exists(attendanceDir)) {
-    if (!SD.mkdir(attendanceDir)) {
-      Serial.println("Failed to create Attendance directory");
-      return false;
-    }
+  bool ok = SD.exists(attendanceDir) || SD.mkdir(attendanceDir);
+  if (!ok) {
+    Serial.println("Failed to create Attendance directory");
   }
 
   // Create month directory if it doesn't exist
-  if (!SD.exists(monthDir)) {
-    if (!SD.mkdir(monthDir)) {
-      Serial.println("Failed to create month directory");
-      return false;
-    }
+  if (ok && !SD.exists(monthDir) && !SD.mkdir(monthDir)) {
+    Serial.println("Failed to create month directory");
+    ok = false;
   }
-
-  return true;
+  spiBusRelease(SPI_DEV_SD);
+  return ok;
 }
 
-bool checkSDCardStatus() {
-  if (!sdCardInitialized) {
-    Serial.println("SD card not initialized");
-    return false;
-  }
-
+// Write, read back and remove a test file, and make sure students.csv exists
+static bool probeSDCard() {
   // Try to create a test file to verify write access
   File testFile = SD.open("/test.txt", FILE_WRITE);
   if (!testFile) {
@@ -233,9 +111,22 @@ bool checkSDCardStatus() {
   return true;
 }
 
+bool checkSDCardStatus() {
+  if (!sdCardInitialized) {
+    Serial.println("SD card not initialized");
+    return false;
+  }
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  bool ok = probeSDCard();
+  spiBusRelease(SPI_DEV_SD);
+  return ok;
+}
+
 bool readFirebaseCredentials() {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
   File file = SD.open("/firebase.txt", FILE_READ);
   if (!file) {
+    spiBusRelease(SPI_DEV_SD);
     Serial.println("Failed to open /firebase.txt");
     return false;
   }
@@ -252,12 +143,15 @@ bool readFirebaseCredentials() {
   }
 
   file.close();
+  spiBusRelease(SPI_DEV_SD);
   return true;
 }
 
 bool readWiFiCredentials(String &ssid, String &password) {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
   File file = SD.open("/wifi.txt", FILE_READ);
   if (!file) {
+    spiBusRelease(SPI_DEV_SD);
     Serial.println("Failed to open /wifi.txt");
     return false;
   }
@@ -274,23 +168,30 @@ bool readWiFiCredentials(String &ssid, String &password) {
   }
 
   file.close();
+  spiBusRelease(SPI_DEV_SD);
   return true;
 }
 
 void readTelegramCredentials() {
+  String botToken = "", chatId = "";
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
   File telegramFile = SD.open("/telegram.txt", FILE_READ);
   if (telegramFile) {
     while (telegramFile.available()) {
       String line = telegramFile.readStringUntil('\n');
       line.trim();
       if (line.startsWith("BOT_TOKEN=")) {
-        telegramBotToken = line.substring(10);
+        botToken = line.substring(10);
       } else if (line.startsWith("CHAT_ID=")) {
-        telegramChatId = line.substring(8);
+        chatId = line.substring(8);
+      } else if (line.startsWith("DIGEST_CUTOFF=")) {
+        absenteeDigestSetCutoff(absenteeDigestParseCutoff(line.substring(14)));
       }
     }
     telegramFile.close();
   }
+  spiBusRelease(SPI_DEV_SD);
+  telegramSetCredentials(botToken, chatId);
 }
 
 String escapeCSV(String input) {
@@ -316,33 +217,92 @@ String unescapeCSV(String input) {
 
 bool writeCSVLine(File &file, String id, String roll, String name) {
   String line = escapeCSV(id) + "," + escapeCSV(roll) + "," + escapeCSV(name) + "\n";
-  return file.print(line);
+  size_t written = file.print(line);
+  metricsInc(METRIC_SD_BYTES_WRITTEN, written);
+  return written;
+}
+
+// Copy one CSV field into out, dropping surrounding quotes and un-doubling
+// the quotes inside them as unescapeCSV() does
+static void assignField(String &out, const char *start, size_t length) {
+  out = "";
+  if (length >= 2 && start[0] == '"' && start[length - 1] == '"') {
+    out.reserve(length - 2);
+    for (size_t i = 1; i < length - 1; i++) {
+      out += start[i];
+      if (start[i] == '"' && i + 1 < length - 1 && start[i + 1] == '"') i++;
+    }
+  } else {
+    out.reserve(length);
+    for (size_t i = 0; i < length; i++) {
+      out += start[i];
+    }
+  }
+}
+
+// Read one line into buf without its line ending or surrounding whitespace.
+// Returns the start of the text and sets length; NULL if the line did not
+// fit (the rest of it is skipped).
+static const char *readLineInto(File &file, char *buf, size_t size, size_t &length) {
+  size_t n = file.readBytesUntil('\n', buf, size - 1);
+  size_t consumed = n + 1;
+  bool fits = true;
+  if (n == size - 1 && file.available()) {
+    // Filled the buffer: either the newline is next or the line is too long
+    while (file.available()) {
+      consumed++;
+      if (file.read() == '\n') break;
+      fits = false;
+    }
+  }
+  metricsInc(METRIC_SD_BYTES_READ, consumed);
+  if (!fits) {
+    LOG_WARN("Skipped a CSV line longer than %d bytes", (int)size - 1);
+    return NULL;
+  }
+
+  const char *start = buf;
+  while (n > 0 && isspace((uint8_t)start[n - 1])) n--;
+  while (n > 0 && isspace((uint8_t)*start)) {
+    start++;
+    n--;
+  }
+  length = n;
+  return start;
+}
+
+static bool parseCSVFields(const char *line, size_t length, String &id, String &roll, String &name) {
+  const char *end = line + length;
+  const char *comma1 = (const char *)memchr(line, ',', length);
+  if (!comma1) return false;
+  const char *comma2 = (const char *)memchr(comma1 + 1, ',', end - comma1 - 1);
+  if (!comma2) return false;
+
+  assignField(id, line, comma1 - line);
+  assignField(roll, comma1 + 1, comma2 - comma1 - 1);
+  assignField(name, comma2 + 1, end - comma2 - 1);
+  return true;
 }
 
 bool readCSVLine(File &file, String &id, String &roll, String &name) {
   if (!file.available()) return false;
-  
-  String line = file.readStringUntil('\n');
-  line.trim();
-  
-  // Parse CSV line
-  int pos1 = 0;
-  int pos2 = 0;
-  
-  // Find first comma
-  pos1 = line.indexOf(',');
-  if (pos1 == -1) return false;
-  
-  // Find second comma
-  pos2 = line.indexOf(',', pos1 + 1);
-  if (pos2 == -1) return false;
-  
-  // Extract fields
-  id = unescapeCSV(line.substring(0, pos1));
-  roll = unescapeCSV(line.substring(pos1 + 1, pos2));
-  name = unescapeCSV(line.substring(pos2 + 1));
-  
-  return true;
+
+  CsvLine *buf = csvLineAcquire();
+  if (!buf) {
+    String line = file.readStringUntil('\n');
+    metricsInc(METRIC_SD_BYTES_READ, line.length() + 1);
+    line.trim();
+    return parseCSVLine(line, id, roll, name);
+  }
+  size_t length = 0;
+  const char *line = readLineInto(file, buf->text, sizeof(buf->text), length);
+  bool ok = line && parseCSVFields(line, length, id, roll, name);
+  csvLineRelease(buf);
+  return ok;
+}
+
+bool parseCSVLine(const String &line, String &id, String &roll, String &name) {
+  return parseCSVFields(line.c_str(), line.length(), id, roll, name);
 }
 
 // Add new functions for CSV attendance handling
@@ -357,75 +317,87 @@ bool writeAttendanceCSVLine(File &file, String roll, String name, String id, Str
   outTime = escapeCSV(outTime);
   
   // Write the CSV line
-  file.print(roll);
-  file.print(",");
-  file.print(name);
-  file.print(",");
-  file.print(id);
-  file.print(",");
-  file.print(inTime);
-  file.print(",");
-  file.println(outTime);
+  size_t written = 0;
+  written += file.print(roll);
+  written += file.print(",");
+  written += file.print(name);
+  written += file.print(",");
+  written += file.print(id);
+  written += file.print(",");
+  written += file.print(inTime);
+  written += file.print(",");
+  written += file.println(outTime);
+  metricsInc(METRIC_SD_BYTES_WRITTEN, written);
   
   return true;
 }
 
-bool readAttendanceCSVLine(File &file, String &roll, String &name, String &id, String &inTime, String &outTime) {
-  if (!file.available()) {
-    return false;
-  }
-
-  String line = file.readStringUntil('\n');
-  line.trim();
-  if (line.length() == 0) {
-    return false;
-  }
+// Split Roll, Name, ID, In Time, Out Time; commas inside quotes do not count
+static bool splitAttendanceLine(const char *line, size_t length, String &roll, String &name, String &id,
+                                String &inTime, String &outTime) {
+  if (length == 0) return false;
 
-  // Split the line into fields
+  const char *fields[5];
+  size_t lengths[5];
   int fieldCount = 0;
-  int startPos = 0;
-  int endPos = 0;
+  size_t startPos = 0;
   bool inQuotes = false;
-  String fields[5];  // Roll, Name, ID, In Time, Out Time
-
-  for (int i = 0; i < line.length(); i++) {
+  for (size_t i = 0; i < length && fieldCount < 5; i++) {
     if (line[i] == '"') {
       inQuotes = !inQuotes;
     } else if (line[i] == ',' && !inQuotes) {
-      if (fieldCount < 5) {
-        fields[fieldCount] = line.substring(startPos, i);
-        fieldCount++;
-        startPos = i + 1;
-      }
+      fields[fieldCount] = line + startPos;
+      lengths[fieldCount] = i - startPos;
+      fieldCount++;
+      startPos = i + 1;
     }
   }
   // Get the last field
   if (fieldCount < 5) {
-    fields[fieldCount] = line.substring(startPos);
+    fields[fieldCount] = line + startPos;
+    lengths[fieldCount] = length - startPos;
     fieldCount++;
   }
-
-  // Check if we have all required fields
   if (fieldCount != 5) {
     return false;
   }
 
-  // Unescape and assign fields
-  roll = unescapeCSV(fields[0]);
-  name = unescapeCSV(fields[1]);
-  id = unescapeCSV(fields[2]);
-  inTime = unescapeCSV(fields[3]);
-  outTime = unescapeCSV(fields[4]);
-
+  assignField(roll, fields[0], lengths[0]);
+  assignField(name, fields[1], lengths[1]);
+  assignField(id, fields[2], lengths[2]);
+  assignField(inTime, fields[3], lengths[3]);
+  assignField(outTime, fields[4], lengths[4]);
   return true;
 }
 
+bool readAttendanceCSVLine(File &file, String &roll, String &name, String &id, String &inTime, String &outTime) {
+  if (!file.available()) {
+    return false;
+  }
+
+  CsvLine *buf = csvLineAcquire();
+  if (!buf) {
+    String line = file.readStringUntil('\n');
+    metricsInc(METRIC_SD_BYTES_READ, line.length() + 1);
+    line.trim();
+    return splitAttendanceLine(line.c_str(), line.length(), roll, name, id, inTime, outTime);
+  }
+  size_t length = 0;
+  const char *line = readLineInto(file, buf->text, sizeof(buf->text), length);
+  bool ok = line && splitAttendanceLine(line, length, roll, name, id, inTime, outTime);
+  csvLineRelease(buf);
+  return ok;
+}
+
 bool createAttendanceCSVFile(String filePath) {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
   File file = SD.open(filePath, FILE_WRITE);
-  if (!file) return false;
-  
-  // Write CSV header
-  file.println("Roll Number,Name,Fingerprint ID,In Time,Out Time");
-  file.close();
-  return true;
+  bool ok = (bool)file;
+  if (ok) {
+    // Write CSV header
+    file.println("Roll Number,Name,Fingerprint ID,In Time,Out Time");
+    file.close();
+  }
+  spiBusRelease(SPI_DEV_SD);
+  return ok;
 } 
\ No newline at end of file
@@ -8,7 +8,6 @@ bool setsd();
 String getAttendanceFilePath(String dateStr);
 bool ensureAttendanceDirectory(String dateStr);
 bool checkSDCardStatus();
-void loadStudentData();
 bool readFirebaseCredentials();
 bool readWiFiCredentials(String &ssid, String &password);
 void readTelegramCredentials();
@@ -18,6 +17,7 @@ String escapeCSV(String input);
 String unescapeCSV(String input);
 bool writeCSVLine(File &file, String id, String roll, String name);
 bool readCSVLine(File &file, String &id, String &roll, String &name);
+bool parseCSVLine(const String &line, String &id, String &roll, String &name);
 
 // Attendance CSV functions
 bool writeAttendanceCSVLine(File &file, String roll, String name, String id, String inTime, String outTime);
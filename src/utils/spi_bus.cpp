@@ -0,0 +1,79 @@
+#include "spi_bus.h"
+#include <atomic>
+
+static SemaphoreHandle_t spiBusMutex = NULL;
+static std::atomic<int> criticalWaiters(0);
+static SpiDeviceStats deviceStats[SPI_DEV_COUNT];
+
+// Owner bookkeeping; only touched while holding the mutex
+static int holdDepth = 0;
+static int64_t holdStart = 0;
+
+static const char *deviceName(SpiDevice device) {
+  return device == SPI_DEV_SD ? "sd" : "tft";
+}
+
+void spiBusBegin() {
+  if (spiBusMutex == NULL) {
+    spiBusMutex = xSemaphoreCreateRecursiveMutex();
+  }
+  memset(deviceStats, 0, sizeof(deviceStats));
+}
+
+bool spiBusAcquire(SpiDevice device, SpiPriority priority, TickType_t wait) {
+  if (spiBusMutex == NULL) return true;
+  SpiDeviceStats &stats = deviceStats[device];
+
+  // Cosmetic work yields to any queued critical write
+  if (priority == SPI_PRIO_COSMETIC) {
+    if (criticalWaiters.load() > 0 || xSemaphoreTakeRecursive(spiBusMutex, 0) != pdTRUE) {
+      stats.deferred++;
+      return false;
+    }
+  } else {
+    if (priority == SPI_PRIO_CRITICAL) criticalWaiters++;
+    bool taken = xSemaphoreTakeRecursive(spiBusMutex, 0) == pdTRUE;
+    if (!taken) {
+      stats.contended++;
+      taken = xSemaphoreTakeRecursive(spiBusMutex, wait) == pdTRUE;
+    }
+    if (priority == SPI_PRIO_CRITICAL) criticalWaiters--;
+    if (!taken) return false;
+  }
+
+  if (holdDepth++ == 0) {
+    holdStart = esp_timer_get_time();
+    stats.transactions++;
+  }
+  return true;
+}
+
+void spiBusRelease(SpiDevice device) {
+  if (spiBusMutex == NULL) return;
+
+  if (--holdDepth == 0) {
+    SpiDeviceStats &stats = deviceStats[device];
+    uint32_t held = esp_timer_get_time() - holdStart;
+    stats.busyMicros += held;
+    if (held > stats.maxHoldMicros) stats.maxHoldMicros = held;
+  }
+  xSemaphoreGiveRecursive(spiBusMutex);
+}
+
+const SpiDeviceStats &spiBusStats(SpiDevice device) {
+  return deviceStats[device];
+}
+
+String spiBusReport() {
+  String report = "SPI bus:";
+  for (int i = 0; i < SPI_DEV_COUNT; i++) {
+    const SpiDeviceStats &s = deviceStats[i];
+    report += String(" ") + deviceName((SpiDevice)i) +
+              " tx=" + String(s.transactions) +
+              " busy=" + String((uint32_t)(s.busyMicros / 1000)) + "ms" +
+              " max=" + String(s.maxHoldMicros) + "us" +
+              " waits=" + String(s.contended) +
+              " deferred=" + String(s.deferred);
+  }
+  return report;
+}
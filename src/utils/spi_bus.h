@@ -0,0 +1,43 @@
+#ifndef SPI_BUS_H
+#define SPI_BUS_H
+
+#include "../config/config.h"
+
+// The TFT and the SD card share the VSPI bus, and the logger, template
+// restore and boot tasks use SD from core 0 while loop() uses it on core 1.
+// Every SD file operation takes the bus through the arbiter: the modules
+// that own a file lock around their own opens, and functions that take an
+// open File (the CSV line readers and writers) expect the caller to hold
+// it. SD writes for attendance records are never stuck behind a cosmetic
+// redraw. The TFT clock is set by SPI_FREQUENCY in TFT_eSPI's User_Setup.h.
+
+#define SD_SPI_FREQUENCY 25000000   // SD default-speed maximum (library default is 4 MHz)
+
+enum SpiDevice {
+  SPI_DEV_SD,
+  SPI_DEV_TFT,
+  SPI_DEV_COUNT
+};
+
+enum SpiPriority {
+  SPI_PRIO_COSMETIC,  // Display refreshes: skipped rather than waited for
+  SPI_PRIO_NORMAL,    // Reads, config and background work
+  SPI_PRIO_CRITICAL   // Attendance writes: cosmetic users back off while these wait
+};
+
+struct SpiDeviceStats {
+  uint32_t transactions;
+  uint32_t contended;  // Had to wait for the other device
+  uint32_t deferred;   // Cosmetic requests skipped because the bus was busy
+  uint64_t busyMicros;
+  uint32_t maxHoldMicros;
+};
+
+// Function declarations for the SPI bus arbiter
+void spiBusBegin();
+bool spiBusAcquire(SpiDevice device, SpiPriority priority, TickType_t wait = portMAX_DELAY);
+void spiBusRelease(SpiDevice device);
+const SpiDeviceStats &spiBusStats(SpiDevice device);
+String spiBusReport();
+
+#endif // SPI_BUS_H
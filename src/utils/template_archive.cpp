@@ -0,0 +1,302 @@
+#include "template_archive.h"
+#include "metrics.h"
+#include "spi_bus.h"
+#include "logger.h"
+#include <rom/crc.h>
+
+#define TEMPLATE_ARCHIVE_MAGIC 0x4B415046  // "FPAK"
+#define TEMPLATE_ARCHIVE_VERSION 1
+
+struct TemplateArchiveHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t maxId;
+  uint16_t slotCount;  // Slots allocated in the file, used or free
+  uint16_t reserved[3];
+};
+
+struct TemplateSlotHeader {
+  uint16_t id;    // 0 when the slot is free
+  uint16_t size;
+  uint32_t crc;
+};
+
+static const uint32_t INDEX_OFFSET = sizeof(TemplateArchiveHeader);
+static const uint32_t INDEX_BYTES = (TEMPLATE_ARCHIVE_MAX_ID + 1) * sizeof(uint16_t);
+static const uint32_t SLOTS_OFFSET = INDEX_OFFSET + INDEX_BYTES;
+static const uint32_t SLOT_BYTES = sizeof(TemplateSlotHeader) + TEMPLATE_ARCHIVE_SLOT_DATA;
+
+// In-memory copy of the header and index; template bodies stay on SD
+static TemplateArchiveHeader archiveHeader;
+static uint16_t archiveIndex[TEMPLATE_ARCHIVE_MAX_ID + 1];
+static bool archiveReady = false;
+
+static uint32_t slotOffset(uint16_t slot) {
+  return SLOTS_OFFSET + (uint32_t)slot * SLOT_BYTES;
+}
+
+static bool writeIndexEntry(File &file, uint16_t id) {
+  file.seek(INDEX_OFFSET + id * sizeof(uint16_t));
+  return file.write((const uint8_t *)&archiveIndex[id], sizeof(uint16_t)) == sizeof(uint16_t);
+}
+
+static bool writeHeader(File &file) {
+  file.seek(0);
+  return file.write((const uint8_t *)&archiveHeader, sizeof(archiveHeader)) == sizeof(archiveHeader);
+}
+
+static bool createArchive() {
+  File file = SD.open(TEMPLATE_ARCHIVE_PATH, FILE_WRITE);
+  if (!file) {
+    LOG_ERROR("Failed to create template archive");
+    return false;
+  }
+
+  archiveHeader = {TEMPLATE_ARCHIVE_MAGIC, TEMPLATE_ARCHIVE_VERSION, TEMPLATE_ARCHIVE_MAX_ID, 0, {0, 0, 0}};
+  for (int i = 0; i <= TEMPLATE_ARCHIVE_MAX_ID; i++) {
+    archiveIndex[i] = TEMPLATE_ARCHIVE_NO_SLOT;
+  }
+
+  bool ok = file.write((const uint8_t *)&archiveHeader, sizeof(archiveHeader)) == sizeof(archiveHeader) &&
+            file.write((const uint8_t *)archiveIndex, INDEX_BYTES) == INDEX_BYTES;
+  file.close();
+  return ok;
+}
+
+// Every entry must point at a distinct slot that exists in the file
+static bool indexValid(uint32_t fileSize) {
+  if (archiveHeader.slotCount > TEMPLATE_ARCHIVE_MAX_ID + 1 || slotOffset(archiveHeader.slotCount) > fileSize) {
+    return false;
+  }
+  if (archiveIndex[0] != TEMPLATE_ARCHIVE_NO_SLOT) return false;
+
+  static bool seen[TEMPLATE_ARCHIVE_MAX_ID + 1];
+  memset(seen, 0, sizeof(seen));
+  for (int i = 1; i <= TEMPLATE_ARCHIVE_MAX_ID; i++) {
+    uint16_t slot = archiveIndex[i];
+    if (slot == TEMPLATE_ARCHIVE_NO_SLOT) continue;
+    if (slot >= archiveHeader.slotCount || seen[slot]) return false;
+    seen[slot] = true;
+  }
+  return true;
+}
+
+static bool loadArchive() {
+  File file = SD.open(TEMPLATE_ARCHIVE_PATH, FILE_READ);
+  if (!file) return false;
+
+  bool ok = file.read((uint8_t *)&archiveHeader, sizeof(archiveHeader)) == sizeof(archiveHeader) &&
+            archiveHeader.magic == TEMPLATE_ARCHIVE_MAGIC &&
+            archiveHeader.version == TEMPLATE_ARCHIVE_VERSION &&
+            archiveHeader.maxId == TEMPLATE_ARCHIVE_MAX_ID &&
+            file.read((uint8_t *)archiveIndex, INDEX_BYTES) == INDEX_BYTES &&
+            indexValid(file.size());
+  file.close();
+  return ok;
+}
+
+// Find a free slot, or the next slot past the end of the file
+static uint16_t allocateSlot() {
+  static bool used[TEMPLATE_ARCHIVE_MAX_ID + 1];
+  memset(used, 0, sizeof(used));
+  for (int i = 0; i <= TEMPLATE_ARCHIVE_MAX_ID; i++) {
+    if (archiveIndex[i] != TEMPLATE_ARCHIVE_NO_SLOT && archiveIndex[i] <= TEMPLATE_ARCHIVE_MAX_ID) {
+      used[archiveIndex[i]] = true;
+    }
+  }
+  for (uint16_t slot = 0; slot < archiveHeader.slotCount; slot++) {
+    if (!used[slot]) return slot;
+  }
+  return archiveHeader.slotCount;
+}
+
+bool templateArchiveBegin() {
+  archiveReady = false;
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  if (SD.exists(TEMPLATE_ARCHIVE_PATH)) {
+    archiveReady = loadArchive();
+    if (!archiveReady) LOG_ERROR("Template archive header or index invalid");
+  } else {
+    archiveReady = createArchive();
+  }
+  int migrated = archiveReady ? migrateTemplateFiles() : 0;
+  spiBusRelease(SPI_DEV_SD);
+  if (!archiveReady) return false;
+
+  if (migrated > 0) {
+    LOG_INFO("Migrated %d template backups into %s", migrated, TEMPLATE_ARCHIVE_PATH);
+  }
+  LOG_INFO("Template archive ready: %d templates", templateArchiveCount());
+  return true;
+}
+
+bool templateArchivePut(uint16_t id, const uint8_t *templateData, uint16_t templateSize) {
+  if (!archiveReady || id == 0 || id > TEMPLATE_ARCHIVE_MAX_ID || templateSize > TEMPLATE_ARCHIVE_SLOT_DATA) {
+    return false;
+  }
+
+  // Existing IDs are updated in place
+  uint16_t slot = archiveIndex[id];
+  bool isNew = slot == TEMPLATE_ARCHIVE_NO_SLOT;
+  if (isNew) {
+    slot = allocateSlot();
+    if (slot > TEMPLATE_ARCHIVE_MAX_ID) return false;
+  }
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File file = SD.open(TEMPLATE_ARCHIVE_PATH, "r+");
+  if (!file) {
+    spiBusRelease(SPI_DEV_SD);
+    LOG_ERROR("Failed to open template archive");
+    return false;
+  }
+
+  uint8_t body[TEMPLATE_ARCHIVE_SLOT_DATA];
+  memset(body, 0, sizeof(body));
+  memcpy(body, templateData, templateSize);
+  TemplateSlotHeader slotHeader = {id, templateSize, crc32_le(0, templateData, templateSize)};
+
+  file.seek(slotOffset(slot));
+  bool ok = file.write((const uint8_t *)&slotHeader, sizeof(slotHeader)) == sizeof(slotHeader) &&
+            file.write(body, sizeof(body)) == sizeof(body);
+  metricsInc(METRIC_SD_BYTES_WRITTEN, SLOT_BYTES);
+
+  // Publish the slot in the index only after its body is written
+  if (ok && isNew) {
+    archiveIndex[id] = slot;
+    if (slot >= archiveHeader.slotCount) {
+      archiveHeader.slotCount = slot + 1;
+      ok = writeHeader(file);
+    }
+    ok = ok && writeIndexEntry(file, id);
+  }
+  file.close();
+  spiBusRelease(SPI_DEV_SD);
+
+  if (!ok) {
+    LOG_ERROR("Failed to write template %u to archive", id);
+    if (isNew) archiveIndex[id] = TEMPLATE_ARCHIVE_NO_SLOT;
+  }
+  return ok;
+}
+
+bool templateArchiveGet(uint16_t id, uint8_t *templateData, uint16_t &templateSize) {
+  if (!templateArchiveHas(id)) return false;
+
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File file = SD.open(TEMPLATE_ARCHIVE_PATH, FILE_READ);
+  TemplateSlotHeader slotHeader;
+  bool ok = false;
+  if (file) {
+    file.seek(slotOffset(archiveIndex[id]));
+    ok = file.read((uint8_t *)&slotHeader, sizeof(slotHeader)) == sizeof(slotHeader) &&
+         slotHeader.id == id && slotHeader.size <= TEMPLATE_ARCHIVE_SLOT_DATA &&
+         file.read(templateData, slotHeader.size) == slotHeader.size;
+    file.close();
+  }
+  spiBusRelease(SPI_DEV_SD);
+
+  if (!ok) return false;
+  metricsInc(METRIC_SD_BYTES_READ, sizeof(slotHeader) + slotHeader.size);
+  if (crc32_le(0, templateData, slotHeader.size) != slotHeader.crc) {
+    LOG_WARN("Template %u failed CRC check", id);
+    return false;
+  }
+  templateSize = slotHeader.size;
+  return true;
+}
+
+bool templateArchiveHas(uint16_t id) {
+  return archiveReady && id > 0 && id <= TEMPLATE_ARCHIVE_MAX_ID && archiveIndex[id] != TEMPLATE_ARCHIVE_NO_SLOT;
+}
+
+bool templateArchiveRemove(uint16_t id) {
+  return templateArchiveRemoveMany(&id, 1);
+}
+
+// Free several slots with the archive opened once
+bool templateArchiveRemoveMany(const uint16_t *ids, int count) {
+  File file;
+  bool ok = true;
+  for (int i = 0; i < count; i++) {
+    uint16_t id = ids[i];
+    if (!templateArchiveHas(id)) continue;
+    if (!file) {
+      spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+      file = SD.open(TEMPLATE_ARCHIVE_PATH, "r+");
+      if (!file) {
+        spiBusRelease(SPI_DEV_SD);
+        return false;
+      }
+    }
+
+    // Drop the index entry first so a partial delete never exposes a freed slot
+    uint16_t slot = archiveIndex[id];
+    archiveIndex[id] = TEMPLATE_ARCHIVE_NO_SLOT;
+    TemplateSlotHeader freed = {0, 0, 0};
+    ok = writeIndexEntry(file, id) && ok;
+    file.seek(slotOffset(slot));
+    ok = file.write((const uint8_t *)&freed, sizeof(freed)) == sizeof(freed) && ok;
+  }
+  if (file) {
+    file.close();
+    spiBusRelease(SPI_DEV_SD);
+  }
+  return ok;
+}
+
+bool templateArchiveClear() {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  if (SD.exists(TEMPLATE_ARCHIVE_PATH) && !SD.remove(TEMPLATE_ARCHIVE_PATH)) {
+    spiBusRelease(SPI_DEV_SD);
+    return false;
+  }
+  archiveReady = createArchive();
+  spiBusRelease(SPI_DEV_SD);
+  return archiveReady;
+}
+
+int templateArchiveCount() {
+  if (!archiveReady) return 0;
+  int count = 0;
+  for (int i = 1; i <= TEMPLATE_ARCHIVE_MAX_ID; i++) {
+    if (archiveIndex[i] != TEMPLATE_ARCHIVE_NO_SLOT) count++;
+  }
+  return count;
+}
+
+// Move legacy /fingerprints/<id>.dat backups into the archive
+int migrateTemplateFiles() {
+  if (!archiveReady || !SD.exists("/fingerprints")) return 0;
+
+  File dir = SD.open("/fingerprints");
+  if (!dir) return 0;
+
+  int migrated = 0;
+  File entry = dir.openNextFile();
+  while (entry) {
+    String fileName = entry.name();
+    uint16_t id = fileName.toInt();
+    if (fileName.endsWith(".dat") && id > 0 && !entry.isDirectory()) {
+      uint8_t buffer[TEMPLATE_ARCHIVE_SLOT_DATA];
+      uint16_t size = entry.read(buffer, sizeof(buffer));
+      entry.close();
+
+      // Only drop the old file once the archive copy reads back intact
+      uint8_t check[TEMPLATE_ARCHIVE_SLOT_DATA];
+      uint16_t checkSize = 0;
+      if (size > 0 && templateArchivePut(id, buffer, size) &&
+          templateArchiveGet(id, check, checkSize) && checkSize == size) {
+        SD.remove("/fingerprints/" + fileName);
+        migrated++;
+      } else {
+        LOG_WARN("Failed to migrate template file %s", fileName.c_str());
+      }
+    } else {
+      entry.close();
+    }
+    entry = dir.openNextFile();
+  }
+  dir.close();
+  return migrated;
+}
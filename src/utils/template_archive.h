@@ -0,0 +1,27 @@
+#ifndef TEMPLATE_ARCHIVE_H
+#define TEMPLATE_ARCHIVE_H
+
+#include "../config/config.h"
+
+// Packed fingerprint template archive (/fingerprints.pak)
+//
+// Layout: header | index (one uint16 slot number per template ID) | slots
+// Each slot holds a small header (id, size, CRC32) and a fixed 512-byte body,
+// so any template is one seek and one read away.
+#define TEMPLATE_ARCHIVE_PATH "/fingerprints.pak"
+#define TEMPLATE_ARCHIVE_MAX_ID 1023
+#define TEMPLATE_ARCHIVE_SLOT_DATA 512
+#define TEMPLATE_ARCHIVE_NO_SLOT 0xFFFF
+
+// Function declarations for the template archive
+bool templateArchiveBegin();
+bool templateArchivePut(uint16_t id, const uint8_t *templateData, uint16_t templateSize);
+bool templateArchiveGet(uint16_t id, uint8_t *templateData, uint16_t &templateSize);
+bool templateArchiveHas(uint16_t id);
+bool templateArchiveRemove(uint16_t id);
+bool templateArchiveRemoveMany(const uint16_t *ids, int count);
+bool templateArchiveClear();
+int templateArchiveCount();
+int migrateTemplateFiles();
+
+#endif // TEMPLATE_ARCHIVE_H
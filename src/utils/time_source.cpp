@@ -0,0 +1,299 @@
+#include "time_source.h"
+#include "time_utils.h"
+#include "sd_utils.h"
+#include "day_rollover.h"
+#include "day_index.h"
+#include "month_rollup.h"
+#include "presence_index.h"
+#include "spi_bus.h"
+#include "logger.h"
+#include "../components/cloud_sync.h"
+#include <Preferences.h>
+#include <esp_sntp.h>
+#include <sys/time.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#define VALID_EPOCH 1577836800      // 2020-01-01, anything earlier is an unset RTC
+#define RTC_CLOCK_MAGIC 0x434C4B31  // "CLK1"
+
+// The RTC keeps counting through a software reset; these remember whether
+// what it holds came from NTP
+RTC_NOINIT_ATTR static uint32_t rtcMagic;
+RTC_NOINIT_ATTR static uint32_t rtcQuality;
+RTC_NOINIT_ATTR static uint32_t rtcChain;
+
+struct ProvisionalStamp {
+  uint32_t chain;
+  uint16_t id;
+  bool isOut;
+  time_t epoch;
+};
+
+static Preferences clockPrefs;
+static ClockQuality quality = CLOCK_PROVISIONAL;
+static const char *sourceName = "build";
+static uint32_t chainId = 0;         // One unbroken provisional timeline
+static int64_t provisionalBase = 0;  // Provisional epoch minus monotonic seconds
+static int64_t syncOffset = 0;       // NTP minus provisional, set by the SNTP callback
+static std::atomic<bool> syncPending(false);
+static unsigned long lastCheckpoint = 0;
+
+static int64_t monotonicSeconds() {
+  return esp_timer_get_time() / 1000000;
+}
+
+// Same offset configTime() applies, set before NTP has ever run so the
+// provisional clock is already local time
+static void setTimeZone() {
+  long offset = gmtOffset_sec + daylightOffset_sec;
+  char tz[16];
+  snprintf(tz, sizeof(tz), "UTC%c%02ld:%02ld", offset >= 0 ? '-' : '+', labs(offset) / 3600, (labs(offset) % 3600) / 60);
+  setenv("TZ", tz, 1);
+  tzset();
+}
+
+// Firmware build time: a floor for devices that have never been synced
+static time_t buildEpoch() {
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char monthName[4] = "";
+  struct tm build = {};
+  sscanf(__DATE__, "%3s %d %d", monthName, &build.tm_mday, &build.tm_year);
+  sscanf(__TIME__, "%d:%d:%d", &build.tm_hour, &build.tm_min, &build.tm_sec);
+  const char *month = strstr(months, monthName);
+  build.tm_mon = month ? (month - months) / 3 : 0;
+  build.tm_year -= 1900;
+  return mktime(&build);
+}
+
+static String dateOf(time_t when) {
+  struct tm info;
+  localtime_r(&when, &info);
+  char dateStr[11];
+  strftime(dateStr, sizeof(dateStr), "%d-%m-%Y", &info);
+  return String(dateStr);
+}
+
+static uint32_t secondsOfDayOf(time_t when) {
+  struct tm info;
+  localtime_r(&when, &info);
+  return info.tm_hour * 3600 + info.tm_min * 60 + info.tm_sec;
+}
+
+static void saveRtcState() {
+  rtcMagic = RTC_CLOCK_MAGIC;
+  rtcQuality = quality;
+  rtcChain = chainId;
+}
+
+static void checkpoint() {
+  clockPrefs.putULong64("epoch", (uint64_t)time(nullptr));
+  lastCheckpoint = millis();
+}
+
+// Runs in the SNTP task; only records what the loop needs
+static void onTimeSync(struct timeval *tv) {
+  syncOffset = (int64_t)tv->tv_sec - (provisionalBase + monotonicSeconds());
+  syncPending.store(true);
+}
+
+typedef std::function<bool(String &roll, String &name, String &inTime, String &outTime)> RowEdit;
+
+// Copy a day file through a temp file, applying edit to the row for id.
+// edit returns false to drop the row. Returns true if the row was found.
+static bool editDayRow(const String &date, uint16_t id, RowEdit edit) {
+  String path = getAttendanceFilePath(date);
+  File src = SD.open(path, FILE_READ);
+  if (!src) return false;
+  String tempPath = path + ".tmp";
+  File dst = SD.open(tempPath, FILE_WRITE);
+  if (!dst) {
+    src.close();
+    return false;
+  }
+
+  dst.println("Roll Number,Name,Fingerprint ID,In Time,Out Time");
+  if (src.available()) {
+    src.readStringUntil('\n');
+  }
+  bool found = false;
+  while (src.available()) {
+    String roll, name, idStr, inTime, outTime;
+    if (!readAttendanceCSVLine(src, roll, name, idStr, inTime, outTime)) continue;
+    if (!found && idStr.toInt() == id) {
+      found = true;
+      if (!edit(roll, name, inTime, outTime)) continue;
+    }
+    writeAttendanceCSVLine(dst, roll, name, idStr, inTime, outTime);
+  }
+  src.close();
+  dst.close();
+
+  if (!found) {
+    SD.remove(tempPath);
+    return false;
+  }
+  monthRollupInvalidate(date);
+  return SD.remove(path) && SD.rename(tempPath, path);
+}
+
+static bool setRowTime(const String &date, uint16_t id, bool isOut, const String &time) {
+  return editDayRow(date, id, [&](String &roll, String &name, String &inTime, String &outTime) {
+    (isOut ? outTime : inTime) = time;
+    return true;
+  });
+}
+
+// NTP put the in-scan on another day: take the row out of the old day file
+// and append it to the right one
+static bool moveRow(const String &fromDate, const String &toDate, uint16_t id, const String &inTime) {
+  String roll, name, outTime;
+  bool taken = editDayRow(fromDate, id, [&](String &r, String &n, String &in, String &out) {
+    roll = r;
+    name = n;
+    outTime = out;
+    return false;
+  });
+  if (!taken) return false;
+  dayIndexAdjust(fromDate, -1);
+  presenceIndexUnmark(fromDate, id);
+
+  String toPath = getAttendanceFilePath(toDate);
+  if (!ensureAttendanceDirectory(toDate) || (!SD.exists(toPath) && !createAttendanceCSVFile(toPath))) {
+    return false;
+  }
+  File file = SD.open(toPath, FILE_APPEND);
+  if (!file) return false;
+  writeAttendanceCSVLine(file, roll, name, String(id), inTime, outTime);
+  file.close();
+  dayIndexAdjust(toDate, 1);
+  presenceIndexMark(toDate, id);
+  return true;
+}
+
+// Correct every provisional stamp from this timeline by the NTP offset.
+// Stamps from an earlier timeline (power was lost, so the gap is unknown)
+// cannot be corrected and keep their provisional mark.
+static void restampProvisional(int64_t offset) {
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File journal = SD.open(PROVISIONAL_JOURNAL_PATH, FILE_READ);
+  if (!journal) {
+    spiBusRelease(SPI_DEV_SD);
+    return;
+  }
+
+  std::vector<ProvisionalStamp> stamps;
+  while (journal.available()) {
+    String line = journal.readStringUntil('\n');
+    unsigned long chain, id, epoch;
+    char kind[4];
+    if (sscanf(line.c_str(), "%lu,%lu,%3[^,],%lu", &chain, &id, kind, &epoch) == 4) {
+      stamps.push_back({(uint32_t)chain, (uint16_t)id, strcmp(kind, "out") == 0, (time_t)epoch});
+    }
+  }
+  journal.close();
+
+  int fixed = 0, stale = 0;
+  for (const ProvisionalStamp &stamp : stamps) {
+    if (stamp.chain != chainId) {
+      stale++;
+      continue;
+    }
+    time_t corrected = stamp.epoch + offset;
+    String oldDate = dateOf(stamp.epoch);
+    String newDate = dateOf(corrected);
+    String newTime = formatTimeOfDay12(secondsOfDayOf(corrected));
+
+    bool ok;
+    if (stamp.isOut) {
+      // The row may already have moved along with its in-time
+      ok = setRowTime(newDate, stamp.id, true, newTime) || setRowTime(oldDate, stamp.id, true, newTime);
+    } else if (oldDate == newDate) {
+      ok = setRowTime(oldDate, stamp.id, false, newTime);
+    } else {
+      ok = moveRow(oldDate, newDate, stamp.id, newTime);
+      if (ok) {
+        cloudSyncMarkAttendance(newDate, stamp.id);  // The scan only queued the old date
+      }
+    }
+    ok ? fixed++ : stale++;
+  }
+  SD.remove(PROVISIONAL_JOURNAL_PATH);
+  spiBusRelease(SPI_DEV_SD);
+
+  LOG_INFO("Re-stamped %d provisional records, %d left marked provisional", fixed, stale);
+  dayRolloverBegin();  // Reload today's records from the corrected files
+}
+
+void timeSourceBegin() {
+  setTimeZone();
+  clockPrefs.begin("clock", false);
+
+  time_t now = time(nullptr);
+  if (now >= VALID_EPOCH && rtcMagic == RTC_CLOCK_MAGIC) {
+    // Software reset: the RTC carried the clock through
+    quality = (ClockQuality)rtcQuality;
+    chainId = rtcChain;
+    sourceName = "rtc";
+  } else {
+    // Power-on: continue from the last checkpoint, never earlier than the build
+    time_t saved = (time_t)clockPrefs.getULong64("epoch", 0);
+    time_t built = buildEpoch();
+    sourceName = saved > built ? "checkpoint" : "build";
+    struct timeval tv = {saved > built ? saved : built, 0};
+    settimeofday(&tv, NULL);
+    quality = CLOCK_PROVISIONAL;
+    chainId = clockPrefs.getUInt("chain", 0) + 1;
+    clockPrefs.putUInt("chain", chainId);
+  }
+  provisionalBase = time(nullptr) - monotonicSeconds();
+  saveRtcState();
+  lastCheckpoint = millis();
+
+  sntp_set_time_sync_notification_cb(onTimeSync);
+  clockTick();
+  LOG_INFO("Clock %s from %s: %s %s", quality == CLOCK_SYNCED ? "synced" : "provisional",
+           sourceName, clockDateStr(), clockTimeStr());
+}
+
+void timeSourceTick() {
+  if (syncPending.exchange(false)) {
+    bool wasProvisional = quality == CLOCK_PROVISIONAL;
+    quality = CLOCK_SYNCED;
+    sourceName = "ntp";
+    saveRtcState();
+    checkpoint();
+    clockTick();
+    if (wasProvisional) {
+      LOG_INFO("NTP sync: provisional clock was off by %ld s", (long)syncOffset);
+      restampProvisional(syncOffset);
+    }
+  }
+
+  if (millis() - lastCheckpoint >= CLOCK_CHECKPOINT_INTERVAL_MS) {
+    checkpoint();
+  }
+}
+
+ClockQuality clockQuality() {
+  return quality;
+}
+
+// True once NTP has answered, even if timeSourceTick() has not applied it yet
+bool ntpSyncSeen() {
+  return quality == CLOCK_SYNCED || syncPending.load();
+}
+
+const char *clockSourceName() {
+  return sourceName;
+}
+
+// Called with the SD bus held, right after a provisional record is written
+bool journalProvisionalStamp(uint16_t id, bool isOut, time_t stamped) {
+  File journal = SD.open(PROVISIONAL_JOURNAL_PATH, FILE_APPEND);
+  if (!journal) return false;
+  journal.printf("%lu,%u,%s,%lu\n", (unsigned long)chainId, id, isOut ? "out" : "in", (unsigned long)stamped);
+  journal.close();
+  return true;
+}
@@ -0,0 +1,27 @@
+#ifndef TIME_SOURCE_H
+#define TIME_SOURCE_H
+
+#include "../config/config.h"
+
+// Where the wall clock currently comes from. Until NTP answers, the clock
+// runs on from the last saved checkpoint (or the firmware build time) and
+// every record stamped with it is provisional.
+enum ClockQuality {
+  CLOCK_PROVISIONAL,
+  CLOCK_SYNCED
+};
+
+#define CLOCK_CHECKPOINT_INTERVAL_MS 60000
+#define CLOCK_SYNC_WAIT_MS 30000  // How long boot waits for NTP before moving on
+#define CLOCK_PROVISIONAL_MARK "~"  // Prefix for provisional times in day files
+#define PROVISIONAL_JOURNAL_PATH "/Attendance/provisional.csv"
+
+// Function declarations for the time source
+void timeSourceBegin();
+void timeSourceTick();
+ClockQuality clockQuality();
+bool ntpSyncSeen();
+const char *clockSourceName();
+bool journalProvisionalStamp(uint16_t id, bool isOut, time_t stamped);
+
+#endif // TIME_SOURCE_H
@@ -1,53 +1,125 @@
 #include "time_utils.h"
 
+// Start SNTP and return. The time source keeps a provisional clock running
+// until the first sync arrives; the day-rollover scheduler keeps the date
+// globals current.
 void timeInit() {
-  // Configure time
   configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-  while (!getLocalTime(&timeinfo)) {
-    tft.fillScreen(TFT_WHITE);                // Clear the screen
-    tft.fillRect(0, 15, 128, 30, TFT_WHITE);  // Clear area below time and WiFi icon
-    tft.setCursor(2, 20);                     // Start below the time/WiFi area
-    tft.setTextColor(TFT_BLACK);              // Set text color to black
-    tft.setTextSize(1);                       // Set text size
-    tft.println("Waiting for time sync...");
-    delay(1000);
+}
+
+// Cached wall clock, refreshed by clockTick()
+static time_t cachedEpoch = 0;
+static struct tm cachedTime;
+static char cachedDate[11] = "00-00-0000";
+static char cachedTime24[9] = "00:00:00";
+static char cachedTime12[12] = "00:00:00 AM";
+static bool cachedValid = false;
+
+void clockTick() {
+  time_t now = time(nullptr);
+  if (now == cachedEpoch) {
+    return;
   }
+  cachedEpoch = now;
+  localtime_r(&now, &cachedTime);
+
+  // Before the first NTP sync the RTC counts from 1970
+  cachedValid = cachedTime.tm_year + 1900 >= 2020;
+  if (!cachedValid) {
+    return;
+  }
+  strftime(cachedDate, sizeof(cachedDate), "%d-%m-%Y", &cachedTime);
+  strftime(cachedTime24, sizeof(cachedTime24), "%H:%M:%S", &cachedTime);
+  strftime(cachedTime12, sizeof(cachedTime12), "%I:%M:%S %p", &cachedTime);
+}
+
+bool clockValid() {
+  clockTick();
+  return cachedValid;
+}
+
+time_t clockEpoch() {
+  clockTick();
+  return cachedEpoch;
+}
+
+uint32_t clockSecondsOfDay() {
+  clockTick();
+  return cachedTime.tm_hour * 3600 + cachedTime.tm_min * 60 + cachedTime.tm_sec;
+}
+
+const struct tm &clockLocalTime() {
+  clockTick();
+  return cachedTime;
+}
 
-  // Update date variables with leading zeros for single-digit values
-  day = (timeinfo.tm_mday < 10) ? "0" + String(timeinfo.tm_mday) : String(timeinfo.tm_mday);
-  month = (timeinfo.tm_mon + 1 < 10) ? "0" + String(timeinfo.tm_mon + 1) : String(timeinfo.tm_mon + 1);
-  year = String(timeinfo.tm_year + 1900);
+const char *clockDateStr() {
+  clockTick();
+  return cachedDate;
+}
+
+const char *clockTimeStr() {
+  clockTick();
+  return cachedTime24;
+}
+
+const char *clockTime12Str() {
+  clockTick();
+  return cachedTime12;
 }
 
 String getCurrentDate() {
-  struct tm timeinfo;
-  if (!getLocalTime(&timeinfo)) {
+  if (!clockValid()) {
     Serial.println("Failed to obtain time");
     return "00-00-0000";
   }
-  char dateStr[11];
-  strftime(dateStr, sizeof(dateStr), "%d-%m-%Y", &timeinfo);
-  return String(dateStr);
+  return String(cachedDate);
 }
 
 String getCurrentTime() {
-  struct tm timeinfo;
-  if (!getLocalTime(&timeinfo)) {
+  if (!clockValid()) {
     Serial.println("Failed to obtain time");
     return "00:00:00";
   }
-  char timeStr[9];
-  strftime(timeStr, sizeof(timeStr), "%H:%M:%S", &timeinfo);
-  return String(timeStr);
+  return String(cachedTime24);
 }
 
 String getCurrentTime12() {
-  struct tm timeinfo;
-  if (!getLocalTime(&timeinfo)) {
+  if (!clockValid()) {
     Serial.println("Failed to obtain time");
     return "00:00:00 AM";
   }
+  return String(cachedTime12);
+}
+
+String formatTimeOfDay12(uint32_t secondsOfDay) {
+  if (secondsOfDay == TIME_OF_DAY_NONE) {
+    return "-";
+  }
+  int hour = secondsOfDay / 3600;
+  int minute = (secondsOfDay / 60) % 60;
+  int second = secondsOfDay % 60;
   char timeStr[12];
-  strftime(timeStr, sizeof(timeStr), "%I:%M:%S %p", &timeinfo);
+  snprintf(timeStr, sizeof(timeStr), "%02d:%02d:%02d %s", hour % 12 == 0 ? 12 : hour % 12, minute, second, hour < 12 ? "AM" : "PM");
   return String(timeStr);
-} 
\ No newline at end of file
+}
+
+// Accepts "hh:mm:ss AM" and "HH:MM:SS", optionally marked provisional with
+// a leading "~"; anything else (including "-") is no time
+uint32_t parseTimeOfDay(const String &text) {
+  int hour, minute, second;
+  const char *start = text.c_str();
+  if (*start == '~') start++;  // Provisional mark
+  if (sscanf(start, "%d:%d:%d", &hour, &minute, &second) != 3) {
+    return TIME_OF_DAY_NONE;
+  }
+  if (text.endsWith("PM") && hour < 12) {
+    hour += 12;
+  } else if (text.endsWith("AM") && hour == 12) {
+    hour = 0;
+  }
+  if (hour > 23 || minute > 59 || second > 59) {
+    return TIME_OF_DAY_NONE;
+  }
+  return hour * 3600 + minute * 60 + second;
+}
@@ -3,10 +3,26 @@
 
 #include "../config/config.h"
 
+#define TIME_OF_DAY_NONE 0xFFFFFFFF  // No timestamp recorded ("-")
+
 // Function declarations for time-related utilities
 void timeInit();
 String getCurrentDate();
 String getCurrentTime();
 String getCurrentTime12();
 
-#endif // TIME_UTILS_H 
\ No newline at end of file
+// Clock service: refreshed at most once per second, accessors are cached
+void clockTick();
+bool clockValid();
+time_t clockEpoch();
+uint32_t clockSecondsOfDay();
+const struct tm &clockLocalTime();
+const char *clockDateStr();    // DD-MM-YYYY
+const char *clockTimeStr();    // HH:MM:SS
+const char *clockTime12Str();  // hh:mm:ss AM
+
+// Compact time-of-day values, formatted only for display and export
+String formatTimeOfDay12(uint32_t secondsOfDay);
+uint32_t parseTimeOfDay(const String &text);
+
+#endif // TIME_UTILS_H
@@ -0,0 +1,83 @@
+#include "wire_format.h"
+#include "sd_utils.h"
+#include "time_utils.h"
+#include "spi_bus.h"
+#include <mbedtls/base64.h>
+#include <algorithm>
+
+String wirePackEvents(const std::vector<WireEvent> &events) {
+  size_t rawSize = events.size() * WIRE_EVENT_BYTES;
+  std::vector<uint8_t> raw(rawSize);
+  for (size_t i = 0; i < events.size(); i++) {
+    const WireEvent &event = events[i];
+    uint32_t packed = (event.secondsOfDay << 2) | (event.isOut ? 2 : 0) | (event.provisional ? 1 : 0);
+    uint8_t *out = &raw[i * WIRE_EVENT_BYTES];
+    out[0] = event.id & 0xFF;
+    out[1] = event.id >> 8;
+    out[2] = packed & 0xFF;
+    out[3] = (packed >> 8) & 0xFF;
+    out[4] = (packed >> 16) & 0xFF;
+  }
+
+  size_t encodedSize = 0;
+  mbedtls_base64_encode(NULL, 0, &encodedSize, raw.data(), rawSize);  // Sizing call
+  std::vector<uint8_t> encoded(encodedSize + 1);
+  if (mbedtls_base64_encode(encoded.data(), encoded.size(), &encodedSize, raw.data(), rawSize) != 0) {
+    return "";
+  }
+  encoded[encodedSize] = '\0';
+  return String((const char *)encoded.data());
+}
+
+bool wireUnpackEvents(const String &packed, std::vector<WireEvent> &events) {
+  events.clear();
+  size_t rawSize = 0;
+  const uint8_t *text = (const uint8_t *)packed.c_str();
+  mbedtls_base64_decode(NULL, 0, &rawSize, text, packed.length());  // Sizing call
+  std::vector<uint8_t> raw(rawSize);
+  if (mbedtls_base64_decode(raw.data(), raw.size(), &rawSize, text, packed.length()) != 0 ||
+      rawSize % WIRE_EVENT_BYTES != 0) {
+    return false;
+  }
+
+  for (size_t offset = 0; offset < rawSize; offset += WIRE_EVENT_BYTES) {
+    const uint8_t *in = &raw[offset];
+    uint32_t flags = in[2] | (in[3] << 8) | ((uint32_t)in[4] << 16);
+    events.push_back({(uint16_t)(in[0] | (in[1] << 8)), flags >> 2, (flags & 2) != 0, (flags & 1) != 0});
+  }
+  return true;
+}
+
+// This gate's events for a day, from its day file, in time order
+bool wireReadDayEvents(const String &date, std::vector<WireEvent> &events) {
+  events.clear();
+  spiBusAcquire(SPI_DEV_SD, SPI_PRIO_NORMAL);
+  File file = SD.open(getAttendanceFilePath(date), FILE_READ);
+  if (!file) {
+    spiBusRelease(SPI_DEV_SD);
+    return false;
+  }
+
+  if (file.available()) {
+    file.readStringUntil('\n');  // Header
+  }
+  while (file.available()) {
+    String roll, studentName, id, inTime, outTime;
+    if (!readAttendanceCSVLine(file, roll, studentName, id, inTime, outTime) || id.toInt() <= 0) continue;
+    uint32_t inSeconds = parseTimeOfDay(inTime);
+    uint32_t outSeconds = parseTimeOfDay(outTime);
+    if (inSeconds != TIME_OF_DAY_NONE) {
+      events.push_back({(uint16_t)id.toInt(), inSeconds, false, inTime.startsWith("~")});
+    }
+    if (outSeconds != TIME_OF_DAY_NONE) {
+      events.push_back({(uint16_t)id.toInt(), outSeconds, true, outTime.startsWith("~")});
+    }
+  }
+  file.close();
+  spiBusRelease(SPI_DEV_SD);
+
+  std::sort(events.begin(), events.end(), [](const WireEvent &a, const WireEvent &b) {
+    return a.secondsOfDay < b.secondsOfDay;
+  });
+  return true;
+}
@@ -0,0 +1,32 @@
+#ifndef WIRE_FORMAT_H
+#define WIRE_FORMAT_H
+
+#include "../config/config.h"
+#include <vector>
+
+// Packed day upload: one gate's whole day as a single base64 value under
+// /packed/MM/DATE/<gate> = {"v": 1, "n": <events>, "d": "<base64>"}.
+//
+// Each event is 5 bytes, little-endian:
+//   bytes 0-1  student ID
+//   bytes 2-4  (second of day << 2) | (out << 1) | provisional
+//
+// Names and roll numbers are left out; the cloud has them under /students.
+// tools/wire_format/expand.py decodes the same layout.
+
+#define WIRE_FORMAT_VERSION 1
+#define WIRE_EVENT_BYTES 5
+
+struct WireEvent {
+  uint16_t id;
+  uint32_t secondsOfDay;
+  bool isOut;
+  bool provisional;
+};
+
+// Function declarations for the packed wire format
+String wirePackEvents(const std::vector<WireEvent> &events);
+bool wireUnpackEvents(const String &packed, std::vector<WireEvent> &events);
+bool wireReadDayEvents(const String &date, std::vector<WireEvent> &events);
+
+#endif // WIRE_FORMAT_H
@@ -1,7 +1,6 @@
 #include "html_components.h"
 
-String getNavbarHtml() {
-  return R"rawliteral(
+const char NAVBAR_HTML[] PROGMEM = R"rawliteral(
 <nav class="navbar navbar-expand-lg navbar-dark shadow-sm">
   <div class="container-fluid px-3">
     <button id="backButton" class="btn btn-link text-light me-2 d-lg-none" onclick="history.back()" style="font-size:1.3rem; display:none;" title="Back">
@@ -15,6 +14,7 @@ String getNavbarHtml() {
       <ul class="navbar-nav me-auto mb-2 mb-lg-0">
         <li class="nav-item"><a class="nav-link" href="/"><i class="fas fa-home me-1"></i>Home</a></li>
         <li class="nav-item"><a class="nav-link" href="/a2z"><i class="fas fa-calendar-alt me-1"></i>Attendance</a></li>
+        <li class="nav-item"><a class="nav-link" href="/reports"><i class="fas fa-chart-bar me-1"></i>Reports</a></li>
         <li class="nav-item"><a class="nav-link" href="/names"><i class="fas fa-users me-1"></i>Students</a></li>
         <li class="nav-item"><a class="nav-link" href="/addnew"><i class="fas fa-user-plus me-1"></i>Add New</a></li>
       </ul>
@@ -149,10 +149,8 @@ String getNavbarHtml() {
 <script src="https://cdn.jsdelivr.net/npm/bootstrap@5.3.0/dist/js/bootstrap.bundle.min.js"></script>
 
 )rawliteral";
-}
 
-String getGlassmorphismStyles() {
-  return R"rawliteral(
+const char GLASSMORPHISM_STYLES[] PROGMEM = R"rawliteral(
 <style>
   :root {
     --primary-color: #2c3e50;
@@ -515,4 +513,11 @@ String getGlassmorphismStyles() {
   });
 </script>
   )rawliteral";
-} 
\ No newline at end of file
+
+String getNavbarHtml() {
+  return NAVBAR_HTML;
+}
+
+String getGlassmorphismStyles() {
+  return GLASSMORPHISM_STYLES;
+}
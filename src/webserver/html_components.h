@@ -3,6 +3,10 @@
 
 #include <Arduino.h>
 
+// Shared page parts, in flash
+extern const char NAVBAR_HTML[] PROGMEM;
+extern const char GLASSMORPHISM_STYLES[] PROGMEM;
+
 // Function declarations for HTML components
 String getNavbarHtml();
 String getGlassmorphismStyles(); // Common glassmorphism styles for all pages
@@ -0,0 +1,79 @@
+#include "page_template.h"
+#include "html_components.h"
+#include "../utils/mem_pool.h"
+
+int16_t pageUnknownSlot() {
+  return PAGE_TEXT;
+}
+
+// Chunk buffer from the request arena; without one every write goes out as is
+PageWriter::PageWriter() {
+  buf = (char *)arenaAlloc(PAGE_CHUNK_BYTES);
+}
+
+PageWriter &PageWriter::add(const char *text, size_t length) {
+  if (!buf || length >= PAGE_CHUNK_BYTES) {
+    flush();
+    if (length) server.sendContent(text, length);
+    return *this;
+  }
+  if (len + length > PAGE_CHUNK_BYTES) flush();
+  memcpy(buf + len, text, length);
+  len += length;
+  return *this;
+}
+
+PageWriter &PageWriter::add(const char *text) {
+  return add(text, strlen(text));
+}
+
+PageWriter &PageWriter::add(const String &text) {
+  return add(text.c_str(), text.length());
+}
+
+PageWriter &PageWriter::addInt(long value) {
+  char digits[12];
+  int length = snprintf(digits, sizeof(digits), "%ld", value);
+  return add(digits, length);
+}
+
+// Static text: short runs join the chunk, long ones go straight from flash
+void PageWriter::flash(const char *text, size_t length) {
+  if (length <= PAGE_COPY_MAX) {
+    add(text, length);
+    return;
+  }
+  flush();
+  server.sendContent_P(text, length);
+}
+
+void PageWriter::flash(const char *text) {
+  flash(text, strlen(text));
+}
+
+void PageWriter::flush() {
+  if (len == 0) return;
+  server.sendContent(buf, len);
+  len = 0;
+}
+
+void pageSendSegments(const char *text, const PageSegment *segments, size_t count, const PageFill &fill) {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/html", "");
+
+  PageWriter out;
+  for (size_t i = 0; i < count; i++) {
+    const PageSegment &segment = segments[i];
+    if (segment.slot == PAGE_TEXT) {
+      out.flash(text + segment.offset, segment.length);
+    } else if (segment.slot == PAGE_INCLUDE_STYLES) {
+      out.flash(GLASSMORPHISM_STYLES);
+    } else if (segment.slot == PAGE_INCLUDE_NAVBAR) {
+      out.flash(NAVBAR_HTML);
+    } else {
+      fill(segment.slot, out);
+    }
+  }
+  out.flush();
+  server.sendContent("");
+}
@@ -0,0 +1,172 @@
+#ifndef PAGE_TEMPLATE_H
+#define PAGE_TEMPLATE_H
+
+#include "../config/config.h"
+#include <functional>
+
+// Pages kept in flash as segment tables. A page is one raw literal with
+// {{name}} placeholders; PAGE_TABLE() splits it at compile time into runs
+// of static text and numbered slots, so nothing is parsed or copied at run
+// time. pageSend() streams the static runs straight from flash and calls
+// the handler's fill function for each slot.
+//
+//   static constexpr char HOME_TEXT[] PROGMEM = R"rawliteral(...{{count}}...)rawliteral";
+//   enum HomeSlot { HOME_COUNT };
+//   static constexpr const char *HOME_SLOTS[] = {"count"};
+//   static constexpr auto HOME_PAGE PROGMEM = PAGE_TABLE(HOME_TEXT, HOME_SLOTS);
+//
+//   pageSend(HOME_PAGE, [&](int slot, PageWriter &out) { out.addInt(count); });
+//
+// {{styles}} and {{navbar}} are the shared includes from html_components
+// and are filled by the engine. Any other name must be in the page's slot
+// list, in enum order; an unknown name fails the build.
+
+#define PAGE_CHUNK_BYTES 1436   // Small writes are sent in chunks of one TCP segment
+#define PAGE_COPY_MAX 256       // Shorter flash runs are copied into the chunk
+#define PAGE_TEXT -1
+#define PAGE_INCLUDE_STYLES -2
+#define PAGE_INCLUDE_NAVBAR -3
+
+struct PageSegment {
+  uint32_t offset;
+  uint32_t length;
+  int16_t slot;  // Slot index, PAGE_TEXT or a PAGE_INCLUDE_
+};
+
+template <size_t N>
+struct PageTable {
+  const char *text;
+  PageSegment segments[N];
+};
+
+// Output side of a page: dynamic text is gathered into chunks in the
+// request arena, static text from flash is sent as it is
+class PageWriter {
+public:
+  PageWriter();
+  PageWriter &add(const char *text, size_t length);
+  PageWriter &add(const char *text);
+  PageWriter &add(const String &text);
+  PageWriter &addInt(long value);
+  void flash(const char *text, size_t length);
+  void flash(const char *text);
+  void flush();
+
+private:
+  char *buf;
+  size_t len = 0;
+};
+
+typedef std::function<void(int slot, PageWriter &out)> PageFill;
+
+// Deliberately not constexpr: reaching it while a page is parsed stops the build
+int16_t pageUnknownSlot();
+
+// The parser below is C++11 constexpr (one return statement, recursion
+// instead of loops) because ESP32 Arduino 2.x builds with -std=gnu++11.
+// Searches split their range in half so recursion stays within GCC's
+// default depth of 512 on pages of any length; segment k is found from
+// segment k - 1, and GCC memoises those calls.
+
+constexpr bool pageNameIs(const char *text, size_t length, const char *name) {
+  return length == 0 ? *name == '\0' : *name == *text && pageNameIs(text + 1, length - 1, name + 1);
+}
+
+constexpr int16_t pageSlotFrom(const char *name, size_t length, const char *const *slots, size_t slotCount, size_t i) {
+  return i == slotCount ? pageUnknownSlot()
+         : pageNameIs(name, length, slots[i]) ? (int16_t)i
+         : pageSlotFrom(name, length, slots, slotCount, i + 1);
+}
+
+constexpr int16_t pageSlotOf(const char *name, size_t length, const char *const *slots, size_t slotCount) {
+  return pageNameIs(name, length, "styles") ? PAGE_INCLUDE_STYLES
+         : pageNameIs(name, length, "navbar") ? PAGE_INCLUDE_NAVBAR
+         : pageSlotFrom(name, length, slots, slotCount, 0);
+}
+
+// First "}}" starting in [from, to), or to
+constexpr size_t pageFindClose(const char *text, size_t from, size_t to);
+
+constexpr size_t pageFindCloseOr(const char *text, size_t found, size_t mid, size_t to) {
+  return found < mid ? found : pageFindClose(text, mid, to);
+}
+
+constexpr size_t pageFindClose(const char *text, size_t from, size_t to) {
+  return to - from <= 1 ? (from < to && text[from] == '}' && text[from + 1] == '}' ? from : to)
+         : pageFindCloseOr(text, pageFindClose(text, from, from + (to - from) / 2), from + (to - from) / 2, to);
+}
+
+// A placeholder opens at i: "{{" with a "}}" somewhere after it.
+// Unterminated, the rest of the page is text.
+constexpr bool pageOpensAt(const char *text, size_t length, size_t i) {
+  return text[i] == '{' && text[i + 1] == '{' && pageFindClose(text, i + 2, length) < length;
+}
+
+// First placeholder starting in [from, to), or to
+constexpr size_t pageFindOpen(const char *text, size_t length, size_t from, size_t to);
+
+constexpr size_t pageFindOpenOr(const char *text, size_t length, size_t found, size_t mid, size_t to) {
+  return found < mid ? found : pageFindOpen(text, length, mid, to);
+}
+
+constexpr size_t pageFindOpen(const char *text, size_t length, size_t from, size_t to) {
+  return to - from <= 1 ? (from < to && pageOpensAt(text, length, from) ? from : to)
+         : pageFindOpenOr(text, length, pageFindOpen(text, length, from, from + (to - from) / 2), from + (to - from) / 2, to);
+}
+
+// Where the segment starting at i ends: past the placeholder's "}}", or
+// at the next placeholder
+constexpr size_t pageSegmentEnd(const char *text, size_t length, size_t i) {
+  return pageOpensAt(text, length, i) ? pageFindClose(text, i + 2, length) + 2 : pageFindOpen(text, length, i, length);
+}
+
+constexpr size_t pageSegmentStart(const char *text, size_t length, size_t k) {
+  return k == 0 ? 0 : pageSegmentEnd(text, length, pageSegmentStart(text, length, k - 1));
+}
+
+constexpr size_t pageCountFrom(const char *text, size_t length, size_t i) {
+  return i >= length ? 0 : 1 + pageCountFrom(text, length, pageSegmentEnd(text, length, i));
+}
+
+constexpr PageSegment pageSegmentFrom(const char *text, size_t length, const char *const *slots, size_t slotCount, size_t i) {
+  return pageOpensAt(text, length, i)
+         ? PageSegment{(uint32_t)i, 0,
+                       pageSlotOf(text + i + 2, pageFindClose(text, i + 2, length) - i - 2, slots, slotCount)}
+         : PageSegment{(uint32_t)i, (uint32_t)(pageSegmentEnd(text, length, i) - i), PAGE_TEXT};
+}
+
+// std::index_sequence is C++14
+template <size_t... I>
+struct PageIndices {};
+
+template <size_t N, size_t... I>
+struct PageMakeIndices : PageMakeIndices<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct PageMakeIndices<0, I...> {
+  typedef PageIndices<I...> type;
+};
+
+template <size_t N, size_t... I>
+constexpr PageTable<N> pageParse(const char *text, size_t length, const char *const *slots, size_t slotCount,
+                                 PageIndices<I...>) {
+  return PageTable<N>{text, {pageSegmentFrom(text, length, slots, slotCount, pageSegmentStart(text, length, I))...}};
+}
+
+// text must be the literal array itself, so its length is known
+#define PAGE_SLOT_COUNT(slots) (sizeof(slots) / sizeof((slots)[0]))
+#define PAGE_TEXT_LENGTH(text) (sizeof(text) - 1)
+#define PAGE_SEGMENT_COUNT(text) pageCountFrom(text, PAGE_TEXT_LENGTH(text), 0)
+#define PAGE_TABLE(text, slots)                                                                   \
+  pageParse<PAGE_SEGMENT_COUNT(text)>(text, PAGE_TEXT_LENGTH(text), slots, PAGE_SLOT_COUNT(slots), \
+                                      PageMakeIndices<PAGE_SEGMENT_COUNT(text)>::type())
+
+// Function declarations for page templates
+void pageSendSegments(const char *text, const PageSegment *segments, size_t count, const PageFill &fill);
+
+template <size_t N>
+void pageSend(const PageTable<N> &page, const PageFill &fill) {
+  pageSendSegments(page.text, page.segments, N, fill);
+}
+
+#endif // PAGE_TEMPLATE_H
@@ -2,228 +2,359 @@
 #include "../handlers/route_handlers.h"
 #include "../utils/security_utils.h"
 #include "../components/fingerprint.h"
+#include "../components/boot.h"
+#include "../components/fleet.h"
+#include "../components/reports.h"
+#include "../components/absentee_digest.h"
+#include "../utils/day_index.h"
+#include "../utils/presence_index.h"
+#include "../utils/display_utils.h"
+#include "../utils/metrics.h"
+#include "../utils/mem_pool.h"
+#include "../utils/logger.h"
+#include "../utils/scan_trace.h"
+
+// Wrap a handler so its latency is recorded under the route's name
+static std::function<void()> timedRoute(const char *route, std::function<void()> handler) {
+  int metric = metricsRegisterRoute(route);
+  return [metric, handler]() {
+    int64_t start = esp_timer_get_time();
+    handler();
+    arenaReset();  // Whatever the handler built is sent by now
+    metricsObserveRoute(metric, esp_timer_get_time() - start);
+  };
+}
 
 void serverInit() {
   // Unprotected routes
-  server.on("/login", handleLogin);
-  server.on("/logout", handleLogout);
+  server.on("/login", timedRoute("/login", handleLogin));
+  server.on("/logout", timedRoute("/logout", handleLogout));
 
   // Protected routes
-  server.on("/", []() {
+  server.on("/", timedRoute("/", []() {
     if (!checkAuth()) {
       server.sendHeader("Location", "/login");
       server.send(302, "text/plain", "");
       return;
     }
     handleRoot();
-  });
+  }));
 
   // Add authentication check to all other routes
-  server.on("/addnew", []() {
+  server.on("/addnew", timedRoute("/addnew", []() {
     if (!checkAuth()) {
       server.sendHeader("Location", "/login");
       server.send(302, "text/plain", "");
       return;
     }
     handleAddnew();
-  });
+  }));
 
-  server.on("/submit", []() {
+  server.on("/submit", timedRoute("/submit", []() {
     if (!checkAuth()) {
       server.sendHeader("Location", "/login");
       server.send(302, "text/plain", "");
       return;
     }
     handleFormSubmit();
-  });
+  }));
 
-  server.on("/scanFingerprint", HTTP_POST, []() {
+  server.on("/scanFingerprint", HTTP_POST, timedRoute("/scanFingerprint", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleScanFingerprint();
-  });
+  }));
 
-  server.on("/names", []() {
+  server.on("/names", timedRoute("/names", []() {
     if (!checkAuth()) {
       server.sendHeader("Location", "/login");
       server.send(302, "text/plain", "");
       return;
     }
     handleShowname();
-  });
+  }));
 
-  server.on("/a2z", []() {
+  server.on("/a2z", timedRoute("/a2z", []() {
     if (!checkAuth()) {
       server.sendHeader("Location", "/login");
       server.send(302, "text/plain", "");
       return;
     }
     a2z();
-  });
+  }));
 
-  server.on("/scan", []() {
+  server.on("/scan", timedRoute("/scan", []() {
     if (!checkAuth()) {
       server.sendHeader("Location", "/login");
       server.send(302, "text/plain", "");
       return;
     }
     handleScanningPage();
-  });
+  }));
 
-  server.on("/erase", []() {
+  server.on("/erase", timedRoute("/erase", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleDltname();
-  });
+  }));
+
+  server.on("/api/students/delete", HTTP_POST, timedRoute("/api/students/delete", []() {
+    if (!checkAuth()) {
+      server.send(401, "text/plain", "Unauthorized");
+      return;
+    }
+    handleDeleteStudents();
+  }));
 
-  server.on("/deleteall", []() {
+  server.on("/deleteall", timedRoute("/deleteall", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleDeleteAll();
-  });
+  }));
 
-  server.on("/deleteAllStudents", HTTP_POST, []() {
+  server.on("/deleteAllStudents", HTTP_POST, timedRoute("/deleteAllStudents", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleDeleteAllStudents();
-  });
+  }));
 
-  server.on("/deleteSelectedDates", HTTP_POST, []() {
+  server.on("/deleteSelectedDates", HTTP_POST, timedRoute("/deleteSelectedDates", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleDeleteSelectedDates();
-  });
+  }));
 
-  server.on("/getAttendanceCount", []() {
+  server.on("/getAttendanceCount", timedRoute("/getAttendanceCount", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleGetAttendanceCount();
-  });
+  }));
 
-  server.on("/getAttendanceData", []() {
+  server.on("/getAttendanceData", timedRoute("/getAttendanceData", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleGetAttendanceData();
-  });
+  }));
 
-  server.on("/deleteAllAttendance", []() {
+  server.on("/deleteAllAttendance", timedRoute("/deleteAllAttendance", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleDeleteAllAttendance();
-  });
+  }));
 
-  server.on("/settings", []() {
+  server.on("/settings", timedRoute("/settings", []() {
     if (!checkAuth()) {
       server.sendHeader("Location", "/login");
       server.send(302, "text/plain", "");
       return;
     }
     handleSettings();
-  });
+  }));
 
-  server.on("/updateFirebase", HTTP_POST, []() {
+  server.on("/updateFirebase", HTTP_POST, timedRoute("/updateFirebase", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleUpdateFirebase();
-  });
+  }));
 
-  server.on("/updateWiFi", HTTP_POST, []() {
+  server.on("/updateWiFi", HTTP_POST, timedRoute("/updateWiFi", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleUpdateWiFi();
-  });
+  }));
 
-  server.on("/updateTelegram", HTTP_POST, []() {
+  server.on("/updateTelegram", HTTP_POST, timedRoute("/updateTelegram", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleUpdateTelegram();
-  });
+  }));
 
-  server.on("/startContinuousScanning", HTTP_POST, []() {
+  server.on("/startContinuousScanning", HTTP_POST, timedRoute("/startContinuousScanning", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleStartContinuousScanning();
-  });
+  }));
 
-  server.on("/stopContinuousScanning", HTTP_POST, []() {
+  server.on("/stopContinuousScanning", HTTP_POST, timedRoute("/stopContinuousScanning", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleStopContinuousScanning();
-  });
+  }));
 
-  server.on("/reinitializeDisplay", HTTP_POST, []() {
+  server.on("/reinitializeDisplay", HTTP_POST, timedRoute("/reinitializeDisplay", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleReinitializeDisplay();
-  });
+  }));
 
-  server.on("/reinitializeSD", HTTP_POST, []() {
+  server.on("/reinitializeSD", HTTP_POST, timedRoute("/reinitializeSD", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleReinitializeSD();
-  });
+  }));
 
-  server.on("/reinitializeFingerprint", HTTP_POST, []() {
+  server.on("/reinitializeFingerprint", HTTP_POST, timedRoute("/reinitializeFingerprint", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleReinitializeFingerprint();
-  });
+  }));
+
+  server.on("/restoreTemplates", HTTP_POST, timedRoute("/restoreTemplates", []() {
+    if (!checkAuth()) {
+      server.send(401, "text/plain", "Unauthorized");
+      return;
+    }
+    handleRestoreTemplates();
+  }));
 
-  server.on("/exportAttendance", HTTP_GET, []() {
+  server.on("/exportAttendance", HTTP_GET, timedRoute("/exportAttendance", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleExportAttendance();
-  });
+  }));
 
-  server.on("/updateAdmin", HTTP_POST, []() {
+  server.on("/updateAdmin", HTTP_POST, timedRoute("/updateAdmin", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleUpdateAdmin();
-  });
+  }));
 
-  server.on("/syncData", HTTP_POST, []() {
+  server.on("/syncData", HTTP_POST, timedRoute("/syncData", []() {
     if (!checkAuth()) {
       server.send(401, "text/plain", "Unauthorized");
       return;
     }
     handleSyncData();
-  });
+  }));
+
+  server.on("/logs", HTTP_GET, timedRoute("/logs", []() {
+    if (!checkAuth()) {
+      server.send(401, "text/plain", "Unauthorized");
+      return;
+    }
+    handleLogs();
+  }));
+
+  server.on("/debug/scans", HTTP_GET, timedRoute("/debug/scans", []() {
+    if (!checkAuth()) {
+      server.send(401, "text/plain", "Unauthorized");
+      return;
+    }
+    handleDebugScans();
+  }));
+
+  server.on("/debug/boot", HTTP_GET, timedRoute("/debug/boot", []() {
+    if (!checkAuth()) {
+      server.send(401, "text/plain", "Unauthorized");
+      return;
+    }
+    handleDebugBoot();
+  }));
+
+  server.on("/api/month-summary", HTTP_GET, timedRoute("/api/month-summary", []() {
+    if (!checkAuth()) {
+      server.send(401, "text/plain", "Unauthorized");
+      return;
+    }
+    handleMonthSummary();
+  }));
+
+  server.on("/reports", HTTP_GET, timedRoute("/reports", []() {
+    if (!checkAuth()) {
+      server.sendHeader("Location", "/login");
+      server.send(302, "text/plain", "");
+      return;
+    }
+    handleReportsPage();
+  }));
+
+  server.on("/api/attendance/query", HTTP_GET, timedRoute("/api/attendance/query", []() {
+    if (!checkAuth()) {
+      server.send(401, "text/plain", "Unauthorized");
+      return;
+    }
+    handleAttendanceQuery();
+  }));
+
+  server.on("/api/attendance/presence", HTTP_GET, timedRoute("/api/attendance/presence", []() {
+    if (!checkAuth()) {
+      server.send(401, "text/plain", "Unauthorized");
+      return;
+    }
+    handlePresenceSummary();
+  }));
+
+  server.on("/api/attendance/holiday", HTTP_POST, timedRoute("/api/attendance/holiday", []() {
+    if (!checkAuth()) {
+      server.send(401, "text/plain", "Unauthorized");
+      return;
+    }
+    handlePresenceHoliday();
+  }));
+
+  server.on("/api/attendance/absentees", HTTP_GET, timedRoute("/api/attendance/absentees", []() {
+    if (!checkAuth()) {
+      server.send(401, "text/plain", "Unauthorized");
+      return;
+    }
+    handleDigestPreview();
+  }));
+
+  server.on("/api/fleet/day", HTTP_GET, timedRoute("/api/fleet/day", []() {
+    if (!checkAuth()) {
+      server.send(401, "text/plain", "Unauthorized");
+      return;
+    }
+    handleFleetDay();
+  }));
+
+  server.on("/api/fleet/publish", HTTP_POST, timedRoute("/api/fleet/publish", []() {
+    if (!checkAuth()) {
+      server.send(401, "text/plain", "Unauthorized");
+      return;
+    }
+    handleFleetPublish();
+  }));
+
+  // Prometheus scrape endpoint. Left open like /login so scrapers need no
+  // session; it exposes counters only, no student data.
+  server.on("/metrics", HTTP_GET, handleMetrics);
 
   // Handle not found (404)
   server.onNotFound([]() {
@@ -238,10 +369,5 @@ void serverInit() {
   // Start server
   server.begin();
   Serial.println("HTTP server started");
-  tft.fillScreen(TFT_WHITE);
-  tft.fillRect(0, 15, 128, 30, TFT_WHITE);
-  tft.setCursor(2, 20);
-  tft.setTextColor(TFT_BLACK);
-  tft.setTextSize(1);
-  tft.println("HTTP server started");
+  displayMessageScreen(TFT_BLACK, "HTTP server started");
 } 
\ No newline at end of file
@@ -0,0 +1,425 @@
+// Host benchmark for the attendance query engine (src/utils/attendance_query).
+//
+// Writes a synthetic multi-year store in the gate's layout
+// (Attendance/MM/DD-MM-YYYY.csv), then runs date-range queries through the
+// engine the way reports.cpp does on the gate: each day file read in
+// 512-byte chunks and streamed through queryFeed(). Results are checked
+// against the generator's own tally. For comparison it also runs a
+// baseline that splits every row into heap strings and keeps a map per
+// student, which is roughly what per-field String parsing costs.
+//
+// It then rolls every month up into the columnar format of
+// src/utils/rollup_format.h, as the gate does once a month closes, and
+// runs the whole-range query again from the rollups.
+//
+//   g++ -O2 -std=c++17 -I../../src/utils query_bench.cpp ../../src/utils/attendance_query.cpp
+//       ../../src/utils/rollup_format.cpp -o query_bench
+//   ./query_bench [--years 3] [--students 120] [--dir /tmp/attendance_bench] [--keep]
+
+#include "attendance_query.h"
+#include "rollup_format.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#define LATE_AFTER (9 * 3600)
+
+struct Truth {
+  int daysPresent = 0;
+  int lateDays = 0;
+  uint64_t workedSeconds = 0;
+};
+
+static std::string dayPath(const std::string &root, int day, int month, int year) {
+  char path[64];
+  snprintf(path, sizeof(path), "/Attendance/%02d/%02d-%02d-%04d.csv", month, day, month, year);
+  return root + path;
+}
+
+static std::string timeText(uint32_t seconds) {
+  int hour = seconds / 3600;
+  char text[16];
+  snprintf(text, sizeof(text), "%02d:%02d:%02d %s", hour % 12 ? hour % 12 : 12, seconds / 60 % 60, seconds % 60,
+           hour >= 12 ? "PM" : "AM");
+  return text;
+}
+
+// Weekdays of `years` years ending at the start of 2025; returns day numbers written
+static std::vector<int32_t> generate(const std::string &root, int years, int students, std::vector<Truth> &truth,
+                                     uint64_t &bytes) {
+  std::mt19937 rng(42);
+  std::normal_distribution<double> arrive(8.5 * 3600, 20 * 60);
+  std::normal_distribution<double> leave(15.5 * 3600, 30 * 60);
+  std::uniform_real_distribution<double> chance(0, 1);
+
+  mkdir(root.c_str(), 0755);
+  mkdir((root + "/Attendance").c_str(), 0755);
+  for (int month = 1; month <= 12; month++) {
+    char dir[32];
+    snprintf(dir, sizeof(dir), "/Attendance/%02d", month);
+    mkdir((root + dir).c_str(), 0755);
+  }
+
+  truth.assign(students + 1, Truth());
+  std::vector<int32_t> days;
+  bytes = 0;
+  int32_t first = queryDayNumber(1, 1, 2025 - years);
+  int32_t last = queryDayNumber(31, 12, 2024);
+  for (int32_t dayNumber = first; dayNumber <= last; dayNumber++) {
+    int weekday = (dayNumber + 4) % 7;  // 1970-01-01 was a Thursday
+    if (weekday == 0 || weekday == 6) continue;
+
+    int day, month, year;
+    queryDateOf(dayNumber, day, month, year);
+    FILE *file = fopen(dayPath(root, day, month, year).c_str(), "w");
+    if (!file) {
+      perror("fopen");
+      exit(1);
+    }
+    bytes += fprintf(file, "Roll Number,Name,Fingerprint ID,In Time,Out Time\n");
+    for (int id = 1; id <= students; id++) {
+      if (chance(rng) > 0.92) continue;
+      uint32_t in = (uint32_t)arrive(rng);
+      bool scannedOut = chance(rng) < 0.95;
+      uint32_t out = scannedOut ? (uint32_t)leave(rng) : QUERY_NO_TIME;
+      std::string inText = (chance(rng) < 0.01 ? "~" : "") + timeText(in);
+      std::string outText = scannedOut ? timeText(out) : "-";
+
+      // Every tenth name has a comma, so it is quoted the way escapeCSV() does it
+      char name[48];
+      if (id % 10 == 0) {
+        snprintf(name, sizeof(name), "\"Student, Number %d\"", id);
+      } else {
+        snprintf(name, sizeof(name), "Student %d", id);
+      }
+      bytes += fprintf(file, "R%03d,%s,%d,%s,%s\n", id, name, id, inText.c_str(), outText.c_str());
+
+      Truth &t = truth[id];
+      t.daysPresent++;
+      if (in > LATE_AFTER) t.lateDays++;
+      if (scannedOut && out >= in) t.workedSeconds += out - in;
+    }
+    fclose(file);
+    days.push_back(dayNumber);
+  }
+  return days;
+}
+
+static void runEngine(const std::string &root, const std::vector<int32_t> &days, const AttendanceQuery &query,
+                      QueryResult &result) {
+  char chunk[512];
+  QueryLineState state;
+  queryBegin(result);
+  for (int32_t dayNumber : days) {
+    if (dayNumber < query.fromDay || dayNumber > query.toDay) continue;
+    int day, month, year;
+    queryDateOf(dayNumber, day, month, year);
+    FILE *file = fopen(dayPath(root, day, month, year).c_str(), "r");
+    if (!file) continue;
+    queryBeginDay(state);
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+      queryFeed(query, result, state, chunk, read);
+    }
+    fclose(file);
+    queryEndDay(query, result, state);
+  }
+}
+
+// Heap strings per field and a map per student
+static size_t runBaseline(const std::string &root, const std::vector<int32_t> &days, int32_t fromDay, int32_t toDay) {
+  struct Aggregate {
+    int daysPresent = 0;
+    std::vector<uint32_t> inTimes;
+    std::vector<uint32_t> outTimes;
+  };
+  std::map<std::string, Aggregate> students;
+  char buffer[512];
+  for (int32_t dayNumber : days) {
+    if (dayNumber < fromDay || dayNumber > toDay) continue;
+    int day, month, year;
+    queryDateOf(dayNumber, day, month, year);
+    FILE *file = fopen(dayPath(root, day, month, year).c_str(), "r");
+    if (!file) continue;
+    fgets(buffer, sizeof(buffer), file);  // Header
+    while (fgets(buffer, sizeof(buffer), file)) {
+      std::string line(buffer);
+      std::vector<std::string> fields;
+      bool inQuotes = false;
+      size_t start = 0;
+      for (size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '"') inQuotes = !inQuotes;
+        else if (line[i] == ',' && !inQuotes) {
+          fields.push_back(line.substr(start, i - start));
+          start = i + 1;
+        }
+      }
+      fields.push_back(line.substr(start));
+      if (fields.size() != 5) continue;
+      Aggregate &student = students[fields[2]];
+      student.daysPresent++;
+      student.inTimes.push_back(queryParseTime(fields[3].c_str(), fields[3].size()));
+      student.outTimes.push_back(queryParseTime(fields[4].c_str(), fields[4].size()));
+    }
+    fclose(file);
+  }
+  return students.size();
+}
+
+struct RollupContext {
+  std::vector<RollupEntry> *entries;
+  int day;
+};
+
+static void collectEntry(const QueryRow &row, void *context) {
+  RollupContext *c = (RollupContext *)context;
+  c->entries->push_back(rollupEntryOf(c->day, row));
+}
+
+static std::string rollupPath(const std::string &root, int month, int year) {
+  char path[48];
+  snprintf(path, sizeof(path), "/Attendance/%02d/rollup-%04d.bin", month, year);
+  return root + path;
+}
+
+static void writeRollup(const std::string &root, int month, int year, std::vector<RollupEntry> &entries,
+                        uint32_t dayMask, uint32_t sourceBytes, uint64_t &written) {
+  std::vector<uint8_t> encoded;
+  if (!rollupEncode(month, year, entries, dayMask, sourceBytes, encoded)) {
+    fprintf(stderr, "rollup %02d-%04d does not fit\n", month, year);
+    exit(1);
+  }
+  FILE *file = fopen(rollupPath(root, month, year).c_str(), "wb");
+  fwrite(encoded.data(), 1, encoded.size(), file);
+  fclose(file);
+  written += encoded.size();
+  entries.clear();
+}
+
+// Roll each month's day files up the way month_rollup.cpp does on the gate
+static uint64_t buildRollups(const std::string &root, const std::vector<int32_t> &days) {
+  std::vector<RollupEntry> entries;
+  uint64_t written = 0;
+  uint32_t dayMask = 0, sourceBytes = 0;
+  int month = 0, year = 0;
+  char chunk[512];
+  QueryLineState state;
+  for (int32_t dayNumber : days) {
+    int day, m, y;
+    queryDateOf(dayNumber, day, m, y);
+    if (m != month || y != year) {
+      if (month) writeRollup(root, month, year, entries, dayMask, sourceBytes, written);
+      month = m;
+      year = y;
+      dayMask = sourceBytes = 0;
+    }
+    FILE *file = fopen(dayPath(root, day, month, year).c_str(), "r");
+    RollupContext context = {&entries, day};
+    size_t before = entries.size();
+    queryBeginDay(state);
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+      queryFeedRows(state, chunk, read, collectEntry, &context);
+      sourceBytes += read;
+    }
+    queryEndRows(state, collectEntry, &context);
+    fclose(file);
+    if (entries.size() > before) dayMask |= 1UL << day;
+  }
+  if (month) writeRollup(root, month, year, entries, dayMask, sourceBytes, written);
+  return written;
+}
+
+static void runRollups(const std::string &root, const AttendanceQuery &query, QueryResult &result) {
+  int day, month, year, lastDay, lastMonth, lastYear;
+  queryDateOf(query.fromDay, day, month, year);
+  queryDateOf(query.toDay, lastDay, lastMonth, lastYear);
+  queryBegin(result);
+  std::vector<uint8_t> data;
+  MonthRollup rollup;
+  while (year < lastYear || (year == lastYear && month <= lastMonth)) {
+    FILE *file = fopen(rollupPath(root, month, year).c_str(), "rb");
+    if (file) {
+      fseek(file, 0, SEEK_END);
+      data.resize(ftell(file));
+      fseek(file, 0, SEEK_SET);
+      data.resize(fread(data.data(), 1, data.size(), file));
+      fclose(file);
+      if (rollupDecode(data.data(), data.size(), rollup)) {
+        // Roll numbers come from the roster on the gate
+        std::vector<std::string> rolls;
+        std::vector<const char *> rollPointers;
+        for (uint16_t id : rollup.ids) {
+          char roll[8];
+          snprintf(roll, sizeof(roll), "R%03u", id);
+          rolls.push_back(roll);
+        }
+        for (const std::string &roll : rolls) rollPointers.push_back(roll.c_str());
+        rollupFeed(rollup, rollPointers.data(), query, result);
+      }
+    }
+    if (++month > 12) {
+      month = 1;
+      year++;
+    }
+  }
+}
+
+template <typename F>
+static double bestOfThree(F run) {
+  double best = 1e9;
+  for (int i = 0; i < 3; i++) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (ms < best) best = ms;
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  int years = 3;
+  int students = 120;
+  std::string root = "/tmp/attendance_bench";
+  bool keep = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--years") && i + 1 < argc) years = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--students") && i + 1 < argc) students = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--dir") && i + 1 < argc) root = argv[++i];
+    else if (!strcmp(argv[i], "--keep")) keep = true;
+    else {
+      fprintf(stderr, "usage: %s [--years N] [--students N] [--dir PATH] [--keep]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (students < 1 || students > QUERY_MAX_STUDENTS) {
+    fprintf(stderr, "--students must be 1..%d\n", QUERY_MAX_STUDENTS);
+    return 2;
+  }
+
+  std::vector<Truth> truth;
+  uint64_t bytes;
+  std::vector<int32_t> days = generate(root, years, students, truth, bytes);
+  printf("dataset: %d years, %zu day files, %d students, %.1f MB in %s\n", years, days.size(), students,
+         bytes / 1e6, root.c_str());
+  printf("engine memory: QueryResult %zu bytes, AttendanceQuery %zu bytes, line state %zu bytes\n",
+         sizeof(QueryResult), sizeof(AttendanceQuery), sizeof(QueryLineState));
+
+  QueryResult *result = new QueryResult;
+  int failures = 0;
+
+  // IDs past QUERY_MAX_ID must be dropped; 65537 and 66000 would wrap to
+  // students 1 and 464 in a uint16_t
+  struct RowCase {
+    const char *line;
+    bool accepted;
+  };
+  RowCase rowCases[] = {
+    {"A01,Edge,1023,09:00:00 AM,-", true},
+    {"A02,Past,1024,09:00:00 AM,-", false},
+    {"A03,Wrap,65537,09:00:00 AM,-", false},
+    {"A04,Wrap,66000,09:00:00 AM,-", false},
+  };
+  for (const RowCase &c : rowCases) {
+    QueryRow row;
+    if (queryParseRow(c.line, strlen(c.line), row) != c.accepted) {
+      printf("  row \"%s\" should be %s\n", c.line, c.accepted ? "accepted" : "dropped");
+      failures++;
+    }
+  }
+
+  struct Case {
+    const char *label;
+    int32_t from;
+    int32_t to;
+    int onlyId;
+  };
+  int32_t first = days.front(), last = days.back();
+  Case cases[] = {
+    {"whole range", first, last, 0},
+    {"last year", queryDayNumber(1, 1, 2024), last, 0},
+    {"last month", queryDayNumber(1, 12, 2024), last, 0},
+    {"whole range, id=7", first, last, 7},
+  };
+
+  printf("\n%-20s %8s %10s %10s %12s %10s\n", "query", "days", "rows", "ms", "rows/s", "baseline");
+  for (const Case &c : cases) {
+    AttendanceQuery query;
+    queryInit(query, c.from, c.to);
+    query.lateAfter = LATE_AFTER;
+    if (c.onlyId) queryAllowId(query, c.onlyId);
+
+    double ms = bestOfThree([&] { runEngine(root, days, query, *result); });
+    double baseline = bestOfThree([&] { runBaseline(root, days, c.from, c.to); });
+    printf("%-20s %8u %10u %10.1f %12.0f %9.1fx\n", c.label, result->daysScanned, result->rowsScanned, ms,
+           result->rowsScanned / (ms / 1000), baseline / ms);
+
+    // The whole-range queries must agree with what was generated
+    if (c.from == first && c.to == last) {
+      for (int i = 0; i < result->studentCount; i++) {
+        const StudentAggregate &s = result->students[i];
+        const Truth &t = truth[s.id];
+        if (s.daysPresent != t.daysPresent || s.lateDays != t.lateDays || s.workedSeconds != t.workedSeconds) {
+          printf("  mismatch for id %u: days %u/%d late %u/%d worked %llu/%llu\n", s.id, s.daysPresent,
+                 t.daysPresent, s.lateDays, t.lateDays, (unsigned long long)s.workedSeconds,
+                 (unsigned long long)t.workedSeconds);
+          failures++;
+        }
+      }
+      int expected = c.onlyId ? 1 : students;
+      if (result->studentCount != expected || result->rowsDropped) {
+        printf("  expected %d students and no dropped rows, got %u and %u\n", expected, result->studentCount,
+               result->rowsDropped);
+        failures++;
+      }
+    }
+  }
+
+  // Whole range again, from monthly rollups
+  uint64_t rollupBytes = buildRollups(root, days);
+  AttendanceQuery query;
+  queryInit(query, first, last);
+  query.lateAfter = LATE_AFTER;
+  double csvMs = bestOfThree([&] { runEngine(root, days, query, *result); });
+  QueryResult *fromRollups = new QueryResult;
+  double rollupMs = bestOfThree([&] { runRollups(root, query, *fromRollups); });
+  printf("\nrollups: %.1f MB of day files in %.1f KB (%.0fx smaller); whole range %.1f ms vs %.1f ms from CSV\n",
+         bytes / 1e6, rollupBytes / 1024.0, (double)bytes / rollupBytes, rollupMs, csvMs);
+  for (int i = 0; i < result->studentCount; i++) {
+    const StudentAggregate &s = result->students[i];
+    int16_t slot = fromRollups->slotById[s.id];
+    const StudentAggregate *r = slot >= 0 ? &fromRollups->students[slot] : NULL;
+    // Minutes: in rounded up, out down, so worked time may only shrink, by under 2 min a day
+    if (!r || r->daysPresent != s.daysPresent || r->lateDays != s.lateDays || r->workedSeconds > s.workedSeconds ||
+        s.workedSeconds - r->workedSeconds > 120ULL * s.out.count) {
+      printf("  rollup mismatch for id %u\n", s.id);
+      failures++;
+    }
+  }
+  if (fromRollups->daysScanned != result->daysScanned || fromRollups->rowsScanned != result->rowsScanned) {
+    printf("  rollups saw %u days and %u rows, day files %u and %u\n", fromRollups->daysScanned,
+           fromRollups->rowsScanned, result->daysScanned, result->rowsScanned);
+    failures++;
+  }
+  delete fromRollups;
+
+  const StudentAggregate &sample = result->students[0];
+  printf("\nid %u: %u days, %u late, in %s +/- %u min, %.1f h total\n", sample.id, sample.daysPresent,
+         sample.lateDays, timeText(queryMean(sample.in)).c_str(), queryStdDev(sample.in) / 60,
+         sample.workedSeconds / 3600.0);
+
+  delete result;
+  if (!keep) {
+    std::string command = "rm -rf '" + root + "'";
+    if (system(command.c_str()) != 0) fprintf(stderr, "could not remove %s\n", root.c_str());
+  }
+  printf("%s\n", failures ? "FAILED" : "results match the generated data");
+  return failures ? 1 : 0;
+}
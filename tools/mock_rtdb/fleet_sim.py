@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+"""Simulate a fleet of gates writing one day's attendance to the mock RTDB.
+
+Each gate is a thread with its own keep-alive connection. A student scans
+several times a day at random doors. Gates write what the firmware writes:
+
+  events  - one PUT per scan to /events/MM/DATE/ID/<gate>-<second>, plus
+            occasional multi-location PATCH batches like an outbox sync
+  packed  - no per-scan upload; every --flush-every scans the gate sends its
+            whole day file as one packed value to /packed/MM/DATE/<gate>
+  legacy  - the old schema: PUT {inTime, outTime} to /attendance/MM/DATE/ID
+            from the gate's own view of the day
+
+Afterwards the day is merged the way /api/fleet/day does (earliest event
+is the in-time, latest is the out-time) and checked against what actually
+happened. Run the schemas side by side to compare lost updates, requests
+and bytes:
+
+    python3 fleet_sim.py --gates 4 --students 120
+    python3 fleet_sim.py --gates 4 --students 120 --schema packed
+    python3 fleet_sim.py --gates 4 --students 120 --schema legacy
+    python3 fleet_sim.py --url http://127.0.0.1:8080   # an already running mock
+"""
+
+import argparse
+import http.client
+import json
+import os
+import random
+import sys
+import threading
+import time
+from urllib.parse import urlsplit
+
+from mock_rtdb import make_server
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "wire_format"))
+from expand import pack, unpack  # noqa: E402
+
+DATE = "15-03-2025"
+MONTH = DATE[3:5]
+
+
+def time_text(seconds):
+    hour = seconds // 3600
+    suffix = "PM" if hour >= 12 else "AM"
+    hour12 = hour % 12 or 12
+    return f"{hour12:02d}:{seconds // 60 % 60:02d}:{seconds % 60:02d} {suffix}"
+
+
+class Client:
+    def __init__(self, url):
+        parts = urlsplit(url)
+        factory = http.client.HTTPSConnection if parts.scheme == "https" else http.client.HTTPConnection
+        self.conn = factory(parts.hostname, parts.port)
+        self.requests = 0
+        self.bytes = 0  # Request line and body, the part that changes with the schema
+
+    def call(self, method, path, body=None, silent=True):
+        query = "?print=silent" if silent else ""
+        data = None if body is None else json.dumps(body)
+        self.conn.request(method, f"/{path}.json{query}", body=data, headers={"Content-Type": "application/json"})
+        self.bytes += len(method) + len(path) + len(query) + 6 + len(data or "")
+        response = self.conn.getresponse()
+        payload = response.read()
+        self.requests += 1
+        if response.status >= 300:
+            raise RuntimeError(f"{method} {path}: {response.status} {payload!r}")
+        return json.loads(payload) if payload else None
+
+
+def plan_scans(args, rng):
+    """Every scan of the day as (second of day, student, gate), in time order."""
+    scans = []
+    for student in range(1, args.students + 1):
+        count = rng.randint(1, args.max_scans)
+        times = sorted(rng.sample(range(8 * 3600, 18 * 3600), count))
+        for seconds in times:
+            scans.append((seconds, student, rng.randrange(args.gates)))
+    scans.sort()
+    return scans
+
+
+def expected_day(scans):
+    day = {}
+    for seconds, student, _ in scans:
+        first, last = day.get(student, (seconds, seconds))
+        day[student] = (min(first, seconds), max(last, seconds))
+    return {s: (time_text(a), time_text(b) if b != a else "-") for s, (a, b) in day.items()}
+
+
+def pack_day(local_day):
+    events = []
+    for student, (first, last) in local_day.items():
+        events.append((student, first, False, False))
+        if last is not None:
+            events.append((student, last, True, False))
+    return pack(sorted(events, key=lambda event: event[1]))
+
+
+def run_gate(gate, url, scans, args, rng, errors):
+    client = Client(url)
+    gate_id = f"gate-{gate:06x}"
+    local_in = {}  # What this gate's own day file would hold
+    local_day = {}  # Student -> [in, out] rows of the day file
+    pending = {}
+    schema = args.schema
+    try:
+        for count, (seconds, student, _) in enumerate(scans, 1):
+            if schema == "packed":
+                row = local_day.setdefault(student, [seconds, None])
+                if row[0] != seconds:
+                    row[1] = seconds
+                if count % args.flush_every == 0 or count == len(scans):
+                    client.call("PATCH", "", {f"packed/{MONTH}/{DATE}/{gate_id}": pack_day(local_day)})
+                continue
+
+            if schema == "legacy":
+                if student in local_in:
+                    record = {"inTime": time_text(local_in[student]), "outTime": time_text(seconds)}
+                else:
+                    local_in[student] = seconds
+                    record = {"inTime": time_text(seconds), "outTime": "-"}
+                client.call("PUT", f"attendance/{MONTH}/{DATE}/{student}", record)
+                continue
+
+            kind = "out" if student in local_in else "in"
+            local_in.setdefault(student, seconds)
+            path = f"events/{MONTH}/{DATE}/{student}/{gate_id}-{seconds}"
+            event = {"at": seconds, "t": time_text(seconds), "kind": kind, "gate": gate_id}
+            if args.batch_every and rng.random() < 1.0 / args.batch_every:
+                pending[path] = event  # Missed its upload; goes out with the next sync batch
+            else:
+                client.call("PUT", path, event)
+            if len(pending) >= 25:
+                client.call("PATCH", "", pending)
+                pending = {}
+        if pending:
+            client.call("PATCH", "", pending)
+    except Exception as exc:  # Reported by the main thread
+        errors.append(f"{gate_id}: {exc}")
+    return client.requests, client.bytes
+
+
+def entries(node):
+    """(key, child) pairs of a node, whether RTDB sent it as an object or,
+    for dense integer keys, as an array."""
+    if isinstance(node, list):
+        return [(str(i), child) for i, child in enumerate(node) if child is not None]
+    return list((node or {}).items())
+
+
+def merge_packed(day):
+    """Same fold as mergePackedDay() on the gate."""
+    merged = {}
+    for value in (day or {}).values():
+        for student, seconds, _, _ in unpack(value):
+            first, last, count = merged.get(student, (seconds, seconds, 0))
+            merged[student] = (min(first, seconds), max(last, seconds), count + 1)
+    return {s: (time_text(a), time_text(b) if n > 1 else "-") for s, (a, b, n) in merged.items()}
+
+
+def merge_events(day):
+    """Same fold as fleetAggregateDay() on the gate."""
+    merged = {}
+    for student, events in entries(day):
+        first = last = None
+        for event in events.values():
+            if first is None or event["at"] < first["at"]:
+                first = event
+            if last is None or event["at"] > last["at"]:
+                last = event
+        merged[int(student)] = (first["t"], last["t"] if len(events) > 1 else "-")
+    return merged
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--url", help="Mock to use; default starts one in-process")
+    parser.add_argument("--gates", type=int, default=4)
+    parser.add_argument("--students", type=int, default=120)
+    parser.add_argument("--max-scans", type=int, default=4, help="Scans per student, 1..N")
+    parser.add_argument("--schema", choices=["events", "packed", "legacy"], default="events")
+    parser.add_argument("--flush-every", type=int, default=50, help="Packed: scans between uploads of the day")
+    parser.add_argument("--batch-every", type=int, default=10, help="About 1 in N event uploads goes through a sync batch (0: never)")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    server = None
+    url = args.url
+    if not url:
+        server, _ = make_server()
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        url = f"http://127.0.0.1:{server.server_address[1]}"
+
+    rng = random.Random(args.seed)
+    scans = plan_scans(args, rng)
+    by_gate = [[scan for scan in scans if scan[2] == gate] for gate in range(args.gates)]
+
+    setup = Client(url)
+    setup.call("DELETE", f"attendance/{MONTH}/{DATE}")
+    setup.call("DELETE", f"events/{MONTH}/{DATE}")
+    setup.call("DELETE", f"packed/{MONTH}/{DATE}")
+
+    errors = []
+    counts = [(0, 0)] * args.gates
+
+    def worker(gate):
+        counts[gate] = run_gate(gate, url, by_gate[gate], args, random.Random(args.seed + gate), errors)
+
+    threads = [threading.Thread(target=worker, args=(gate,)) for gate in range(args.gates)]
+    start = time.perf_counter()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.perf_counter() - start
+
+    if args.schema == "legacy":
+        stored = setup.call("GET", f"attendance/{MONTH}/{DATE}", silent=False)
+        merged = {int(k): (v["inTime"], v["outTime"]) for k, v in entries(stored)}
+    elif args.schema == "packed":
+        merged = merge_packed(setup.call("GET", f"packed/{MONTH}/{DATE}", silent=False))
+    else:
+        merged = merge_events(setup.call("GET", f"events/{MONTH}/{DATE}", silent=False))
+
+    expected = expected_day(scans)
+    wrong = sorted(s for s in expected if merged.get(s) != expected[s])
+    requests = sum(c[0] for c in counts)
+    sent = sum(c[1] for c in counts)
+
+    print(f"schema={args.schema} gates={args.gates} students={args.students} scans={len(scans)}")
+    print(f"{requests} write requests, {sent} bytes sent in {elapsed:.2f} s "
+          f"({requests / elapsed:.0f} req/s, {len(scans) / elapsed:.0f} scans/s)")
+    print(f"students correct after merge: {len(expected) - len(wrong)}/{len(expected)}")
+    for student in wrong[:5]:
+        print(f"  student {student}: expected {expected[student]}, got {merged.get(student)}")
+    for error in errors:
+        print("error:", error)
+
+    if server:
+        server.shutdown()
+    return 1 if wrong or errors else 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,320 @@
+#!/usr/bin/env python3
+"""Local stand-in for the Firebase Realtime Database REST API.
+
+Implements the subset the gates use: GET/PUT/PATCH/POST/DELETE on
+/<path>.json, multi-location PATCH (keys containing '/'), print=silent,
+shallow=true and orderBy/startAt/endAt/equalTo/limitToFirst/limitToLast
+queries on a child key. Data lives in memory. Like the real service, a
+node whose keys are mostly dense small integers is returned as a JSON
+array (--no-arrays turns that off).
+
+    python3 mock_rtdb.py --port 8080
+    python3 mock_rtdb.py --port 443 --tls-cert cert.pem --tls-key key.pem --auth SECRET
+
+Point a gate at it by putting HOST=<this machine's IP> in firebase.txt.
+The gate's HTTPS client does not verify certificates, so a self-signed
+one works:
+
+    openssl req -x509 -newkey rsa:2048 -nodes -days 365 \\
+        -keyout key.pem -out cert.pem -subj /CN=mock-rtdb
+"""
+
+import argparse
+import json
+import ssl
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlsplit
+
+PUSH_CHARS = "-0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz"
+
+
+class Database:
+    """A JSON tree with Firebase semantics: null deletes, empty parents vanish."""
+
+    def __init__(self):
+        self.root = {}
+        self.lock = threading.Lock()
+        self.last_push = 0
+        self.push_seq = 0
+        self.stats = {"GET": 0, "PUT": 0, "PATCH": 0, "POST": 0, "DELETE": 0, "writes": 0}
+
+    @staticmethod
+    def split(path):
+        return [part for part in path.split("/") if part]
+
+    def get(self, parts):
+        node = self.root
+        for part in parts:
+            if not isinstance(node, dict) or part not in node:
+                return None
+            node = node[part]
+        return node
+
+    def set(self, parts, value):
+        self.stats["writes"] += 1
+        if not parts:
+            self.root = value if isinstance(value, dict) else {}
+            return
+        if value is None or value == {}:
+            self._delete(self.root, parts)
+            return
+        node = self.root
+        for part in parts[:-1]:
+            child = node.get(part)
+            if not isinstance(child, dict):
+                child = node[part] = {}
+            node = child
+        node[parts[-1]] = self._clean(value)
+
+    def _clean(self, value):
+        if isinstance(value, dict):
+            cleaned = {k: self._clean(v) for k, v in value.items() if v is not None}
+            return {k: v for k, v in cleaned.items() if v != {}}
+        return value
+
+    def _delete(self, node, parts):
+        if not isinstance(node, dict) or parts[0] not in node:
+            return
+        if len(parts) == 1:
+            del node[parts[0]]
+            return
+        self._delete(node[parts[0]], parts[1:])
+        if node[parts[0]] == {}:
+            del node[parts[0]]
+
+    def push_id(self):
+        now = int(time.time() * 1000)
+        self.push_seq = self.push_seq + 1 if now == self.last_push else 0
+        self.last_push = now
+        stamp = ""
+        for _ in range(8):
+            stamp = PUSH_CHARS[now % 64] + stamp
+            now //= 64
+        seq = ""
+        n = self.push_seq
+        for _ in range(12):
+            seq = PUSH_CHARS[n % 64] + seq
+            n //= 64
+        return stamp + seq
+
+
+def query_value(raw):
+    """Query parameters are JSON literals: "updatedAt", 1700000000, true."""
+    try:
+        return json.loads(raw)
+    except ValueError:
+        return raw
+
+
+def apply_query(node, params):
+    if not isinstance(node, dict):
+        return node
+    if "shallow" in params and params["shallow"] == "true":
+        return {k: (True if isinstance(v, dict) else v) for k, v in node.items()}
+    if "orderBy" not in params:
+        return node
+
+    order = query_value(params["orderBy"])
+    if order == "$key":
+        key_of = lambda item: item[0]
+    elif order == "$value":
+        key_of = lambda item: item[1]
+    else:
+        key_of = lambda item: item[1].get(order) if isinstance(item[1], dict) else None
+
+    def rank(value):
+        # Firebase ordering: null, false, true, numbers, strings, objects
+        if value is None:
+            return (0, 0)
+        if isinstance(value, bool):
+            return (1, int(value))
+        if isinstance(value, (int, float)):
+            return (2, value)
+        if isinstance(value, str):
+            return (3, value)
+        return (4, 0)
+
+    items = sorted(node.items(), key=lambda item: (rank(key_of(item)), item[0]))
+    if "equalTo" in params:
+        target = rank(query_value(params["equalTo"]))
+        items = [item for item in items if rank(key_of(item)) == target]
+    if "startAt" in params:
+        low = rank(query_value(params["startAt"]))
+        items = [item for item in items if key_of(item) is not None and rank(key_of(item)) >= low]
+    if "endAt" in params:
+        high = rank(query_value(params["endAt"]))
+        items = [item for item in items if rank(key_of(item)) <= high]
+    if "limitToFirst" in params:
+        items = items[: int(params["limitToFirst"])]
+    if "limitToLast" in params:
+        items = items[-int(params["limitToLast"]):]
+    return dict(items)
+
+
+def as_arrays(node):
+    """Render like RTDB: an object whose keys are all integers, more than
+    half of 0..max present, comes back as an array with nulls in the gaps."""
+    if not isinstance(node, dict):
+        return node
+    node = {k: as_arrays(v) for k, v in node.items()}
+    if node and all(k.isdigit() and str(int(k)) == k for k in node):
+        highest = max(int(k) for k in node)
+        if len(node) * 2 > highest + 1:
+            return [node.get(str(i)) for i in range(highest + 1)]
+    return node
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    db = None
+    auth = None
+    quiet = False
+    arrays = True
+
+    def log_message(self, fmt, *args):
+        if not self.quiet:
+            super().log_message(fmt, *args)
+
+    def reply(self, status, body=None):
+        data = b"" if body is None and status == 204 else json.dumps(body).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json; charset=utf-8")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        if data:
+            self.wfile.write(data)
+
+    def parse(self):
+        url = urlsplit(self.path)
+        path = url.path
+        if not path.endswith(".json"):
+            self.reply(400, {"error": "Path must end in .json"})
+            return None
+        params = {k: v[-1] for k, v in parse_qs(url.query).items()}
+        if self.auth is not None and params.get("auth") != self.auth:
+            self.reply(401, {"error": "Permission denied"})
+            return None
+        return Database.split(path[: -len(".json")]), params
+
+    def body(self):
+        length = int(self.headers.get("Content-Length") or 0)
+        raw = self.rfile.read(length) if length else b"null"
+        return json.loads(raw or b"null")
+
+    def respond_written(self, params, value):
+        if params.get("print") == "silent":
+            self.reply(204)
+        else:
+            self.reply(200, value)
+
+    def do_GET(self):
+        parsed = self.parse()
+        if not parsed:
+            return
+        parts, params = parsed
+        with self.db.lock:
+            self.db.stats["GET"] += 1
+            value = apply_query(self.db.get(parts), params)
+            if self.arrays and params.get("shallow") != "true":
+                value = as_arrays(value)
+            self.reply(200, value)
+
+    def do_PUT(self):
+        parsed = self.parse()
+        if not parsed:
+            return
+        parts, params = parsed
+        value = self.body()
+        with self.db.lock:
+            self.db.stats["PUT"] += 1
+            self.db.set(parts, value)
+        self.respond_written(params, value)
+
+    def do_PATCH(self):
+        parsed = self.parse()
+        if not parsed:
+            return
+        parts, params = parsed
+        value = self.body()
+        if not isinstance(value, dict):
+            self.reply(400, {"error": "Invalid data; couldn't parse JSON object"})
+            return
+        # Every key is a path relative to the target, so one request can
+        # touch several locations; all of them apply under one lock
+        with self.db.lock:
+            self.db.stats["PATCH"] += 1
+            for key, child in value.items():
+                self.db.set(parts + Database.split(key), child)
+        self.respond_written(params, value)
+
+    def do_POST(self):
+        parsed = self.parse()
+        if not parsed:
+            return
+        parts, params = parsed
+        value = self.body()
+        with self.db.lock:
+            self.db.stats["POST"] += 1
+            key = self.db.push_id()
+            self.db.set(parts + [key], value)
+        self.respond_written(params, {"name": key})
+
+    def do_DELETE(self):
+        parsed = self.parse()
+        if not parsed:
+            return
+        parts, params = parsed
+        with self.db.lock:
+            self.db.stats["DELETE"] += 1
+            self.db.set(parts, None)
+        self.respond_written(params, None)
+
+
+def make_server(host="127.0.0.1", port=0, auth=None, quiet=True, tls_cert=None, tls_key=None, arrays=True):
+    """Start a server; returns (server, database). Port 0 picks a free port."""
+    db = Database()
+    handler = type("BoundHandler", (Handler,), {"db": db, "auth": auth, "quiet": quiet, "arrays": arrays})
+    server = ThreadingHTTPServer((host, port), handler)
+    server.daemon_threads = True
+    if tls_cert:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(tls_cert, tls_key)
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+    return server, db
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--auth", help="Require ?auth=<secret> (the gate's AUTH token)")
+    parser.add_argument("--tls-cert")
+    parser.add_argument("--tls-key")
+    parser.add_argument("--load", help="JSON file to start from")
+    parser.add_argument("--save", help="Write the database here on exit")
+    parser.add_argument("--verbose", action="store_true", help="Log every request")
+    parser.add_argument("--no-arrays", action="store_true", help="Always return objects, never arrays")
+    args = parser.parse_args()
+
+    server, db = make_server(args.host, args.port, args.auth, not args.verbose, args.tls_cert, args.tls_key,
+                             not args.no_arrays)
+    if args.load:
+        with open(args.load) as f:
+            db.root = json.load(f)
+    scheme = "https" if args.tls_cert else "http"
+    print(f"Mock RTDB listening on {scheme}://{args.host}:{server.server_address[1]}")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        print("Requests:", db.stats)
+        if args.save:
+            with open(args.save, "w") as f:
+                json.dump(db.root, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
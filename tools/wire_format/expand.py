@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Expand packed day uploads (/packed/MM/DATE/<gate>) into readable rows.
+
+Layout, matching src/utils/wire_format.h: the "d" field is base64 of
+5-byte little-endian events,
+
+    bytes 0-1  student ID
+    bytes 2-4  (second of day << 2) | (out << 1) | provisional
+
+Read from a database export or a live database (the mock works too):
+
+    python3 expand.py --file export.json
+    python3 expand.py --url https://<project>.firebaseio.com --auth <secret> --date 15-03-2025
+    python3 expand.py --url http://127.0.0.1:8080 --write-events
+
+Prints CSV: date,gate,id,kind,time,provisional. --write-events also
+writes each event to /events/MM/DATE/ID/<gate>-<second>, the per-scan
+layout that /api/fleet/day and realtime dashboards read.
+"""
+
+import argparse
+import base64
+import csv
+import json
+import struct
+import sys
+import urllib.request
+
+VERSION = 1
+EVENT = struct.Struct("<HBBB")
+
+
+def pack(events):
+    """events: iterable of (id, second_of_day, is_out, provisional)."""
+    raw = bytearray()
+    for student, seconds, is_out, provisional in events:
+        flags = (seconds << 2) | (2 if is_out else 0) | (1 if provisional else 0)
+        raw += EVENT.pack(student, flags & 0xFF, (flags >> 8) & 0xFF, flags >> 16)
+    return {"v": VERSION, "n": len(raw) // EVENT.size, "d": base64.b64encode(bytes(raw)).decode()}
+
+
+def unpack(value):
+    if value.get("v") != VERSION:
+        raise ValueError(f"unsupported packed version {value.get('v')}")
+    raw = base64.b64decode(value["d"])
+    if len(raw) % EVENT.size:
+        raise ValueError("packed data is not a whole number of events")
+    for student, b0, b1, b2 in EVENT.iter_unpack(raw):
+        flags = b0 | (b1 << 8) | (b2 << 16)
+        yield student, flags >> 2, bool(flags & 2), bool(flags & 1)
+
+
+def time_text(seconds):
+    hour = seconds // 3600
+    return f"{hour % 12 or 12:02d}:{seconds // 60 % 60:02d}:{seconds % 60:02d} {'PM' if hour >= 12 else 'AM'}"
+
+
+def fetch(url, path, auth, method="GET", body=None):
+    query = f"?auth={auth}" if auth else ""
+    data = None if body is None else json.dumps(body).encode()
+    request = urllib.request.Request(f"{url.rstrip('/')}/{path}.json{query}", data=data, method=method)
+    with urllib.request.urlopen(request) as response:
+        payload = response.read()
+    return json.loads(payload) if payload else None
+
+
+def packed_days(root, date):
+    """Yield (date, gate, value) from a /packed subtree."""
+    for month, days in (root or {}).items():
+        for day, gates in days.items():
+            if date and day != date:
+                continue
+            for gate, value in gates.items():
+                yield day, gate, value
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--file", help="Database export (JSON) with a top-level 'packed' node")
+    source.add_argument("--url", help="Database base URL")
+    parser.add_argument("--auth", help="Database secret for --url")
+    parser.add_argument("--date", help="Only this DD-MM-YYYY")
+    parser.add_argument("--write-events", action="store_true", help="Expand into /events at --url")
+    args = parser.parse_args()
+
+    if args.file:
+        with open(args.file) as f:
+            packed = json.load(f).get("packed")
+    elif args.date:
+        packed = {args.date[3:5]: {args.date: fetch(args.url, f"packed/{args.date[3:5]}/{args.date}", args.auth) or {}}}
+    else:
+        packed = fetch(args.url, "packed", args.auth)
+
+    writer = csv.writer(sys.stdout)
+    writer.writerow(["date", "gate", "id", "kind", "time", "provisional"])
+    for day, gate, value in packed_days(packed, args.date):
+        updates = {}
+        for student, seconds, is_out, provisional in unpack(value):
+            kind = "out" if is_out else "in"
+            text = ("~" if provisional else "") + time_text(seconds)
+            writer.writerow([day, gate, student, kind, text, int(provisional)])
+            updates[f"events/{day[3:5]}/{day}/{student}/{gate}-{seconds}"] = {
+                "t": text, "kind": kind, "gate": gate}
+        if args.write_events and args.url and updates:
+            fetch(args.url, "", args.auth, "PATCH", updates)
+
+
+if __name__ == "__main__":
+    main()